@@ -6,6 +6,7 @@
 #include <IOKit/audio/IOAudioDebug.h>
 
 #include <IOKit/IOFilterInterruptEventSource.h>
+#include <IOKit/IOTimerEventSource.h>
 #include <IOKit/IOWorkLoop.h>
 
 #include "AudioHardwareUtilities.h"
@@ -16,8 +17,6 @@
 #pragma mark  Constants
 #pragma mark ------------------------ 
 
-#define kIOProcTimingCountCurrent 10
-#define kIOProcTimingCountAverage 100
 
 extern "C" {
 extern vm_offset_t phystokv(vm_offset_t pa);
@@ -41,6 +40,9 @@ const UInt32 AppleDBDMAAudio::kMaxBitWidth		= 32;
 bool AppleDBDMAAudio::filterInterrupt (int index) {
 	UInt32 resultOut = 1;
     UInt32 resultIn = 1;
+	IODBDMADescriptor *	wrapCommand;
+	AbsoluteTime		uptime;
+	UInt64				nanos;
 	
 	// check to see if this interupt is because the DMA went bad
 	if ( ioBaseDMAOutput ) {
@@ -48,8 +50,9 @@ bool AppleDBDMAAudio::filterInterrupt (int index) {
 	}
 
 	if (ioBaseDMAInput) {
-		resultIn = IOGetDBDMAChannelStatus (ioBaseDMAInput) & kdbdmaActive;
+		resultIn = IOGetDBDMAChannelStatus (ioBaseDMAInput);
 	}
+	trace (kDBDMATraceInterrupt, resultOut, resultIn, mDmaInterruptCount);
 
 	if ( mHasOutput ) {
 		if ( !(resultOut & kdbdmaActive) ) {
@@ -62,16 +65,34 @@ bool AppleDBDMAAudio::filterInterrupt (int index) {
 			mNeedToRestartDMA = TRUE;
 		}
 	}
+
+	// a bus error, or an interrupt raised before a restart, has no wrap to stamp; the restart
+	// brings the loop count and time stamp up to date
+	wrapCommand = mHasOutput ? dmaCommandBufferOut : dmaCommandBufferIn;
+	if ( NULL != wrapCommand ) {
+		wrapCommand = &wrapCommand[numBlocks - 1];
+	}
+	if ( !DBDMATakeWrap (wrapCommand, resultOut | resultIn) ) {
+		goto Exit;
+	}
 	
 	// test the takeTimeStamp :it will increment the fCurrentLoopCount and time stamp it with the time now
-	takeTimeStamp ();
+	// less the interrupt latency the time stamp loop can see; a slaved clock can change rate under it
+	if (sampleRate.whole != mTimeStampFilter.sampleRate) {
+		DBDMATimeStampFilterReset (&mTimeStampFilter, numSampleFramesPerBuffer, sampleRate.whole);
+	}
+	clock_get_uptime (&uptime);
+	absolutetime_to_nanoseconds (uptime, &nanos);
+	nanoseconds_to_absolutetime (DBDMATimeStampFilterUpdate (&mTimeStampFilter, nanos), &uptime);
+	takeTimeStamp (true, &uptime);
 	
 	//	[3305011]	begin {
 	//	Increment the activity counter that can be viewed with the AOA Viewer to verify DMA operation
 	mDmaInterruptCount++;
 	mDmaRecoveryInProcess = FALSE;
 	//	} end	[3305011]
-	
+
+Exit:
     return false;
 }
 
@@ -83,6 +104,11 @@ void AppleDBDMAAudio::free()
         interruptEventSource->release();
         interruptEventSource = 0;
     }
+
+	if (NULL != mStallWatchdog) {
+		mStallWatchdog->release ();
+		mStallWatchdog = NULL;
+	}
     
 	if (NULL != mOutputStream) {
 		mOutputStream->release ();
@@ -107,9 +133,9 @@ void AppleDBDMAAudio::free()
 		IOFreeAligned (temp, numBlocks * mMaxBlockSize);
 	}
 
-	if (NULL != mIntermediateOutputSampleBuffer) {
-		IOFreeAligned (mIntermediateOutputSampleBuffer, numBlocks * mMaxBlockSize);
-		mIntermediateOutputSampleBuffer = NULL;
+	if (NULL != mOutputScratchBuffer) {
+		IOFreeAligned (mOutputScratchBuffer, DBDMAAUDIODMAENGINE_SCRATCH_SAMPLES * sizeof (float));
+		mOutputScratchBuffer = NULL;
 	}
 
 	if (NULL != mIntermediateInputSampleBuffer) {
@@ -130,19 +156,50 @@ void AppleDBDMAAudio::free()
 		deviceFormats = NULL;
 	}
 
+	if (NULL != mOutputDSP) {
+		mOutputDSP->release ();
+		mOutputDSP = NULL;
+	}
+
+	if (NULL != mOutputFixupDelay) {
+		mOutputFixupDelay->release ();
+		mOutputFixupDelay = NULL;
+	}
+
+	if (NULL != mInputFixupDelay) {
+		mInputFixupDelay->release ();
+		mInputFixupDelay = NULL;
+	}
+
+	if (NULL != mInputCapture) {
+		mInputCapture->release ();
+		mInputCapture = NULL;
+	}
+
 
     super::free();
 
 	debugIOLog (3, "- AppleDBDMAAudio::free()");
 }
 
+// The I2S frame counter gives the serializer's frame.  Where it does not run the command pointer
+// gives the DMA's, to a block, which is ahead of the serializer and so still safe to erase behind.
 UInt32 AppleDBDMAAudio::getCurrentSampleFrame()
 {
-	SInt32		curFrame;
+	UInt32		curFrame;
 
-	curFrame = ((AppleOnboardAudio *)audioDevice)->getCurrentSampleFrame () % getNumSampleFramesPerBuffer ();
+	if (mFrameCounterChecked && !mFrameCounterRuns) {
+		curFrame = getDMAPositionFrame ();
+	} else {
+		curFrame = mPlatformObject->getFrameCount ();
+		// a counter still at 0 after a pass around the ring is not counting
+		if (!mFrameCounterChecked && mDmaInterruptCount != mStartDmaInterruptCount) {
+			mFrameCounterRuns = (0 != curFrame);
+			mFrameCounterChecked = TRUE;
+		}
+	}
 
-	return curFrame;
+	return curFrame % getNumSampleFramesPerBuffer ();
 }
 
 bool AppleDBDMAAudio::init (OSDictionary *			properties,
@@ -154,6 +211,7 @@ bool AppleDBDMAAudio::init (OSDictionary *			properties,
                                  UInt32				nBlocks )
 {
 	Boolean					result;
+	UInt32					stage;
 
 	debugIOLog (3,  "+ AppleDBDMAAudio::init ( %X, %X, %d, %d, %X, %X )",
 			(unsigned int)properties,
@@ -167,9 +225,16 @@ bool AppleDBDMAAudio::init (OSDictionary *			properties,
 	
 	mHasInput = hasInput;
 	mHasOutput = hasOutput;
-    
-    mEnableCPUProfiling = FALSE;
-    
+
+	for (stage = 0; stage < kDBDMAIOProcStageCount; stage++) {
+		DBDMAIOProcHistogramClear (&mIOProcHistograms[stage]);
+	}
+	mIOProcTimingClears = 0;
+	mOutputClearsSeen = 0;
+	mInputClearsSeen = 0;
+	bzero (&mTrace, sizeof (mTrace));
+	mTraceReadSlot = 0;
+
 	//	[3305011]	begin {
 	//	Init the dma activity counter that can be viewed with AOA Viewer
 	mDmaInterruptCount = 0;
@@ -188,6 +253,13 @@ bool AppleDBDMAAudio::init (OSDictionary *			properties,
 	deviceFormats = formatsArray;
 	deviceFormats->retain ();
 
+	mOutputDSP = DSP_Manager::create ();
+	FailIf (NULL == mOutputDSP, Exit);
+
+	DSPExchangeInit (&mVolumeExchange);
+	bzero (&mLiveVolume, sizeof (mLiveVolume));
+	mReleasingSoftwareVolume = FALSE;
+
 	mDeviceProvider = theDeviceProvider; // i2s-a
 
 	//	There is a system I/O controller dependency here.  Keylargo systems describe the DMA channel registers
@@ -220,6 +292,25 @@ bool AppleDBDMAAudio::init (OSDictionary *			properties,
 	blockSize = 0;
 
 	mMaxBlockSize = ( DBDMAAUDIODMAENGINE_ROOT_BLOCK_SIZE * ( kMaxBitWidth / 8 ) );
+	mBlockSamples = DBDMAAUDIODMAENGINE_ROOT_BLOCK_SIZE;
+	mTotalBlockSamples = numBlocks * mBlockSamples;
+	mRequestedBlockSamples = DBDMAAUDIODMAENGINE_ROOT_BLOCK_SIZE;
+	mTargetBlockSamples = DBDMAAUDIODMAENGINE_ROOT_BLOCK_SIZE;
+	mClipOverrunCount = 0;
+	mLastClipOverrunCount = 0;
+	mBlockBackOffCount = 0;
+	mDeadlineClipCount = 0;
+	mDeadlineUnderrunCount = 0;
+	mDeadlineNearMissCount = 0;
+	mMinDeadlineMargin = 0;
+	mLastDeadlineMargin = 0;
+	mDeadlineMarginSum = 0;
+	bzero (mDeadlineHistogram, sizeof (mDeadlineHistogram));
+	mDeadlineClears = 0;
+	mDeadlineClearsSeen = 0;
+	mNotifyUnderruns = FALSE;
+	mReportedUnderrunCount = 0;
+	mTotalUnderrunCount = 0;
 
 	mInputDualMonoMode = e_Mode_Disabled;		   
 		   
@@ -229,6 +320,20 @@ bool AppleDBDMAAudio::init (OSDictionary *			properties,
 	mInputGainLPtr = NULL;	
 	mInputGainRPtr = NULL;	
 
+	mHardwareOutputLatency = 0;
+	mHardwareInputLatency = 0;
+	fNeedsRightChanDelay = FALSE;
+	fNeedsLeftChanDelay = FALSE;
+	mOutputFixupDelay = NULL;
+	mInputFixupDelay = NULL;
+	fNeedsRightChanDelayInput = FALSE;
+	DSPExchangeInit (&mInputConversionExchange);
+	mLiveInputConversion.convertRoutine = &AppleDBDMAAudio::convertAppleDBDMAFromInputStream16;
+	mLiveInputConversion.rightChanDelay = FALSE;
+	mInputCapture = NULL;
+	mInputCaptureEnabled = FALSE;
+	mOutputSampleFrame = 0;
+	mOutputVolumedB = 0;
     
 	mOutputIOProcCallCount = 0;
 	mStartOutputIOProcUptime.hi = 0;
@@ -274,6 +379,7 @@ bool AppleDBDMAAudio::initHardware (IOService *provider) {
 
     ourProvider = (AppleOnboardAudio *)provider;
 	mNeedToRestartDMA = FALSE;
+	mRestartClaimed = 0;
 
 	// create the streams, this will also cause the DMA programs to be created.
 	result = publishStreamFormats ();
@@ -285,6 +391,9 @@ bool AppleDBDMAAudio::initHardware (IOService *provider) {
 
 	debugIOLog (3, "  AppleDBDMAAudio:: setNumSampleFramesPerBuffer(%lu)  numBlocks=%lu blockSize=%lu ",(numBlocks * blockSize / ((mDBDMAOutputFormat.fBitWidth / 8) * mDBDMAOutputFormat.fNumChannels)), numBlocks, blockSize);
 
+	// zero what the DMA has played so a late IOProc leaves silence rather than the last pass
+	setRunEraseHead (mHasOutput);
+
 	// install an interrupt handler only on the Output size of it !!! input only??
     workLoop = getWorkLoop();
     FailIf (!workLoop, Exit);
@@ -305,6 +414,11 @@ bool AppleDBDMAAudio::initHardware (IOService *provider) {
     workLoop->addEventSource(interruptEventSource);
 	// don't release interruptEventSource since we enable/disable it later
 
+	// on the same work loop as the poll, so a recovery the watchdog starts is serialized with the poll's
+	mStallWatchdog = IOTimerEventSource::timerEventSource (this, stallWatchdogCallback);
+	FailIf (!mStallWatchdog, Exit);
+	workLoop->addEventSource (mStallWatchdog);
+
     iSubBufferMemory = NULL;
 	iSubEngine = NULL;
 
@@ -658,6 +772,7 @@ Exit:
 }
 
 void AppleDBDMAAudio::deallocateDMAMemory () {
+	mNumCommandSegments = 0;
     if (dmaCommandBufferOut && (commandBufferSize > 0)) {
         IOFreeAligned(dmaCommandBufferOut, commandBufferSize);
         dmaCommandBufferOut = NULL;
@@ -665,7 +780,7 @@ void AppleDBDMAAudio::deallocateDMAMemory () {
     
     if (dmaCommandBufferIn && (commandBufferSize > 0)) {
         IOFreeAligned(dmaCommandBufferIn, commandBufferSize);
-        dmaCommandBufferOut = NULL;
+        dmaCommandBufferIn = NULL;
     }
 
 	if (NULL != dmaCommandBufferOutMemDescriptor) {
@@ -706,10 +821,10 @@ void AppleDBDMAAudio::allocateDMABuffers (void) {
 			mOutputSampleBuffer = IOMallocAligned(numBlocks * mMaxBlockSize, PAGE_SIZE);
 			debugIOLog ( 3, "  allocated mOutputSampleBuffer %p", mOutputSampleBuffer );
 		}
-		// floating point copy buffer
-		if (NULL == mIntermediateOutputSampleBuffer) {
-			mIntermediateOutputSampleBuffer = IOMallocAligned(numBlocks * mMaxBlockSize, PAGE_SIZE);
-			debugIOLog ( 3, "  allocated mIntermediateOutputSampleBuffer %p", mIntermediateOutputSampleBuffer );
+		// floating point scratch for one piece of a clip, small enough to stay in the cache between stages
+		if (NULL == mOutputScratchBuffer) {
+			mOutputScratchBuffer = IOMallocAligned(DBDMAAUDIODMAENGINE_SCRATCH_SAMPLES * sizeof (float), PAGE_SIZE);
+			debugIOLog ( 3, "  allocated mOutputScratchBuffer %p", mOutputScratchBuffer );
 		}
 	}
 	if(ioBaseDMAInput) {
@@ -717,7 +832,7 @@ void AppleDBDMAAudio::allocateDMABuffers (void) {
 			mInputSampleBuffer = IOMallocAligned(numBlocks * mMaxBlockSize, PAGE_SIZE);
 			debugIOLog ( 3, "  allocated mInputSampleBuffer %p", mInputSampleBuffer );
 		}
-		// floating point copy buffer
+		// floating point copy of the ring; input is converted ahead of the HAL and read back by position
 		if (NULL == mIntermediateInputSampleBuffer) {
 			mIntermediateInputSampleBuffer = IOMallocAligned(numBlocks * mMaxBlockSize, PAGE_SIZE);
 			debugIOLog ( 3, "  allocated mIntermediateInputSampleBuffer", mIntermediateInputSampleBuffer );
@@ -835,6 +950,8 @@ bool AppleDBDMAAudio::createDMAPrograms ( void ) {
 	
 			// This code assumes that the size of the IODBDMADescriptor divides evenly into the page size
 			// If this is the last block, branch to the first block
+			// Only the last block interrupts: the engine time stamps once per pass around the ring and
+			// the HAL extrapolates the position in between, so smaller blocks add no interrupts.
 			if (blockNum == (numBlocks - 1)) {
 				cmdDest = commandBufferPhys;
 				doInterrupt = true;
@@ -958,6 +1075,7 @@ bool AppleDBDMAAudio::createDMAPrograms ( void ) {
 
     }
 
+	recordCommandSegments ();
 	result = TRUE;
 
 Exit:
@@ -987,6 +1105,115 @@ void AppleDBDMAAudio::interruptHandler(OSObject *owner, IOInterruptEventSource *
     return;
 }
 
+void AppleDBDMAAudio::stallWatchdogCallback (OSObject *owner, IOTimerEventSource *source) {
+	AppleDBDMAAudio *			dmaEngine;
+
+	dmaEngine = OSDynamicCast (AppleDBDMAAudio, owner);
+	FailIf (NULL == dmaEngine, Exit);
+	dmaEngine->checkForStall ();
+Exit:
+	return;
+}
+
+// The ring only interrupts once a pass, which is far too seldom to notice a stall quickly, but
+// the command pointer moves on every block.  The watchdog looks every few blocks and finishes
+// timing a recovery it started.
+void AppleDBDMAAudio::armStallWatchdog (void) {
+	IODBDMAChannelRegisters *	channel;
+	AbsoluteTime				uptime;
+	UInt64						nanos;
+
+	FailIf (NULL == mStallWatchdog, Exit);
+	channel = (NULL != ioBaseDMAOutput) ? ioBaseDMAOutput : ioBaseDMAInput;
+	FailIf (NULL == channel, Exit);
+
+	clock_get_uptime (&uptime);
+	absolutetime_to_nanoseconds (uptime, &nanos);
+	if (0 != mStallStartNanos) {
+		mLastRecoveryMicros = (UInt32)((nanos - mStallStartNanos) / 1000);
+		recordRecoveryTime (mLastRecoveryMicros);
+		mStallStartNanos = 0;
+	}
+
+	mWatchdogNanos = DBDMAStallWatchdogPeriod (mBlockSamples / getBlockChannels (), sampleRate.whole);
+	DBDMAStallWatchdogArm (&mWatchdog, IOGetDBDMACommandPtr (channel), mDmaInterruptCount);
+	mWatchdogProgressNanos = nanos;
+	mWatchdogStallPending = FALSE;
+	// the channel has just been started, so any recovery is over
+	mDmaRecoveryInProcess = FALSE;
+	mStallWatchdog->setTimeout (mWatchdogNanos, kNanosecondScale);
+
+Exit:
+	return;
+}
+
+void AppleDBDMAAudio::recordRecoveryTime (UInt32 inMicros) {
+	UInt32						bucket;
+	UInt32						bucketLimitMillis;
+
+	mRecoveryCount++;
+	bucket = 0;
+	bucketLimitMillis = 1 << kDBDMARecoveryHistogramFirstShift;
+	while (bucket < kDBDMARecoveryHistogramBuckets - 1 && inMicros >= bucketLimitMillis * 1000) {
+		bucket++;
+		bucketLimitMillis <<= 1;
+	}
+	mRecoveryHistogram[bucket]++;
+}
+
+// A dead channel is recovered at once, a frozen one after DBDMAStallWatchdogCheck has seen it
+// frozen on consecutive looks.
+void AppleDBDMAAudio::checkForStall (void) {
+	IODBDMAChannelRegisters *	channel;
+	AbsoluteTime				uptime;
+	UInt64						nanos;
+	bool						stalled;
+
+	stalled = FALSE;
+	channel = (NULL != ioBaseDMAOutput) ? ioBaseDMAOutput : ioBaseDMAInput;
+	FailIf (NULL == channel, Exit);
+	if (!dmaRunState) {
+		goto Exit;
+	}
+
+	clock_get_uptime (&uptime);
+	absolutetime_to_nanoseconds (uptime, &nanos);
+	switch (DBDMAStallWatchdogCheck (&mWatchdog, IOGetDBDMAChannelStatus (channel), IOGetDBDMACommandPtr (channel), mDmaInterruptCount)) {
+		case kDBDMAWatchdogDead:
+			if (!mWatchdogStallPending) {
+				mDmaHwDiedCount++;
+			}
+			stalled = TRUE;
+			break;
+		case kDBDMAWatchdogStalled:
+			if (!mWatchdogStallPending) {
+				mDmaStalledCount++;
+			}
+			stalled = TRUE;
+			break;
+		case kDBDMAWatchdogMoving:
+			mWatchdogProgressNanos = nanos;
+			break;
+	}
+
+	if (stalled) {
+		mDmaRecoveryInProcess = TRUE;
+		mWatchdogStallPending = TRUE;
+		mStallStartNanos = mWatchdogProgressNanos;
+		// the restart rearms the watchdog; without one, say while the provider is asleep or
+		// changing clocks, it has to rearm itself or it is gone until the next engine start
+		ourProvider->dmaEngineStalled ();
+		if (mWatchdogStallPending && dmaRunState) {
+			mStallWatchdog->setTimeout (mWatchdogNanos, kNanosecondScale);
+		}
+	} else {
+		mStallWatchdog->setTimeout (mWatchdogNanos, kNanosecondScale);
+	}
+
+Exit:
+	return;
+}
+
 IOReturn AppleDBDMAAudio::performAudioEngineStart()
 {
 	IOPhysicalAddress			commandBufferPhys;
@@ -1035,11 +1262,17 @@ IOReturn AppleDBDMAAudio::performAudioEngineStart()
 
     interruptEventSource->enable();
 
+	mFrameCounterChecked = FALSE;
+	mStartDmaInterruptCount = mDmaInterruptCount;
+	mInPlaceRestartTried = FALSE;
+
 	// add the time stamp take to test
+	DBDMATimeStampFilterReset (&mTimeStampFilter, getNumSampleFramesPerBuffer (), getSampleRate ()->whole);
     takeTimeStamp(false);
 
 	debugIOLog (6, "  getNumSampleFramesPerBuffer %ld", getNumSampleFramesPerBuffer() );
 	((AppleOnboardAudio *)audioDevice)->setCurrentSampleFrame (0);
+	clearWrapResults ();
 
 	// start the input DMA first
     if (ioBaseDMAInput) {
@@ -1061,12 +1294,18 @@ IOReturn AppleDBDMAAudio::performAudioEngineStart()
 	}
 
 	// start with the lastest user set volume before playback [3527440] aml
-	if (TRUE == mUseSoftwareOutputVolume) {
-		*((UInt32 *)mPreviousLeftVolume) = *((UInt32 *)mLeftVolume);
-		*((UInt32 *)mPreviousRightVolume) = *((UInt32 *)mRightVolume);
+	// the IOProc is not running yet, so take the published set on its behalf
+	if (DSPExchangeAcquire (&mVolumeExchange)) {
+		mLiveVolume = mVolumeSlots[mVolumeExchange.readSlot];
+	}
+	mReleasingSoftwareVolume = FALSE;
+	if (TRUE == mLiveVolume.useSoftwareVolume) {
+		mPreviousLeftVolume[0] = mLiveVolume.leftVolume;
+		mPreviousRightVolume[0] = mLiveVolume.rightVolume;
 	}
 
 	dmaRunState = TRUE;				//	rbm 7.12.02	added for user client support
+	armStallWatchdog ();
 	result = kIOReturnSuccess;
 
     debugIOLog (3, "- AppleDBDMAAudio::performAudioEngineStart() returns %X", result);
@@ -1090,6 +1329,9 @@ IOReturn AppleDBDMAAudio::performAudioEngineStop()
         return kIOReturnError;
     }
 
+	if (NULL != mStallWatchdog) {
+		mStallWatchdog->cancelTimeout ();
+	}
     interruptEventSource->disable();
         
 	// stop the output
@@ -1201,16 +1443,522 @@ void AppleDBDMAAudio::resetClipPosition (IOAudioStream *audioStream, UInt32 clip
 IOReturn AppleDBDMAAudio::restartDMA () {
 	IOReturn					result;
 	
-	performAudioEngineStop ();
-	performAudioEngineStart ();
-	result = kIOReturnSuccess;
+	// the work loop may be recovering the channel already, in which case there is nothing to do
+	result = kIOReturnBusy;
+	if (!claimRestart ()) {
+		goto Exit;
+	}
+
+	// a full stop and start only when the channel cannot be picked up where it was
+	result = restartDMAInPlace ();
+	if (kIOReturnSuccess != result) {
+		traceRestart (FALSE, result);
+		performAudioEngineStop ();
+		performAudioEngineStart ();
+		result = kIOReturnSuccess;
+	}
+	releaseRestart ();
 
+Exit:
     return result;
 }
 
+// The IOProc, through restartDMA, and the work loop, through AppleOnboardAudio::recoverDeadDMA,
+// can both find the channel dead.  Only the one that claims the restart runs it; the other
+// backs off, so the channels are restarted and the missed wraps stamped once.
+bool AppleDBDMAAudio::claimRestart (void) {
+	return OSCompareAndSwap (0, 1, &mRestartClaimed);
+}
+
+// The restart answers whatever filterInterrupt saw before it finished.
+void AppleDBDMAAudio::releaseRestart (void) {
+	mNeedToRestartDMA = FALSE;
+	OSCompareAndSwap (1, 0, &mRestartClaimed);
+}
+
+// Starts the channels again where the serializer has got to by the loop time stamps, which is
+// where the HAL has the IOProc writing.  The ring, the loop count and the time stamps are left
+// as they are, and the wraps the outage spanned are stamped as their interrupts would have
+// stamped them, so the HAL's sample time carries straight on.  Fails, for a full restart, if
+// the outage was long or the last restart in place has not been followed by an interrupt.
+// The caller holds the restart claim.
+IOReturn AppleDBDMAAudio::restartDMAInPlace (void) {
+	AbsoluteTime				uptime;
+	UInt64						nowNanos;
+	UInt64						loopNanos;
+	UInt64						passNanos;
+	UInt32						passes;
+	UInt32						pass;
+	UInt32						blockNum;
+	IOReturn					result;
+
+	result = kIOReturnError;
+	FailIf (NULL == status, Exit);
+	FailIf (mInPlaceRestartTried && mDmaInterruptCount == mInPlaceRestartInterruptCount, Exit);
+
+	clock_get_uptime (&uptime);
+	absolutetime_to_nanoseconds (uptime, &nowNanos);
+	absolutetime_to_nanoseconds (status->fLastLoopTime, &loopNanos);
+	FailIf (!DBDMAInPlaceRestartPoint (nowNanos, loopNanos, sampleRate.whole, numSampleFramesPerBuffer, mBlockSamples / getBlockChannels (), numBlocks, &passes, &blockNum), Exit);
+	if (NULL != ioBaseDMAInput) {
+		FailIf (!restartChannelAtBlock (ioBaseDMAInput, dmaCommandBufferInMemDescriptor, blockNum), Exit);
+	}
+	if (NULL != ioBaseDMAOutput) {
+		FailIf (!restartChannelAtBlock (ioBaseDMAOutput, dmaCommandBufferOutMemDescriptor, blockNum), Exit);
+	}
+	clearWrapResults ();
+
+	passNanos = DBDMATimeStampFilterPeriod (&mTimeStampFilter);
+	for (pass = 1; pass <= passes; pass++) {
+		nanoseconds_to_absolutetime (loopNanos + pass * passNanos, &uptime);
+		takeTimeStamp (true, &uptime);
+	}
+	DBDMATimeStampFilterSkip (&mTimeStampFilter, passes);
+
+	mInPlaceRestartTried = TRUE;
+	mInPlaceRestartInterruptCount = mDmaInterruptCount;
+	mInPlaceRestartCount++;
+	armStallWatchdog ();
+	result = kIOReturnSuccess;
+	traceRestart (TRUE, result);
+
+Exit:
+	return result;
+}
+
+// An interrupt still in flight from before a start or restart then finds no wrap to stamp.
+void AppleDBDMAAudio::clearWrapResults (void) {
+	if (NULL != dmaCommandBufferOut) {
+		IOSetCCDescriptor (&dmaCommandBufferOut[numBlocks - 1], result, 0);
+	}
+	if (NULL != dmaCommandBufferIn) {
+		IOSetCCDescriptor (&dmaCommandBufferIn[numBlocks - 1], result, 0);
+	}
+}
+
+bool AppleDBDMAAudio::restartChannelAtBlock (IODBDMAChannelRegisters * channel, IOMemoryDescriptor * commandMemDescriptor, UInt32 blockNum) {
+	IOPhysicalAddress			commandPhys;
+	IOByteCount					length;
+	bool						result;
+
+	result = FALSE;
+	FailIf (NULL == commandMemDescriptor, Exit);
+	commandPhys = commandMemDescriptor->getPhysicalSegment (blockNum * sizeof (IODBDMADescriptor), &length);
+	FailIf (NULL == commandPhys, Exit);
+
+	DBDMARestartChannel (channel, (IODBDMADescriptor *)commandPhys);
+	result = TRUE;
+
+Exit:
+	return result;
+}
+
+#pragma mark ------------------------ 
+#pragma mark  DMA Block Size
+#pragma mark ------------------------ 
+
+//	Low latency mode.  The channel reads up to a block ahead of the serializer, so a
+//	smaller block lets the IOProc write closer to it.  The ring keeps its length in
+//	samples; only the number of descriptors changes.
+
+UInt32 AppleDBDMAAudio::getBlockChannels (void) {
+	return (0 == mDBDMAOutputFormat.fNumChannels) ? DBDMAAUDIODMAENGINE_DEFAULT_NUM_CHANNELS : mDBDMAOutputFormat.fNumChannels;
+}
+
+// kMinimumLatency covers a root block, so the offset comes down by what the block gives up
+UInt32 AppleDBDMAAudio::getMinimumSampleOffset (void) {
+	return kMinimumLatency - ((DBDMAAUDIODMAENGINE_ROOT_BLOCK_SIZE - mBlockSamples) / getBlockChannels ());
+}
+
+void AppleDBDMAAudio::updateSampleOffset (UInt32 inSampleRate) {
+	// the iSub keeps its own, larger offset whatever the block size
+	if ((NULL == iSubBufferMemory) || (NULL == iSubEngine)) {
+		setSampleOffset ((getMinimumSampleOffset () * ((inSampleRate * 1000) / 44100)) / 1000);
+	}
+}
+
+void AppleDBDMAAudio::setBlockSamples (UInt32 inBlockSamples) {
+	mBlockSamples = inBlockSamples;
+	numBlocks = mTotalBlockSamples / mBlockSamples;
+	mMaxBlockSize = mBlockSamples * (kMaxBitWidth / 8);
+	// before the first format change there is no bit width yet; performFormatChange sets it
+	if (0 != blockSize) {
+		blockSize = mBlockSamples * (mDBDMAOutputFormat.fBitWidth / 8);
+	}
+}
+
+// From the layout or the user client, in frames; the limits are in samples, so a stereo engine
+// takes 8 to 32 frames.  The program is rebuilt at the next runPolledTasks, with the engine
+// paused.  0 asks for the root block size.
+IOReturn AppleDBDMAAudio::requestBlockFrames (UInt32 inFrames) {
+	IOReturn			result = kIOReturnBadArgument;
+	UInt32				samples;
+
+	samples = (0 == inFrames) ? DBDMAAUDIODMAENGINE_ROOT_BLOCK_SIZE : inFrames * getBlockChannels ();
+	FailIf (samples < DBDMAAUDIODMAENGINE_MIN_BLOCK_SIZE || samples > DBDMAAUDIODMAENGINE_ROOT_BLOCK_SIZE, Exit);
+	FailIf (0 != (samples & (samples - 1)), Exit);
+
+	mRequestedBlockSamples = samples;
+	mTargetBlockSamples = samples;
+	result = kIOReturnSuccess;
+Exit:
+	debugIOLog (3, " AppleDBDMAAudio::requestBlockFrames (%ld) returns %lX", inFrames, result);
+	return result;
+}
+
+// Polled once a second.  A small block that keeps making the clip late is doubled until
+// the clip keeps up or the root size is reached; it stays there until the next request.
+bool AppleDBDMAAudio::blockSizeChangeNeeded (void) {
+	UInt32				overruns;
+
+	overruns = mClipOverrunCount - mLastClipOverrunCount;
+	mLastClipOverrunCount = mClipOverrunCount;
+	if (dmaRunState && mTargetBlockSamples == mBlockSamples && mBlockSamples < DBDMAAUDIODMAENGINE_ROOT_BLOCK_SIZE && overruns >= kDBDMAClipOverrunsToBackOff) {
+		mTargetBlockSamples = mBlockSamples * 2;
+		mBlockBackOffCount++;
+		debugIOLog (3, "  AppleDBDMAAudio::blockSizeChangeNeeded %ld late clips, backing off to %ld sample blocks", overruns, mTargetBlockSamples);
+	}
+	return mTargetBlockSamples != mBlockSamples;
+}
+
+// Called with the engine paused.  The sample buffers, the stream and the iSub buffers
+// are sized by mTotalBlockSamples, so only the descriptors are rebuilt.
+bool AppleDBDMAAudio::applyBlockSize (void) {
+	UInt32				previousBlockSamples;
+	bool				result = FALSE;
+
+	FailIf (dmaRunState, Exit);
+
+	previousBlockSamples = mBlockSamples;
+	if (NULL == dmaCommandBufferOut && NULL == dmaCommandBufferIn) {
+		setBlockSamples (mTargetBlockSamples);
+	} else {
+		deallocateDMAMemory ();
+		setBlockSamples (mTargetBlockSamples);
+		if (!createDMAPrograms ()) {
+			// put the last program back so the engine can still run
+			deallocateDMAMemory ();
+			setBlockSamples (previousBlockSamples);
+			mTargetBlockSamples = previousBlockSamples;
+			createDMAPrograms ();
+			goto Exit;
+		}
+	}
+	updateSampleOffset (sampleRate.whole);
+	mLastClipOverrunCount = mClipOverrunCount;
+	result = TRUE;
+Exit:
+	debugIOLog (3, " AppleDBDMAAudio::applyBlockSize %ld to %ld samples, %ld blocks, returns %d", previousBlockSamples, mBlockSamples, numBlocks, result);
+	return result;
+}
+
+// The serializer is at the frame counter and the channel has read at most a block past it.
+// A clip that finishes with its first frame inside that block, or behind the serializer,
+// was too late for part of what it wrote.  The margin is the lead left once that block is
+// counted as read, so it goes negative for a late clip.
+inline void AppleDBDMAAudio::checkClipDeadline (UInt32 firstSampleFrame) {
+	UInt32				numSampleFramesPerBuffer;
+	UInt32				blockFrames;
+	UInt32				dmaFrame;
+	UInt32				lead;
+	SInt32				margin;
+	UInt32				bucket;
+	SInt32				bucketLimit;
+
+	if (!dmaRunState || 0 == mNumCommandSegments) {
+		goto Exit;
+	}
+	if (mDeadlineClearsSeen != mDeadlineClears) {
+		mDeadlineClearsSeen = mDeadlineClears;
+		mDeadlineClipCount = 0;
+		mDeadlineUnderrunCount = 0;
+		mDeadlineNearMissCount = 0;
+		mDeadlineMarginSum = 0;
+		bzero (mDeadlineHistogram, sizeof (mDeadlineHistogram));
+	}
+
+	numSampleFramesPerBuffer = getNumSampleFramesPerBuffer ();
+	blockFrames = mBlockSamples / getBlockChannels ();
+	dmaFrame = getDMAPositionFrame ();
+	lead = (firstSampleFrame + numSampleFramesPerBuffer - dmaFrame) % numSampleFramesPerBuffer;
+	if (lead > numSampleFramesPerBuffer / 2) {
+		margin = (SInt32)lead - (SInt32)numSampleFramesPerBuffer;
+	} else {
+		margin = (SInt32)lead - (SInt32)blockFrames;
+	}
+
+	mDeadlineClipCount++;
+	mDeadlineMarginSum += margin;
+	mLastDeadlineMargin = margin;
+	if (1 == mDeadlineClipCount || margin < mMinDeadlineMargin) {
+		mMinDeadlineMargin = margin;
+	}
+	bucket = 0;
+	if (margin < 0) {
+		mClipOverrunCount++;
+		mDeadlineUnderrunCount++;
+		mTotalUnderrunCount++;
+		trace (kDBDMATraceDeadline, firstSampleFrame, dmaFrame, (UInt32)margin);
+	} else {
+		if (margin < (SInt32)blockFrames) {
+			mDeadlineNearMissCount++;
+		}
+		bucket = 1;
+		bucketLimit = 1 << kDBDMADeadlineHistogramFirstShift;
+		while (bucket < kDBDMADeadlineHistogramBuckets - 1 && margin >= bucketLimit) {
+			bucket++;
+			bucketLimit <<= 1;
+		}
+	}
+	mDeadlineHistogram[bucket]++;
+Exit:
+	return;
+}
+
+// The descriptors can sit on more than one physical run, so keep where each run starts to turn
+// the command pointer back into a block.
+void AppleDBDMAAudio::recordCommandSegments (void) {
+	IOMemoryDescriptor *		commandMemDescriptor;
+	IOByteCount					offset;
+	IOByteCount					length;
+	IOPhysicalAddress			physical;
+
+	mNumCommandSegments = 0;
+	commandMemDescriptor = (NULL != ioBaseDMAOutput) ? dmaCommandBufferOutMemDescriptor : dmaCommandBufferInMemDescriptor;
+	FailIf (NULL == commandMemDescriptor, Exit);
+
+	offset = 0;
+	while (offset < commandBufferSize && mNumCommandSegments < DBDMAAUDIODMAENGINE_MAX_COMMAND_SEGMENTS) {
+		physical = commandMemDescriptor->getPhysicalSegment (offset, &length);
+		FailIf (NULL == physical || 0 == length, Exit);
+		mCommandSegments[mNumCommandSegments].physical = physical;
+		mCommandSegments[mNumCommandSegments].offset = offset;
+		mCommandSegments[mNumCommandSegments].length = length;
+		mNumCommandSegments++;
+		offset += length;
+	}
+
+Exit:
+	return;
+}
+
+// The command pointer names the block the channel is moving; everything before it has been
+// read.  DBDMA keeps no running byte count, so this is good to a block.
+UInt32 AppleDBDMAAudio::getDMAPositionFrame (void) {
+	IODBDMAChannelRegisters *	channel;
+	IOPhysicalAddress			commandPtr;
+	UInt32						segment;
+	UInt32						blockNum;
+	UInt32						result;
+
+	result = 0;
+	channel = (NULL != ioBaseDMAOutput) ? ioBaseDMAOutput : ioBaseDMAInput;
+	if (NULL != channel) {
+		commandPtr = IOGetDBDMACommandPtr (channel);
+		for (segment = 0; segment < mNumCommandSegments; segment++) {
+			if (commandPtr >= mCommandSegments[segment].physical && commandPtr - mCommandSegments[segment].physical < mCommandSegments[segment].length) {
+				blockNum = (mCommandSegments[segment].offset + (commandPtr - mCommandSegments[segment].physical)) / sizeof (IODBDMADescriptor);
+				if (blockNum < numBlocks) {
+					result = blockNum * (mBlockSamples / getBlockChannels ());
+				}
+				break;
+			}
+		}
+	}
+	return result;
+}
+
+IOReturn AppleDBDMAAudio::copyBlockState (DBDMABlockUserClientStructPtr outState) {
+	outState->requestedBlockFrames = mRequestedBlockSamples / getBlockChannels ();
+	outState->blockFrames = mBlockSamples / getBlockChannels ();
+	outState->numBlocks = numBlocks;
+	outState->sampleOffset = sampleOffset;
+	outState->clipOverrunCount = mClipOverrunCount;
+	outState->backOffCount = mBlockBackOffCount;
+	outState->blocksPerInterrupt = numBlocks;
+	outState->interruptCount = mDmaInterruptCount;
+	return kIOReturnSuccess;
+}
+
+IOReturn AppleDBDMAAudio::setBlockState (DBDMABlockUserClientStructPtr inState) {
+	return requestBlockFrames (inState->requestedBlockFrames);
+}
+
+IOReturn AppleDBDMAAudio::copyDeadlineState (DBDMADeadlineUserClientStructPtr outState) {
+	UInt32		bucket;
+
+	outState->notifyUnderruns = mNotifyUnderruns;
+	outState->clipCount = mDeadlineClipCount;
+	outState->underrunCount = mDeadlineUnderrunCount;
+	outState->nearMissCount = mDeadlineNearMissCount;
+	outState->minMarginFrames = mMinDeadlineMargin;
+	outState->lastMarginFrames = mLastDeadlineMargin;
+	outState->meanMarginFrames = (0 == mDeadlineClipCount) ? 0 : (SInt32)(mDeadlineMarginSum / (SInt64)mDeadlineClipCount);
+	outState->safetyOffsetFrames = sampleOffset;
+	for (bucket = 0; bucket < kDBDMADeadlineHistogramBuckets; bucket++) {
+		outState->marginHistogram[bucket] = mDeadlineHistogram[bucket];
+	}
+	return kIOReturnSuccess;
+}
+
+// The IOProc owns the counts, so it clears them at its next clip.
+IOReturn AppleDBDMAAudio::setDeadlineState (DBDMADeadlineUserClientStructPtr inState) {
+	mNotifyUnderruns = (0 != inState->notifyUnderruns);
+	mReportedUnderrunCount = mTotalUnderrunCount;
+	mDeadlineClears++;
+	return kIOReturnSuccess;
+}
+
+// Polled.  Late clips since the last poll are published, and clients told, when asked for.
+void AppleDBDMAAudio::reportClipUnderruns (void) {
+	UInt32		underruns;
+
+	underruns = mTotalUnderrunCount;
+	if (mNotifyUnderruns && underruns != mReportedUnderrunCount) {
+		debugIOLog (3, "  AppleDBDMAAudio::reportClipUnderruns %ld late clips, minimum margin %ld frames", underruns - mReportedUnderrunCount, mMinDeadlineMargin);
+		mReportedUnderrunCount = underruns;
+		setProperty (kClipUnderrunCount, underruns, 32);
+		messageClients (kIOMessageServicePropertyChange);
+	}
+}
+
+// Polled.  A run list rebuild the IOProc held off is made now.
+void AppleDBDMAAudio::updateOutputDSP (void) {
+	if (NULL != mOutputDSP) {
+		mOutputDSP->updateRunListIfStale ();
+	}
+}
+
+IOReturn AppleDBDMAAudio::copyTimeStampState (DBDMATimeStampUserClientStructPtr outState) {
+	outState->nominalPeriodNanos = (UInt32)mTimeStampFilter.nominalNanos;
+	outState->periodNanos = (UInt32)(mTimeStampFilter.periodFixed >> kDBDMATimeStampFractionBits);
+	outState->passCount = mTimeStampFilter.passCount;
+	outState->unlockCount = mTimeStampFilter.unlockCount;
+	outState->lastResidualNanos = (SInt32)mTimeStampFilter.lastResidual;
+	outState->meanResidualNanos = (UInt32)mTimeStampFilter.meanResidual;
+	outState->maxResidualNanos = (UInt32)mTimeStampFilter.maxResidual;
+	return kIOReturnSuccess;
+}
+
+// getCurrentSampleFrame limits the erase to what has already been read.  The mix buffer and
+// the sample buffer both go through ZeroSamples, which does not read the lines it clears.
+void AppleDBDMAAudio::eraseOutputSamples (const void *mixBuf, void *sampleBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat, IOAudioStream *audioStream) {
+	AbsoluteTime				startUptime;
+	AbsoluteTime				endUptime;
+	UInt64						nanos;
+	UInt32						mixFrameBytes;
+	UInt32						sampleFrameBytes;
+
+	mixFrameBytes = streamFormat->fNumChannels * sizeof (float);
+	sampleFrameBytes = streamFormat->fNumChannels * (streamFormat->fBitWidth / 8);
+
+	clock_get_uptime (&startUptime);
+	if (mGenericEraser) {
+		super::eraseOutputSamples (mixBuf, sampleBuf, firstSampleFrame, numSampleFrames, streamFormat, audioStream);
+	} else {
+		if (NULL != mixBuf) {
+			ZeroSamples ((UInt8 *)mixBuf + firstSampleFrame * mixFrameBytes, numSampleFrames * mixFrameBytes);
+		}
+		if (NULL != sampleBuf) {
+			ZeroSamples ((UInt8 *)sampleBuf + firstSampleFrame * sampleFrameBytes, numSampleFrames * sampleFrameBytes);
+		}
+	}
+	clock_get_uptime (&endUptime);
+	SUB_ABSOLUTETIME (&endUptime, &startUptime);
+	absolutetime_to_nanoseconds (endUptime, &nanos);
+
+	mEraseCount++;
+	mEraseNanos += nanos;
+	mEraseBytes += numSampleFrames * ((NULL != mixBuf ? mixFrameBytes : 0) + (NULL != sampleBuf ? sampleFrameBytes : 0));
+}
+
+IOReturn AppleDBDMAAudio::copyEraseState (DBDMAEraseUserClientStructPtr outState) {
+	outState->genericEraser = mGenericEraser;
+	outState->eraseCount = mEraseCount;
+	outState->eraseKiloBytes = (UInt32)(mEraseBytes >> 10);
+	outState->eraseMicroseconds = (UInt32)(mEraseNanos / 1000);
+	outState->megaBytesPerSecond = (0 == mEraseNanos) ? 0 : (UInt32)((mEraseBytes * 1000) / mEraseNanos);
+	return kIOReturnSuccess;
+}
+
+IOReturn AppleDBDMAAudio::copyWatchdogState (DBDMAWatchdogUserClientStructPtr outState) {
+	UInt32		bucket;
+
+	outState->checkNanos = mWatchdogNanos;
+	outState->stallCount = mDmaStalledCount;
+	outState->deadCount = mDmaHwDiedCount;
+	outState->recoveryCount = mRecoveryCount;
+	outState->lastRecoveryMicroseconds = mLastRecoveryMicros;
+	outState->inPlaceRestartCount = mInPlaceRestartCount;
+	for (bucket = 0; bucket < kDBDMARecoveryHistogramBuckets; bucket++) {
+		outState->recoveryHistogram[bucket] = mRecoveryHistogram[bucket];
+	}
+	return kIOReturnSuccess;
+}
+
+IOReturn AppleDBDMAAudio::setEraseState (DBDMAEraseUserClientStructPtr inState) {
+	mGenericEraser = (0 != inState->genericEraser);
+	mEraseCount = 0;
+	mEraseBytes = 0;
+	mEraseNanos = 0;
+	return kIOReturnSuccess;
+}
+
+// Safe while the engine runs; a stage the IOProc was writing on every try is counted as torn.
+IOReturn AppleDBDMAAudio::copyIOProcTiming (DBDMAIOProcTimingUserClientStructPtr outState) {
+	DBDMAIOProcHistogram				histogram;
+	DBDMAIOProcStageUserClientStruct *	stageState;
+	UInt32								stage;
+	UInt32								bucket;
+
+	outState->bucketFirstShift = kDBDMAIOProcHistogramFirstShift;
+	outState->tornCount = 0;
+	for (stage = 0; stage < kDBDMAIOProcStageCount; stage++) {
+		if (!DBDMAIOProcHistogramCopy (&mIOProcHistograms[stage], &histogram)) {
+			outState->tornCount++;
+		}
+		stageState = &outState->stages[stage];
+		stageState->count = histogram.count;
+		stageState->p50Nanos = DBDMAIOProcHistogramPercentile (&histogram, 500);
+		stageState->p99Nanos = DBDMAIOProcHistogramPercentile (&histogram, 990);
+		stageState->maxNanos = histogram.maxNanos;
+		stageState->maxUptimeNanos_hi = (UInt32)(histogram.maxEndNanos >> 32);
+		stageState->maxUptimeNanos_lo = (UInt32)histogram.maxEndNanos;
+		for (bucket = 0; bucket < kDBDMAIOProcHistogramBuckets; bucket++) {
+			stageState->buckets[bucket] = histogram.buckets[bucket];
+		}
+	}
+	return kIOReturnSuccess;
+}
+
+// The IOProcs own the histograms, so each clears its own the next time it runs.
+void AppleDBDMAAudio::clearIOProcTiming (void) {
+	mIOProcTimingClears++;
+}
+
+IOReturn AppleDBDMAAudio::copyTrace (DBDMATraceUserClientStructPtr outState) {
+	outState->entryCount = DBDMATraceDrain (&mTrace, &mTraceReadSlot, outState->entries, kDBDMATraceDrainEntries, &outState->lostCount);
+	outState->pendingCount = mTrace.next - mTraceReadSlot;
+	if (outState->pendingCount > kDBDMATraceEntries) {
+		outState->pendingCount = kDBDMATraceEntries;
+	}
+	outState->reserved = 0;
+	return kIOReturnSuccess;
+}
+
+// the software DSP chain adds its own latency on top of what the hardware plugin reports
 void AppleDBDMAAudio::setSampleLatencies (UInt32 outputLatency, UInt32 inputLatency) {
-	setOutputSampleLatency (outputLatency);
-	setInputSampleLatency (inputLatency);
+	mHardwareOutputLatency = outputLatency;
+	mHardwareInputLatency = inputLatency;
+	updateSampleLatencies ();
+}
+
+void AppleDBDMAAudio::updateSampleLatencies (void) {
+	UInt32		captureLatency;
+
+	captureLatency = (mInputCaptureEnabled && NULL != mInputCapture) ? mInputCapture->getLatency () : 0;
+	setOutputSampleLatency (mHardwareOutputLatency + mOutputDSP->getLatency ());
+	setInputSampleLatency (mHardwareInputLatency + captureLatency);
 }
 
 void AppleDBDMAAudio::stop(IOService *provider)
@@ -1225,6 +1973,14 @@ void AppleDBDMAAudio::stop(IOService *provider)
             workLoop->removeEventSource(interruptEventSource);
         }
     }
+
+	if (NULL != mStallWatchdog) {
+		mStallWatchdog->cancelTimeout ();
+		workLoop = getWorkLoop ();
+		if (workLoop) {
+			workLoop->removeEventSource (mStallWatchdog);
+		}
+	}
  	
     if (NULL != iSubEngineNotifier) {
         iSubEngineNotifier->remove ();
@@ -1349,47 +2105,90 @@ void AppleDBDMAAudio::chooseOutputClippingRoutinePtr()
 }
 
 // [3094574] aml, pick the correct input conversion routine based on our current state
+//	The choice is published to the input IOProc, which picks it up on its next block.
 void AppleDBDMAAudio::chooseInputConversionRoutinePtr() 
 {
+	InputConversion *			nextConversion;
+	DBDMAConvertInputRoutine	convertRoutine;
+	bool						useCapture;
+
+	convertRoutine = NULL;
+
+	//	the capture routines also carry software input gain and the dual mono copy
+	useCapture = mInputCaptureEnabled && (NULL != mInputCapture) && mInputCapture->isActive () && (mInputCapture->getNumChannels () == mDBDMAInputFormat.fNumChannels);
+
 	if (32 == mDBDMAInputFormat.fBitWidth) {
-		if (mUseSoftwareInputGain) {
-			mConvertInputStreamToAppleDBDMARoutine = &AppleDBDMAAudio::convertAppleDBDMAFromInputStream32WithGain;
+		if (useCapture) {
+			convertRoutine = &AppleDBDMAAudio::convertAppleDBDMAFromInputStream32Capture;
+		} else if (mUseSoftwareInputGain) {
+			convertRoutine = &AppleDBDMAAudio::convertAppleDBDMAFromInputStream32WithGain;
 		} else {
-			mConvertInputStreamToAppleDBDMARoutine = &AppleDBDMAAudio::convertAppleDBDMAFromInputStream32;
+			convertRoutine = &AppleDBDMAAudio::convertAppleDBDMAFromInputStream32;
 		}
 	} else if (16 == mDBDMAInputFormat.fBitWidth) {
-		if (mUseSoftwareInputGain) {
-			mConvertInputStreamToAppleDBDMARoutine = &AppleDBDMAAudio::convertAppleDBDMAFromInputStream16WithGain;
+		if (useCapture) {
+			convertRoutine = &AppleDBDMAAudio::convertAppleDBDMAFromInputStream16Capture;
+		} else if (mUseSoftwareInputGain) {
+			convertRoutine = &AppleDBDMAAudio::convertAppleDBDMAFromInputStream16WithGain;
 		} else {
 			if (e_Mode_CopyRightToLeft == mInputDualMonoMode) {
-				mConvertInputStreamToAppleDBDMARoutine = &AppleDBDMAAudio::convertAppleDBDMAFromInputStream16CopyR2L;
+				convertRoutine = &AppleDBDMAAudio::convertAppleDBDMAFromInputStream16CopyR2L;
 			} else {
-				mConvertInputStreamToAppleDBDMARoutine = &AppleDBDMAAudio::convertAppleDBDMAFromInputStream16;
+				convertRoutine = &AppleDBDMAAudio::convertAppleDBDMAFromInputStream16;
 			}
 		}
 	} else {
 		debugIOLog (3, " AppleDBDMAAudio::chooseInputConversionRoutinePtr - Non-supported input bit depth!");
 	}
+
+	if (NULL != convertRoutine) {
+		nextConversion = &mInputConversionSlots[mInputConversionExchange.writeSlot];
+		nextConversion->convertRoutine = convertRoutine;
+		nextConversion->rightChanDelay = fNeedsRightChanDelayInput;
+		DSPExchangePublish (&mInputConversionExchange);
+	}
 }
 
 IOReturn AppleDBDMAAudio::clipOutputSamples(const void *mixBuf, void *sampleBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat, IOAudioStream *audioStream)
 {
 	IOReturn 			result;
+	UInt32				scratchFrames;
+	UInt32				pieceFirstSampleFrame;
+	UInt32				pieceFrames;
+	UInt32				framesLeft;
+	UInt64				nanos;
 	
 	result = kIOReturnSuccess;
+	startOutputTiming ();
  
  	// if the DMA went bad restart it
 	if (mNeedToRestartDMA) {
-		mNeedToRestartDMA = FALSE;
 		restartDMA ();
 	}
     
 	if (0 != numSampleFrames) {
 
 		// [3094574] aml, use function pointer instead of if/else block - handles both iSub and non-iSub clipping cases.
-		result = (*this.*mClipAppleDBDMAToOutputStreamRoutine)(mixBuf, sampleBuf, firstSampleFrame, numSampleFrames, streamFormat);
+		if (&AppleDBDMAAudio::clipMemCopyToOutputStream == mClipAppleDBDMAToOutputStreamRoutine) {
+			result = (*this.*mClipAppleDBDMAToOutputStreamRoutine)(mixBuf, sampleBuf, firstSampleFrame, numSampleFrames, streamFormat);
+		} else {
+			// the float stages run in the scratch buffer, so a clip longer than it goes through a piece at a time
+			scratchFrames = DBDMAAUDIODMAENGINE_SCRATCH_SAMPLES / streamFormat->fNumChannels;
+			pieceFirstSampleFrame = firstSampleFrame;
+			framesLeft = numSampleFrames;
+			while (0 != framesLeft && kIOReturnSuccess == result) {
+				pieceFrames = framesLeft < scratchFrames ? framesLeft : scratchFrames;
+				result = (*this.*mClipAppleDBDMAToOutputStreamRoutine)(mixBuf, sampleBuf, pieceFirstSampleFrame, pieceFrames, streamFormat);
+				pieceFirstSampleFrame += pieceFrames;
+				framesLeft -= pieceFrames;
+			}
+		}
+
+		checkClipDeadline (firstSampleFrame);
 	}
-    
+
+	nanos = endOutputTiming ();
+	trace (kDBDMATraceClip, firstSampleFrame, numSampleFrames, (UInt32)nanos);
 	return result;
 }
 
@@ -1397,15 +2196,23 @@ IOReturn AppleDBDMAAudio::clipOutputSamples(const void *mixBuf, void *sampleBuf,
 IOReturn AppleDBDMAAudio::convertInputSamples(const void *sampleBuf, void *destBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat, IOAudioStream *audioStream)
 {
 	IOReturn result;
+	UInt64 nanos;
+
+	startInputTiming ();
 
  	// if the DMA went bad restart it
 	if (mNeedToRestartDMA) {
-		mNeedToRestartDMA = FALSE;
 		restartDMA ();
 	}
     
-	result = (*this.*mConvertInputStreamToAppleDBDMARoutine)(sampleBuf, destBuf, firstSampleFrame, numSampleFrames, streamFormat);
-    
+	if (DSPExchangeAcquire (&mInputConversionExchange)) {
+		mLiveInputConversion = mInputConversionSlots[mInputConversionExchange.readSlot];
+	}
+
+	result = (*this.*mLiveInputConversion.convertRoutine)(sampleBuf, destBuf, firstSampleFrame, numSampleFrames, streamFormat);
+
+	nanos = endInputTiming ();
+	trace (kDBDMATraceConvert, firstSampleFrame, numSampleFrames, (UInt32)nanos);
 	return result;
 }
 
@@ -1414,18 +2221,58 @@ IOReturn AppleDBDMAAudio::convertInputSamples(const void *sampleBuf, void *destB
 #pragma mark ------------------------ 
 
 inline void AppleDBDMAAudio::outputProcessing (float* inFloatBufferPtr, UInt32 inNumSamples) {
-	if (mUseSoftwareOutputVolume) {
-		volume (inFloatBufferPtr, inNumSamples, mLeftVolume, mRightVolume, mPreviousLeftVolume, mPreviousRightVolume);
+	// clip option fixups apply whether or not the software DSP is enabled
+	if (NULL != mOutputFixupDelay) {
+		mOutputFixupDelay->process (inFloatBufferPtr, inNumSamples);
+	}
+	if (DSPExchangeAcquire (&mVolumeExchange)) {
+		acquireSoftwareOutputVolume ();
+	}
+	if (mLiveVolume.useSoftwareVolume) {
+		volume (inFloatBufferPtr, inNumSamples, &mLiveVolume.leftVolume, &mLiveVolume.rightVolume, mPreviousLeftVolume, mPreviousRightVolume);
+	} else if (mReleasingSoftwareVolume) {
+		float		unity = 1.0f;
+
+		volume (inFloatBufferPtr, inNumSamples, &unity, &unity, mPreviousLeftVolume, mPreviousRightVolume);
+		if (DSPAbs (1.0f - mPreviousLeftVolume[0]) < 0.001f && DSPAbs (1.0f - mPreviousRightVolume[0]) < 0.001f) {
+			mReleasingSoftwareVolume = FALSE;
+		}
+	}
+	// the chain ends in its clip and true peak limiter stages, so it has to follow every gain stage
+	mOutputDSP->process (inFloatBufferPtr, inNumSamples);
+	// what goes to the DAC is what the echo canceller has to take back out of the microphones
+	if (mInputCaptureEnabled) {
+		mInputCapture->writeEchoReference (inFloatBufferPtr, mOutputSampleFrame, inNumSamples / mDBDMAOutputFormat.fNumChannels, mDBDMAOutputFormat.fNumChannels);
 	}
 }
 
+// Without software volume the stream passes at unity gain, so turning it on
+// ramps down from unity and turning it off ramps back up to unity before the
+// volume stage drops out.  The gains themselves are smoothed by volume ().
+inline void AppleDBDMAAudio::acquireSoftwareOutputVolume (void) {
+	SoftwareOutputVolume *		nextVolume;
+
+	nextVolume = &mVolumeSlots[mVolumeExchange.readSlot];
+	if (nextVolume->useSoftwareVolume && !mLiveVolume.useSoftwareVolume && !mReleasingSoftwareVolume) {
+		mPreviousLeftVolume[0] = 1.0f;
+		mPreviousRightVolume[0] = 1.0f;
+	} else if (!nextVolume->useSoftwareVolume && mLiveVolume.useSoftwareVolume) {
+		mReleasingSoftwareVolume = TRUE;
+	}
+	if (nextVolume->useSoftwareVolume) {
+		mReleasingSoftwareVolume = FALSE;
+	}
+	mLiveVolume = *nextVolume;
+}
+
 inline void AppleDBDMAAudio::setupOutputBuffer (const void *mixBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat) {
 	float*			tempFloatPtr;
 
 	mMixBufferPtr = (float *)mixBuf;
+	mOutputSampleFrame = firstSampleFrame;
 	tempFloatPtr = (float *)mixBuf+firstSampleFrame*streamFormat->fNumChannels;
 
-	memcpy (mIntermediateOutputSampleBuffer, tempFloatPtr, numSampleFrames*streamFormat->fNumChannels*sizeof(float));
+	memcpy (mOutputScratchBuffer, tempFloatPtr, numSampleFrames*streamFormat->fNumChannels*sizeof(float));
 }
 
 IOReturn AppleDBDMAAudio::clipMemCopyToOutputStream (const void *mixBuf, void *sampleBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat)
@@ -1437,6 +2284,7 @@ IOReturn AppleDBDMAAudio::clipMemCopyToOutputStream (const void *mixBuf, void *s
 	offset = firstSampleFrame * streamSize;
 
 	memcpy ((UInt8 *)sampleBuf + offset, (UInt8 *)mixBuf, numSampleFrames * streamSize);
+	markOutputStage (kDBDMAIOProcStageOutputCopy);
 	return kIOReturnSuccess;
 }
 
@@ -1452,14 +2300,13 @@ IOReturn AppleDBDMAAudio::clipAppleDBDMAToOutputStream16(const void *inFloatBuff
 	outSInt16BufferPtr = (SInt16 *)sampleBuf+firstSampleFrame * streamFormat->fNumChannels;	
 
 	setupOutputBuffer (inFloatBufferPtr, firstSampleFrame, numSampleFrames, streamFormat);
-    
-    startOutputTiming();
-    
-	outputProcessing((float *)mIntermediateOutputSampleBuffer, numSamples);
-	
-    endOutputTiming();
-    
-	Float32ToNativeInt16( (float *)mIntermediateOutputSampleBuffer, outSInt16BufferPtr, numSamples );
+	markOutputStage (kDBDMAIOProcStageOutputCopy);
+
+	outputProcessing((float *)mOutputScratchBuffer, numSamples);
+	markOutputStage (kDBDMAIOProcStageOutputDSP);
+
+	Float32ToNativeInt16( (float *)mOutputScratchBuffer, outSInt16BufferPtr, numSamples );
+	markOutputStage (kDBDMAIOProcStageOutputConvert);
 
     return kIOReturnSuccess;
 }
@@ -1477,16 +2324,16 @@ IOReturn AppleDBDMAAudio::clipAppleDBDMAToOutputStream16MixRightChannel(const vo
 	outSInt16BufferPtr = (SInt16 *)sampleBuf+firstSampleFrame * streamFormat->fNumChannels;
 
 	setupOutputBuffer (inFloatBufferPtr, firstSampleFrame, numSampleFrames, streamFormat);
-    
-    startOutputTiming();
-    
-	outputProcessing((float *)mIntermediateOutputSampleBuffer, numSamples);
-	
-    endOutputTiming();
-    
-	mixAndMuteRightChannel( (float *)mIntermediateOutputSampleBuffer, (float *)mIntermediateOutputSampleBuffer, numSamples );
+	markOutputStage (kDBDMAIOProcStageOutputCopy);
+
+	outputProcessing((float *)mOutputScratchBuffer, numSamples);
+	markOutputStage (kDBDMAIOProcStageOutputDSP);
+
+	mixAndMuteRightChannel( (float *)mOutputScratchBuffer, (float *)mOutputScratchBuffer, numSamples );
+	markOutputStage (kDBDMAIOProcStageOutputConvert);
 
-	Float32ToNativeInt16( (float *)mIntermediateOutputSampleBuffer, outSInt16BufferPtr, numSamples );
+	Float32ToNativeInt16( (float *)mOutputScratchBuffer, outSInt16BufferPtr, numSamples );
+	markOutputStage (kDBDMAIOProcStageOutputConvert);
 
     return kIOReturnSuccess;
 }
@@ -1503,14 +2350,13 @@ IOReturn AppleDBDMAAudio::clipAppleDBDMAToOutputStream32(const void *inFloatBuff
 	outSInt32BufferPtr = (SInt32 *)sampleBuf + firstSampleFrame * streamFormat->fNumChannels;
 
 	setupOutputBuffer (inFloatBufferPtr, firstSampleFrame, numSampleFrames, streamFormat);
-    
-    startOutputTiming();
-    
-	outputProcessing((float *)mIntermediateOutputSampleBuffer, numSamples);
-    
-    endOutputTiming();
-    
-	Float32ToNativeInt32( (float *)mIntermediateOutputSampleBuffer, outSInt32BufferPtr, numSamples );
+	markOutputStage (kDBDMAIOProcStageOutputCopy);
+
+	outputProcessing((float *)mOutputScratchBuffer, numSamples);
+	markOutputStage (kDBDMAIOProcStageOutputDSP);
+
+	Float32ToNativeInt32( (float *)mOutputScratchBuffer, outSInt32BufferPtr, numSamples );
+	markOutputStage (kDBDMAIOProcStageOutputConvert);
 
     return kIOReturnSuccess;
 }
@@ -1528,16 +2374,16 @@ IOReturn AppleDBDMAAudio::clipAppleDBDMAToOutputStream32MixRightChannel(const vo
 	outSInt32BufferPtr = (SInt32 *)sampleBuf + firstSampleFrame * streamFormat->fNumChannels;
 
 	setupOutputBuffer (inFloatBufferPtr, firstSampleFrame, numSampleFrames, streamFormat);
-    
-    startOutputTiming();
-    
-	outputProcessing((float *)mIntermediateOutputSampleBuffer, numSamples);
-    
-    endOutputTiming();
-    
-	mixAndMuteRightChannel( (float *)mIntermediateOutputSampleBuffer, (float *)mIntermediateOutputSampleBuffer, numSamples );
+	markOutputStage (kDBDMAIOProcStageOutputCopy);
+
+	outputProcessing((float *)mOutputScratchBuffer, numSamples);
+	markOutputStage (kDBDMAIOProcStageOutputDSP);
 
-	Float32ToNativeInt32( (float *)mIntermediateOutputSampleBuffer, outSInt32BufferPtr, numSamples );
+	mixAndMuteRightChannel( (float *)mOutputScratchBuffer, (float *)mOutputScratchBuffer, numSamples );
+	markOutputStage (kDBDMAIOProcStageOutputConvert);
+
+	Float32ToNativeInt32( (float *)mOutputScratchBuffer, outSInt32BufferPtr, numSamples );
+	markOutputStage (kDBDMAIOProcStageOutputConvert);
 
     return kIOReturnSuccess;
 }
@@ -1556,6 +2402,7 @@ IOReturn AppleDBDMAAudio::clipAppleDBDMAToOutputStream16iSub(const void *inFloat
 	UInt32		sampleIndex;
 
 	iSubSynchronize(firstSampleFrame, numSampleFrames);
+	markOutputStage (kDBDMAIOProcStageOutputiSub);
 
 	PreviousValues* filterState = &(miSubProcessingParams.filterState);
 	PreviousValues* filterState2 = &(miSubProcessingParams.filterState2);
@@ -1576,21 +2423,22 @@ IOReturn AppleDBDMAAudio::clipAppleDBDMAToOutputStream16iSub(const void *inFloat
     maxSampleIndex = (firstSampleFrame + numSampleFrames) * streamFormat->fNumChannels;
 
 	setupOutputBuffer (inFloatBufferPtr, firstSampleFrame, numSampleFrames, streamFormat);
+	markOutputStage (kDBDMAIOProcStageOutputCopy);
 
-	StereoLowPass4thOrder ((float *)mIntermediateOutputSampleBuffer, &low[firstSampleFrame * streamFormat->fNumChannels], numSampleFrames, sampleRate, coefficients, filterState, filterState2);
+	StereoLowPass4thOrder ((float *)mOutputScratchBuffer, &low[firstSampleFrame * streamFormat->fNumChannels], numSampleFrames, sampleRate, coefficients, filterState, filterState2);
+	markOutputStage (kDBDMAIOProcStageOutputiSub);
 
 	outputBuf16 = (SInt16 *)sampleBuf+firstSampleFrame * streamFormat->fNumChannels;
-    
-    startOutputTiming();
-    
-	outputProcessing ((float *)mIntermediateOutputSampleBuffer, numSamples);
-    
-    endOutputTiming();
-    
-	Float32ToNativeInt16( (float *)mIntermediateOutputSampleBuffer, outputBuf16, numSamples );
+
+	outputProcessing ((float *)mOutputScratchBuffer, numSamples);
+	markOutputStage (kDBDMAIOProcStageOutputDSP);
+
+	Float32ToNativeInt16( (float *)mOutputScratchBuffer, outputBuf16, numSamples );
+	markOutputStage (kDBDMAIOProcStageOutputConvert);
 
  	sampleIndex = (firstSampleFrame * streamFormat->fNumChannels);
 	iSubDownSampleLinearAndConvert( low, srcPhase, srcState, adaptiveSampleRate, outputSampleRate, sampleIndex, maxSampleIndex, iSubBufferMemory, iSubBufferOffset, iSubBufferLen, loopCount );	
+	markOutputStage (kDBDMAIOProcStageOutputiSub);
 
 	updateiSubPosition(firstSampleFrame, numSampleFrames);
 		
@@ -1607,6 +2455,7 @@ IOReturn AppleDBDMAAudio::clipAppleDBDMAToOutputStream16iSubMixRightChannel(cons
     SInt16 *	outputBuf16;
 
 	iSubSynchronize(firstSampleFrame, numSampleFrames);
+	markOutputStage (kDBDMAIOProcStageOutputiSub);
 
 	PreviousValues* filterState = &(miSubProcessingParams.filterState);
 	PreviousValues* filterState2 = &(miSubProcessingParams.filterState2);
@@ -1627,23 +2476,25 @@ IOReturn AppleDBDMAAudio::clipAppleDBDMAToOutputStream16iSubMixRightChannel(cons
     maxSampleIndex = (firstSampleFrame + numSampleFrames) * streamFormat->fNumChannels;
 
 	setupOutputBuffer (inFloatBufferPtr, firstSampleFrame, numSampleFrames, streamFormat);
+	markOutputStage (kDBDMAIOProcStageOutputCopy);
 
     // Filter audio into low and high buffers using a 24 dB/octave crossover
-	StereoLowPass4thOrder ((float *)mIntermediateOutputSampleBuffer, &low[firstSampleFrame * streamFormat->fNumChannels], numSampleFrames, sampleRate, coefficients, filterState, filterState2);
+	StereoLowPass4thOrder ((float *)mOutputScratchBuffer, &low[firstSampleFrame * streamFormat->fNumChannels], numSampleFrames, sampleRate, coefficients, filterState, filterState2);
+	markOutputStage (kDBDMAIOProcStageOutputiSub);
 
 	outputBuf16 = (SInt16 *)sampleBuf+firstSampleFrame * streamFormat->fNumChannels;
-	mixAndMuteRightChannel( (float *)mIntermediateOutputSampleBuffer, (float *)mIntermediateOutputSampleBuffer, numSamples );
-    
-    startOutputTiming();
-    
-	outputProcessing ((float *)mIntermediateOutputSampleBuffer, numSamples);
-    
-    endOutputTiming();
-    
-	Float32ToNativeInt16( (float *)mIntermediateOutputSampleBuffer, outputBuf16, numSamples );
+	mixAndMuteRightChannel( (float *)mOutputScratchBuffer, (float *)mOutputScratchBuffer, numSamples );
+	markOutputStage (kDBDMAIOProcStageOutputConvert);
+
+	outputProcessing ((float *)mOutputScratchBuffer, numSamples);
+	markOutputStage (kDBDMAIOProcStageOutputDSP);
+
+	Float32ToNativeInt16( (float *)mOutputScratchBuffer, outputBuf16, numSamples );
+	markOutputStage (kDBDMAIOProcStageOutputConvert);
 
  	sampleIndex = (firstSampleFrame * streamFormat->fNumChannels);
 	iSubDownSampleLinearAndConvert( low, srcPhase, srcState, adaptiveSampleRate, outputSampleRate, sampleIndex, maxSampleIndex, iSubBufferMemory, iSubBufferOffset, iSubBufferLen, loopCount );	
+	markOutputStage (kDBDMAIOProcStageOutputiSub);
 		
 	updateiSubPosition(firstSampleFrame, numSampleFrames);
 		
@@ -1659,6 +2510,7 @@ IOReturn AppleDBDMAAudio::clipAppleDBDMAToOutputStream32iSub(const void *inFloat
     SInt32 *	outputBuf32;
 
 	iSubSynchronize(firstSampleFrame, numSampleFrames);
+	markOutputStage (kDBDMAIOProcStageOutputiSub);
 
 	PreviousValues* filterState = &(miSubProcessingParams.filterState);
 	PreviousValues* filterState2 = &(miSubProcessingParams.filterState2);
@@ -1679,21 +2531,22 @@ IOReturn AppleDBDMAAudio::clipAppleDBDMAToOutputStream32iSub(const void *inFloat
     maxSampleIndex = (firstSampleFrame + numSampleFrames) * streamFormat->fNumChannels;
 
 	setupOutputBuffer (inFloatBufferPtr, firstSampleFrame, numSampleFrames, streamFormat);
+	markOutputStage (kDBDMAIOProcStageOutputCopy);
 
-	StereoLowPass4thOrder ((float *)mIntermediateOutputSampleBuffer, &low[firstSampleFrame * streamFormat->fNumChannels], numSampleFrames, sampleRate, coefficients, filterState, filterState2);
+	StereoLowPass4thOrder ((float *)mOutputScratchBuffer, &low[firstSampleFrame * streamFormat->fNumChannels], numSampleFrames, sampleRate, coefficients, filterState, filterState2);
+	markOutputStage (kDBDMAIOProcStageOutputiSub);
 
 	outputBuf32 = (SInt32 *)sampleBuf + firstSampleFrame * streamFormat->fNumChannels;
-    
-    startOutputTiming();
-    
-	outputProcessing ((float *)mIntermediateOutputSampleBuffer, numSamples);
-    
-    endOutputTiming();
-    
-	Float32ToNativeInt32( (float *)mIntermediateOutputSampleBuffer, outputBuf32, numSamples );
+
+	outputProcessing ((float *)mOutputScratchBuffer, numSamples);
+	markOutputStage (kDBDMAIOProcStageOutputDSP);
+
+	Float32ToNativeInt32( (float *)mOutputScratchBuffer, outputBuf32, numSamples );
+	markOutputStage (kDBDMAIOProcStageOutputConvert);
 
   	sampleIndex = (firstSampleFrame * streamFormat->fNumChannels);
 	iSubDownSampleLinearAndConvert( low, srcPhase, srcState, adaptiveSampleRate, outputSampleRate, sampleIndex, maxSampleIndex, iSubBufferMemory, iSubBufferOffset, iSubBufferLen, loopCount );	
+	markOutputStage (kDBDMAIOProcStageOutputiSub);
 		
 	updateiSubPosition(firstSampleFrame, numSampleFrames);
 
@@ -1709,6 +2562,7 @@ IOReturn AppleDBDMAAudio::clipAppleDBDMAToOutputStream32iSubMixRightChannel(cons
     SInt32 *	outputBuf32;
 
 	iSubSynchronize(firstSampleFrame, numSampleFrames);
+	markOutputStage (kDBDMAIOProcStageOutputiSub);
 
 	PreviousValues* filterState = &(miSubProcessingParams.filterState);
 	PreviousValues* filterState2 = &(miSubProcessingParams.filterState2);
@@ -1729,22 +2583,24 @@ IOReturn AppleDBDMAAudio::clipAppleDBDMAToOutputStream32iSubMixRightChannel(cons
     maxSampleIndex = (firstSampleFrame + numSampleFrames) * streamFormat->fNumChannels;
 
 	setupOutputBuffer (inFloatBufferPtr, firstSampleFrame, numSampleFrames, streamFormat);
+	markOutputStage (kDBDMAIOProcStageOutputCopy);
 
-	StereoLowPass4thOrder ((float *) mIntermediateOutputSampleBuffer, &low[firstSampleFrame * streamFormat->fNumChannels], numSampleFrames, sampleRate, coefficients, filterState, filterState2);
+	StereoLowPass4thOrder ((float *)mOutputScratchBuffer, &low[firstSampleFrame * streamFormat->fNumChannels], numSampleFrames, sampleRate, coefficients, filterState, filterState2);
+	markOutputStage (kDBDMAIOProcStageOutputiSub);
 
 	outputBuf32 = (SInt32 *)sampleBuf + firstSampleFrame * streamFormat->fNumChannels;
-	mixAndMuteRightChannel( (float *)mIntermediateOutputSampleBuffer, (float *)mIntermediateOutputSampleBuffer, numSamples );
-    
-    startOutputTiming();
-    
-	outputProcessing ((float *)mIntermediateOutputSampleBuffer, numSamples);
-    
-    endOutputTiming();
-    
-	Float32ToNativeInt32( (float *)mIntermediateOutputSampleBuffer, outputBuf32, numSamples );
+	mixAndMuteRightChannel( (float *)mOutputScratchBuffer, (float *)mOutputScratchBuffer, numSamples );
+	markOutputStage (kDBDMAIOProcStageOutputConvert);
+
+	outputProcessing ((float *)mOutputScratchBuffer, numSamples);
+	markOutputStage (kDBDMAIOProcStageOutputDSP);
+
+	Float32ToNativeInt32( (float *)mOutputScratchBuffer, outputBuf32, numSamples );
+	markOutputStage (kDBDMAIOProcStageOutputConvert);
 
  	sampleIndex = (firstSampleFrame * streamFormat->fNumChannels);
 	iSubDownSampleLinearAndConvert( low, srcPhase, srcState, adaptiveSampleRate, outputSampleRate, sampleIndex, maxSampleIndex, iSubBufferMemory, iSubBufferOffset, iSubBufferLen, loopCount );	
+	markOutputStage (kDBDMAIOProcStageOutputiSub);
 		
 	updateiSubPosition(firstSampleFrame, numSampleFrames);
 		
@@ -1756,6 +2612,10 @@ IOReturn AppleDBDMAAudio::clipAppleDBDMAToOutputStream32iSubMixRightChannel(cons
 #pragma mark ------------------------ 
 
 inline void AppleDBDMAAudio::inputProcessing (float* inFloatBufferPtr, UInt32 inNumSamples) {
+	// [3173869]
+	if (mLiveInputConversion.rightChanDelay) {
+		mInputFixupDelay->process (inFloatBufferPtr, inNumSamples);
+	}
 }
 
 // ------------------------------------------------------------------------
@@ -1774,7 +2634,80 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream16(const void *sampleB
 	inputBuf16 = &(((SInt16 *)sampleBuf)[mLastSampleFrameConverted * streamFormat->fNumChannels]);
 	convertAtPointer = (float *)mIntermediateInputSampleBuffer + mLastSampleFrameConverted * streamFormat->fNumChannels;
 
-	currentSampleFrame = (mPlatformObject->getFrameCount () % numSampleFramesPerBuffer) - (kMinimumLatency >> 1);
+	currentSampleFrame = (SInt32)getCurrentSampleFrame () - (kMinimumLatency >> 1);
+	if (currentSampleFrame < 0) {
+		currentSampleFrame += numSampleFramesPerBuffer;
+	}
+	targetSampleFrame = (UInt32)currentSampleFrame;
+
+	if (targetSampleFrame > mLastSampleFrameConverted) {
+
+		samplesToConvert = (targetSampleFrame - mLastSampleFrameConverted) * streamFormat->fNumChannels;		
+
+		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld", inputBuf16, inputBuf16 - (SInt16 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
+
+		NativeInt16ToFloat32(inputBuf16, convertAtPointer, samplesToConvert, 16);
+		markInputStage (kDBDMAIOProcStageInputConvert);
+
+		inputProcessing (convertAtPointer, samplesToConvert); 
+		markInputStage (kDBDMAIOProcStageInputDSP);
+	} else if (targetSampleFrame < mLastSampleFrameConverted) {
+
+		samplesToConvert = (numSampleFramesPerBuffer - mLastSampleFrameConverted) * streamFormat->fNumChannels;		
+
+		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld\n", inputBuf16, inputBuf16 - (SInt16 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
+
+		NativeInt16ToFloat32(inputBuf16, convertAtPointer, samplesToConvert, 16);
+		markInputStage (kDBDMAIOProcStageInputConvert);
+
+		inputProcessing (convertAtPointer, samplesToConvert);
+		markInputStage (kDBDMAIOProcStageInputDSP);
+
+		samplesToConvert = targetSampleFrame * streamFormat->fNumChannels;
+		inputBuf16 = (SInt16 *)sampleBuf;
+		convertAtPointer = (float *)mIntermediateInputSampleBuffer;
+
+		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld\n", inputBuf16, inputBuf16 - (SInt16 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
+
+		NativeInt16ToFloat32(inputBuf16, convertAtPointer, samplesToConvert, 16);
+		markInputStage (kDBDMAIOProcStageInputConvert);
+
+		inputProcessing (convertAtPointer, samplesToConvert);
+		markInputStage (kDBDMAIOProcStageInputDSP);
+	}
+	
+	debugIOLog (7, "  copy:\t\t%ld\t\t%ld\t\t%ld\n", firstSampleFrame, firstSampleFrame + numSampleFrames - 1, numSampleFrames);
+
+    floatDestBuf = (float *)destBuf;
+	copyFromPointer = &(((float *)mIntermediateInputSampleBuffer)[firstSampleFrame * streamFormat->fNumChannels]);
+
+	memcpy(destBuf, copyFromPointer, numSampleFrames * streamFormat->fNumChannels * sizeof (float));
+	markInputStage (kDBDMAIOProcStageInputCopy);
+
+	mLastSampleFrameConverted = targetSampleFrame;
+
+    return kIOReturnSuccess;
+}
+
+// ------------------------------------------------------------------------
+// Native SInt16 to Float32, copy the rigth sample to the left channel for
+// older machines only.  Note that there is no 32 bit version of this  
+// function because older hardware does not support it.
+// ------------------------------------------------------------------------
+IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream16CopyR2L(const void *sampleBuf, void *destBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat)
+{
+    UInt32		samplesToConvert;
+    float*		floatDestBuf;
+    SInt16*		inputBuf16;
+	SInt32		currentSampleFrame;
+	UInt32		targetSampleFrame;
+	float*		convertAtPointer;
+	float*		copyFromPointer;
+		
+	inputBuf16 = &(((SInt16 *)sampleBuf)[mLastSampleFrameConverted * streamFormat->fNumChannels]);
+	convertAtPointer = (float *)mIntermediateInputSampleBuffer + mLastSampleFrameConverted * streamFormat->fNumChannels;
+
+	currentSampleFrame = (SInt32)getCurrentSampleFrame () - (kMinimumLatency >> 1);
 	if (currentSampleFrame < 0) {
 		currentSampleFrame += numSampleFramesPerBuffer;
 	}
@@ -1786,41 +2719,34 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream16(const void *sampleB
 
 		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld", inputBuf16, inputBuf16 - (SInt16 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
 
-		NativeInt16ToFloat32(inputBuf16, convertAtPointer, samplesToConvert, 16);
-        
-        startInputTiming();
-        
-		inputProcessing (convertAtPointer, samplesToConvert); 
-        
-        endInputTiming();
-        
+		NativeInt16ToFloat32CopyRightToLeft(inputBuf16, convertAtPointer, samplesToConvert, 16);
+		markInputStage (kDBDMAIOProcStageInputConvert);
+
+        inputProcessing (convertAtPointer, samplesToConvert);
+        markInputStage (kDBDMAIOProcStageInputDSP);
 	} else if (targetSampleFrame < mLastSampleFrameConverted) {
 
 		samplesToConvert = (numSampleFramesPerBuffer - mLastSampleFrameConverted) * streamFormat->fNumChannels;		
 
 		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld\n", inputBuf16, inputBuf16 - (SInt16 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
 
-		NativeInt16ToFloat32(inputBuf16, convertAtPointer, samplesToConvert, 16);
-        
-        startInputTiming();
-        
-		inputProcessing (convertAtPointer, samplesToConvert);
-        
-        pauseInputTiming();
-        
+		NativeInt16ToFloat32CopyRightToLeft(inputBuf16, convertAtPointer, samplesToConvert, 16);
+		markInputStage (kDBDMAIOProcStageInputConvert);
+
+		inputProcessing (convertAtPointer, samplesToConvert); 
+		markInputStage (kDBDMAIOProcStageInputDSP);
+
 		samplesToConvert = targetSampleFrame * streamFormat->fNumChannels;
 		inputBuf16 = (SInt16 *)sampleBuf;
 		convertAtPointer = (float *)mIntermediateInputSampleBuffer;
 
 		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld\n", inputBuf16, inputBuf16 - (SInt16 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
 
-		NativeInt16ToFloat32(inputBuf16, convertAtPointer, samplesToConvert, 16);
-        
-        resumeInputTiming();
-        
-		inputProcessing (convertAtPointer, samplesToConvert);
-        
-        endInputTiming();
+		NativeInt16ToFloat32CopyRightToLeft(inputBuf16, convertAtPointer, samplesToConvert, 16);
+		markInputStage (kDBDMAIOProcStageInputConvert);
+
+        inputProcessing (convertAtPointer, samplesToConvert);
+        markInputStage (kDBDMAIOProcStageInputDSP);
 	}
 	
 	debugIOLog (7, "  copy:\t\t%ld\t\t%ld\t\t%ld\n", firstSampleFrame, firstSampleFrame + numSampleFrames - 1, numSampleFrames);
@@ -1829,6 +2755,7 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream16(const void *sampleB
 	copyFromPointer = &(((float *)mIntermediateInputSampleBuffer)[firstSampleFrame * streamFormat->fNumChannels]);
 
 	memcpy(destBuf, copyFromPointer, numSampleFrames * streamFormat->fNumChannels * sizeof (float));
+	markInputStage (kDBDMAIOProcStageInputCopy);
 
 	mLastSampleFrameConverted = targetSampleFrame;
 
@@ -1836,11 +2763,9 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream16(const void *sampleB
 }
 
 // ------------------------------------------------------------------------
-// Native SInt16 to Float32, copy the rigth sample to the left channel for
-// older machines only.  Note that there is no 32 bit version of this  
-// function because older hardware does not support it.
+// Native SInt16 to Float32, with software input gain
 // ------------------------------------------------------------------------
-IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream16CopyR2L(const void *sampleBuf, void *destBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat)
+IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream16WithGain(const void *sampleBuf, void *destBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat)
 {
     UInt32		samplesToConvert;
     float*		floatDestBuf;
@@ -1853,7 +2778,7 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream16CopyR2L(const void *
 	inputBuf16 = &(((SInt16 *)sampleBuf)[mLastSampleFrameConverted * streamFormat->fNumChannels]);
 	convertAtPointer = (float *)mIntermediateInputSampleBuffer + mLastSampleFrameConverted * streamFormat->fNumChannels;
 
-	currentSampleFrame = mPlatformObject->getFrameCount () % numSampleFramesPerBuffer - (kMinimumLatency >> 1);
+	currentSampleFrame = (SInt32)getCurrentSampleFrame () - (kMinimumLatency >> 1);
 	if (currentSampleFrame < 0) {
 		currentSampleFrame += numSampleFramesPerBuffer;
 	}
@@ -1865,41 +2790,34 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream16CopyR2L(const void *
 
 		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld", inputBuf16, inputBuf16 - (SInt16 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
 
-		NativeInt16ToFloat32CopyRightToLeft(inputBuf16, convertAtPointer, samplesToConvert, 16);
-        
-		startInputTiming();
-        
-        inputProcessing (convertAtPointer, samplesToConvert);
-        
-        endInputTiming();
-        
+		NativeInt16ToFloat32Gain(inputBuf16, convertAtPointer, samplesToConvert, 16, mInputGainLPtr, mInputGainRPtr);
+		markInputStage (kDBDMAIOProcStageInputConvert);
+
+        inputProcessing (convertAtPointer, samplesToConvert); 
+        markInputStage (kDBDMAIOProcStageInputDSP);
 	} else if (targetSampleFrame < mLastSampleFrameConverted) {
 
 		samplesToConvert = (numSampleFramesPerBuffer - mLastSampleFrameConverted) * streamFormat->fNumChannels;		
 
 		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld\n", inputBuf16, inputBuf16 - (SInt16 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
 
-		NativeInt16ToFloat32CopyRightToLeft(inputBuf16, convertAtPointer, samplesToConvert, 16);
-        
-        startInputTiming();
-        
-		inputProcessing (convertAtPointer, samplesToConvert); 
-        
-        pauseInputTiming();
-        
+		NativeInt16ToFloat32Gain(inputBuf16, convertAtPointer, samplesToConvert, 16, mInputGainLPtr, mInputGainRPtr);
+		markInputStage (kDBDMAIOProcStageInputConvert);
+
+        inputProcessing (convertAtPointer, samplesToConvert);
+        markInputStage (kDBDMAIOProcStageInputDSP);
+
 		samplesToConvert = targetSampleFrame * streamFormat->fNumChannels;
 		inputBuf16 = (SInt16 *)sampleBuf;
 		convertAtPointer = (float *)mIntermediateInputSampleBuffer;
 
 		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld\n", inputBuf16, inputBuf16 - (SInt16 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
 
-		NativeInt16ToFloat32CopyRightToLeft(inputBuf16, convertAtPointer, samplesToConvert, 16);
-        
-		resumeInputTiming();
-        
-        inputProcessing (convertAtPointer, samplesToConvert);
-        
-        endInputTiming();
+		NativeInt16ToFloat32Gain(inputBuf16, convertAtPointer, samplesToConvert, 16, mInputGainLPtr, mInputGainRPtr);
+		markInputStage (kDBDMAIOProcStageInputConvert);
+
+		inputProcessing (convertAtPointer, samplesToConvert);
+		markInputStage (kDBDMAIOProcStageInputDSP);
 	}
 	
 	debugIOLog (7, "  copy:\t\t%ld\t\t%ld\t\t%ld\n", firstSampleFrame, firstSampleFrame + numSampleFrames - 1, numSampleFrames);
@@ -1908,6 +2826,7 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream16CopyR2L(const void *
 	copyFromPointer = &(((float *)mIntermediateInputSampleBuffer)[firstSampleFrame * streamFormat->fNumChannels]);
 
 	memcpy(destBuf, copyFromPointer, numSampleFrames * streamFormat->fNumChannels * sizeof (float));
+	markInputStage (kDBDMAIOProcStageInputCopy);
 
 	mLastSampleFrameConverted = targetSampleFrame;
 
@@ -1915,9 +2834,10 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream16CopyR2L(const void *
 }
 
 // ------------------------------------------------------------------------
-// Native SInt16 to Float32, with software input gain
+// Native SInt16 to Float32 through the capture chain.  Software input gain
+// and the copy right to left mode are applied in the same pass.
 // ------------------------------------------------------------------------
-IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream16WithGain(const void *sampleBuf, void *destBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat)
+IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream16Capture(const void *sampleBuf, void *destBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat)
 {
     UInt32		samplesToConvert;
     float*		floatDestBuf;
@@ -1926,11 +2846,18 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream16WithGain(const void
 	UInt32		targetSampleFrame;
 	float*		convertAtPointer;
 	float*		copyFromPointer;
+	const float*	gainL;
+	const float*	gainR;
+	bool		copyRightToLeft;
 		
+	gainL = mUseSoftwareInputGain ? mInputGainLPtr : NULL;
+	gainR = mUseSoftwareInputGain ? mInputGainRPtr : NULL;
+	copyRightToLeft = (e_Mode_CopyRightToLeft == mInputDualMonoMode);
+
 	inputBuf16 = &(((SInt16 *)sampleBuf)[mLastSampleFrameConverted * streamFormat->fNumChannels]);
 	convertAtPointer = (float *)mIntermediateInputSampleBuffer + mLastSampleFrameConverted * streamFormat->fNumChannels;
 
-	currentSampleFrame = mPlatformObject->getFrameCount () % numSampleFramesPerBuffer - (kMinimumLatency >> 1);
+	currentSampleFrame = (SInt32)getCurrentSampleFrame () - (kMinimumLatency >> 1);
 	if (currentSampleFrame < 0) {
 		currentSampleFrame += numSampleFramesPerBuffer;
 	}
@@ -1942,41 +2869,34 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream16WithGain(const void
 
 		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld", inputBuf16, inputBuf16 - (SInt16 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
 
-		NativeInt16ToFloat32Gain(inputBuf16, convertAtPointer, samplesToConvert, 16, mInputGainLPtr, mInputGainRPtr);
-
-		startInputTiming();
+		mInputCapture->convertInt16 (inputBuf16, convertAtPointer, mLastSampleFrameConverted, samplesToConvert, gainL, gainR, copyRightToLeft);
+		markInputStage (kDBDMAIOProcStageInputConvert);
         
         inputProcessing (convertAtPointer, samplesToConvert); 
-        
-        endInputTiming();
-        
+        markInputStage (kDBDMAIOProcStageInputDSP);
 	} else if (targetSampleFrame < mLastSampleFrameConverted) {
 
 		samplesToConvert = (numSampleFramesPerBuffer - mLastSampleFrameConverted) * streamFormat->fNumChannels;		
 
 		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld\n", inputBuf16, inputBuf16 - (SInt16 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
 
-		NativeInt16ToFloat32Gain(inputBuf16, convertAtPointer, samplesToConvert, 16, mInputGainLPtr, mInputGainRPtr);
-        
-        startInputTiming();
+		mInputCapture->convertInt16 (inputBuf16, convertAtPointer, mLastSampleFrameConverted, samplesToConvert, gainL, gainR, copyRightToLeft);
+		markInputStage (kDBDMAIOProcStageInputConvert);
 		
         inputProcessing (convertAtPointer, samplesToConvert);
-        
-        pauseInputTiming();
-        
+        markInputStage (kDBDMAIOProcStageInputDSP);
+
 		samplesToConvert = targetSampleFrame * streamFormat->fNumChannels;
 		inputBuf16 = (SInt16 *)sampleBuf;
 		convertAtPointer = (float *)mIntermediateInputSampleBuffer;
 
 		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld\n", inputBuf16, inputBuf16 - (SInt16 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
 
-		NativeInt16ToFloat32Gain(inputBuf16, convertAtPointer, samplesToConvert, 16, mInputGainLPtr, mInputGainRPtr);
-        
-        resumeInputTiming();
+		mInputCapture->convertInt16 (inputBuf16, convertAtPointer, 0, samplesToConvert, gainL, gainR, copyRightToLeft);
+		markInputStage (kDBDMAIOProcStageInputConvert);
         
 		inputProcessing (convertAtPointer, samplesToConvert);
-        
-        endInputTiming();
+		markInputStage (kDBDMAIOProcStageInputDSP);
 	}
 	
 	debugIOLog (7, "  copy:\t\t%ld\t\t%ld\t\t%ld\n", firstSampleFrame, firstSampleFrame + numSampleFrames - 1, numSampleFrames);
@@ -1985,6 +2905,7 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream16WithGain(const void
 	copyFromPointer = &(((float *)mIntermediateInputSampleBuffer)[firstSampleFrame * streamFormat->fNumChannels]);
 
 	memcpy(destBuf, copyFromPointer, numSampleFrames * streamFormat->fNumChannels * sizeof (float));
+	markInputStage (kDBDMAIOProcStageInputCopy);
 
 	mLastSampleFrameConverted = targetSampleFrame;
 
@@ -2007,7 +2928,7 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream32(const void *sampleB
 	inputBuf32 = &(((SInt32 *)sampleBuf)[mLastSampleFrameConverted * streamFormat->fNumChannels]);
 	convertAtPointer = (float *)mIntermediateInputSampleBuffer + mLastSampleFrameConverted * streamFormat->fNumChannels;
 
-	currentSampleFrame = mPlatformObject->getFrameCount () % numSampleFramesPerBuffer - (kMinimumLatency >> 1);
+	currentSampleFrame = (SInt32)getCurrentSampleFrame () - (kMinimumLatency >> 1);
 	if (currentSampleFrame < 0) {
 		currentSampleFrame += numSampleFramesPerBuffer;
 	}
@@ -2020,13 +2941,10 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream32(const void *sampleB
 		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld", inputBuf32, inputBuf32 - (SInt32 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
 
 		NativeInt32ToFloat32(inputBuf32, convertAtPointer, samplesToConvert, 32);
-        
-        startInputTiming();
-        
+		markInputStage (kDBDMAIOProcStageInputConvert);
+
 		inputProcessing (convertAtPointer, samplesToConvert); 
-        
-        endInputTiming();
-        
+		markInputStage (kDBDMAIOProcStageInputDSP);
 	} else if (targetSampleFrame < mLastSampleFrameConverted) {
 
 		samplesToConvert = (numSampleFramesPerBuffer - mLastSampleFrameConverted) * streamFormat->fNumChannels;		
@@ -2034,13 +2952,11 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream32(const void *sampleB
 		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld\n", inputBuf32, inputBuf32 - (SInt32 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
 
 		NativeInt32ToFloat32(inputBuf32, convertAtPointer, samplesToConvert, 32);
-        
-        startInputTiming();
-		
+		markInputStage (kDBDMAIOProcStageInputConvert);
+
         inputProcessing (convertAtPointer, samplesToConvert);
-        
-        pauseInputTiming();
-        
+        markInputStage (kDBDMAIOProcStageInputDSP);
+
 		samplesToConvert = targetSampleFrame * streamFormat->fNumChannels;
 		inputBuf32 = (SInt32 *)sampleBuf;
 		convertAtPointer = (float *)mIntermediateInputSampleBuffer;
@@ -2048,12 +2964,10 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream32(const void *sampleB
 		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld\n", inputBuf32, inputBuf32 - (SInt32 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
 
 		NativeInt32ToFloat32(inputBuf32, convertAtPointer, samplesToConvert, 32);
-        
-        resumeInputTiming();
-        
+		markInputStage (kDBDMAIOProcStageInputConvert);
+
         inputProcessing (convertAtPointer, samplesToConvert);
-        
-        endInputTiming();
+        markInputStage (kDBDMAIOProcStageInputDSP);
 	}
 	
 	debugIOLog (7, "  copy:\t\t%ld\t\t%ld\t\t%ld\n", firstSampleFrame, firstSampleFrame + numSampleFrames - 1, numSampleFrames);
@@ -2062,6 +2976,7 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream32(const void *sampleB
 	copyFromPointer = &(((float *)mIntermediateInputSampleBuffer)[firstSampleFrame * streamFormat->fNumChannels]);
 
 	memcpy(destBuf, copyFromPointer, numSampleFrames * streamFormat->fNumChannels * sizeof (float));
+	markInputStage (kDBDMAIOProcStageInputCopy);
 
 	mLastSampleFrameConverted = targetSampleFrame;
 
@@ -2084,7 +2999,7 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream32WithGain(const void
 	inputBuf32 = &(((SInt32 *)sampleBuf)[mLastSampleFrameConverted * streamFormat->fNumChannels]);
 	convertAtPointer = (float *)mIntermediateInputSampleBuffer + mLastSampleFrameConverted * streamFormat->fNumChannels;
 
-	currentSampleFrame = mPlatformObject->getFrameCount () % numSampleFramesPerBuffer - (kMinimumLatency >> 1);
+	currentSampleFrame = (SInt32)getCurrentSampleFrame () - (kMinimumLatency >> 1);
 	if (currentSampleFrame < 0) {
 		currentSampleFrame += numSampleFramesPerBuffer;
 	}
@@ -2097,13 +3012,10 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream32WithGain(const void
 		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld", inputBuf32, inputBuf32 - (SInt32 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
 
 		NativeInt32ToFloat32Gain(inputBuf32, convertAtPointer, samplesToConvert, 32, mInputGainLPtr, mInputGainRPtr);
-        
-        startInputTiming();
-        
+		markInputStage (kDBDMAIOProcStageInputConvert);
+
 		inputProcessing (convertAtPointer, samplesToConvert); 
-        
-        endInputTiming();
-        
+		markInputStage (kDBDMAIOProcStageInputDSP);
 	} else if (targetSampleFrame < mLastSampleFrameConverted) {
 
 		samplesToConvert = (numSampleFramesPerBuffer - mLastSampleFrameConverted) * streamFormat->fNumChannels;		
@@ -2111,13 +3023,11 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream32WithGain(const void
 		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld\n", inputBuf32, inputBuf32 - (SInt32 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
 
 		NativeInt32ToFloat32Gain(inputBuf32, convertAtPointer, samplesToConvert, 32, mInputGainLPtr, mInputGainRPtr);
-        
-        startInputTiming();
-        
+		markInputStage (kDBDMAIOProcStageInputConvert);
+
 		inputProcessing (convertAtPointer, samplesToConvert);
-        
-        pauseInputTiming();
-        
+		markInputStage (kDBDMAIOProcStageInputDSP);
+
 		samplesToConvert = targetSampleFrame * streamFormat->fNumChannels;
 		inputBuf32 = (SInt32 *)sampleBuf;
 		convertAtPointer = (float *)mIntermediateInputSampleBuffer;
@@ -2125,12 +3035,86 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream32WithGain(const void
 		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld\n", inputBuf32, inputBuf32 - (SInt32 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
 
 		NativeInt32ToFloat32Gain(inputBuf32, convertAtPointer, samplesToConvert, 32, mInputGainLPtr, mInputGainRPtr);
+		markInputStage (kDBDMAIOProcStageInputConvert);
+
+		inputProcessing (convertAtPointer, samplesToConvert);
+		markInputStage (kDBDMAIOProcStageInputDSP);
+	}
+	
+	debugIOLog (7, "  copy:\t\t%ld\t\t%ld\t\t%ld\n", firstSampleFrame, firstSampleFrame + numSampleFrames - 1, numSampleFrames);
+
+    floatDestBuf = (float *)destBuf;
+	copyFromPointer = &(((float *)mIntermediateInputSampleBuffer)[firstSampleFrame * streamFormat->fNumChannels]);
+
+	memcpy(destBuf, copyFromPointer, numSampleFrames * streamFormat->fNumChannels * sizeof (float));
+	markInputStage (kDBDMAIOProcStageInputCopy);
+
+	mLastSampleFrameConverted = targetSampleFrame;
+
+    return kIOReturnSuccess;
+}
+
+// ------------------------------------------------------------------------
+// Native SInt32 to Float32 through the capture chain, with software input gain
+// ------------------------------------------------------------------------
+IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream32Capture(const void *sampleBuf, void *destBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat)
+{
+    UInt32		samplesToConvert;
+    float*		floatDestBuf;
+    SInt32*		inputBuf32;
+	SInt32		currentSampleFrame;
+	UInt32		targetSampleFrame;
+	float*		convertAtPointer;
+	float*		copyFromPointer;
+	const float*	gainL;
+	const float*	gainR;
+		
+	gainL = mUseSoftwareInputGain ? mInputGainLPtr : NULL;
+	gainR = mUseSoftwareInputGain ? mInputGainRPtr : NULL;
+
+	inputBuf32 = &(((SInt32 *)sampleBuf)[mLastSampleFrameConverted * streamFormat->fNumChannels]);
+	convertAtPointer = (float *)mIntermediateInputSampleBuffer + mLastSampleFrameConverted * streamFormat->fNumChannels;
+
+	currentSampleFrame = (SInt32)getCurrentSampleFrame () - (kMinimumLatency >> 1);
+	if (currentSampleFrame < 0) {
+		currentSampleFrame += numSampleFramesPerBuffer;
+	}
+	targetSampleFrame = (UInt32)currentSampleFrame;
+
+	if (targetSampleFrame > mLastSampleFrameConverted) {
+
+		samplesToConvert = (targetSampleFrame - mLastSampleFrameConverted) * streamFormat->fNumChannels;		
+
+		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld", inputBuf32, inputBuf32 - (SInt32 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
+
+		mInputCapture->convertInt32 (inputBuf32, convertAtPointer, mLastSampleFrameConverted, samplesToConvert, gainL, gainR);
+		markInputStage (kDBDMAIOProcStageInputConvert);
         
-        resumeInputTiming();
+		inputProcessing (convertAtPointer, samplesToConvert); 
+		markInputStage (kDBDMAIOProcStageInputDSP);
+	} else if (targetSampleFrame < mLastSampleFrameConverted) {
+
+		samplesToConvert = (numSampleFramesPerBuffer - mLastSampleFrameConverted) * streamFormat->fNumChannels;		
+
+		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld\n", inputBuf32, inputBuf32 - (SInt32 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
+
+		mInputCapture->convertInt32 (inputBuf32, convertAtPointer, mLastSampleFrameConverted, samplesToConvert, gainL, gainR);
+		markInputStage (kDBDMAIOProcStageInputConvert);
         
 		inputProcessing (convertAtPointer, samplesToConvert);
+		markInputStage (kDBDMAIOProcStageInputDSP);
+
+		samplesToConvert = targetSampleFrame * streamFormat->fNumChannels;
+		inputBuf32 = (SInt32 *)sampleBuf;
+		convertAtPointer = (float *)mIntermediateInputSampleBuffer;
+
+		debugIOLog (7, "  convert:\t%p\t%ld\t%p\t%ld\t%ld\n", inputBuf32, inputBuf32 - (SInt32 *)sampleBuf, convertAtPointer, convertAtPointer - (float *)mIntermediateInputSampleBuffer, samplesToConvert);
+
+		mInputCapture->convertInt32 (inputBuf32, convertAtPointer, 0, samplesToConvert, gainL, gainR);
+		markInputStage (kDBDMAIOProcStageInputConvert);
         
-        endInputTiming();
+		inputProcessing (convertAtPointer, samplesToConvert);
+		markInputStage (kDBDMAIOProcStageInputDSP);
 	}
 	
 	debugIOLog (7, "  copy:\t\t%ld\t\t%ld\t\t%ld\n", firstSampleFrame, firstSampleFrame + numSampleFrames - 1, numSampleFrames);
@@ -2139,6 +3123,7 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream32WithGain(const void
 	copyFromPointer = &(((float *)mIntermediateInputSampleBuffer)[firstSampleFrame * streamFormat->fNumChannels]);
 
 	memcpy(destBuf, copyFromPointer, numSampleFrames * streamFormat->fNumChannels * sizeof (float));
+	markInputStage (kDBDMAIOProcStageInputCopy);
 
 	mLastSampleFrameConverted = targetSampleFrame;
 
@@ -2151,33 +3136,112 @@ IOReturn AppleDBDMAAudio::convertAppleDBDMAFromInputStream32WithGain(const void
 
 void AppleDBDMAAudio::resetOutputClipOptions() {
 	fNeedsRightChanMixed = false;
+	setRightChanDelay (false);
+	setLeftChanDelay (false);
 	
 	chooseOutputClippingRoutinePtr ();
 }
 
 void AppleDBDMAAudio::resetInputClipOptions() {
 	mInputDualMonoMode = e_Mode_Disabled;
-	fNeedsRightChanDelayInput = false;
+	setRightChanDelayInput (false);
 
 	chooseInputConversionRoutinePtr ();
 }
 
+//	The chain is rebuilt disabled.  DSP_Manager::setProcessing waits for the output IOProc to leave
+//	the old chain before releasing it, so this is safe while the engine is running.
 void AppleDBDMAAudio::setOutputSignalProcessing (OSDictionary * inDictionary) {
+	bool					result;
+
+	debugIOLog (3, "+ AppleDBDMAAudio::setOutputSignalProcessing (%p)", inDictionary);
+
+	result = mOutputDSP->setProcessing (inDictionary, mDBDMAOutputFormat.fNumChannels, sampleRate.whole);
+	FailIf (FALSE == result, Exit);
+
+	applyOutputVolumeDecibels ();
+	updateSampleLatencies ();
+	enableOutputProcessing ();
+Exit:
+	debugIOLog (3, "- AppleDBDMAAudio::setOutputSignalProcessing (%p), %ld stages, latency %ld", inDictionary, mOutputDSP->getNumStages (), mOutputDSP->getLatency ());
+	return;
+}
+
+//	Moves as many of the ParametricEQ stage's bands onto the codec's biquads as it has room for
+//	and returns them for the codec, or NULL when the codec should be left flat.  Bands that can
+//	raise the level stay in the chain if a soft clip or limiter stage would otherwise end up
+//	ahead of them.
+OSArray * AppleDBDMAAudio::planOutputEQ (UInt32 inNumCodecSections)
+{
+	DSP_ParametricEQ *		theEQ;
+	OSArray *				result = NULL;
+	bool					allowBoost;
+	bool					wasActive;
+
+	theEQ = OSDynamicCast (DSP_ParametricEQ, mOutputDSP->getStage (kParametricEQEntry));
+	if (NULL != theEQ) {
+		allowBoost = (NULL == mOutputDSP->getStage (kSoftClipEntry)) && (NULL == mOutputDSP->getStage (kTruePeakEntry));
+		wasActive = theEQ->isActive ();
+		if (0 != theEQ->planOffload (inNumCodecSections, allowBoost)) {
+			result = theEQ->getCodecBands ();
+		}
+		if (theEQ->isActive () != wasActive) {
+			mOutputDSP->updateRunList ();
+		}
+	}
+	debugIOLog (3, " AppleDBDMAAudio::planOutputEQ (%ld) returns %p", inNumCodecSections, result);
+	return result;
 }
 
+//	Like the output fixup delay, the capture chain is created the first time it is needed and then
+//	left in place, so the input IOProc never sees it go away.  It is switched in and out by changing
+//	the input conversion routine.
 void AppleDBDMAAudio::setInputSignalProcessing (OSDictionary * inDictionary) {
+	debugIOLog (3, "+ AppleDBDMAAudio::setInputSignalProcessing (%p)", inDictionary);
+
+	disableInputProcessing ();
+	FailIf (NULL == inDictionary, Exit);
+
+	if (NULL == mInputCapture) {
+		mInputCapture = DSP_Capture::create (mDBDMAInputFormat.fNumChannels);
+		FailIf (NULL == mInputCapture, Exit);
+	}
+	// the echo reference is kept per frame of the DMA buffer
+	mInputCapture->setReferenceFrames (numSampleFramesPerBuffer);
+	mInputCapture->setSampleRate (sampleRate.whole);
+	mInputCapture->setParameters (inDictionary);
+
+	enableInputProcessing ();
+Exit:
+	debugIOLog (3, "- AppleDBDMAAudio::setInputSignalProcessing (%p), capture %s", inDictionary, mInputCaptureEnabled ? "enabled" : "disabled");
+	return;
 }
 
 void AppleDBDMAAudio::enableOutputProcessing (void) {
+	mOutputDSP->enable ();
 }
 
 void AppleDBDMAAudio::disableOutputProcessing (void) {
+	mOutputDSP->disable ();
 }
 
+//	The chain's filters and detectors are cleared on the way in so stale state from the last
+//	time it ran does not leak into the new capture.
 void AppleDBDMAAudio::enableInputProcessing (void) {
+	if (NULL != mInputCapture && !mInputCaptureEnabled) {
+		mInputCapture->reset ();
+		mInputCaptureEnabled = TRUE;
+		chooseInputConversionRoutinePtr ();
+		updateSampleLatencies ();
+	}
 }
 
 void AppleDBDMAAudio::disableInputProcessing (void) {
+	if (mInputCaptureEnabled) {
+		mInputCaptureEnabled = FALSE;
+		chooseInputConversionRoutinePtr ();
+		updateSampleLatencies ();
+	}
 }
 
 void AppleDBDMAAudio::setDualMonoMode(const DualMonoModeType inDualMonoMode) 
@@ -2216,6 +3280,55 @@ void AppleDBDMAAudio::setRightChanMixed(const bool needsRightChanMixed)
 	return;   
 }
 
+//	The one frame DelayLeft / DelayRight clip options share a two frame DSP_Delay.  It is only
+//	allocated the first time a delay is requested and is left in place (idle) once cleared so
+//	the output IOProc never sees it go away.
+void AppleDBDMAAudio::setRightChanDelay(const bool needsRightChanDelay)  
+{
+	fNeedsRightChanDelay = needsRightChanDelay;
+	if (NULL == mOutputFixupDelay && needsRightChanDelay) {
+		mOutputFixupDelay = DSP_Delay::create (mDBDMAOutputFormat.fNumChannels, 1);
+		FailIf (NULL == mOutputFixupDelay, Exit);
+	}
+	if (NULL != mOutputFixupDelay) {
+		mOutputFixupDelay->setDelayFrames (1, needsRightChanDelay ? 1.0f : 0.0f);
+	}
+Exit:
+	return;   
+}
+
+void AppleDBDMAAudio::setLeftChanDelay(const bool needsLeftChanDelay)  
+{
+	fNeedsLeftChanDelay = needsLeftChanDelay;
+	if (NULL == mOutputFixupDelay && needsLeftChanDelay) {
+		mOutputFixupDelay = DSP_Delay::create (mDBDMAOutputFormat.fNumChannels, 1);
+		FailIf (NULL == mOutputFixupDelay, Exit);
+	}
+	if (NULL != mOutputFixupDelay) {
+		mOutputFixupDelay->setDelayFrames (0, needsLeftChanDelay ? 1.0f : 0.0f);
+	}
+Exit:
+	return;   
+}
+
+// [3173869]
+void AppleDBDMAAudio::setRightChanDelayInput(const bool needsRightChanDelayInput)  
+{
+	if (NULL == mInputFixupDelay && needsRightChanDelayInput) {
+		mInputFixupDelay = DSP_Delay::create (mDBDMAInputFormat.fNumChannels, 1);
+		FailIf (NULL == mInputFixupDelay, Exit);
+	}
+	if (NULL != mInputFixupDelay) {
+		mInputFixupDelay->setDelayFrames (1, needsRightChanDelayInput ? 1.0f : 0.0f);
+		mInputFixupDelay->reset ();
+	}
+	//	the delay is configured before the flag reaches the input IOProc
+	fNeedsRightChanDelayInput = needsRightChanDelayInput;
+	chooseInputConversionRoutinePtr ();
+Exit:
+	return;   
+}
+
 void AppleDBDMAAudio::setUseSoftwareInputGain(const bool inUseSoftwareInputGain) 
 {     
 	debugIOLog (3, " AppleDBDMAAudio::setUseSoftwareInputGain (%s)", inUseSoftwareInputGain ? "true" : "false");
@@ -2236,21 +3349,36 @@ void AppleDBDMAAudio::setUseSoftwareOutputVolume(const bool inUseSoftwareOutputV
 	mMaxVolumedB = inMaxdB;
 	
 	mUseSoftwareOutputVolume = inUseSoftwareOutputVolume;     	
+	publishSoftwareOutputVolume ();
+	applyOutputVolumeDecibels ();
 	
 	return;   
 }
 
+// Called on the command gate after any change to the software volume state.
+void AppleDBDMAAudio::publishSoftwareOutputVolume (void) {
+	SoftwareOutputVolume *		nextVolume;
+
+	nextVolume = &mVolumeSlots[mVolumeExchange.writeSlot];
+	nextVolume->useSoftwareVolume = mUseSoftwareOutputVolume;
+	nextVolume->leftVolume = mLeftVolume[0];
+	nextVolume->rightVolume = mRightVolume[0];
+	DSPExchangePublish (&mVolumeExchange);
+}
+
 void AppleDBDMAAudio::setOutputVolumeLeft(UInt32 inVolume) 
 { 
 	debugIOLog (3, " AppleDBDMAAudio::setOutputVolumeLeft (%ld)", inVolume);
 
 #ifndef TESTING_VOLUME_SCALING
     volumeConverter(inVolume, mMinVolumeLinear, mMaxVolumeLinear, mMinVolumedB, mMaxVolumedB, mLeftVolume);
+	publishSoftwareOutputVolume ();
 #else
 	float t1, t2, t3, t4, t5;
 	char floatstr[128];
 
     volumeConverter(inVolume, mMinVolumeLinear, mMaxVolumeLinear, mMinVolumedB, mMaxVolumedB, mLeftVolume, &t1, &t2, &t3, &t4, &t5);
+	publishSoftwareOutputVolume ();
 
 	float2string(mLeftVolume, floatstr);
 	debugIOLog (1, "  mLeftVolume after conversion: %s", floatstr);
@@ -2276,11 +3404,13 @@ void AppleDBDMAAudio::setOutputVolumeRight(UInt32 inVolume)
 
 #ifndef TESTING_VOLUME_SCALING
     volumeConverter(inVolume, mMinVolumeLinear, mMaxVolumeLinear, mMinVolumedB, mMaxVolumedB, mRightVolume);
+	publishSoftwareOutputVolume ();
 #else
 	float t1, t2, t3, t4, t5;
 	char fstr[128];
 
     volumeConverter(inVolume, mMinVolumeLinear, mMaxVolumeLinear, mMinVolumedB, mMaxVolumedB, mRightVolume, &t1, &t2, &t3, &t4, &t5);
+	publishSoftwareOutputVolume ();
 
 	float2string(mRightVolume, fstr);
 	debugIOLog (1, "  mRightVolume after conversion: %s", fstr);
@@ -2289,6 +3419,38 @@ void AppleDBDMAAudio::setOutputVolumeRight(UInt32 inVolume)
     return;   
 }
 
+//	The loudness stage follows the listening level whichever side does the attenuating, so the
+//	volume reaches it here in dB rather than through the software volume path.
+void AppleDBDMAAudio::setOutputVolumeDecibels (IOFixed inVolumedB)
+{
+	debugIOLog (3, " AppleDBDMAAudio::setOutputVolumeDecibels (%lX)", inVolumedB);
+
+	mOutputVolumedB = inVolumedB;
+	applyOutputVolumeDecibels ();
+}
+
+//	Also run after the chain is rebuilt, so a new stage starts at the current volume.  With the
+//	codec attenuating, the samples reach the loudness stage at full scale and it has to make
+//	its own headroom.
+void AppleDBDMAAudio::applyOutputVolumeDecibels (void)
+{
+	DSP_Loudness *			theLoudness;
+	bool					wasActive;
+
+	FailIf (NULL == mOutputDSP, Exit);
+	theLoudness = OSDynamicCast (DSP_Loudness, mOutputDSP->getStage (kLoudnessEntry));
+	if (NULL != theLoudness) {
+		wasActive = theLoudness->isActive ();
+		theLoudness->setCodecVolume (!mUseSoftwareOutputVolume);
+		theLoudness->setVolume ((float)mOutputVolumedB / 65536.0f);
+		if (theLoudness->isActive () != wasActive) {
+			mOutputDSP->updateRunList ();
+		}
+	}
+Exit:
+	return;
+}
+
 #pragma mark ------------------------ 
 #pragma mark  USER CLIENT SUPPORT
 #pragma mark ------------------------ 
@@ -2308,7 +3470,7 @@ IOReturn AppleDBDMAAudio::copyDMAStateAndFormat (DBDMAUserClientStructPtr outSta
 	outState->driverTag = mDBDMAOutputFormat.fDriverTag;
 	outState->needsPhaseInversion = false;
 	outState->needsRightChanMixed = fNeedsRightChanMixed;
-	outState->needsRightChanDelay = false;
+	outState->needsRightChanDelay = fNeedsRightChanDelay;
 	outState->needsBalanceAdjust = false;
 	outState->inputDualMonoMode = mInputDualMonoMode;
 	outState->useSoftwareInputGain = mUseSoftwareInputGain;
@@ -2352,6 +3514,7 @@ IOReturn AppleDBDMAAudio::setDMAStateAndFormat ( DBDMAUserClientStructPtr inStat
 		mRightVolume[0] = inState->softwareOutputRightVolume;
 		result = kIOReturnSuccess;
 	}
+	publishSoftwareOutputVolume ();
 	
 	return result;
 }
@@ -2716,7 +3879,7 @@ IOReturn AppleDBDMAAudio::performFormatChange(IOAudioStream *audioStream, const
 			if (mDBDMAOutputFormat.fBitWidth != newFormat->fBitWidth) {
 				debugIOLog (3, "  changing bit width");
 
-				blockSize = ( DBDMAAUDIODMAENGINE_ROOT_BLOCK_SIZE * ( newFormat->fBitWidth / 8 ) );
+				blockSize = ( mBlockSamples * ( newFormat->fBitWidth / 8 ) );
 
 				mDBDMAOutputFormat.fBitWidth = newFormat->fBitWidth;
 				mDBDMAInputFormat.fBitWidth = newFormat->fBitWidth;
@@ -2766,7 +3929,7 @@ IOReturn AppleDBDMAAudio::performFormatChange(IOAudioStream *audioStream, const
 
 					newSampleOffset = (kMinimumLatencyiSub * ((newSampleRate->whole * 1000) / 44100)) / 1000;
 				} else {
-					newSampleOffset = (kMinimumLatency * ((newSampleRate->whole * 1000) / 44100)) / 1000;
+					newSampleOffset = (getMinimumSampleOffset () * ((newSampleRate->whole * 1000) / 44100)) / 1000;
 				}
 				setSampleOffset (newSampleOffset);
 			}
@@ -2793,6 +3956,13 @@ Exit:
 }
 
 void AppleDBDMAAudio::updateDSPForSampleRate (UInt32 inSampleRate) {	
+	mOutputDSP->setSampleRate (inSampleRate);
+	mOutputDSP->reset ();
+	if (NULL != mInputCapture) {
+		mInputCapture->setSampleRate (inSampleRate);
+		mInputCapture->reset ();
+	}
+	updateSampleLatencies ();
 }
 
 #pragma mark ------------------------ 
@@ -2898,7 +4068,7 @@ Exit:
 		dbdmaEngineObject->iSubBufferMemory = NULL;
 		dbdmaEngineObject->iSubEngine = NULL;
 		dbdmaEngineObject->iSubOpen = FALSE;
-		dbdmaEngineObject->setSampleOffset(kMinimumLatency);
+		dbdmaEngineObject->setSampleOffset(dbdmaEngineObject->getMinimumSampleOffset ());
 
 		if (NULL != dbdmaEngineObject->miSubProcessingParams.lowFreqSamples) {
 			IOFree (dbdmaEngineObject->miSubProcessingParams.lowFreqSamples, (dbdmaEngineObject->numBlocks * dbdmaEngineObject->blockSize) * sizeof (float));
@@ -3067,6 +4237,9 @@ void AppleDBDMAAudio::iSubSynchronize(UInt32 firstSampleFrame, UInt32 numSampleF
 				debugIOLog (3, "  just right %ld, %ld, %ld", initialiSubLead, distance, iSubEngine->GetCurrentByteCount () / 2);
 			}
 		}
+		if (adaptiveSampleRate != sampleRate) {
+			trace (kDBDMATraceiSubRate, adaptiveSampleRate, distance, initialiSubLead);
+		}
 	}
 	
 	// Detect being out of sync with the iSub
@@ -3197,6 +4370,7 @@ void AppleDBDMAAudio::iSubSynchronize(UInt32 firstSampleFrame, UInt32 numSampleF
 			}
 			initialiSubLead = miSubProcessingParams.iSubBufferOffset;
 		}
+		trace (kDBDMATraceiSubSync, firstSampleFrame, curSampleFrame, miSubProcessingParams.iSubBufferOffset);
 	}
 
 	// [3094574] aml - updated iSub state, some of this could probably be done once off line, but it isn't any worse than before
@@ -3321,130 +4495,91 @@ void AppleDBDMAAudio::updateiSubPosition(UInt32 firstSampleFrame, UInt32 numSamp
 #pragma mark  Utilities
 #pragma mark ------------------------ 
 
-inline void AppleDBDMAAudio::startOutputTiming() {
-    if ( mEnableCPUProfiling )
-    {
-        mOutputIOProcCallCount++;
-        if ((mOutputIOProcCallCount % kIOProcTimingCountCurrent) == 0) {
-            AbsoluteTime				uptime;
-            UInt64						nanos;
-            // get time for end of last cycle
-            clock_get_uptime (&uptime);
-            // calculate total time between start of last cycle and end of last cycle
-            SUB_ABSOLUTETIME (&uptime, &mStartOutputIOProcUptime);
-            // convert total time to nanos
-            absolutetime_to_nanoseconds (uptime, &mCurrentTotalOutputNanos);
-            mTotalOutputIOProcNanos += mCurrentTotalOutputNanos >> 10;
-            // calculate time between start of last cycle and end of output processing time
-            SUB_ABSOLUTETIME (&mEndOutputProcessingUptime, &mStartOutputIOProcUptime);
-            // convert output processing time to nanos
-            absolutetime_to_nanoseconds (mEndOutputProcessingUptime, &nanos);
-            // subtract any time spent not actually output processing
-            nanos -= mCurrentTotalPausedOutputNanos;
-            mTotalOutputProcessingNanos += nanos >> 10;
-            // calculate the percentage of nonos out of the cycle spent in output processing
-            convertNanosToPercent(nanos, mCurrentTotalOutputNanos, &mCurrentOutputCPUUsagePercent);
-        }
-        
-        if ((mOutputIOProcCallCount % kIOProcTimingCountAverage) == 0) {
-            convertNanosToPercent(mTotalOutputProcessingNanos, mTotalOutputIOProcNanos, &mAverageOutputCPUUsagePercent);
-        }
-        
-        // reset count of paused output processing time
-        mCurrentTotalPausedOutputNanos = 0;
-        // store start time for new cycle
-        clock_get_uptime (&mStartOutputIOProcUptime);
-    }
+static inline UInt64 IOProcUptimeNanos (void) {
+	AbsoluteTime				uptime;
+	UInt64						nanos;
+
+	clock_get_uptime (&uptime);
+	absolutetime_to_nanoseconds (uptime, &nanos);
+	return nanos;
 }
 
-inline void AppleDBDMAAudio::endOutputTiming() {
-    if ( mEnableCPUProfiling )
-    {
-        clock_get_uptime (&mEndOutputProcessingUptime);		
-    }
+// Each direction's IOProc is its own writer: it marks the end of each stage as it goes, adding
+// up a stage that runs more than once, and files the stages and the total when it is done.
+inline void AppleDBDMAAudio::startOutputTiming () {
+	mOutputStartNanos = IOProcUptimeNanos ();
+	mOutputMarkNanos = mOutputStartNanos;
+	mOutputStagesMarked = 0;
 }
 
-inline void AppleDBDMAAudio::pauseOutputTiming() {
-    if ( mEnableCPUProfiling )
-    {
-        clock_get_uptime (&mPauseOutputProcessingUptime);
-    }
+inline void AppleDBDMAAudio::markOutputStage (UInt32 inStage) {
+	UInt64						nanos;
+
+	nanos = IOProcUptimeNanos ();
+	if (0 == (mOutputStagesMarked & (1 << inStage))) {
+		mOutputStagesMarked |= (1 << inStage);
+		mIOProcStageNanos[inStage] = 0;
+	}
+	mIOProcStageNanos[inStage] += nanos - mOutputMarkNanos;
+	mOutputMarkNanos = nanos;
 }
 
-inline void AppleDBDMAAudio::resumeOutputTiming() {
-    if ( mEnableCPUProfiling )
-    {
-        AbsoluteTime    uptime;
-        UInt64          nanos;
-        
-        clock_get_uptime (&uptime);
-        SUB_ABSOLUTETIME (&uptime, &mPauseOutputProcessingUptime);
-        absolutetime_to_nanoseconds (uptime, &nanos);
-        mCurrentTotalPausedOutputNanos += nanos;
-    }
+inline UInt64 AppleDBDMAAudio::endOutputTiming () {
+	return recordIOProcTiming (kDBDMAIOProcStageOutputCopy, kDBDMAIOProcStageOutputTotal, mOutputStartNanos, mOutputStagesMarked, &mOutputClearsSeen);
 }
 
-inline void AppleDBDMAAudio::startInputTiming() {
-    if ( mEnableCPUProfiling )
-    {
-        mInputIOProcCallCount++;
-        if ((mInputIOProcCallCount % kIOProcTimingCountCurrent) == 0) {
-            AbsoluteTime				uptime;
-            UInt64						nanos;
-            // get time for end of last cycle
-            clock_get_uptime (&uptime);
-            // calculate total time between start of last cycle and end of last cycle
-            SUB_ABSOLUTETIME (&uptime, &mStartInputIOProcUptime);
-            // convert total time to nanos
-            absolutetime_to_nanoseconds (uptime, &mCurrentTotalInputNanos);
-            mTotalInputIOProcNanos += mCurrentTotalInputNanos >> 10;
-            // calculate time between start of last cycle and end of input processing time
-            SUB_ABSOLUTETIME (&mEndInputProcessingUptime, &mStartInputIOProcUptime);
-            // convert input processing time to nanos
-            absolutetime_to_nanoseconds (mEndInputProcessingUptime, &nanos);
-            // subtract any time spent not actually input processing
-            nanos -= mCurrentTotalPausedInputNanos;
-            mTotalInputProcessingNanos += nanos >> 10;
-            // calculate the percentage of nanos out of the cycle spent in input processing
-            convertNanosToPercent(nanos, mCurrentTotalInputNanos, &mCurrentInputCPUUsagePercent);
-        }
-        
-        if ((mInputIOProcCallCount % kIOProcTimingCountAverage) == 0) {
-            convertNanosToPercent(mTotalInputProcessingNanos, mTotalInputIOProcNanos, &mAverageInputCPUUsagePercent);
-        }
-        
-        // reset count of paused input processing time
-        mCurrentTotalPausedInputNanos = 0;
-        // store start time for new cycle
-        clock_get_uptime (&mStartInputIOProcUptime);
-    }
+inline void AppleDBDMAAudio::startInputTiming () {
+	mInputStartNanos = IOProcUptimeNanos ();
+	mInputMarkNanos = mInputStartNanos;
+	mInputStagesMarked = 0;
 }
 
-inline void AppleDBDMAAudio::endInputTiming() {
-    if ( mEnableCPUProfiling )
-    {
-        clock_get_uptime (&mEndInputProcessingUptime);		
-    }
+inline void AppleDBDMAAudio::markInputStage (UInt32 inStage) {
+	UInt64						nanos;
+
+	nanos = IOProcUptimeNanos ();
+	if (0 == (mInputStagesMarked & (1 << inStage))) {
+		mInputStagesMarked |= (1 << inStage);
+		mIOProcStageNanos[inStage] = 0;
+	}
+	mIOProcStageNanos[inStage] += nanos - mInputMarkNanos;
+	mInputMarkNanos = nanos;
 }
 
-inline void AppleDBDMAAudio::pauseInputTiming() {
-    if ( mEnableCPUProfiling )
-    {
-        clock_get_uptime (&mPauseInputProcessingUptime);
-    }
+inline UInt64 AppleDBDMAAudio::endInputTiming () {
+	return recordIOProcTiming (kDBDMAIOProcStageInputConvert, kDBDMAIOProcStageInputTotal, mInputStartNanos, mInputStagesMarked, &mInputClearsSeen);
 }
 
-inline void AppleDBDMAAudio::resumeInputTiming() {
-    if ( mEnableCPUProfiling )
-    {
-        AbsoluteTime    uptime;
-        UInt64          nanos;
-        
-        clock_get_uptime (&uptime);
-        SUB_ABSOLUTETIME (&uptime, &mPauseInputProcessingUptime);
-        absolutetime_to_nanoseconds (uptime, &nanos);
-        mCurrentTotalPausedInputNanos += nanos;
-    }
+// Returns the whole IOProc's time.
+UInt64 AppleDBDMAAudio::recordIOProcTiming (UInt32 inFirstStage, UInt32 inTotalStage, UInt64 inStartNanos, UInt32 inStagesMarked, UInt32 * ioClearsSeen) {
+	UInt64						nanos;
+	UInt32						stage;
+
+	nanos = IOProcUptimeNanos ();
+	if (*ioClearsSeen != mIOProcTimingClears) {
+		*ioClearsSeen = mIOProcTimingClears;
+		for (stage = inFirstStage; stage <= inTotalStage; stage++) {
+			DBDMAIOProcHistogramClear (&mIOProcHistograms[stage]);
+		}
+	}
+	for (stage = inFirstStage; stage < inTotalStage; stage++) {
+		if (inStagesMarked & (1 << stage)) {
+			DBDMAIOProcHistogramRecord (&mIOProcHistograms[stage], mIOProcStageNanos[stage], nanos);
+		}
+	}
+	DBDMAIOProcHistogramRecord (&mIOProcHistograms[inTotalStage], nanos - inStartNanos, nanos);
+	return nanos - inStartNanos;
+}
+
+// Cheap enough for the interrupt filter and the IOProcs; see AppleDBDMATrace.h.
+void AppleDBDMAAudio::trace (UInt32 inEvent, UInt32 inArg0, UInt32 inArg1, UInt32 inArg2) {
+	DBDMATraceRecord (&mTrace, inEvent, IOProcUptimeNanos (), inArg0, inArg1, inArg2);
+}
+
+// Each restart, in place or a full stop and start by whichever path runs it; a full one
+// carries what refused the restart in place.
+void AppleDBDMAAudio::traceRestart (bool inInPlace, IOReturn inResult) {
+	trace (kDBDMATraceRestart, inInPlace, inResult, mDmaInterruptCount);
 }
 
 // --------------------------------------------------------------------------
@@ -3489,10 +4624,9 @@ inline void AppleDBDMAAudio::resumeInputTiming() {
 //	[3305011]	begin {
 bool AppleDBDMAAudio::engineDied ( void ) {
 	bool			result = FALSE;
-	UInt32			tempInterruptCount;
 	UInt32			dmaHwStatus;
 	
-	if ( mHasInput ) {
+	if ( mHasInput && !mWatchdogStallPending ) {
 		dmaHwStatus =  OSReadLittleInt32( &ioBaseDMAInput->channelStatus, 0 );		//	[3514709]
 		if ( 0 != ( dmaHwStatus & kdbdmaDead ) ) {
 			mDmaRecoveryInProcess = TRUE;
@@ -3501,27 +4635,22 @@ bool AppleDBDMAAudio::engineDied ( void ) {
 		}
 	}
 	if ( !mDmaRecoveryInProcess ) {
-		tempInterruptCount = 0;
-		if ( dmaRunState ) {
-			tempInterruptCount = mDmaInterruptCount;
-			if ( tempInterruptCount == mLastDmaInterruptCount ) {
-				mNumberOfFrozenDmaInterruptCounts++;
-				if ( kMAXIMUM_NUMBER_OF_FROZEN_DMA_IRQ_COUNTS <= mNumberOfFrozenDmaInterruptCounts ) {
-					result = TRUE;
-					mDmaRecoveryInProcess = TRUE;
-					mDmaStalledCount++;
-					mNumberOfFrozenDmaInterruptCounts = 0;
-				}
-			} else {
-				mLastDmaInterruptCount = tempInterruptCount;
-				mNumberOfFrozenDmaInterruptCounts = 0;
+		switch ( DBDMAPollInterruptCount ( mDmaInterruptCount, dmaRunState, &mLastDmaInterruptCount, &mNumberOfFrozenDmaInterruptCounts ) ) {
+			case kDBDMAInterruptsFrozen:
+				result = TRUE;
+				mDmaRecoveryInProcess = TRUE;
+				mDmaStalledCount++;
+				break;
+			case kDBDMAInterruptsMoving:
 				mDmaRecoveryInProcess = FALSE;								//	[3514709]
-			}
-		} else {
-			mLastDmaInterruptCount = tempInterruptCount;
-			mNumberOfFrozenDmaInterruptCounts = 0;
+				break;
 		}
 	}
+	//	the stall watchdog has already counted this one and set mDmaRecoveryInProcess
+	if ( mWatchdogStallPending ) {
+		mWatchdogStallPending = FALSE;
+		result = TRUE;
+	}
 	return result;
 }
 //	} end	[3305011]
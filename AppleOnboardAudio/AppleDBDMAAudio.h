@@ -10,8 +10,18 @@
 #include "AudioHardwareCommon.h"
 #include "PlatformInterface.h"
 #include "AppleDBDMAFloatLib.h"
+#include "AppleDBDMATimeStamp.h"
+#include "AppleDBDMARecovery.h"
+#include "AppleDBDMAIOProcTiming.h"
+#include "AppleDBDMATrace.h"
 
 #include "DSP_Manager.h"
+#include "DSP_Delay.h"
+#include "DSP_Capture.h"
+#include "DSP_Loudness.h"
+#include "DSP_ParametricEQ.h"
+#include "DSP_SoftClip.h"
+#include "DSP_TruePeakLimiter.h"
 
 // aml 2.28.02 adding header to get constants
 #include "AppleiSubEngine.h"
@@ -19,10 +29,14 @@
 class AppleOnboardAudio;
 class IOInterruptEventSource;
 class IOFilterInterruptEventSource;
+class IOTimerEventSource;
 
 // reducing the block size makes the problem happen less often
 #define DBDMAAUDIODMAENGINE_DEFAULT_NUM_BLOCKS		512
-#define DBDMAAUDIODMAENGINE_ROOT_BLOCK_SIZE			64
+#define DBDMAAUDIODMAENGINE_ROOT_BLOCK_SIZE			64		// in samples, so 32 frames of stereo
+#define DBDMAAUDIODMAENGINE_MIN_BLOCK_SIZE			16		// low latency mode, in samples like the root block size: 8 frames of stereo
+#define DBDMAAUDIODMAENGINE_SCRATCH_SAMPLES			1024	// float output processing is done this many samples at a time
+#define DBDMAAUDIODMAENGINE_MAX_COMMAND_SEGMENTS	16		// physical runs the descriptors may be split across
 #define DBDMAAUDIODMAENGINE_DEFAULT_SAMPLE_RATE		44100
 #define DBDMAAUDIODMAENGINE_DEFAULT_BIT_DEPTH		16
 #define DBDMAAUDIODMAENGINE_DEFAULT_NUM_CHANNELS	2
@@ -38,10 +52,35 @@ class IOFilterInterruptEventSource;
 #define kBitDepth				"BitDepth"
 #define kBitWidth				"BitWidth"
 #define kSampleRates			"SampleRates"
-
-//	[3305011]	begin {
-#define	kMAXIMUM_NUMBER_OF_FROZEN_DMA_IRQ_COUNTS		3
-//	} end	[3305011]
+#define kClipUnderrunCount		"ClipUnderrunCount"
+
+#define kDBDMARecoveryHistogramBuckets				8		// recovery time in ms: < 4, < 8 ... < 256, and longer
+#define kDBDMARecoveryHistogramFirstShift			2
+
+// late clips in one poll period before a low latency block size is doubled
+#define kDBDMAClipOverrunsToBackOff					2
+#define kDBDMADeadlineHistogramBuckets				12		// clip margin in frames: late, < 8, < 16 ... < 4096, and more
+#define kDBDMADeadlineHistogramFirstShift			3
+
+//	Software output volume as seen by the IOProc.  The command gate publishes
+//	a complete set through a DSPExchange so the enable flag and both gains
+//	always change together, at a block boundary.
+typedef struct {
+	bool				useSoftwareVolume;
+	float				leftVolume;
+	float				rightVolume;
+} SoftwareOutputVolume;
+
+//	Input conversion as seen by the input IOProc.  The command gate publishes the
+//	routine together with the right channel delay it runs with, so a format, gain
+//	or capture change reaches the IOProc whole, at a block boundary.
+class AppleDBDMAAudio;
+typedef IOReturn (AppleDBDMAAudio::*DBDMAConvertInputRoutine)(const void *sampleBuf, void *destBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat);
+
+typedef struct {
+	DBDMAConvertInputRoutine	convertRoutine;
+	bool				rightChanDelay;
+} InputConversion;
 
 //
 // DBDMA get state
@@ -61,7 +100,16 @@ typedef enum {
 	kGetDMAOutputCommands_1,
 	kSetDMAStateAndFormat,
 	kGetDMAInputChannelCommands1,
-	kGetDMAOutputChannelCommands1
+	kGetDMAOutputChannelCommands1,
+	kGetDMABlockState,
+	kSetDMABlockState,
+	kGetDMATimeStampState,
+	kGetDMAEraseState,
+	kSetDMAEraseState,
+	kGetDMAWatchdogState,
+	kGetDMATraceState,
+	kGetDMADeadlineState,
+	kSetDMADeadlineState
 } DMA_STATE_SELECTOR;
 
 
@@ -104,6 +152,125 @@ typedef struct DBDMAUserClientState_t {
 	UInt32		reserved_31;
 } DBDMAUserClientStruct, *DBDMAUserClientStructPtr;
 
+// DMA block size for the user client.  Only requestedBlockFrames is written;
+// 0 asks for the default blocks.  The block is a power of two from
+// DBDMAAUDIODMAENGINE_MIN_BLOCK_SIZE to DBDMAAUDIODMAENGINE_ROOT_BLOCK_SIZE
+// samples, which is 8 to 32 frames on a stereo engine.
+typedef struct DBDMABlockUserClientState_t {
+	UInt32		requestedBlockFrames;
+	UInt32		blockFrames;									// in the running program
+	UInt32		numBlocks;
+	UInt32		sampleOffset;
+	UInt32		clipOverrunCount;								// clips that finished inside the block the channel was reading
+	UInt32		backOffCount;									// times the block size was doubled for overruns
+	UInt32		blocksPerInterrupt;								// the interrupt stride, one per pass around the ring
+	UInt32		interruptCount;
+} DBDMABlockUserClientStruct, *DBDMABlockUserClientStructPtr;
+
+// Ring wrap time stamp loop for the user client.  A residual is the raw
+// interrupt time less the loop's prediction, in nanoseconds.
+typedef struct DBDMATimeStampUserClientState_t {
+	UInt32		nominalPeriodNanos;
+	UInt32		periodNanos;									// as the loop has it now
+	UInt32		passCount;										// since the loop last locked
+	UInt32		unlockCount;
+	SInt32		lastResidualNanos;
+	UInt32		meanResidualNanos;
+	UInt32		maxResidualNanos;
+} DBDMATimeStampUserClientStruct, *DBDMATimeStampUserClientStructPtr;
+
+// Erase head cost for the user client.  Only genericEraser is written; it
+// picks IOAudioEngine's eraser over the engine's so the two can be compared,
+// and clears the totals.
+typedef struct DBDMAEraseUserClientState_t {
+	UInt32		genericEraser;
+	UInt32		eraseCount;
+	UInt32		eraseKiloBytes;									// mix and sample buffers together
+	UInt32		eraseMicroseconds;
+	UInt32		megaBytesPerSecond;
+} DBDMAEraseUserClientStruct, *DBDMAEraseUserClientStructPtr;
+
+// Stall watchdog for the user client.  Recovery time runs from the last look
+// that saw the channel moving to the DMA being started again.
+typedef struct DBDMAWatchdogUserClientState_t {
+	UInt32		checkNanos;										// between looks at the command pointer
+	UInt32		stallCount;										// channel frozen but not dead
+	UInt32		deadCount;										// channel reported dead
+	UInt32		recoveryCount;
+	UInt32		lastRecoveryMicroseconds;
+	UInt32		recoveryHistogram[kDBDMARecoveryHistogramBuckets];
+	UInt32		inPlaceRestartCount;							// without stopping the engine
+} DBDMAWatchdogUserClientStruct, *DBDMAWatchdogUserClientStructPtr;
+
+// IOProc stages with a duration histogram each.  The copy stages move samples
+// between the mix or DMA buffer and the float scratch space, convert is the
+// float to or from integer step, and a total is the whole clip or convert call.
+typedef enum {
+	kDBDMAIOProcStageOutputCopy		= 0,
+	kDBDMAIOProcStageOutputDSP,
+	kDBDMAIOProcStageOutputConvert,
+	kDBDMAIOProcStageOutputiSub,
+	kDBDMAIOProcStageOutputTotal,
+	kDBDMAIOProcStageInputConvert,
+	kDBDMAIOProcStageInputDSP,
+	kDBDMAIOProcStageInputCopy,
+	kDBDMAIOProcStageInputTotal,
+	kDBDMAIOProcStageCount
+} DBDMAIOProcStage;
+
+// IOProc stage timing for the user client, all in nanoseconds.  A percentile
+// is the upper edge of the bucket it falls in.  Writing it clears the
+// histograms at each direction's next IOProc.
+typedef struct DBDMAIOProcStageUserClientState_t {
+	UInt32		count;
+	UInt32		p50Nanos;
+	UInt32		p99Nanos;
+	UInt32		maxNanos;
+	UInt32		maxUptimeNanos_hi;								// when the longest run ended
+	UInt32		maxUptimeNanos_lo;
+	UInt32		buckets[kDBDMAIOProcHistogramBuckets];
+} DBDMAIOProcStageUserClientStruct;
+
+typedef struct DBDMAIOProcTimingUserClientState_t {
+	UInt32		bucketFirstShift;								// bucket 0 is under 1 << this
+	UInt32		tornCount;										// stages copied while the IOProc was writing them
+	DBDMAIOProcStageUserClientStruct	stages[kDBDMAIOProcStageCount];
+} DBDMAIOProcTimingUserClientStruct, *DBDMAIOProcTimingUserClientStructPtr;
+
+// Trace entries for the user client, oldest first.  Each get hands back what
+// the last one left and moves the driver's read slot on, so there should be
+// only one reader.
+typedef struct DBDMATraceUserClientState_t {
+	UInt32		entryCount;
+	UInt32		lostCount;										// overwritten before they could be read
+	UInt32		pendingCount;									// left in the ring for the next get
+	UInt32		reserved;
+	DBDMATraceEntry		entries[kDBDMATraceDrainEntries];
+} DBDMATraceUserClientStruct, *DBDMATraceUserClientStructPtr;
+
+// Clip deadline for the user client.  The margin is how far ahead of the DMA
+// a clip started, less the block the channel may already have read; under 0
+// the clip wrote audio that had already gone out.  Only notifyUnderruns is
+// written; it has late clips posted as a property change from the poll, and
+// clears the rest at the next clip.
+typedef struct DBDMADeadlineUserClientState_t {
+	UInt32		notifyUnderruns;
+	UInt32		clipCount;
+	UInt32		underrunCount;
+	UInt32		nearMissCount;									// under a block of margin
+	SInt32		minMarginFrames;
+	SInt32		lastMarginFrames;
+	SInt32		meanMarginFrames;
+	UInt32		safetyOffsetFrames;								// the HAL's, to compare against
+	UInt32		marginHistogram[kDBDMADeadlineHistogramBuckets];
+} DBDMADeadlineUserClientStruct, *DBDMADeadlineUserClientStructPtr;
+
+typedef struct {
+	IOPhysicalAddress		physical;
+	UInt32					offset;							// into the descriptors
+	UInt32					length;
+} DBDMACommandSegment;
+
 typedef struct UCIODBDMAChannelCommands {
 	UInt32					numBlocks;
 	IODBDMADescriptor		channelCommands[1];
@@ -134,7 +301,12 @@ public:
     virtual IOReturn	performAudioEngineStart();
     virtual IOReturn 	performAudioEngineStop();
     IOReturn     		restartDMA();
+	IOReturn			restartDMAInPlace (void);
+	bool				claimRestart (void);
+	void				releaseRestart (void);
 	virtual void 		setSampleLatencies (UInt32 outputLatency, UInt32 inputLatency); 
+			void		updateSampleLatencies (void);
+			void		publishSoftwareOutputVolume (void);
 	virtual void 		stop(IOService *provider);
 	virtual bool		willTerminate (IOService * provider, IOOptionBits options);
 	static void 		requestiSubClose (IOAudioEngine * audioEngine);
@@ -154,6 +326,7 @@ public:
 			void  		setRightChanMixed(const bool needsRightChanMixed);
     inline	bool  		getRightChanMixed() { return fNeedsRightChanMixed; };
 			void  		setRightChanDelay(const bool needsRightChanDelay);
+			void  		setLeftChanDelay(const bool needsLeftChanDelay);
 
 	void 				setDualMonoMode(const DualMonoModeType inDualMonoMode);
 
@@ -165,6 +338,7 @@ public:
     void		 		setUseSoftwareOutputVolume(bool inUseSoftwareOutputVolume, UInt32 inMinLinear = 0, UInt32 inMaxLinear = 0, SInt32 inMindB = 0, SInt32 inMaxdB = 0);
     void	 			setOutputVolumeLeft(UInt32 inVolume); 
     void	 			setOutputVolumeRight(UInt32 inVolume); 
+	void				setOutputVolumeDecibels (IOFixed inVolumedB);
 
 	void				enableOutputProcessing ();
 	void				disableOutputProcessing ();
@@ -173,6 +347,7 @@ public:
 
 	void				setOutputSignalProcessing (OSDictionary * inDictionary);
 	void				setInputSignalProcessing (OSDictionary * inDictionary);
+	OSArray *			planOutputEQ (UInt32 inNumCodecSections);
 
 	AudioHardwareObjectInterface* getCurrentOutputPlugin ();
  	
@@ -183,6 +358,7 @@ public:
 	virtual	bool		getDmaState (void);
 
 	void				updateDSPForSampleRate (UInt32 inSampleRate);
+	void				applyOutputVolumeDecibels (void);
 	
 	virtual bool		isMixable ();
 	
@@ -196,19 +372,34 @@ public:
 	IOReturn			copyOutputChannelRegisters (void * outState);
 	IOReturn			setInputChannelRegisters (void * inState);
 	IOReturn			setOutputChannelRegisters (void * inState);
+	IOReturn			copyBlockState (DBDMABlockUserClientStructPtr outState);
+	IOReturn			setBlockState (DBDMABlockUserClientStructPtr inState);
+	IOReturn			copyTimeStampState (DBDMATimeStampUserClientStructPtr outState);
+	IOReturn			copyEraseState (DBDMAEraseUserClientStructPtr outState);
+	IOReturn			setEraseState (DBDMAEraseUserClientStructPtr inState);
+	IOReturn			copyWatchdogState (DBDMAWatchdogUserClientStructPtr outState);
+	IOReturn			copyIOProcTiming (DBDMAIOProcTimingUserClientStructPtr outState);
+	void				clearIOProcTiming (void);
+	IOReturn			copyTrace (DBDMATraceUserClientStructPtr outState);
+	IOReturn			copyDeadlineState (DBDMADeadlineUserClientStructPtr outState);
+	IOReturn			setDeadlineState (DBDMADeadlineUserClientStructPtr inState);
+	void				reportClipUnderruns (void);
+	void				updateOutputDSP (void);
+	void				trace (UInt32 inEvent, UInt32 inArg0, UInt32 inArg1, UInt32 inArg2);
+	void				traceRestart (bool inInPlace, IOReturn inResult);
+
+	IOReturn			requestBlockFrames (UInt32 inFrames);
+	bool				blockSizeChangeNeeded (void);
+	bool				applyBlockSize (void);
 
 	bool				updateOutputStreamFormats ();
 
 
-	UInt64				getTotalNanos () { return mCurrentTotalOutputNanos; }
-
     static const int 	kDBDMADeviceIndex;
     static const int 	kDBDMAOutputIndex;
     static const int 	kDBDMAInputIndex;
     static const UInt32 kMaxBitWidth;
-#if 0
-	virtual bool		getRunEraseHead ( void ) { return ( false ); }
-#endif
+	virtual void		eraseOutputSamples (const void *mixBuf, void *sampleBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat, IOAudioStream *audioStream);
 
 	//	[3305011]	begin {
 	bool				engineDied ( void );
@@ -229,7 +420,7 @@ protected:
 	IOAudioStream *					mInputStream;
 	OSArray *						deviceFormats;
 	void *							mOutputSampleBuffer;
-	void *							mIntermediateOutputSampleBuffer;
+	void *							mOutputScratchBuffer;
 	void *							mIntermediateInputSampleBuffer;
 	void *							mInputSampleBuffer;
     UInt32							commandBufferSize;
@@ -237,6 +428,25 @@ protected:
     UInt32							numBlocks;
     UInt32							blockSize;
     UInt32							mMaxBlockSize;
+	UInt32							mBlockSamples;							//	root block size, or smaller in low latency mode
+	UInt32							mTotalBlockSamples;						//	numBlocks * mBlockSamples, so the buffers never move
+	UInt32							mRequestedBlockSamples;
+	UInt32							mTargetBlockSamples;					//	applied from the next runPolledTasks
+	UInt32							mClipOverrunCount;						//	written by the IOProc only
+	UInt32							mLastClipOverrunCount;
+	UInt32							mBlockBackOffCount;
+	UInt32							mDeadlineClipCount;						//	the deadline state is written by the IOProc only
+	UInt32							mDeadlineUnderrunCount;
+	UInt32							mDeadlineNearMissCount;
+	SInt32							mMinDeadlineMargin;
+	SInt32							mLastDeadlineMargin;
+	SInt64							mDeadlineMarginSum;
+	UInt32							mDeadlineHistogram[kDBDMADeadlineHistogramBuckets];
+	UInt32							mDeadlineClears;						//	the user client's requests
+	UInt32							mDeadlineClearsSeen;
+	bool							mNotifyUnderruns;
+	UInt32							mReportedUnderrunCount;
+	UInt32							mTotalUnderrunCount;					//	not cleared, for the notification
 	PlatformInterface *				mPlatformObject;
 	
 	//	[3305011]	begin {
@@ -247,9 +457,32 @@ protected:
 	UInt32							mDmaStalledCount;						//	[3514709]	for user client
 	UInt32							mDmaHwDiedCount;						//	[3514709]	for user client
 	UInt32							mInterruptActionCount;					//	[3514709]	for user client
+	DBDMATimeStampFilter			mTimeStampFilter;						//	filterInterrupt only, once the engine has started
+	DBDMACommandSegment				mCommandSegments[DBDMAAUDIODMAENGINE_MAX_COMMAND_SEGMENTS];
+	UInt32							mNumCommandSegments;
+	UInt32							mStartDmaInterruptCount;
+	bool							mFrameCounterChecked;					//	once a pass has been made since the start
+	bool							mFrameCounterRuns;
+	bool							mGenericEraser;
+	UInt32							mEraseCount;
+	UInt64							mEraseBytes;
+	UInt64							mEraseNanos;
+	IOTimerEventSource *			mStallWatchdog;
+	UInt32							mWatchdogNanos;							//	set when the engine starts
+	DBDMAStallWatchdog				mWatchdog;
+	UInt64							mWatchdogProgressNanos;					//	the last look that saw the channel move
+	bool							mWatchdogStallPending;					//	until engineDied reports it
+	UInt64							mStallStartNanos;						//	0 unless a recovery is being timed
+	UInt32							mRecoveryCount;
+	UInt32							mLastRecoveryMicros;
+	UInt32							mRecoveryHistogram[kDBDMARecoveryHistogramBuckets];
+	bool							mInPlaceRestartTried;					//	until the channel next interrupts
+	UInt32							mInPlaceRestartInterruptCount;
+	UInt32							mInPlaceRestartCount;
 	//	} end	[3305011]
 
-	Boolean							mNeedToRestartDMA;
+	Boolean							mNeedToRestartDMA;						//	set by filterInterrupt, cleared by releaseRestart
+	UInt32							mRestartClaimed;						//	1 while the IOProc or the work loop restarts the channels
 	
 	Boolean							mHasInput;
 	Boolean							mHasOutput;
@@ -277,6 +510,12 @@ protected:
 	Boolean							iSubOpen;
 
 	bool							fNeedsRightChanMixed;
+	bool							fNeedsRightChanDelay;
+	bool							fNeedsLeftChanDelay;
+	DSP_Delay *						mOutputFixupDelay;		//	one frame DelayLeft / DelayRight clip options
+	DSP_Delay *						mInputFixupDelay;		//	[3173869]
+	DSP_Capture *					mInputCapture;			//	internal microphone chain, run as part of input conversion
+	bool							mInputCaptureEnabled;
 	
 	DualMonoModeType				mInputDualMonoMode;
 
@@ -291,11 +530,19 @@ protected:
 	UInt32							mMaxVolumeLinear;
 	SInt32							mMinVolumedB;
 	SInt32							mMaxVolumedB;
+	IOFixed							mOutputVolumedB;		//	listening level for the loudness stage, hardware or software volume
+	SoftwareOutputVolume			mVolumeSlots[kDSPExchangeSlots];
+	DSPExchange						mVolumeExchange;
+	SoftwareOutputVolume			mLiveVolume;			//	IOProc side
+	bool							mReleasingSoftwareVolume;	//	ramping back to unity
 
     bool 							mUseSoftwareInputGain;
     float *							mInputGainLPtr;				
     float *							mInputGainRPtr;				
 	bool							fNeedsRightChanDelayInput;// [3173869]
+	InputConversion					mInputConversionSlots[kDSPExchangeSlots];
+	DSPExchange						mInputConversionExchange;
+	InputConversion					mLiveInputConversion;	//	input IOProc side
 
 	
 	bool							dmaRunState;			//	rbm 7.12.02 added for user client support
@@ -310,6 +557,10 @@ protected:
 	float							mLastInputSample;
 	float							mLastOutputSample;
 
+	DSP_Manager *					mOutputDSP;
+	UInt32							mHardwareOutputLatency;
+	UInt32							mHardwareInputLatency;
+
     virtual bool					filterInterrupt(int index);
 
 	void							chooseOutputClippingRoutinePtr();
@@ -322,6 +573,13 @@ protected:
 	bool							allocateInputDMADescriptors (void);
 	bool							createDMAPrograms ( void );
 	void							deallocateDMAMemory ();
+	UInt32							getBlockChannels (void);
+	UInt32							getMinimumSampleOffset (void);
+	void							setBlockSamples (UInt32 inBlockSamples);
+	void							updateSampleOffset (UInt32 inSampleRate);
+	inline	void					checkClipDeadline (UInt32 firstSampleFrame);
+	void							recordCommandSegments (void);
+	UInt32							getDMAPositionFrame (void);
 
 	void	 						iSubSynchronize(UInt32 firstSampleFrame, UInt32 numSampleFrames);
 	void							updateiSubPosition(UInt32 firstSampleFrame, UInt32 numSampleFrames);
@@ -329,53 +587,49 @@ protected:
 	UInt32							GetEncodingFormat (OSString * theEncoding);
 	static bool 					interruptFilter(OSObject *owner, IOFilterInterruptEventSource *source);
     static void 					interruptHandler(OSObject *owner, IOInterruptEventSource *source, int count);
+	static void						stallWatchdogCallback (OSObject *owner, IOTimerEventSource *source);
+	void							armStallWatchdog (void);
+	void							recordRecoveryTime (UInt32 inMicros);
+	void							checkForStall (void);
+	bool							restartChannelAtBlock (IODBDMAChannelRegisters * channel, IOMemoryDescriptor * commandMemDescriptor, UInt32 blockNum);
+	void							clearWrapResults (void);
 	static IOReturn 				iSubAttachChangeHandler (IOService *target, IOAudioControl *attachControl, SInt32 oldValue, SInt32 newValue);
     static bool						iSubEnginePublished (AppleDBDMAAudio * dbdmaEngineObject, void * refCon, IOService * newService);
 	static IOReturn 				iSubCloseAction (OSObject *owner, void *arg1, void *arg2, void *arg3, void *arg4);
 	static IOReturn 				iSubOpenAction (OSObject *owner, void *arg1, void *arg2, void *arg3, void *arg4);
 
 	IOReturn 						(AppleDBDMAAudio::*mClipAppleDBDMAToOutputStreamRoutine)(const void *mixBuf, void *sampleBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat);
-	IOReturn 						(AppleDBDMAAudio::*mConvertInputStreamToAppleDBDMARoutine)(const void *sampleBuf, void *destBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat);
-
-	inline	void					startOutputTiming();
-	inline 	void					endOutputTiming();
-    inline  void                    pauseOutputTiming();
-    inline  void                    resumeOutputTiming();
-    inline  void                    startInputTiming();
-    inline  void                    endInputTiming();
-    inline  void                    pauseInputTiming();
-    inline  void                    resumeInputTiming();
+
+	inline	void					startOutputTiming ();
+	inline	void					markOutputStage (UInt32 inStage);
+	inline	UInt64					endOutputTiming ();
+	inline	void					startInputTiming ();
+	inline	void					markInputStage (UInt32 inStage);
+	inline	UInt64					endInputTiming ();
+	UInt64							recordIOProcTiming (UInt32 inFirstStage, UInt32 inTotalStage, UInt64 inStartNanos, UInt32 inStagesMarked, UInt32 * ioClearsSeen);
 	
 	float*							mMixBufferPtr;
-    
-    bool                            mEnableCPUProfiling;
-    
-	UInt32 							mOutputIOProcCallCount;
-	AbsoluteTime					mStartOutputIOProcUptime;
-	AbsoluteTime					mEndOutputProcessingUptime;
-    AbsoluteTime                    mPauseOutputProcessingUptime;
-	UInt64							mCurrentTotalOutputNanos;
-	UInt64							mTotalOutputIOProcNanos;
-	UInt64							mTotalOutputProcessingNanos;
-    UInt64                          mCurrentTotalPausedOutputNanos;
-	float							mCurrentOutputCPUUsagePercent;
-	float							mAverageOutputCPUUsagePercent;
-    
-	UInt32 							mInputIOProcCallCount;
-	AbsoluteTime					mStartInputIOProcUptime;
-	AbsoluteTime					mEndInputProcessingUptime;
-    AbsoluteTime                    mPauseInputProcessingUptime;
-	UInt64							mCurrentTotalInputNanos;
-	UInt64							mTotalInputIOProcNanos;
-	UInt64							mTotalInputProcessingNanos;
-    UInt64                          mCurrentTotalPausedInputNanos;
-	float							mCurrentInputCPUUsagePercent;
-	float							mAverageInputCPUUsagePercent;
+	UInt32							mOutputSampleFrame;		//	first DMA buffer frame of the block in outputProcessing ()
+
+	DBDMAIOProcHistogram			mIOProcHistograms[kDBDMAIOProcStageCount];
+	UInt64							mIOProcStageNanos[kDBDMAIOProcStageCount];	//	so far in this IOProc
+	UInt64							mOutputStartNanos;
+	UInt64							mOutputMarkNanos;						//	end of the last output stage
+	UInt32							mOutputStagesMarked;					//	bit per stage
+	UInt32							mOutputClearsSeen;
+	UInt64							mInputStartNanos;
+	UInt64							mInputMarkNanos;
+	UInt32							mInputStagesMarked;
+	UInt32							mInputClearsSeen;
+	UInt32							mIOProcTimingClears;					//	the user client's requests
+	DBDMATraceRing					mTrace;
+	UInt32							mTraceReadSlot;							//	the user client's place in mTrace
     
 #pragma mark ---------------------------------------- 
 #pragma mark  Output Conversion Routines
 #pragma mark ---------------------------------------- 
 	inline void outputProcessing (float* inFloatBufferPtr, UInt32 inNumSamples);
+	inline void acquireSoftwareOutputVolume (void);
 	inline void setupOutputBuffer (const void *mixBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat);
 
 	IOReturn clipMemCopyToOutputStream (const void *inFloatBufferPtr, void *sampleBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat);
@@ -403,9 +657,11 @@ protected:
 	IOReturn convertAppleDBDMAFromInputStream16(const void *sampleBuf, void *destBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat);
 	IOReturn convertAppleDBDMAFromInputStream16CopyR2L(const void *sampleBuf, void *destBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat);
 	IOReturn convertAppleDBDMAFromInputStream16WithGain(const void *sampleBuf, void *destBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat);
+	IOReturn convertAppleDBDMAFromInputStream16Capture(const void *sampleBuf, void *destBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat);
 	
 	IOReturn convertAppleDBDMAFromInputStream32(const void *sampleBuf, void *destBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat);
 	IOReturn convertAppleDBDMAFromInputStream32WithGain(const void *sampleBuf, void *destBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat);
+	IOReturn convertAppleDBDMAFromInputStream32Capture(const void *sampleBuf, void *destBuf, UInt32 firstSampleFrame, UInt32 numSampleFrames, const IOAudioStreamFormat *streamFormat);
 
 };
 
@@ -1,4 +1,6 @@
 #include <libkern/OSTypes.h>
+#include <stdint.h>
+#include <string.h>
 #include <IOKit/IOReturn.h>
 //#include <libkern/libkern.h>
 
@@ -3765,3 +3767,68 @@ void volumeConverter (UInt32 inVolume, UInt32 inMinLinear, UInt32 inMaxLinear, S
 #endif	
 }
 
+// dcbz establishes a whole line in the cache as zeroes without reading it from memory first,
+// which halves the bus traffic of storing zeroes.  The G5 runs dcbz on 32 byte lines as well.
+#define kZeroCacheLineBytes		32
+
+void ZeroSamples (void * ioBuffer, UInt32 inByteCount)
+{
+#if	defined(__ppc__)
+	register UInt8 *	bytePtr;
+	register UInt8 *	endPtr;
+	register UInt8 *	lineEndPtr;
+
+	bytePtr = (UInt8 *)ioBuffer;
+	endPtr = bytePtr + inByteCount;
+	lineEndPtr = (UInt8 *)( (uintptr_t)endPtr & ~( (uintptr_t)kZeroCacheLineBytes - 1 ) );
+
+	while ( bytePtr < endPtr && 0 != ( (uintptr_t)bytePtr & ( kZeroCacheLineBytes - 1 ) ) ) {
+		*bytePtr++ = 0;
+	}
+	while ( bytePtr < lineEndPtr ) {
+		__asm__ __volatile__ ( "dcbz 0, %0" : : "r" (bytePtr) : "memory" );
+		bytePtr += kZeroCacheLineBytes;
+	}
+	while ( bytePtr < endPtr ) {
+		*bytePtr++ = 0;
+	}
+#else
+	bzero ( ioBuffer, inByteCount );
+#endif
+}
+
+// ------------------------------------------------------------------------
+// Math for the software DSP stages.  The fp library headers are C only,
+// so the C++ stages reach it through these.  None of them belong in an
+// IOProc; they are meant for building tables and coefficients.
+// ------------------------------------------------------------------------
+float dspSin (float inX)
+{
+	return (float)sin ((double)inX);
+}
+
+float dspCos (float inX)
+{
+	return (float)cos ((double)inX);
+}
+
+float dspPow (float inX, float inY)
+{
+	return (float)pow ((double)inX, (double)inY);
+}
+
+float dspSqrt (float inX)
+{
+	return (float)sqrt ((double)inX);
+}
+
+float dspLog10 (float inX)
+{
+	return (float)log10 ((double)inX);
+}
+
+float dspExp (float inX)
+{
+	return (float)exp ((double)inX);
+}
+
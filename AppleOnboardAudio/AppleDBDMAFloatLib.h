@@ -76,7 +76,14 @@ void 	inputGainConverter (UInt32 inGainIndex, float* ioGainPtr);
 void 	volumeConverter (UInt32 inVolume, UInt32 inMinLinear, UInt32 inMaxLinear, SInt32 inMindB, SInt32 inMaxdB, float* outVolume);
 void 	convertToFourDotTwenty(FourDotTwenty* ioFourDotTwenty, float* inFloatPtr);
 
-void	convertNanosToPercent (UInt64 inNumerator, UInt64 inDenominator, float * percent);
+void	ZeroSamples (void * ioBuffer, UInt32 inByteCount);
+
+float	dspSin (float inX);
+float	dspCos (float inX);
+float	dspPow (float inX, float inY);
+float	dspSqrt (float inX);
+float	dspLog10 (float inX);
+float	dspExp (float inX);
 
 };
 
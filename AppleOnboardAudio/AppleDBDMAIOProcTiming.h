@@ -0,0 +1,146 @@
+/*
+ *  AppleDBDMAIOProcTiming.h
+ *  AppleOnboardAudio
+ *
+ *  Duration histograms for the stages of the engine's IOProc work.  A
+ *  late IOProc is a glitch however good the average is, so each stage
+ *  keeps a count per power of two of nanoseconds along with its longest
+ *  run and when that run ended, and the percentiles are read back off the
+ *  buckets.
+ *
+ *  Each histogram has one writer, the IOProc for its direction, and is
+ *  read through the user client while the engine runs, so there is no
+ *  lock.  The writer makes the sequence count odd before it changes
+ *  anything and even again after; a reader keeps its copy only if it saw
+ *  the same even count on both sides of it.  Clearing is left to the
+ *  writer for the same reason.
+ *
+ *  Bucket 0 holds anything under 1 << kDBDMAIOProcHistogramFirstShift ns
+ *  and each bucket after it covers twice the span of the one before; the
+ *  last takes everything longer.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __APPLEDBDMAIOPROCTIMING__
+#define __APPLEDBDMAIOPROCTIMING__
+
+#include <libkern/OSTypes.h>
+
+#define kDBDMAIOProcHistogramBuckets		20		/*	< 512 ns, < 1 us ... < 134 ms, and longer			*/
+#define kDBDMAIOProcHistogramFirstShift		9
+#define kDBDMAIOProcHistogramCopyTries		4		/*	before a reader gives up on a busy writer			*/
+
+#if defined ( __ppc__ )
+#define DBDMAIOProcTimingBarrier()			__asm__ __volatile__ ( "sync" : : : "memory" )
+#else
+#define DBDMAIOProcTimingBarrier()			__sync_synchronize ()
+#endif
+
+typedef struct {
+	volatile UInt32		sequence;				//	odd while the writer is in the middle of an update
+	UInt32				count;
+	UInt32				maxNanos;
+	UInt64				maxEndNanos;			//	uptime at the end of the longest run
+	UInt32				buckets[kDBDMAIOProcHistogramBuckets];
+} DBDMAIOProcHistogram;
+
+static inline UInt32 DBDMAIOProcHistogramBucket ( UInt64 inNanos ) {
+	UInt32				bucket;
+	UInt64				limit;
+
+	bucket = 0;
+	limit = 1ULL << kDBDMAIOProcHistogramFirstShift;
+	while ( bucket < kDBDMAIOProcHistogramBuckets - 1 && inNanos >= limit ) {
+		bucket++;
+		limit <<= 1;
+	}
+	return bucket;
+}
+
+//	The longest a run in the bucket can have been, which is what a percentile reports.
+static inline UInt32 DBDMAIOProcHistogramBucketLimit ( UInt32 inBucket ) {
+	return ( inBucket >= kDBDMAIOProcHistogramBuckets - 1 ) ? 0xFFFFFFFF : ( 1UL << ( kDBDMAIOProcHistogramFirstShift + inBucket ) );
+}
+
+//	Writer only.
+static inline void DBDMAIOProcHistogramRecord ( DBDMAIOProcHistogram * ioHistogram, UInt64 inNanos, UInt64 inEndNanos ) {
+	ioHistogram->sequence++;
+	DBDMAIOProcTimingBarrier ();
+	ioHistogram->count++;
+	ioHistogram->buckets[DBDMAIOProcHistogramBucket ( inNanos )]++;
+	if ( inNanos > ioHistogram->maxNanos ) {
+		ioHistogram->maxNanos = ( inNanos > 0xFFFFFFFFULL ) ? 0xFFFFFFFF : (UInt32)inNanos;
+		ioHistogram->maxEndNanos = inEndNanos;
+	}
+	DBDMAIOProcTimingBarrier ();
+	ioHistogram->sequence++;
+}
+
+//	Writer only.
+static inline void DBDMAIOProcHistogramClear ( DBDMAIOProcHistogram * ioHistogram ) {
+	UInt32				bucket;
+
+	ioHistogram->sequence++;
+	DBDMAIOProcTimingBarrier ();
+	ioHistogram->count = 0;
+	ioHistogram->maxNanos = 0;
+	ioHistogram->maxEndNanos = 0;
+	for ( bucket = 0; bucket < kDBDMAIOProcHistogramBuckets; bucket++ ) {
+		ioHistogram->buckets[bucket] = 0;
+	}
+	DBDMAIOProcTimingBarrier ();
+	ioHistogram->sequence++;
+}
+
+//	False if the writer was busy on every try; the copy is then as torn as the last try left it.
+static inline bool DBDMAIOProcHistogramCopy ( const DBDMAIOProcHistogram * inHistogram, DBDMAIOProcHistogram * outCopy ) {
+	UInt32				sequence;
+	UInt32				bucket;
+	UInt32				tries;
+
+	for ( tries = 0; tries < kDBDMAIOProcHistogramCopyTries; tries++ ) {
+		sequence = inHistogram->sequence;
+		DBDMAIOProcTimingBarrier ();
+		outCopy->count = inHistogram->count;
+		outCopy->maxNanos = inHistogram->maxNanos;
+		outCopy->maxEndNanos = inHistogram->maxEndNanos;
+		for ( bucket = 0; bucket < kDBDMAIOProcHistogramBuckets; bucket++ ) {
+			outCopy->buckets[bucket] = inHistogram->buckets[bucket];
+		}
+		DBDMAIOProcTimingBarrier ();
+		if ( 0 == ( sequence & 1 ) && sequence == inHistogram->sequence ) {
+			outCopy->sequence = sequence;
+			return true;
+		}
+	}
+	return false;
+}
+
+//	inPerThousand of the runs took no longer than the value returned, which is never more than the longest run.
+static inline UInt32 DBDMAIOProcHistogramPercentile ( const DBDMAIOProcHistogram * inHistogram, UInt32 inPerThousand ) {
+	UInt64				target;
+	UInt64				seen;
+	UInt32				bucket;
+	UInt32				result;
+
+	result = 0;
+	if ( 0 != inHistogram->count ) {
+		target = ( (UInt64)inHistogram->count * inPerThousand + 999 ) / 1000;
+		seen = 0;
+		for ( bucket = 0; bucket < kDBDMAIOProcHistogramBuckets; bucket++ ) {
+			seen += inHistogram->buckets[bucket];
+			if ( seen >= target ) {
+				break;
+			}
+		}
+		result = DBDMAIOProcHistogramBucketLimit ( bucket );
+		if ( result > inHistogram->maxNanos ) {
+			result = inHistogram->maxNanos;
+		}
+	}
+	return result;
+}
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ *  AppleDBDMARecovery.h
+ *  AppleOnboardAudio
+ *
+ *  What AppleDBDMAAudio decides about a channel that may have stopped:
+ *  whether a ring interrupt carries a wrap to stamp, whether the stall
+ *  watchdog or the engineDied poll has seen the channel stop, and where
+ *  a restart in place picks the ring up again.  The engine supplies the
+ *  register values, counts and times and acts on the answer, so DBDMASim
+ *  runs this same code against its model of the channel.
+ *
+ *  Like the time stamp loop, parts of it run in the primary interrupt
+ *  filter, so it is integer only and takes no locks.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __APPLEDBDMARECOVERY__
+#define __APPLEDBDMARECOVERY__
+
+#include <libkern/OSTypes.h>
+#include <IOKit/ppc/IODBDMA.h>
+
+//	[3305011]	begin {
+#define	kMAXIMUM_NUMBER_OF_FROZEN_DMA_IRQ_COUNTS		3
+//	} end	[3305011]
+
+//	The stall watchdog looks at the command pointer every few blocks, but no
+//	more often than the minimum period, and calls for recovery once it has
+//	failed to move for the frozen count of looks in a row.
+#define kDBDMAStallWatchdogBlocks					2
+#define kDBDMAStallWatchdogMinimumNanos				5000000ULL
+#define kDBDMAStallWatchdogFrozenChecks				2
+
+//	An outage longer than this many passes around the ring is left to a full
+//	stop and start rather than being restarted in place.
+#define kDBDMAInPlaceRestartMaxPasses				4
+
+enum {
+	kDBDMAWatchdogMoving							= 0,	//	the channel has moved since the last look
+	kDBDMAWatchdogFrozen,									//	it has not, but not for long enough yet
+	kDBDMAWatchdogStalled,									//	frozen for the count of looks in a row
+	kDBDMAWatchdogDead										//	the channel reports a bus error
+};
+
+enum {
+	kDBDMAInterruptsMoving							= 0,	//	the count has moved, so any recovery is over
+	kDBDMAInterruptsWaiting,								//	it has not, or the engine is stopped
+	kDBDMAInterruptsFrozen									//	it has stood still for the count of polls
+};
+
+typedef struct {
+	UInt32				commandPtr;				//	as the last look that saw the channel move found it
+	UInt32				interruptCount;
+	UInt32				frozenChecks;
+} DBDMAStallWatchdog;
+
+//	filterInterrupt.  The wrap leaves its status in the ring's last command; without it the
+//	interrupt was raised by a bus error, or before a restart that has already stamped the
+//	wraps it covered.  Taking the wrap clears the status for the next one.
+static inline bool DBDMATakeWrap ( IODBDMADescriptor * ioWrapCommand, UInt32 inChannelStatus ) {
+	bool				result;
+
+	result = false;
+	if ( 0 != ( inChannelStatus & kdbdmaDead ) ) {
+		goto Exit;
+	}
+	if ( NULL != ioWrapCommand ) {
+		if ( 0 == IOGetCCResult ( ioWrapCommand ) ) {
+			goto Exit;
+		}
+		IOSetCCDescriptor ( ioWrapCommand, result, 0 );
+	}
+	result = true;
+Exit:
+	return result;
+}
+
+//	The time between looks, in ns.
+static inline UInt32 DBDMAStallWatchdogPeriod ( UInt32 inBlockFrames, UInt32 inSampleRate ) {
+	UInt64				blockNanos;
+	UInt64				result;
+
+	blockNanos = ( 0 == inSampleRate ) ? 0 : ( (UInt64)inBlockFrames * 1000000000ULL ) / inSampleRate;
+	result = blockNanos * kDBDMAStallWatchdogBlocks;
+	if ( result < kDBDMAStallWatchdogMinimumNanos ) {
+		result = kDBDMAStallWatchdogMinimumNanos;
+	}
+	return (UInt32)result;
+}
+
+//	When the channel has just been started.
+static inline void DBDMAStallWatchdogArm ( DBDMAStallWatchdog * ioWatchdog, UInt32 inCommandPtr, UInt32 inInterruptCount ) {
+	ioWatchdog->commandPtr = inCommandPtr;
+	ioWatchdog->interruptCount = inInterruptCount;
+	ioWatchdog->frozenChecks = 0;
+}
+
+//	A dead channel is stalled at once; a live one must be seen frozen on consecutive looks,
+//	with no interrupt in between, since a pointer found on the same block a whole pass later
+//	has still moved.
+static inline UInt32 DBDMAStallWatchdogCheck ( DBDMAStallWatchdog * ioWatchdog, UInt32 inChannelStatus, UInt32 inCommandPtr, UInt32 inInterruptCount ) {
+	UInt32				result;
+
+	if ( 0 != ( inChannelStatus & kdbdmaDead ) ) {
+		result = kDBDMAWatchdogDead;
+	} else if ( inCommandPtr == ioWatchdog->commandPtr && inInterruptCount == ioWatchdog->interruptCount ) {
+		ioWatchdog->frozenChecks++;
+		result = ( kDBDMAStallWatchdogFrozenChecks <= ioWatchdog->frozenChecks ) ? kDBDMAWatchdogStalled : kDBDMAWatchdogFrozen;
+	} else {
+		DBDMAStallWatchdogArm ( ioWatchdog, inCommandPtr, inInterruptCount );
+		result = kDBDMAWatchdogMoving;
+	}
+	return result;
+}
+
+//	engineDied, polled from the work loop while no recovery is under way.  The ring interrupts
+//	once a pass, so a count that stands still over several polls means the channel has stopped.
+static inline UInt32 DBDMAPollInterruptCount ( UInt32 inInterruptCount, bool inRunning, UInt32 * ioLastInterruptCount, UInt32 * ioFrozenPolls ) {
+	UInt32				result;
+
+	result = kDBDMAInterruptsWaiting;
+	if ( !inRunning ) {
+		*ioLastInterruptCount = 0;
+		*ioFrozenPolls = 0;
+	} else if ( inInterruptCount == *ioLastInterruptCount ) {
+		( *ioFrozenPolls )++;
+		if ( kMAXIMUM_NUMBER_OF_FROZEN_DMA_IRQ_COUNTS <= *ioFrozenPolls ) {
+			*ioFrozenPolls = 0;
+			result = kDBDMAInterruptsFrozen;
+		}
+	} else {
+		*ioLastInterruptCount = inInterruptCount;
+		*ioFrozenPolls = 0;
+		result = kDBDMAInterruptsMoving;
+	}
+	return result;
+}
+
+//	Where a restart in place picks the ring up, from the time of the last wrap stamped.
+//	outPasses is the wraps the outage spanned.  outBlockNum is the block after the
+//	serializer's, which the IOProc has filled and the erase head has not reached; in the
+//	last block that would skip a wrap, so it stays there.  False when the outage is too
+//	long for a restart in place.
+static inline bool DBDMAInPlaceRestartPoint ( UInt64 inNowNanos, UInt64 inLoopNanos, UInt32 inSampleRate, UInt32 inFramesPerBuffer, UInt32 inBlockFrames, UInt32 inNumBlocks, UInt32 * outPasses, UInt32 * outBlockNum ) {
+	UInt64				frames;
+	UInt32				blockNum;
+	bool				result;
+
+	result = false;
+	if ( 0 == inSampleRate || 0 == inFramesPerBuffer || 0 == inBlockFrames || inNowNanos < inLoopNanos ) {
+		goto Exit;
+	}
+	frames = ( ( inNowNanos - inLoopNanos ) * inSampleRate ) / 1000000000ULL;
+	if ( kDBDMAInPlaceRestartMaxPasses < frames / inFramesPerBuffer ) {
+		goto Exit;
+	}
+	blockNum = (UInt32)( ( frames % inFramesPerBuffer ) / inBlockFrames );
+	if ( blockNum + 1 < inNumBlocks ) {
+		blockNum++;
+	}
+	*outPasses = (UInt32)( frames / inFramesPerBuffer );
+	*outBlockNum = blockNum;
+	result = true;
+Exit:
+	return result;
+}
+
+//	Stopping the channel clears 'dead' and drops whatever it had fetched; it then runs from
+//	inCommand with the S0 handshake open, as performAudioEngineStart leaves it.
+static inline void DBDMARestartChannel ( volatile IODBDMAChannelRegisters * ioChannel, IODBDMADescriptor * inCommand ) {
+	IODBDMAStop ( ioChannel );
+	IODBDMAReset ( ioChannel );
+	IOSetDBDMAChannelControl ( ioChannel, IOClearDBDMAChannelControlBits ( kdbdmaS0 ) );
+	IOSetDBDMABranchSelect ( ioChannel, IOSetDBDMAChannelControlBits ( kdbdmaS0 ) );
+	IODBDMAStart ( ioChannel, inCommand );
+}
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ *  AppleDBDMATimeStamp.h
+ *  AppleOnboardAudio
+ *
+ *  Delay locked loop for the ring wrap time stamps.  The interrupt that
+ *  marks each pass around the DMA ring reaches filterInterrupt after a
+ *  latency that varies from one pass to the next, and the HAL takes the
+ *  time stamp as the moment the serializer wrapped.  The loop fits a
+ *  steady sample clock to the raw interrupt times and hands back the time
+ *  it predicted for this pass, so the published stamps carry the clock
+ *  and not the interrupt latency.  The prediction follows the mean
+ *  latency; it is published two mean residuals earlier, which puts it
+ *  near the low edge of the latency spread and so close to the wrap.
+ *
+ *  The update runs in the primary interrupt filter, where the floating
+ *  point unit is off limits, so everything is integer nanoseconds and the
+ *  loop gains are powers of two.  With a phase gain of 1/16 and a period
+ *  gain of 1/512 the loop is critically damped and settles in about sixty
+ *  passes.  The period starts at the nominal value, which is off only by
+ *  the crystal's tolerance, so the stamps are usable from the first pass.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __APPLEDBDMATIMESTAMP__
+#define __APPLEDBDMATIMESTAMP__
+
+#include <libkern/OSTypes.h>
+
+#define kDBDMATimeStampPhaseShift			4		/*	1/16 of each residual moves the next prediction			*/
+#define kDBDMATimeStampPeriodShift			9		/*	1/512 of it moves the period							*/
+#define kDBDMATimeStampFractionBits			8		/*	the period is kept to 1/256 ns							*/
+#define kDBDMATimeStampMeanShift			4		/*	the mean residual is smoothed over 16 passes			*/
+#define kDBDMATimeStampUnlockDivisor		4		/*	a residual over a quarter of a pass is a lost pass		*/
+
+typedef struct {
+	UInt32				sampleRate;				//	the nominal pass was worked out for
+	UInt64				nominalNanos;			//	one pass at the nominal sample rate
+	SInt64				periodFixed;			//	estimated pass in ns << kDBDMATimeStampFractionBits
+	UInt64				nextNanos;				//	predicted time of the next pass
+	SInt64				lastResidual;			//	raw time less prediction, in ns
+	UInt64				maxResidual;			//	since the last reset
+	UInt64				meanResidual;			//	since the last reset
+	UInt32				passCount;				//	passes since the loop last locked, 0 when unlocked
+	UInt32				unlockCount;			//	over the life of the engine
+} DBDMATimeStampFilter;
+
+//	Called before the engine starts and when the sample rate changes under it; the first
+//	interrupt after it locks the loop.  The residuals are cleared so the mean that offsets
+//	each stamp is not carried over from a different rate.
+static inline void DBDMATimeStampFilterReset ( DBDMATimeStampFilter * ioFilter, UInt32 inFramesPerPass, UInt32 inSampleRate ) {
+	ioFilter->sampleRate = inSampleRate;
+	ioFilter->nominalNanos = ( 0 == inSampleRate ) ? 0 : ( (UInt64)inFramesPerPass * 1000000000ULL ) / inSampleRate;
+	ioFilter->lastResidual = 0;
+	ioFilter->maxResidual = 0;
+	ioFilter->meanResidual = 0;
+	ioFilter->passCount = 0;
+}
+
+//	Takes the raw time of a ring wrap interrupt and returns the time stamp to publish.
+//	A residual too large to be interrupt latency means a pass was lost or the clock
+//	changed; the loop then starts over from the raw time rather than slewing to it.
+static inline UInt64 DBDMATimeStampFilterUpdate ( DBDMATimeStampFilter * ioFilter, UInt64 inRawNanos ) {
+	SInt64				residual;
+	UInt64				magnitude;
+	UInt64				stamp;
+	UInt64				result;
+
+	result = inRawNanos;
+	if ( 0 == ioFilter->nominalNanos ) {
+		goto Exit;
+	}
+	if ( 0 != ioFilter->passCount ) {
+		residual = (SInt64)( inRawNanos - ioFilter->nextNanos );
+		magnitude = ( residual < 0 ) ? (UInt64)-residual : (UInt64)residual;
+		if ( magnitude <= ioFilter->nominalNanos / kDBDMATimeStampUnlockDivisor ) {
+			//	never publish a wrap later than the interrupt that reported it
+			stamp = ioFilter->nextNanos - 2 * ioFilter->meanResidual;
+			if ( stamp < inRawNanos ) {
+				result = stamp;
+			}
+			ioFilter->nextNanos += residual / ( 1 << kDBDMATimeStampPhaseShift ) + ( ioFilter->periodFixed >> kDBDMATimeStampFractionBits );
+			ioFilter->periodFixed += ( residual * ( 1 << kDBDMATimeStampFractionBits ) ) / ( 1 << kDBDMATimeStampPeriodShift );
+
+			ioFilter->lastResidual = residual;
+			if ( magnitude > ioFilter->maxResidual ) {
+				ioFilter->maxResidual = magnitude;
+			}
+			ioFilter->meanResidual = (UInt64)( (SInt64)ioFilter->meanResidual + ( (SInt64)magnitude - (SInt64)ioFilter->meanResidual ) / ( 1 << kDBDMATimeStampMeanShift ) );
+			ioFilter->passCount++;
+			goto Exit;
+		}
+		ioFilter->unlockCount++;
+	}
+	ioFilter->nextNanos = inRawNanos + ioFilter->nominalNanos;
+	ioFilter->periodFixed = (SInt64)( ioFilter->nominalNanos << kDBDMATimeStampFractionBits );
+	ioFilter->lastResidual = 0;
+	ioFilter->passCount = 1;
+Exit:
+	return result;
+}
+
+//	The pass as the loop has it, or the nominal pass until it has locked.
+static inline UInt64 DBDMATimeStampFilterPeriod ( const DBDMATimeStampFilter * inFilter ) {
+	return ( 0 == inFilter->passCount ) ? inFilter->nominalNanos : (UInt64)( inFilter->periodFixed >> kDBDMATimeStampFractionBits );
+}
+
+//	For passes whose interrupts were lost while the channel was restarted in place; the
+//	loop stays locked and expects the next wrap where those passes put it.
+static inline void DBDMATimeStampFilterSkip ( DBDMATimeStampFilter * ioFilter, UInt32 inPasses ) {
+	if ( 0 != ioFilter->passCount ) {
+		ioFilter->nextNanos += inPasses * DBDMATimeStampFilterPeriod ( ioFilter );
+	}
+}
+
+#endif
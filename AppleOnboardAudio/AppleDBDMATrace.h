@@ -0,0 +1,116 @@
+/*
+ *  AppleDBDMATrace.h
+ *  AppleOnboardAudio
+ *
+ *  Binary trace ring for the engine's real time paths.  debugIOLog is far
+ *  too slow to leave on in the IOProc or the interrupt filter, so these
+ *  paths drop a fixed size entry, an event code, an uptime in nanoseconds
+ *  and three arguments, into a ring that the user client drains.
+ *
+ *  Writers come from the primary interrupt, both IOProcs and the work
+ *  loop at once.  Each takes the next slot with one atomic increment and
+ *  never waits on anything else; the slot's sequence is cleared while the
+ *  entry is written and set to the slot number plus one when it is done.
+ *  The ring does not stop for a slow reader.  The one reader keeps its
+ *  own read index, and an entry a writer has come round and overwritten
+ *  is counted lost rather than read torn.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __APPLEDBDMATRACE__
+#define __APPLEDBDMATRACE__
+
+#include <libkern/OSTypes.h>
+#include <libkern/OSAtomic.h>
+
+#define kDBDMATraceEntries				512			/*	a power of two											*/
+#define kDBDMATraceDrainEntries			120			/*	as many as fit in one user client transfer				*/
+
+#if defined ( __ppc__ )
+#define DBDMATraceBarrier()				__asm__ __volatile__ ( "sync" : : : "memory" )
+#else
+#define DBDMATraceBarrier()				__sync_synchronize ()
+#endif
+
+typedef enum {
+	kDBDMATraceClip					= 1,		//	first frame, frames, ns in clipOutputSamples
+	kDBDMATraceConvert,							//	first frame, frames, ns in convertInputSamples
+	kDBDMATraceInterrupt,						//	output status, input status, interrupt count before this one
+	kDBDMATraceRestart,							//	1 if in place, result, interrupt count
+	kDBDMATraceiSubRate,						//	adaptive rate, distance to the iSub's read head, target lead
+	kDBDMATraceiSubSync,						//	first frame, current frame, new iSub buffer offset
+	kDBDMATracePower,							//	requested state, state reached, result
+	kDBDMATraceDeadline							//	first frame of a late clip, DMA frame, margin
+} DBDMATraceEvent;
+
+typedef struct {
+	volatile UInt32		sequence;				//	slot number + 1 once written, 0 while being written
+	UInt32				event;
+	UInt64				nanos;					//	uptime
+	UInt32				arg[4];
+} DBDMATraceEntry;
+
+typedef struct {
+	volatile UInt32		next;					//	slots handed out so far
+	DBDMATraceEntry		entries[kDBDMATraceEntries];
+} DBDMATraceRing;
+
+//	Any context, including the primary interrupt.
+static inline void DBDMATraceRecord ( DBDMATraceRing * ioRing, UInt32 inEvent, UInt64 inNanos, UInt32 inArg0, UInt32 inArg1, UInt32 inArg2 ) {
+	UInt32				slot;
+	DBDMATraceEntry *	entry;
+
+	slot = (UInt32)OSIncrementAtomic ( (volatile SInt32 *)&ioRing->next );
+	entry = &ioRing->entries[slot & ( kDBDMATraceEntries - 1 )];
+	entry->sequence = 0;
+	DBDMATraceBarrier ();
+	entry->event = inEvent;
+	entry->nanos = inNanos;
+	entry->arg[0] = inArg0;
+	entry->arg[1] = inArg1;
+	entry->arg[2] = inArg2;
+	entry->arg[3] = 0;
+	DBDMATraceBarrier ();
+	entry->sequence = slot + 1;
+}
+
+//	Reader only.  Copies out up to inMaxEntries in order from *ioReadSlot and moves it on; stops early
+//	at an entry that is still being written, which the next drain picks up.
+static inline UInt32 DBDMATraceDrain ( DBDMATraceRing * inRing, UInt32 * ioReadSlot, DBDMATraceEntry * outEntries, UInt32 inMaxEntries, UInt32 * outLost ) {
+	DBDMATraceEntry *	entry;
+	UInt32				next;
+	UInt32				sequence;
+	UInt32				count;
+
+	count = 0;
+	*outLost = 0;
+	next = inRing->next;
+	DBDMATraceBarrier ();
+	if ( next - *ioReadSlot > kDBDMATraceEntries ) {
+		*outLost = next - kDBDMATraceEntries - *ioReadSlot;
+		*ioReadSlot = next - kDBDMATraceEntries;
+	}
+	while ( count < inMaxEntries && *ioReadSlot != next ) {
+		entry = &inRing->entries[*ioReadSlot & ( kDBDMATraceEntries - 1 )];
+		sequence = entry->sequence;
+		DBDMATraceBarrier ();
+		outEntries[count] = *(DBDMATraceEntry *)entry;
+		DBDMATraceBarrier ();
+		if ( sequence == *ioReadSlot + 1 && sequence == entry->sequence ) {
+			count++;
+		} else if ( 0 != sequence && (SInt32)( sequence - ( *ioReadSlot + 1 ) ) < 0 ) {
+			//	the writer that took this slot has not finished with it yet
+			break;
+		} else if ( 0 == sequence && (SInt32)( inRing->next - *ioReadSlot ) <= (SInt32)kDBDMATraceEntries ) {
+			break;
+		} else {
+			( *outLost )++;
+		}
+		( *ioReadSlot )++;
+	}
+	return count;
+}
+
+#endif
@@ -1104,17 +1104,19 @@ void AppleOnboardAudio::protectedRunPolledTasks ( void ) {
 				//		do not attempt to change the clock source but do perform the configuration change helper object
 				//		so that the DMA engine is stopped and restarted (required to recover from a DBDMA dead status).
 				if ( mDriverDMAEngine->engineDied() ) {
-					debugIOLog ( 5, "  ** AppleOnboardAudio[%ld]::runPolledTasks invoking 'ConfigChangeHelper' to recover from 'DEAD' DMA", mInstanceIndex );
-					ConfigChangeHelper theConfigeChangeHelper(mDriverDMAEngine);	
-					if ( ( kTransportInterfaceType_I2S_Slave_Only != transportType ) && ( kTransportInterfaceType_I2S_Opaque_Slave_Only != transportType ) ) {
-						if ( kTRANSPORT_MASTER_CLOCK != mTransportInterface->transportGetClockSelect() ) {
-							UInt32 currentBitDepth = mTransportInterface->transportGetSampleWidth();
-							mTransportInterface->transportSetSampleWidth ( currentBitDepth, mTransportInterface->transportGetDMAWidth() );
-							callPluginsInOrder ( kSetSampleBitDepth, currentBitDepth );
-						}
-					}
+					recoverDeadDMA ( transportType );
 				}
 				//	} end	[3305011, 3514709]
+
+				//	A low latency block size is changed, requested or backed off, only with the engine paused.
+				if ( mDriverDMAEngine->blockSizeChangeNeeded () ) {
+					debugIOLog ( 5, "  ** AppleOnboardAudio[%ld]::runPolledTasks invoking 'ConfigChangeHelper' to change the DMA block size", mInstanceIndex );
+					ConfigChangeHelper theConfigeChangeHelper(mDriverDMAEngine);
+					mDriverDMAEngine->applyBlockSize ();
+				}
+
+				mDriverDMAEngine->updateOutputDSP ();
+				mDriverDMAEngine->reportClipUnderruns ();
 			}
 			
 			//	Then give other objects requiring a poll to have an opportunity to execute.
@@ -1138,6 +1140,78 @@ void AppleOnboardAudio::protectedRunPolledTasks ( void ) {
 }
 
 
+//	--------------------------------------------------------------------------------
+//	[3305011, 3514709]	Stops and starts the DMA engine.  Anything but a slave only transport
+//	running from an external clock also has its sample width set again.  A channel that can
+//	be restarted in place is, which costs the HAL no break in its sample time; the engine
+//	refuses a second restart in place until the first has been seen to work.  Nothing is done
+//	while the IOProc is restarting the channel itself.
+void AppleOnboardAudio::recoverDeadDMA ( UInt32 transportType ) {
+	IOReturn		result;
+
+	if ( !mDriverDMAEngine->claimRestart () ) {
+		debugIOLog ( 5, "  ** AppleOnboardAudio[%ld]::recoverDeadDMA leaves the restart to the IOProc", mInstanceIndex );
+		goto Exit;
+	}
+	result = mDriverDMAEngine->restartDMAInPlace ();
+	if ( kIOReturnSuccess == result ) {
+		debugIOLog ( 5, "  ** AppleOnboardAudio[%ld]::recoverDeadDMA restarted the DMA in place", mInstanceIndex );
+	} else {
+		debugIOLog ( 5, "  ** AppleOnboardAudio[%ld]::recoverDeadDMA invoking 'ConfigChangeHelper' to recover from 'DEAD' DMA", mInstanceIndex );
+		mDriverDMAEngine->traceRestart ( FALSE, result );
+		ConfigChangeHelper theConfigeChangeHelper(mDriverDMAEngine);	
+		if ( ( kTransportInterfaceType_I2S_Slave_Only != transportType ) && ( kTransportInterfaceType_I2S_Opaque_Slave_Only != transportType ) ) {
+			if ( kTRANSPORT_MASTER_CLOCK != mTransportInterface->transportGetClockSelect() ) {
+				UInt32 currentBitDepth = mTransportInterface->transportGetSampleWidth();
+				mTransportInterface->transportSetSampleWidth ( currentBitDepth, mTransportInterface->transportGetDMAWidth() );
+				callPluginsInOrder ( kSetSampleBitDepth, currentBitDepth );
+			}
+		}
+	}
+	mDriverDMAEngine->releaseRestart ();
+Exit:
+	return;
+}
+
+
+//	--------------------------------------------------------------------------------
+//	The DMA engine's stall watchdog calls this from the work loop as soon as it finds the
+//	channel stopped, rather than leaving the silence to the next poll.  When a recovery cannot
+//	run now the stall stays pending in the engine and the poll recovers it instead.
+void AppleOnboardAudio::dmaEngineStalled ( void ) {
+	IOCommandGate *				cg;
+	
+	cg = getCommandGate ();
+	if ( 0 != cg ) {
+		cg->runAction ( runDMARecovery, (void*)0, (void*)0 );
+	}
+	return;
+}
+
+
+//	--------------------------------------------------------------------------------
+IOReturn AppleOnboardAudio::runDMARecovery (OSObject * owner, void * arg1, void * arg2, void * arg3, void * arg4) {
+	FailIf ( 0 == owner, Exit );
+	((AppleOnboardAudio*)owner)->protectedRecoverDMA ();
+Exit:
+	return kIOReturnSuccess;
+}
+
+
+//	--------------------------------------------------------------------------------
+//	Under the same conditions the poll checks before it looks at the DMA engine.
+void AppleOnboardAudio::protectedRecoverDMA ( void ) {
+	FailIf ( 0 == mDriverDMAEngine, Exit );
+	if ( ( kIOAudioDeviceActive == getPowerState () ) && ( 0 == mDelayPollAfterWakeFromSleep ) && !mClockSelectInProcessSemaphore && !mSampleRateSelectInProcessSemaphore ) {
+		if ( mDriverDMAEngine->engineDied() ) {
+			recoverDeadDMA ( mTransportInterface->transportGetTransportInterfaceType() );
+		}
+	}
+Exit:
+	return;
+}
+
+
 // --------------------------------------------------------------------------
 //	Returns a target output selection for the current detect states as
 //	follows:
@@ -3825,6 +3899,7 @@ IOReturn AppleOnboardAudio::configureDMAEngines(IOService *provider) {
 	OSArray *						formatsArray;
 	OSArray *						inputListArray;
 	OSArray *						outputListArray;
+	OSNumber *						blockFramesNumber;
     
     result = kIOReturnError;
 
@@ -3848,6 +3923,12 @@ IOReturn AppleOnboardAudio::configureDMAEngines(IOService *provider) {
 		mDriverDMAEngine = 0;
         goto Exit;
     }
+
+	//	A layout may start in low latency mode; the first poll builds the program for it.
+	blockFramesNumber = OSDynamicCast (OSNumber, getLayoutEntry (kDMABlockFrames, this));
+	if (0 != blockFramesNumber) {
+		FailMessage (kIOReturnSuccess != mDriverDMAEngine->requestBlockFrames (blockFramesNumber->unsigned32BitValue ()));
+	}
    
 	result = kIOReturnSuccess;
 
@@ -4493,6 +4574,7 @@ void AppleOnboardAudio::setSoftwareOutputDSP (const char * inSelectedOutput) {
 	OSDictionary *						theSoftwareDSPDict;
 	OSString *							speakerIDString;
 	char								speakerIDCString[32];
+	bool								processingEnabled = false;
 	
 	if ( 0 == inSelectedOutput ) {
 		debugIOLog ( 3, "+ AppleOnboardAudio[%ld]::setSoftwareOutputDSP (%p).", mInstanceIndex, inSelectedOutput);
@@ -4508,6 +4590,7 @@ void AppleOnboardAudio::setSoftwareOutputDSP (const char * inSelectedOutput) {
 		debugIOLog ( 3, "  Enabling DSP");
 	
 		mDriverDMAEngine->enableOutputProcessing ();
+		processingEnabled = true;
 		
 		debugIOLog ( 3, "  mCurrentProcessingOutputString is '%s', coefficients not updated.", mCurrentProcessingOutputString->getCStringNoCopy ());
 	} else {
@@ -4538,6 +4621,7 @@ void AppleOnboardAudio::setSoftwareOutputDSP (const char * inSelectedOutput) {
 				debugIOLog ( 3, "  setSoftwareOutputDSP: theSoftwareDSPDict = %p", theSoftwareDSPDict);
 		
 				mDriverDMAEngine->setOutputSignalProcessing (theSoftwareDSPDict);
+				processingEnabled = true;
 				
 				debugIOLog ( 3, "  Processing set");
 				
@@ -4550,6 +4634,7 @@ void AppleOnboardAudio::setSoftwareOutputDSP (const char * inSelectedOutput) {
 	}	
 
 Exit:
+	planOutputEQ ( processingEnabled );
 	if ( 0 == inSelectedOutput ) {
 		debugIOLog ( 3, "- AppleOnboardAudio[%ld]::setSoftwareOutputDSP (%p).", mInstanceIndex, inSelectedOutput);
 	} else {
@@ -4558,6 +4643,36 @@ Exit:
 	return;
 }
 
+//  ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//	Splits the output EQ between the current codec's biquads and the software chain, so
+//	the host only runs the bands the codec has no room for.  Runs on every output or codec
+//	change.  The codec that last held bands is returned to flat when it is no longer the
+//	output, and the current one is flat whenever software processing is off.
+void AppleOnboardAudio::planOutputEQ (bool inProcessingEnabled) {
+	OSArray *							theCodecBands;
+	UInt32								numCodecSections;
+
+	theCodecBands = 0;
+	numCodecSections = 0;
+
+	if ( mOutputEQPlugin != mCurrentOutputPlugin ) {
+		if ( 0 != mOutputEQPlugin ) {
+			mOutputEQPlugin->setEQProcessing ( 0, FALSE );
+		}
+		mOutputEQPlugin = mCurrentOutputPlugin;
+	}
+	FailIf ( 0 == mOutputEQPlugin, Exit );
+
+	if ( inProcessingEnabled ) {
+		numCodecSections = mOutputEQPlugin->getNumOutputBiquads ();
+		theCodecBands = mDriverDMAEngine->planOutputEQ ( numCodecSections );
+	}
+	mOutputEQPlugin->setEQProcessing ( theCodecBands, FALSE );
+Exit:
+	debugIOLog ( 3, " AppleOnboardAudio[%ld]::planOutputEQ (%d), %ld codec sections, codec bands %p", mInstanceIndex, inProcessingEnabled, numCodecSections, theCodecBands );
+	return;
+}
+
 //  ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // [3306305]
 void AppleOnboardAudio::setSoftwareInputDSP (const char * inSelectedInput) {
@@ -4681,6 +4796,10 @@ UInt32 AppleOnboardAudio::setClipRoutineForOutput (const char * inSelectedOutput
 
 		if (clipRoutineString->isEqualTo (kStereoToRightChanClipString)) {
 			mDriverDMAEngine->setRightChanMixed (true);
+		} else if (clipRoutineString->isEqualTo (kDelayRightChan1SampleClipString)) {
+			mDriverDMAEngine->setRightChanDelay (true);
+		} else if (clipRoutineString->isEqualTo (kDelayLeftChan1SampleClipString)) {
+			mDriverDMAEngine->setLeftChanDelay (true);
 		} else {
 			mDriverDMAEngine->resetOutputClipOptions();
 		}
@@ -4732,6 +4851,8 @@ UInt32 AppleOnboardAudio::setClipRoutineForInput (const char * inSelectedInput)
 			mDriverDMAEngine->setDualMonoMode (e_Mode_CopyLeftToRight);
 		} else if (clipRoutineString->isEqualTo (kCopyRightToLeft)) {
 			mDriverDMAEngine->setDualMonoMode (e_Mode_CopyRightToLeft);
+		} else if (clipRoutineString->isEqualTo (kDelayRightChan1SampleClipString)) {
+			mDriverDMAEngine->setRightChanDelayInput (true);						//	[3173869]
 		}
 	}	
 
@@ -5887,6 +6008,7 @@ IOReturn AppleOnboardAudio::volumeLeftChange (SInt32 newValue, bool ignoreMuteSt
 	}
 
 	mVolLeft = newValue;
+	updateOutputVolumeDecibels ();
 
 	debugIOLog ( 3, "- AppleOnboardAudio[%ld]::volumeLeftChange ( %ld, %d )", mInstanceIndex, newValue, ignoreMuteState);
 	return kIOReturnSuccess;
@@ -5940,12 +6062,49 @@ IOReturn AppleOnboardAudio::volumeRightChange (SInt32 newValue, bool ignoreMuteS
 	}
 
 	mVolRight = newValue;
+	updateOutputVolumeDecibels ();
 
 	debugIOLog ( 3, "- AppleOnboardAudio[%ld]::volumeRightChange ( %ld, %d )", mInstanceIndex, newValue, ignoreMuteState);
 	return kIOReturnSuccess;
 }
 
 
+//  ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//	The software loudness stage needs the listening level in dB.  The published control maps its
+//	range linearly onto its dB range, and the louder side sets the level so balance does not
+//	change the tone.
+void AppleOnboardAudio::updateOutputVolumeDecibels (void) {
+	IOAudioLevelControl *				theControl;
+	SInt32								volume;
+	SInt32								range;
+	IOFixed								volumedB;
+
+	FailIf (0 == mDriverDMAEngine, Exit);
+
+	theControl = mOutMasterVolumeControl;
+	if (0 == theControl) {
+		theControl = (0 != mOutLeftVolumeControl) ? mOutLeftVolumeControl : mOutRightVolumeControl;
+	}
+	if (0 == theControl) {
+		goto Exit;
+	}
+	range = theControl->getMaxValue () - theControl->getMinValue ();
+	if (range <= 0) {
+		goto Exit;
+	}
+	volume = (mVolLeft > mVolRight) ? mVolLeft : mVolRight;
+	if (volume < theControl->getMinValue ()) {
+		volume = theControl->getMinValue ();
+	} else if (volume > theControl->getMaxValue ()) {
+		volume = theControl->getMaxValue ();
+	}
+	volumedB = theControl->getMinDB () + (IOFixed)(((SInt64)(theControl->getMaxDB () - theControl->getMinDB ()) * (volume - theControl->getMinValue ())) / range);
+	mDriverDMAEngine->setOutputVolumeDecibels (volumedB);
+Exit:
+	return;
+}
+
+
 //  ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 IOReturn AppleOnboardAudio::selectCodecOutputWithMuteState ( SInt32 newValue ) {
 	UInt32			comboOutJackTypeState;
@@ -6811,6 +6970,9 @@ Exit:
 	
 	protectedCompletePowerStateChange ();
 	acknowledgeSetPowerState ();				//	[3931723]
+	if ( 0 != mDriverDMAEngine ) {
+		mDriverDMAEngine->trace ( kDBDMATracePower, (UInt32)newPowerState, getPowerState (), result );
+	}
 	
 	debugIOLog ( 6, "  AOA[%ld] getPowerState () = %d, pendingPowerState = %d", mInstanceIndex, getPowerState (), pendingPowerState );
 	debugIOLog ( 6, "- AppleOnboardAudio[%ld]::performPowerStateAction ( %p, %p, %d, %d, %d ) returns 0x%X", mInstanceIndex, owner, newPowerState, arg2, arg3, arg4, result );
@@ -7626,6 +7788,12 @@ IOReturn AppleOnboardAudio::getDMAStateAndFormat ( UInt32 arg2, void * outState
 		case kGetDMAOutputChannelCommands1:	result = mDriverDMAEngine->copyOutputChannelCommands1 ( outState );							break;
 		case kGetInputChannelRegisters:		result = mDriverDMAEngine->copyInputChannelRegisters ( outState );							break;
 		case kGetOutputChannelRegisters:	result = mDriverDMAEngine->copyOutputChannelRegisters ( outState );							break;
+		case kGetDMABlockState:				result = mDriverDMAEngine->copyBlockState ( (DBDMABlockUserClientStructPtr)outState );		break;
+		case kGetDMATimeStampState:			result = mDriverDMAEngine->copyTimeStampState ( (DBDMATimeStampUserClientStructPtr)outState );	break;
+		case kGetDMAEraseState:				result = mDriverDMAEngine->copyEraseState ( (DBDMAEraseUserClientStructPtr)outState );		break;
+		case kGetDMAWatchdogState:			result = mDriverDMAEngine->copyWatchdogState ( (DBDMAWatchdogUserClientStructPtr)outState );	break;
+		case kGetDMATraceState:				result = mDriverDMAEngine->copyTrace ( (DBDMATraceUserClientStructPtr)outState );				break;
+		case kGetDMADeadlineState:			result = mDriverDMAEngine->copyDeadlineState ( (DBDMADeadlineUserClientStructPtr)outState );	break;
 		default:							result = kIOReturnBadArgument;																break;
 	}
 	return result;
@@ -7640,6 +7808,9 @@ IOReturn AppleOnboardAudio::setDMAStateAndFormat ( UInt32 arg2, void * inState )
 		case kSetInputChannelRegisters:		result = mDriverDMAEngine->setInputChannelRegisters ( inState );							break;
 		case kSetOutputChannelRegisters:	result = mDriverDMAEngine->setOutputChannelRegisters ( inState );							break;
 		case kSetDMAStateAndFormat:			result = mDriverDMAEngine->setDMAStateAndFormat ( (DBDMAUserClientStructPtr)inState );		break;
+		case kSetDMABlockState:				result = mDriverDMAEngine->setBlockState ( (DBDMABlockUserClientStructPtr)inState );			break;
+		case kSetDMAEraseState:				result = mDriverDMAEngine->setEraseState ( (DBDMAEraseUserClientStructPtr)inState );			break;
+		case kSetDMADeadlineState:			result = mDriverDMAEngine->setDeadlineState ( (DBDMADeadlineUserClientStructPtr)inState );	break;
 		default:							result = kIOReturnBadArgument;																break;
 	}
 	debugIOLog ( 5, "- AppleOnboardAudio[%ld]::setDMAStateAndFormat( %d, %p ) returns %lX", mInstanceIndex, arg2, inState, result );
@@ -7656,7 +7827,13 @@ IOReturn AppleOnboardAudio::getSoftwareProcessingState ( UInt32 arg2, void * out
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 IOReturn AppleOnboardAudio::getRealTimeCPUUsage ( UInt32 arg2, void * outState ) {
 #pragma unused ( arg2 )
-	return kIOReturnError;
+	IOReturn		result = kIOReturnError;
+
+	FailIf ( 0 == outState, Exit );
+	FailIf ( 0 == mDriverDMAEngine, Exit );
+	result = mDriverDMAEngine->copyIOProcTiming ( (DBDMAIOProcTimingUserClientStructPtr)outState );
+Exit:
+	return result;
 }
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -7762,6 +7939,19 @@ IOReturn AppleOnboardAudio::setSoftwareProcessingState ( UInt32 arg2, void * inS
 	return kIOReturnError;
 }
 
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//	Clears the IOProc stage histograms; there is nothing to write.
+IOReturn AppleOnboardAudio::setRealTimeCPUUsage ( UInt32 arg2, void * inState ) {
+#pragma unused ( arg2, inState )
+	IOReturn		result = kIOReturnError;
+
+	FailIf ( 0 == mDriverDMAEngine, Exit );
+	mDriverDMAEngine->clearIOProcTiming ();
+	result = kIOReturnSuccess;
+Exit:
+	return result;
+}
+
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 IOReturn AppleOnboardAudio::setAOAState ( UInt32 arg2, void * inState ) {
 #pragma unused ( arg2 )
@@ -180,6 +180,7 @@ typedef struct AOAStateUserClientStruct {
 #define kSleepsLayoutIDAOAInstance		"SleepsLayoutIDAOAInstance"		/*  [3515371]   */
 #define kUIMutesAmps					"UIMutesAmps"
 #define kMuteAmpWhenClockInterrupted    "MuteAmpWhenClockInterrupted"
+#define kDMABlockFrames					"DMABlockFrames"				/*	low latency mode: frames per DMA block, a power of two	*/
 #define kInputsBitmap					"InputsBitmap"
 #define kOutputsBitmap					"OutputsBitmap"
 #define kSuppressBootChimeLevelCtrl		"suppressBootChimeLevelControl" /*  [3730863]	*/
@@ -304,6 +305,7 @@ protected:
 	PlatformInterface *					mPlatformInterface;
 	TransportInterface *				mTransportInterface;
 	AudioHardwareObjectInterface *		mCurrentOutputPlugin;				
+	AudioHardwareObjectInterface *		mOutputEQPlugin;					//	codec last given output EQ bands
 	AudioHardwareObjectInterface *		mCurrentInputPlugin;				
 
 #ifdef THREAD_POWER_MANAGEMENT
@@ -448,6 +450,7 @@ public:
 	virtual IOReturn		volumeMasterChange (SInt32 newValue);
     virtual IOReturn		volumeLeftChange (SInt32 newValue, bool ignoreMuteState = FALSE);
     virtual IOReturn		volumeRightChange (SInt32 newValue, bool ignoreMuteState = FALSE);
+	virtual void			updateOutputVolumeDecibels (void);
 	virtual IOReturn		selectCodecOutputWithMuteState (SInt32 newValue);
     virtual IOReturn		gainLeftChanged (SInt32 newValue);
     virtual IOReturn		gainRightChanged (SInt32 newValue);
@@ -505,6 +508,7 @@ public:
 	virtual IOReturn		formatChangeRequest (const IOAudioStreamFormat * inFormat, const IOAudioSampleRate * inRate);
 	virtual	UInt32			getCurrentSampleFrame (void);
 	virtual void			setCurrentSampleFrame (UInt32 value);
+			void			dmaEngineStalled ( void );
 			UInt32 			getNumHardwareEQBandsForCurrentOutput ();
 	AudioHardwareObjectInterface * getCurrentOutputPlugin () { return mCurrentOutputPlugin; };
 	//	
@@ -523,6 +527,7 @@ public:
 	IOReturn 				setPluginState ( HardwarePluginType arg2, void * inState );
 	IOReturn 				setDMAState ( UInt32 arg2, void * inState );
 	IOReturn 				setSoftwareProcessingState ( UInt32 arg2, void * inState );
+	IOReturn				setRealTimeCPUUsage ( UInt32 arg2, void * inState );
 	IOReturn				setAOAState ( UInt32 arg2, void * inState );
 	IOReturn				setTransportInterfaceState ( UInt32 arg2, void * inState );
 	
@@ -572,6 +577,7 @@ protected:
 
 	void				setSoftwareOutputDSP (const char * inSelectedOutput);
 	void				setSoftwareInputDSP (const char * inSelectedInput);
+	void				planOutputEQ (bool inProcessingEnabled);
 
 	UInt32				getMaxVolumeOffsetForOutput (const UInt32 inCode);
 	UInt32				getMaxVolumeOffsetForOutput (const char * inSelectedOutput);
@@ -625,6 +631,9 @@ protected:
 
 	static IOReturn		runPolledTasks (OSObject * owner, void * arg1, void * arg2, void * arg3, void * arg4);
 	void				protectedRunPolledTasks ( void );
+	void				recoverDeadDMA ( UInt32 transportType );
+	static IOReturn		runDMARecovery (OSObject * owner, void * arg1, void * arg2, void * arg3, void * arg4);
+	void				protectedRecoverDMA ( void );
 	bool				isTargetForMessage ( UInt32 index, AppleOnboardAudio * theAOA );
 	virtual AppleOnboardAudio* findAOAInstanceWithLayoutID ( UInt32 layoutID );				//	[3515371]	rbm		19 Dec 2003
 	UInt32				mUsesAOAPowerManagement;											//	[3515371]	rbm		26 May 2004
@@ -223,6 +223,9 @@ IOReturn AppleOnboardAudioUserClient::setState (UInt32 selector, UInt32 arg2, vo
 			case kSoftwareProcessingSelector:
 				err = mDriver->setSoftwareProcessingState ( arg2, inState );
 				break;
+			case kRealTimeCPUUsage:
+				err = mDriver->setRealTimeCPUUsage ( arg2, inState );
+				break;
 			case kAppleOnboardAudioSelector:
 				err = mDriver->setAOAState ( arg2, inState );
 				break;
@@ -92,6 +92,10 @@ void AppleTAS3004Audio::free()
 {
 	debugIOLog (3, "+ AppleTAS3004Audio::free");
 
+	if ( 0 != mEQBands ) {
+		mEQBands->release ();
+		mEQBands = 0;
+	}
 	super::free();
 
 	debugIOLog (3, "- AppleTAS3004Audio::free");
@@ -555,6 +559,12 @@ IOReturn	AppleTAS3004Audio::setSampleRate ( UInt32 sampleRate ) {
 	debugIOLog (5,  "+ AppleTAS3004Audio:: setSampleRate ( %d )", (unsigned int) sampleRate );
 	if ( ( kMinimumTAS3004SampleRate <= sampleRate ) && ( kMaximumTAS3004SampleRate >= sampleRate ) ) {
 		CODEC_Initialize();
+		if ( sampleRate != mEQPref.filterSampleRate ) {
+			mEQPref.filterSampleRate = sampleRate;
+			if ( 0 != mEQBands ) {
+				loadCustomEQ ();
+			}
+		}
 		result = kIOReturnSuccess;
 	}
 	debugIOLog (5,  "- AppleTAS3004Audio:: setSampleRate ( %d ) returns %lX", (unsigned int) sampleRate, result );
@@ -1298,10 +1308,53 @@ void AppleTAS3004Audio::setDRCProcessing (void * inDRCStructure, Boolean inRealt
 }
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//	inEQStructure is the OSArray of band dictionaries the EQ offload planner chose for the
+//	codec, or NULL to return the codec to flat.  The array is kept so that a sample rate
+//	change can redesign the filters.
 void AppleTAS3004Audio::setEQProcessing (void * inEQStructure, Boolean inRealtime) {
+	OSArray *			theBands;
+
+	debugIOLog (3, "+ AppleTAS3004Audio::setEQProcessing (%p, %d)", inEQStructure, inRealtime);
+
+	theBands = OSDynamicCast ( OSArray, (OSObject *)inEQStructure );
+	FailIf ( 0 != inEQStructure && 0 == theBands, Exit );
+	if ( 0 == theBands && 0 == mEQBands ) {
+		goto Exit;										//	already flat
+	}
+
+	if ( 0 != theBands ) {
+		theBands->retain ();
+	}
+	if ( 0 != mEQBands ) {
+		mEQBands->release ();
+	}
+	mEQBands = theBands;
+	loadCustomEQ ();
+Exit:
+	debugIOLog (3, "- AppleTAS3004Audio::setEQProcessing (%p, %d)", inEQStructure, inRealtime);
 	return;
 }
 
+//	While processing is disabled the biquads hold unity all pass coefficients and
+//	enableProcessing restores the standby set, so the new set is loaded after that.
+IOReturn AppleTAS3004Audio::loadCustomEQ ( void )
+{
+	IOReturn				err;
+
+	err = BuildCustomEQCoefficients ( mEQBands );
+	FailIf ( kIOReturnSuccess != err, Exit );
+
+	if ( mEQDisabled ) {
+		mEQPending = TRUE;
+	} else {
+		err = SndHWSetOutputBiquadGroup ( mEQPref.filterCount, mEQPref.filter[0].coefficient );
+		FailMessage ( kIOReturnSuccess != err );
+		mEQPending = FALSE;
+	}
+Exit:
+	return err;
+}
+
 IOReturn AppleTAS3004Audio::setBiquadCoefficients ( void * biquadCoefficients )
 {
 	IOReturn				err;
@@ -1320,8 +1373,41 @@ IOReturn AppleTAS3004Audio::setBiquadCoefficients ( void * biquadCoefficients )
 	return totalErr;
 }
 
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//	Builds mEQPref from an OSArray of band dictionaries in the same form the
+//	software equalizer reads, or flat sections for NULL.  Both channels get
+//	the same six designed sections; the 7th biquad keeps the [3280002] phase
+//	fix (identity on the left, one sample delay on the right, as
+//	disableProcessing loads it).  loadCustomEQ sends the result to the codec.
 IOReturn AppleTAS3004Audio::BuildCustomEQCoefficients ( void * inEQStructure ) 
 {
+	EQBandSpec			specs[kTAS3004MaxBiquadRefNum];
+	FourDotTwenty		designed[kTAS3004MaxBiquadRefNum * kNumberOfCoefficientsPerBiquad];
+	UInt32				numBands;
+	UInt32				sampleRate;
+	UInt32				section;
+	UInt32				index;
+
+	sampleRate = ( 0 != mEQPref.filterSampleRate ) ? mEQPref.filterSampleRate : 44100;
+	numBands = EQReadBandArray ( OSDynamicCast ( OSArray, (OSObject *)inEQStructure ), specs, kTAS3004MaxBiquadRefNum );
+	numBands = EQDesignCodecCascade ( specs, numBands, sampleRate, kTAS3004MaxBiquadRefNum, designed, 0 );
+	debugIOLog ( 3, "  AppleTAS3004Audio::BuildCustomEQCoefficients designed %ld bands at %ld Hz", numBands, sampleRate );
+
+	for ( section = 0; section < kTAS3004MaxBiquadRefNum; section++ ) {
+		for ( index = 0; index < kNumberOfCoefficientsPerBiquad; index++ ) {
+			mEQPref.filter[section].coefficient[index] = designed[section * kNumberOfCoefficientsPerBiquad + index];
+			mEQPref.filter[section + kTAS3004NumBiquads].coefficient[index] = designed[section * kNumberOfCoefficientsPerBiquad + index];
+		}
+	}
+	for ( index = 0; index < kNumberOfCoefficientsPerBiquad; index++ ) {
+		EQQuantizeFourDotTwenty ( 0.0f, &mEQPref.filter[kTAS3004MaxBiquadRefNum].coefficient[index] );
+		EQQuantizeFourDotTwenty ( 0.0f, &mEQPref.filter[kTAS3004MaxBiquadRefNum + kTAS3004NumBiquads].coefficient[index] );
+	}
+	EQQuantizeFourDotTwenty ( 1.0f, &mEQPref.filter[kTAS3004MaxBiquadRefNum].coefficient[0] );
+	EQQuantizeFourDotTwenty ( 1.0f, &mEQPref.filter[kTAS3004MaxBiquadRefNum + kTAS3004NumBiquads].coefficient[1] );
+
+	mEQPref.filterSampleRate = sampleRate;
+	mEQPref.filterCount = kTAS3004NumBiquads * kTAS3004MaxStreamCnt;
 	return kIOReturnSuccess;
 }
 
@@ -1492,6 +1578,9 @@ void AppleTAS3004Audio::enableProcessing (void) {
 	}
 
 	mEQDisabled = FALSE;
+	if ( mEQPending ) {
+		loadCustomEQ ();
+	}
 
 	debugIOLog (3,  "- AppleTAS3004Audio::enableEQ" );
 }
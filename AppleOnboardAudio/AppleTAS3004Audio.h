@@ -219,6 +219,7 @@ public:
     virtual IOReturn	setPlayThrough (bool playthroughstate);
 
 	virtual	void		setEQProcessing (void * inEQStructure, Boolean inRealtime);
+	virtual	UInt32		getNumOutputBiquads (void) { return kTAS3004MaxBiquadRefNum; }
 	virtual	void		setDRCProcessing (void * inDRCStructure, Boolean inRealtime);
 	virtual	void		disableProcessing (Boolean inRealtime);
 	virtual	void		enableProcessing (void);
@@ -263,6 +264,7 @@ private:
 	void				SetBiquadInfoToUnityAllPass (void);
 	void				SetUnityGainAllPass (void);
 	IOReturn			BuildCustomEQCoefficients ( void * eqPrefs );
+	IOReturn			loadCustomEQ ( void );
 	IOReturn			SndHWSetOutputBiquad( UInt32 streamID, UInt32 biquadRefNum, FourDotTwenty *biquadCoefficients );
 	IOReturn			SndHWSetOutputBiquadGroup( UInt32 biquadFilterCount, FourDotTwenty *biquadCoefficients );
 	IOReturn			SetOutputBiquadCoefficients (UInt32 streamID, UInt32 biquadRefNum, UInt8 *biquadCoefficients);
@@ -290,6 +292,8 @@ private:
 	};
 
 	EQPrefsElement		mEQPref;
+	OSArray *			mEQBands;				//	bands on the codec, 0 when flat
+	Boolean				mEQPending;				//	mEQPref built while processing was disabled
 
 };
 
@@ -83,6 +83,7 @@ public:
 	
 	virtual	void			setProcessing (UInt32 inEQIndex) {return;}
 	virtual	void			setEQProcessing (void * inEQStructure, Boolean inRealtime) {return;}
+	virtual	UInt32			getNumOutputBiquads (void) {return 0;}											//	per channel, for the EQ offload planner
 	virtual	void			setDRCProcessing (void * inDRCStructure, Boolean inRealtime) {return;}
 	virtual	void			disableProcessing (Boolean inRealtime) {return;}
 	virtual	void			enableProcessing (void) {return;}
@@ -0,0 +1,485 @@
+/*
+ *  DSP_Capture.cpp
+ *  AppleOnboardAudio
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#include "DSP_Capture.h"
+
+#include "AppleDBDMAFloatLib.h"
+
+#define super DSP_Processor
+
+OSDefineMetaClassAndStructors ( DSP_Capture, DSP_Processor )
+
+static const float kCaptureInt16Scale			= 1.0f / 32768.0f;
+static const float kCaptureInt32Scale			= 1.0f / 2147483648.0f;
+static const float kCaptureAGCCeiling			= 0.7f;			//	peak the AGC will not push a block beyond
+static const float kCaptureAGCSilence			= 1.0e-9f;		//	mean square under which the level is not trusted
+static const UInt32 kCaptureAGCLevelMilliseconds	= 300;
+
+//	Defaults for entries that are present but incomplete
+#define kCaptureDefaultGateThreshold	-50
+#define kCaptureDefaultGateFloor		-20
+#define kCaptureDefaultGateHold			150
+#define kCaptureDefaultGateAttack		2
+#define kCaptureDefaultGateRelease		150
+#define kCaptureDefaultAGCTarget		-20
+#define kCaptureDefaultAGCMaxGain		18
+#define kCaptureDefaultAGCMinGain		-6
+#define kCaptureDefaultAGCAttack		50
+#define kCaptureDefaultAGCRelease		2000
+#define kCaptureMaxMilliseconds			10000
+
+#pragma mark ------------------------
+#pragma mark --- Construction
+#pragma mark ------------------------
+
+DSP_Capture * DSP_Capture::create ( UInt32 inNumChannels ) {
+	DSP_Capture *			result;
+
+	result = new DSP_Capture;
+	if ( 0 != result ) {
+		if ( !result->init ( inNumChannels ) ) {
+			result->release ();
+			result = 0;
+		}
+	}
+	return result;
+}
+
+bool DSP_Capture::init ( UInt32 inNumChannels ) {
+	UInt32					channel;
+	bool					result = false;
+
+	FailIf ( 0 == inNumChannels || inNumChannels > kDSPMaxChannels, Exit );
+	FailIf ( !super::init ( inNumChannels ), Exit );
+
+	mUseHighPass = false;
+	mHighPassFrequency = (float)kCaptureDefaultHighPass;
+	mUseEqualizer = false;
+	mNumBandSpecs = 0;
+	mUseGate = false;
+	mUseAGC = false;
+	mEcho = 0;
+	mReferenceFrames = 0;
+
+	bzero ( &mParameters, sizeof ( mParameters ) );
+	DSPExchangeInit ( &mExchange );
+	design ();
+	mLive = mParameters;
+
+	for ( channel = 0; channel < kDSPMaxChannels; channel++ ) {
+		mScale[channel] = 1.0f;
+	}
+	bzero ( mHighPassState, sizeof ( mHighPassState ) );
+	bzero ( mBandState, sizeof ( mBandState ) );
+	mControlFrame = 0;
+	mBlockPeak = 0.0f;
+	mBlockPower = 0.0f;
+	mGateOpen = false;
+	mGateHoldRemaining = 0;
+	mGateGain = 1.0f;
+	mGateTarget = 1.0f;
+	mGateCoefficient = 0.0f;
+	mAGCLevel = 0.0f;
+	mAGCGain = 1.0f;
+	mAGCTarget = 1.0f;
+	mAGCStep = 0.0f;
+
+	result = true;
+Exit:
+	return result;
+}
+
+void DSP_Capture::free ( void ) {
+	if ( 0 != mEcho ) {
+		mEcho->release ();
+		mEcho = 0;
+	}
+	super::free ();
+}
+
+#pragma mark ------------------------
+#pragma mark --- Parameters
+#pragma mark ------------------------
+
+static UInt32 CaptureGetMilliseconds ( OSDictionary * inDictionary, const char * inKey, SInt32 inDefault ) {
+	SInt32					milliseconds;
+
+	milliseconds = DSPGetSInt32Parameter ( inDictionary, inKey, inDefault );
+	if ( milliseconds < 0 ) {
+		milliseconds = 0;
+	} else if ( milliseconds > kCaptureMaxMilliseconds ) {
+		milliseconds = kCaptureMaxMilliseconds;
+	}
+	return (UInt32)milliseconds;
+}
+
+void DSP_Capture::setParameters ( OSDictionary * inDictionary ) {
+	OSDictionary *			theEntry;
+	SInt32					frequency;
+	SInt32					blockFrames;
+
+	theEntry = OSDynamicCast ( OSDictionary, inDictionary->getObject ( kCaptureHighPassEntry ) );
+	mUseHighPass = ( 0 != theEntry ) && !DSPGetBoolParameter ( theEntry, kDSPProcessorBypass, false );
+	frequency = DSPGetSInt32Parameter ( theEntry, kCaptureFrequency, kCaptureDefaultHighPass );
+	if ( frequency < kCaptureDefaultHighPass ) {
+		frequency = kCaptureDefaultHighPass;
+	}
+	mHighPassFrequency = (float)frequency;
+
+	theEntry = OSDynamicCast ( OSDictionary, inDictionary->getObject ( kCaptureEqualizerEntry ) );
+	mUseEqualizer = ( 0 != theEntry ) && !DSPGetBoolParameter ( theEntry, kDSPProcessorBypass, false );
+	mNumBandSpecs = ( 0 == theEntry ) ? 0 : EQReadBandArray ( OSDynamicCast ( OSArray, theEntry->getObject ( kCaptureBands ) ), mBandSpecs, kCaptureMaxBands );
+
+	theEntry = OSDynamicCast ( OSDictionary, inDictionary->getObject ( kCaptureNoiseGateEntry ) );
+	mUseGate = ( 0 != theEntry ) && !DSPGetBoolParameter ( theEntry, kDSPProcessorBypass, false );
+	mGateThresholddB = DSPGetSInt32Parameter ( theEntry, kCaptureThresholdDecibels, kCaptureDefaultGateThreshold );
+	mGateFloordB = DSPGetSInt32Parameter ( theEntry, kCaptureFloorDecibels, kCaptureDefaultGateFloor );
+	mGateHoldMilliseconds = CaptureGetMilliseconds ( theEntry, kCaptureHoldMilliseconds, kCaptureDefaultGateHold );
+	mGateAttackMilliseconds = CaptureGetMilliseconds ( theEntry, kCaptureAttackMilliseconds, kCaptureDefaultGateAttack );
+	mGateReleaseMilliseconds = CaptureGetMilliseconds ( theEntry, kCaptureReleaseMilliseconds, kCaptureDefaultGateRelease );
+
+	theEntry = OSDynamicCast ( OSDictionary, inDictionary->getObject ( kCaptureAGCEntry ) );
+	mUseAGC = ( 0 != theEntry ) && !DSPGetBoolParameter ( theEntry, kDSPProcessorBypass, false );
+	mAGCTargetdB = DSPGetSInt32Parameter ( theEntry, kCaptureTargetDecibels, kCaptureDefaultAGCTarget );
+	mAGCMaxGaindB = DSPGetSInt32Parameter ( theEntry, kCaptureMaxGainDecibels, kCaptureDefaultAGCMaxGain );
+	mAGCMinGaindB = DSPGetSInt32Parameter ( theEntry, kCaptureMinGainDecibels, kCaptureDefaultAGCMinGain );
+	mAGCAttackMilliseconds = CaptureGetMilliseconds ( theEntry, kCaptureAttackMilliseconds, kCaptureDefaultAGCAttack );
+	mAGCReleaseMilliseconds = CaptureGetMilliseconds ( theEntry, kCaptureReleaseMilliseconds, kCaptureDefaultAGCRelease );
+	if ( mAGCMinGaindB > mAGCMaxGaindB ) {
+		mAGCMinGaindB = mAGCMaxGaindB;
+	}
+
+	//	The canceller is allocated the first time it is asked for and kept; its block size and
+	//	reference ring cannot change under a running IOProc.
+	theEntry = OSDynamicCast ( OSDictionary, inDictionary->getObject ( kEchoCancellerEntry ) );
+	if ( 0 != theEntry && DSPGetBoolParameter ( theEntry, kDSPProcessorBypass, false ) ) {
+		theEntry = 0;
+	}
+	blockFrames = DSPGetSInt32Parameter ( theEntry, kEchoBlockFrames, kEchoDefaultBlockFrames );
+	if ( 0 != theEntry && 0 == mEcho ) {
+		mEcho = DSP_EchoCanceller::create ( mNumChannels, (UInt32)blockFrames, mReferenceFrames );
+		if ( 0 == mEcho ) {
+			debugIOLog ( 1, "  DSP_Capture::setParameters no echo canceller for %ld frame blocks and a %ld frame buffer", blockFrames, mReferenceFrames );
+		}
+	}
+	if ( 0 != mEcho ) {
+		if ( 0 != theEntry && ( mEcho->getReferenceFrames () != mReferenceFrames || mEcho->getBlockFrames () != (UInt32)blockFrames ) ) {
+			debugIOLog ( 1, "  DSP_Capture::setParameters echo canceller was built for %ld frame blocks and a %ld frame buffer, now off", mEcho->getBlockFrames (), mEcho->getReferenceFrames () );
+			theEntry = 0;
+		}
+		mEcho->setSampleRate ( mSampleRate );
+		mEcho->setParameters ( theEntry );
+	}
+
+	design ();
+	publishParameters ();
+
+	debugIOLog ( 3, "  DSP_Capture::setParameters high pass %d (%ld Hz), %ld bands, gate %d (%ld dB), agc %d (%ld dB), echo %d, active %d", mUseHighPass, frequency, mParameters.numBands, mUseGate, mGateThresholddB, mUseAGC, mAGCTargetdB, mParameters.useEcho, mParameters.active );
+}
+
+void DSP_Capture::setSampleRate ( UInt32 inSampleRate ) {
+	super::setSampleRate ( inSampleRate );
+	if ( 0 != mEcho ) {
+		mEcho->setSampleRate ( inSampleRate );
+	}
+	design ();
+	publishParameters ();
+}
+
+//	The filters and detectors belong to the IOProc; they are cleared when the new count arrives.
+void DSP_Capture::reset ( void ) {
+	if ( 0 != mEcho ) {
+		mEcho->reset ();
+	}
+	mParameters.resetCount++;
+	publishParameters ();
+}
+
+UInt32 DSP_Capture::getLatency ( void ) {
+	return mParameters.useEcho ? mEcho->getLatency () : 0;
+}
+
+void DSP_Capture::publishParameters ( void ) {
+	mParameterSlots[mExchange.writeSlot] = mParameters;
+	DSPExchangePublish ( &mExchange );
+}
+
+//	One pole smoothing coefficient reaching 63% in inMilliseconds when applied every inPeriodFrames frames.
+static float CaptureCoefficient ( UInt32 inMilliseconds, UInt32 inPeriodFrames, UInt32 inSampleRate ) {
+	float					periods;
+
+	periods = (float)inMilliseconds * (float)inSampleRate / ( 1000.0f * (float)inPeriodFrames );
+	if ( periods <= 1.0f ) {
+		return 1.0f;
+	}
+	return 1.0f - dspExp ( -1.0f / periods );
+}
+
+static float CaptureDecibelsToGain ( SInt32 inDecibels ) {
+	return dspPow ( 10.0f, (float)inDecibels / 20.0f );
+}
+
+void DSP_Capture::design ( void ) {
+	EQBandSpec				highPassSpec;
+	UInt32					index;
+
+	mParameters.useEcho = ( 0 != mEcho ) && mEcho->isActive ();
+	mParameters.active = mUseHighPass || ( mUseEqualizer && 0 != mNumBandSpecs ) || mUseGate || mUseAGC || mParameters.useEcho;
+
+	//	any active chain takes the DC out, even when no corner is given
+	highPassSpec.type = kEQHighPass;
+	highPassSpec.frequency = mUseHighPass ? mHighPassFrequency : (float)kCaptureDefaultHighPass;
+	highPassSpec.q = (float)kEQDefaultCentiQ / 100.0f;
+	highPassSpec.gaindB = 0.0f;
+	EQDesignBiquad ( &highPassSpec, mSampleRate, &mParameters.highPass );
+
+	mParameters.numBands = mUseEqualizer ? mNumBandSpecs : 0;
+	for ( index = 0; index < mParameters.numBands; index++ ) {
+		EQDesignBiquad ( &mBandSpecs[index], mSampleRate, &mParameters.band[index] );
+	}
+
+	mParameters.useGate = mUseGate;
+	mParameters.gateOpenLevel = CaptureDecibelsToGain ( mGateThresholddB );
+	mParameters.gateCloseLevel = CaptureDecibelsToGain ( mGateThresholddB - kCaptureGateHysteresisDecibels );
+	mParameters.gateFloor = CaptureDecibelsToGain ( mGateFloordB > 0 ? 0 : mGateFloordB );
+	mParameters.gateHoldBlocks = ( mGateHoldMilliseconds * mSampleRate ) / ( 1000 * kCaptureControlFrames );
+	mParameters.gateAttack = CaptureCoefficient ( mGateAttackMilliseconds, 1, mSampleRate );
+	mParameters.gateRelease = CaptureCoefficient ( mGateReleaseMilliseconds, 1, mSampleRate );
+
+	//	the level is a mean square, so the target is squared too
+	mParameters.useAGC = mUseAGC;
+	mParameters.agcTargetPower = CaptureDecibelsToGain ( mAGCTargetdB );
+	mParameters.agcTargetPower *= mParameters.agcTargetPower;
+	mParameters.agcMaxGain = CaptureDecibelsToGain ( mAGCMaxGaindB );
+	mParameters.agcMinGain = CaptureDecibelsToGain ( mAGCMinGaindB );
+	mParameters.agcLevelCoefficient = CaptureCoefficient ( kCaptureAGCLevelMilliseconds, kCaptureControlFrames, mSampleRate );
+	mParameters.agcAttack = CaptureCoefficient ( mAGCAttackMilliseconds, kCaptureControlFrames, mSampleRate );
+	mParameters.agcRelease = CaptureCoefficient ( mAGCReleaseMilliseconds, kCaptureControlFrames, mSampleRate );
+}
+
+#pragma mark ------------------------
+#pragma mark --- Processing
+#pragma mark ------------------------
+
+void DSP_Capture::acquireParameters ( void ) {
+	if ( !DSPExchangeAcquire ( &mExchange ) ) {
+		return;
+	}
+	if ( mParameterSlots[mExchange.readSlot].resetCount != mLive.resetCount ) {
+		bzero ( mHighPassState, sizeof ( mHighPassState ) );
+		bzero ( mBandState, sizeof ( mBandState ) );
+		mControlFrame = 0;
+		mBlockPeak = 0.0f;
+		mBlockPower = 0.0f;
+		mGateOpen = false;
+		mGateHoldRemaining = 0;
+		mGateGain = mParameterSlots[mExchange.readSlot].useGate ? mParameterSlots[mExchange.readSlot].gateFloor : 1.0f;
+		mAGCLevel = mParameterSlots[mExchange.readSlot].agcTargetPower;
+		mAGCGain = 1.0f;
+		mAGCTarget = 1.0f;
+		mAGCStep = 0.0f;
+	}
+	mLive = mParameterSlots[mExchange.readSlot];
+	if ( !mLive.useGate ) {
+		mGateTarget = 1.0f;
+		mGateCoefficient = mLive.gateAttack;
+	}
+	if ( !mLive.useAGC ) {
+		mAGCStep = ( 1.0f - mAGCGain ) / (float)kCaptureControlFrames;
+		mAGCTarget = 1.0f;
+	}
+}
+
+//	Called once every kCaptureControlFrames frames with the peak and energy of the
+//	block just filtered.  Sets the gate target and the AGC ramp for the next block.
+void DSP_Capture::updateControl ( void ) {
+	float					power;
+	float					desired;
+	UInt32					channel;
+	UInt32					band;
+
+	if ( mLive.useGate ) {
+		if ( mBlockPeak > mLive.gateOpenLevel ) {
+			mGateOpen = true;
+			mGateHoldRemaining = mLive.gateHoldBlocks;
+		} else if ( mGateOpen && mBlockPeak < mLive.gateCloseLevel ) {
+			if ( 0 != mGateHoldRemaining ) {
+				mGateHoldRemaining--;
+			} else {
+				mGateOpen = false;
+			}
+		}
+		mGateTarget = mGateOpen ? 1.0f : mLive.gateFloor;
+		mGateCoefficient = mGateOpen ? mLive.gateAttack : mLive.gateRelease;
+	}
+
+	mAGCGain = mAGCTarget;
+	if ( mLive.useAGC ) {
+		//	hold the level while the gate is closed so the AGC does not ride up on room noise
+		power = mBlockPower / (float)( kCaptureControlFrames * mNumChannels );
+		if ( !mLive.useGate || mGateOpen ) {
+			mAGCLevel += ( power - mAGCLevel ) * mLive.agcLevelCoefficient;
+		}
+
+		if ( mAGCLevel > kCaptureAGCSilence ) {
+			desired = dspSqrt ( mLive.agcTargetPower / mAGCLevel );
+			if ( desired > mLive.agcMaxGain ) {
+				desired = mLive.agcMaxGain;
+			} else if ( desired < mLive.agcMinGain ) {
+				desired = mLive.agcMinGain;
+			}
+			mAGCTarget += ( desired - mAGCTarget ) * ( ( desired < mAGCTarget ) ? mLive.agcAttack : mLive.agcRelease );
+		}
+		//	a transient the slow loop has not caught up with is pulled down straight away
+		if ( mBlockPeak * mAGCTarget > kCaptureAGCCeiling ) {
+			mAGCTarget = kCaptureAGCCeiling / mBlockPeak;
+			if ( mAGCTarget < mLive.agcMinGain ) {
+				mAGCTarget = mLive.agcMinGain;
+			}
+		}
+	} else {
+		mAGCTarget = 1.0f;
+	}
+	mAGCStep = ( mAGCTarget - mAGCGain ) / (float)kCaptureControlFrames;
+
+	mControlFrame = 0;
+	mBlockPeak = 0.0f;
+	mBlockPower = 0.0f;
+
+	for ( channel = 0; channel < mNumChannels; channel++ ) {
+		EQFlushDenormals ( &mHighPassState[channel] );
+		for ( band = 0; band < mLive.numBands; band++ ) {
+			EQFlushDenormals ( &mBandState[channel][band] );
+		}
+	}
+}
+
+inline void DSP_Capture::filterFrame ( float * ioFrame ) {
+	float					sample;
+	UInt32					channel;
+	UInt32					band;
+
+	for ( channel = 0; channel < mNumChannels; channel++ ) {
+		sample = EQBiquadProcess ( &mLive.highPass, &mHighPassState[channel], ioFrame[channel] );
+		for ( band = 0; band < mLive.numBands; band++ ) {
+			sample = EQBiquadProcess ( &mLive.band[band], &mBandState[channel][band], sample );
+		}
+		ioFrame[channel] = sample;
+	}
+}
+
+inline void DSP_Capture::levelFrame ( float * ioFrame ) {
+	float					sample;
+	float					magnitude;
+	float					gain;
+	UInt32					channel;
+
+	mGateGain += ( mGateTarget - mGateGain ) * mGateCoefficient;
+	mAGCGain += mAGCStep;
+	gain = mGateGain * mAGCGain;
+
+	for ( channel = 0; channel < mNumChannels; channel++ ) {
+		sample = ioFrame[channel];
+		magnitude = DSPAbs ( sample );
+		if ( magnitude > mBlockPeak ) {
+			mBlockPeak = magnitude;
+		}
+		mBlockPower += sample * sample;
+		ioFrame[channel] = sample * gain;
+	}
+
+	if ( ++mControlFrame == kCaptureControlFrames ) {
+		updateControl ();
+	}
+}
+
+//	The rest of the chain for frames that have been filtered already.  Without the canceller the
+//	frames are levelled as they are filtered and inFiltered means there is nothing left to do.
+void DSP_Capture::processFrames ( float * ioBuffer, UInt32 inFirstFrame, UInt32 inNumFrames, bool inFiltered ) {
+	UInt32					frame;
+
+	if ( !mLive.useEcho ) {
+		if ( !inFiltered ) {
+			for ( frame = 0; frame < inNumFrames; frame++ ) {
+				filterFrame ( &ioBuffer[frame * mNumChannels] );
+				levelFrame ( &ioBuffer[frame * mNumChannels] );
+			}
+		}
+		return;
+	}
+	if ( !inFiltered ) {
+		for ( frame = 0; frame < inNumFrames; frame++ ) {
+			filterFrame ( &ioBuffer[frame * mNumChannels] );
+		}
+	}
+	mEcho->process ( ioBuffer, inFirstFrame, inNumFrames );
+	for ( frame = 0; frame < inNumFrames; frame++ ) {
+		levelFrame ( &ioBuffer[frame * mNumChannels] );
+	}
+}
+
+void DSP_Capture::setScale ( float inFullScale, const float * inGainL, const float * inGainR ) {
+	mScale[0] = ( 0 == inGainL ) ? inFullScale : inFullScale * *inGainL;
+	mScale[1] = ( 0 == inGainR ) ? inFullScale : inFullScale * *inGainR;
+}
+
+void DSP_Capture::convertInt16 ( const SInt16 * inSource, float * outDest, UInt32 inFirstFrame, UInt32 inNumSamples, const float * inGainL, const float * inGainR, bool inCopyRightToLeft ) {
+	UInt32					leftOffset;
+	UInt32					channel;
+	UInt32					index;
+
+	acquireParameters ();
+	setScale ( kCaptureInt16Scale, inGainL, inGainR );
+	leftOffset = ( inCopyRightToLeft && 2 == mNumChannels ) ? 1 : 0;
+
+	for ( index = 0; index + mNumChannels <= inNumSamples; index += mNumChannels ) {
+		outDest[index] = (float)inSource[index + leftOffset] * mScale[0];
+		for ( channel = 1; channel < mNumChannels; channel++ ) {
+			outDest[index + channel] = (float)inSource[index + channel] * mScale[channel];
+		}
+		filterFrame ( &outDest[index] );
+		if ( !mLive.useEcho ) {
+			levelFrame ( &outDest[index] );
+		}
+	}
+	processFrames ( outDest, inFirstFrame, inNumSamples / mNumChannels, true );
+}
+
+void DSP_Capture::convertInt32 ( const SInt32 * inSource, float * outDest, UInt32 inFirstFrame, UInt32 inNumSamples, const float * inGainL, const float * inGainR ) {
+	UInt32					channel;
+	UInt32					index;
+
+	acquireParameters ();
+	setScale ( kCaptureInt32Scale, inGainL, inGainR );
+
+	for ( index = 0; index + mNumChannels <= inNumSamples; index += mNumChannels ) {
+		for ( channel = 0; channel < mNumChannels; channel++ ) {
+			outDest[index + channel] = (float)inSource[index + channel] * mScale[channel];
+		}
+		filterFrame ( &outDest[index] );
+		if ( !mLive.useEcho ) {
+			levelFrame ( &outDest[index] );
+		}
+	}
+	processFrames ( outDest, inFirstFrame, inNumSamples / mNumChannels, true );
+}
+
+//	Without a DMA buffer position the echo reference cannot be lined up; this entry point treats
+//	ioBuffer as starting at frame 0.
+void DSP_Capture::process ( float * ioBuffer, UInt32 inNumSamples ) {
+	acquireParameters ();
+	processFrames ( ioBuffer, 0, inNumSamples / mNumChannels, false );
+}
+
+//	Runs on the output IOProc.  mEcho is created once on the command gate before the flag that
+//	lets the reference through is set, and is not released while the engine runs.
+void DSP_Capture::writeEchoReference ( const float * inBuffer, UInt32 inFirstFrame, UInt32 inNumFrames, UInt32 inNumChannels ) {
+	if ( mParameters.useEcho ) {
+		mEcho->writeReference ( inBuffer, inFirstFrame, inNumFrames, inNumChannels );
+	}
+}
@@ -0,0 +1,176 @@
+/*
+ *  DSP_Capture.h
+ *  AppleOnboardAudio
+ *
+ *  Voice capture chain for the internal microphones:  high-pass (DC
+ *  removal at the least), a fixed equalizer, a noise gate and an automatic
+ *  gain control.  The layout selects the settings per microphone through
+ *  the 'MicrophoneID_n' entry that carries the input 'SoftwareDSP'
+ *  dictionary, so each microphone part gets its own correction curve.
+ *
+ *  The chain is run one frame at a time straight out of the native integer
+ *  input buffer, so each sample is converted, filtered and scaled while it
+ *  is in a register and the intermediate buffer is written once.  Level
+ *  detection accumulates per sample; the gate and gain decisions are made
+ *  every kCaptureControlFrames frames and the resulting gains are ramped
+ *  per sample.
+ *
+ *  With an 'EchoCanceller' entry the frames are filtered first, run through
+ *  DSP_EchoCanceller as a block, and then gated and levelled, so the gain
+ *  stages see the residual rather than the speaker echo.  The canceller
+ *  needs the DMA buffer length for its reference ring; setReferenceFrames
+ *  must be called before the dictionary that enables it.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSP_CAPTURE__
+#define __DSP_CAPTURE__
+
+#include "DSP_Processor.h"
+#include "DSP_Equalizer.h"
+#include "DSP_EchoCanceller.h"
+
+//	Input 'SoftwareDSP' dictionary entries.  Each is a dictionary and any of
+//	them may carry 'Bypass'; the chain runs when at least one is present.
+#define kCaptureEntry					"Capture"
+#define kCaptureHighPassEntry			"HighPass"
+#define kCaptureEqualizerEntry			"Equalizer"
+#define kCaptureNoiseGateEntry			"NoiseGate"
+#define kCaptureAGCEntry				"AutomaticGainControl"
+
+#define kCaptureFrequency				"Frequency"				/*	HighPass corner, Hz									*/
+#define kCaptureBands					"Bands"					/*	Equalizer array of band dictionaries				*/
+#define kCaptureThresholdDecibels		"ThresholdDecibels"		/*	NoiseGate opening peak level, dBFS					*/
+#define kCaptureFloorDecibels			"FloorDecibels"			/*	NoiseGate gain while closed							*/
+#define kCaptureHoldMilliseconds		"HoldMilliseconds"
+#define kCaptureAttackMilliseconds		"AttackMilliseconds"
+#define kCaptureReleaseMilliseconds		"ReleaseMilliseconds"
+#define kCaptureTargetDecibels			"TargetDecibels"		/*	AGC target RMS level, dBFS							*/
+#define kCaptureMaxGainDecibels			"MaxGainDecibels"
+#define kCaptureMinGainDecibels			"MinGainDecibels"
+
+#define kCaptureMaxBands				6
+#define kCaptureControlFrames			32
+#define kCaptureDefaultHighPass			20						/*	Hz, DC removal only									*/
+#define kCaptureGateHysteresisDecibels	6
+
+typedef struct {
+	EQBiquad				highPass;
+	EQBiquad				band[kCaptureMaxBands];
+	UInt32					numBands;
+
+	bool					useGate;
+	float					gateOpenLevel;				//	linear peak
+	float					gateCloseLevel;
+	float					gateFloor;					//	linear gain while closed
+	UInt32					gateHoldBlocks;				//	control blocks
+	float					gateAttack;					//	per sample smoothing coefficients
+	float					gateRelease;
+
+	bool					useAGC;
+	float					agcTargetPower;
+	float					agcMaxGain;
+	float					agcMinGain;
+	float					agcLevelCoefficient;		//	per control block
+	float					agcAttack;					//	per control block, gain falling
+	float					agcRelease;					//	per control block, gain rising
+
+	bool					useEcho;
+
+	bool					active;
+	UInt32					resetCount;					//	a change clears the filters and detectors
+} CaptureParameters;
+
+class DSP_Capture : public DSP_Processor {
+
+    OSDeclareDefaultStructors ( DSP_Capture );
+
+public:
+
+	static DSP_Capture *	create ( UInt32 inNumChannels );
+
+	virtual bool			init ( UInt32 inNumChannels );
+	virtual void			free ( void );
+
+	virtual const char *	getStageName ( void ) { return kCaptureEntry; }
+
+	//	inDictionary is the whole input 'SoftwareDSP' dictionary
+	virtual void			setParameters ( OSDictionary * inDictionary );
+	virtual void			setSampleRate ( UInt32 inSampleRate );
+	virtual void			reset ( void );
+	void					setReferenceFrames ( UInt32 inReferenceFrames ) { mReferenceFrames = inReferenceFrames; }
+
+	virtual bool			isActive ( void ) { return mParameters.active; }
+	virtual UInt32			getLatency ( void );
+
+	virtual void			process ( float * ioBuffer, UInt32 inNumSamples );
+
+	//	Conversion from the native input format fused with the chain.  inFirstFrame is the
+	//	DMA buffer frame of inSource.  The gains are the software input gains (0 when not
+	//	in use); inCopyRightToLeft replaces the left channel with the right before any
+	//	processing.
+	void					convertInt16 ( const SInt16 * inSource, float * outDest, UInt32 inFirstFrame, UInt32 inNumSamples, const float * inGainL, const float * inGainR, bool inCopyRightToLeft );
+	void					convertInt32 ( const SInt32 * inSource, float * outDest, UInt32 inFirstFrame, UInt32 inNumSamples, const float * inGainL, const float * inGainR );
+
+	//	output IOProc:  the final output mix, as the echo reference
+	void					writeEchoReference ( const float * inBuffer, UInt32 inFirstFrame, UInt32 inNumFrames, UInt32 inNumChannels );
+
+protected:
+
+	void					design ( void );
+	void					publishParameters ( void );
+
+	void					acquireParameters ( void );
+	inline void				filterFrame ( float * ioFrame );
+	inline void				levelFrame ( float * ioFrame );
+	void					processFrames ( float * ioBuffer, UInt32 inFirstFrame, UInt32 inNumFrames, bool inFiltered );
+	void					updateControl ( void );
+	void					setScale ( float inFullScale, const float * inGainL, const float * inGainR );
+
+	//	command gate side, as read from the dictionary
+	bool					mUseHighPass;
+	float					mHighPassFrequency;
+	bool					mUseEqualizer;
+	EQBandSpec				mBandSpecs[kCaptureMaxBands];
+	UInt32					mNumBandSpecs;
+	bool					mUseGate;
+	SInt32					mGateThresholddB;
+	SInt32					mGateFloordB;
+	UInt32					mGateHoldMilliseconds;
+	UInt32					mGateAttackMilliseconds;
+	UInt32					mGateReleaseMilliseconds;
+	bool					mUseAGC;
+	SInt32					mAGCTargetdB;
+	SInt32					mAGCMaxGaindB;
+	SInt32					mAGCMinGaindB;
+	UInt32					mAGCAttackMilliseconds;
+	UInt32					mAGCReleaseMilliseconds;
+	DSP_EchoCanceller *		mEcho;
+	UInt32					mReferenceFrames;
+
+	CaptureParameters		mParameters;
+	CaptureParameters		mParameterSlots[kDSPExchangeSlots];
+	DSPExchange				mExchange;
+
+	//	IOProc side
+	CaptureParameters		mLive;
+	float					mScale[kDSPMaxChannels];
+	EQBiquadState			mHighPassState[kDSPMaxChannels];
+	EQBiquadState			mBandState[kDSPMaxChannels][kCaptureMaxBands];
+	UInt32					mControlFrame;
+	float					mBlockPeak;
+	float					mBlockPower;
+	bool					mGateOpen;
+	UInt32					mGateHoldRemaining;
+	float					mGateGain;
+	float					mGateTarget;
+	float					mGateCoefficient;
+	float					mAGCLevel;					//	smoothed mean square
+	float					mAGCGain;
+	float					mAGCTarget;
+	float					mAGCStep;
+};
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ *  DSP_Common.h
+ *  AppleOnboardAudio
+ *
+ *  Definitions shared by the software DSP stages.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSP_COMMON__
+#define __DSP_COMMON__
+
+#include <libkern/OSTypes.h>
+#include <libkern/OSAtomic.h>
+#include <libkern/c++/OSObject.h>
+#include <libkern/c++/OSDictionary.h>
+#include <libkern/c++/OSNumber.h>
+#include <libkern/c++/OSBoolean.h>
+#include <IOKit/IOLib.h>
+
+#include "AudioHardwareUtilities.h"
+
+//	The onboard I2S engines carry at most a stereo pair.  Stages that keep
+//	per channel state size their state arrays with this.
+#define kDSPMaxChannels					2
+
+//	Helpers for reading stage parameters out of the 'SoftwareDSP' dictionary.
+//	Kernel property lists only carry integers, so fractional parameters are
+//	expressed in scaled integer units by each stage.
+static inline SInt32 DSPGetSInt32Parameter ( OSDictionary * inDictionary, const char * inKey, SInt32 inDefault ) {
+	OSNumber *			theNumber;
+
+	theNumber = ( 0 == inDictionary ) ? 0 : OSDynamicCast ( OSNumber, inDictionary->getObject ( inKey ) );
+	return ( 0 == theNumber ) ? inDefault : (SInt32)theNumber->unsigned32BitValue ();
+}
+
+static inline bool DSPGetBoolParameter ( OSDictionary * inDictionary, const char * inKey, bool inDefault ) {
+	OSBoolean *			theBoolean;
+
+	theBoolean = ( 0 == inDictionary ) ? 0 : OSDynamicCast ( OSBoolean, inDictionary->getObject ( inKey ) );
+	return ( 0 == theBoolean ) ? inDefault : theBoolean->getValue ();
+}
+
+static inline float DSPAbs ( float inValue ) {
+	return ( inValue < 0.0f ) ? -inValue : inValue;
+}
+
+//	Four independent sums keep the adds from waiting on one another; a single
+//	running sum leaves the FPU idle for most of each add's latency.
+static inline float DSPDotProduct ( const float * inA, const float * inB, UInt32 inLength ) {
+	float				sum0;
+	float				sum1;
+	float				sum2;
+	float				sum3;
+	UInt32				index;
+
+	sum0 = 0.0f;
+	sum1 = 0.0f;
+	sum2 = 0.0f;
+	sum3 = 0.0f;
+	for ( index = 0; index + 3 < inLength; index += 4 ) {
+		sum0 += inA[index] * inB[index];
+		sum1 += inA[index + 1] * inB[index + 1];
+		sum2 += inA[index + 2] * inB[index + 2];
+		sum3 += inA[index + 3] * inB[index + 3];
+	}
+	for ( ; index < inLength; index++ ) {
+		sum0 += inA[index] * inB[index];
+	}
+	return ( sum0 + sum1 ) + ( sum2 + sum3 );
+}
+
+//	Three slot parameter exchange between the command gate, which is the only
+//	writer, and the IOProc, which is the only reader.  The writer fills the
+//	slot it owns and swaps it into the shared middle position.  At the top of
+//	a block the reader swaps the middle slot for its own, but only when the
+//	writer has published since the last swap.  Neither side waits on the
+//	other and the reader never looks at a slot that is being written.
+//
+//	A stage keeps kDSPExchangeSlots copies of its parameter set and indexes
+//	them with writeSlot on the command gate and readSlot in process ().
+#define kDSPExchangeSlots				3
+#define kDSPExchangeSlotMask			0x00000003
+#define kDSPExchangeFresh				0x00000004			/*	set in shared when the middle slot has not been taken yet	*/
+
+typedef struct {
+	UInt32				shared;								//	index of the middle slot | kDSPExchangeFresh
+	UInt32				writeSlot;							//	owned by the command gate
+	UInt32				readSlot;							//	owned by the IOProc
+} DSPExchange;
+
+static inline void DSPExchangeInit ( DSPExchange * inExchange ) {
+	inExchange->writeSlot = 0;
+	inExchange->shared = 1;
+	inExchange->readSlot = 2;
+}
+
+//	The writer's slot must be completely filled in before this is called.
+static inline void DSPExchangePublish ( DSPExchange * inExchange ) {
+	UInt32				middle;
+
+	OSSynchronizeIO ();
+	do {
+		middle = *(volatile UInt32 *)&inExchange->shared;
+	} while ( !OSCompareAndSwap ( middle, inExchange->writeSlot | kDSPExchangeFresh, &inExchange->shared ) );
+	inExchange->writeSlot = middle & kDSPExchangeSlotMask;
+}
+
+//	True when the writer has published a set the reader has not taken.  Only
+//	the reader can clear this, so a true result holds until it acquires.
+static inline bool DSPExchangePending ( DSPExchange * inExchange ) {
+	return 0 != ( *(volatile UInt32 *)&inExchange->shared & kDSPExchangeFresh );
+}
+
+//	Returns true when readSlot now refers to a newly published set.
+static inline bool DSPExchangeAcquire ( DSPExchange * inExchange ) {
+	UInt32				middle;
+
+	do {
+		middle = *(volatile UInt32 *)&inExchange->shared;
+		if ( 0 == ( middle & kDSPExchangeFresh ) ) {
+			return false;
+		}
+	} while ( !OSCompareAndSwap ( middle, inExchange->readSlot, &inExchange->shared ) );
+	inExchange->readSlot = middle & kDSPExchangeSlotMask;
+	OSSynchronizeIO ();
+	return true;
+}
+
+#endif
@@ -0,0 +1,462 @@
+/*
+ *  DSP_Convolver.cpp
+ *  AppleOnboardAudio
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#include "DSP_Convolver.h"
+
+#define super DSP_Processor
+
+OSDefineMetaClassAndStructors ( DSP_Convolver, DSP_Processor )
+
+#pragma mark ------------------------
+#pragma mark --- Construction
+#pragma mark ------------------------
+
+DSP_Convolver * DSP_Convolver::create ( UInt32 inNumChannels ) {
+	DSP_Convolver *			result;
+
+	result = new DSP_Convolver;
+	if ( 0 != result ) {
+		if ( !result->init ( inNumChannels ) ) {
+			result->release ();
+			result = 0;
+		}
+	}
+	return result;
+}
+
+//	Nothing is allocated until the first setParameters () says how big the filter is.
+bool DSP_Convolver::init ( UInt32 inNumChannels ) {
+	bool					result = false;
+
+	mFFT = 0;
+	mMemory = 0;
+	mMemoryBytes = 0;
+
+	FailIf ( 0 == inNumChannels || inNumChannels > kDSPMaxChannels, Exit );
+	FailIf ( !super::init ( inNumChannels ), Exit );
+
+	mPartitionFrames = 0;
+	mNumTaps = 0;
+	mRequiredSampleRate = 0;
+	mActive = false;
+	mResetCount = 0;
+	bzero ( &mLiveKernel, sizeof ( mLiveKernel ) );
+	DSPExchangeInit ( &mExchange );
+	mFadeHeadLength = 0;
+	mFadeActive = false;
+	mFading = false;
+	mSpectrumIndex = 0;
+	mPosition = 0;
+
+	result = true;
+Exit:
+	return result;
+}
+
+void DSP_Convolver::free ( void ) {
+	releaseMemory ();
+	super::free ();
+}
+
+void DSP_Convolver::releaseMemory ( void ) {
+	if ( 0 != mFFT ) {
+		mFFT->release ();
+		mFFT = 0;
+	}
+	if ( 0 != mMemory ) {
+		IOFree ( mMemory, mMemoryBytes );
+		mMemory = 0;
+		mMemoryBytes = 0;
+	}
+}
+
+//	Carves every buffer the stage will need out of a single allocation.
+//	Each kernel bank holds the head and the tail spectra for every channel.
+bool DSP_Convolver::configure ( UInt32 inPartitionFrames, UInt32 inNumTaps ) {
+	float *					next;
+	UInt32					log2Length;
+	UInt32					bankFloats;
+	UInt32					totalFloats;
+	UInt32					slot;
+	UInt32					channel;
+	bool					result = false;
+
+	for ( log2Length = 0; ( 1UL << log2Length ) < 2 * inPartitionFrames; log2Length++ ) {}
+	mFFT = DSP_FFT::create ( log2Length );
+	FailIf ( 0 == mFFT, Exit );
+
+	mPartitionFrames = inPartitionFrames;
+	mMaxPartitions = ( inNumTaps > inPartitionFrames ) ? ( inNumTaps - inPartitionFrames + inPartitionFrames - 1 ) / inPartitionFrames : 0;
+	mTapCapacity = ( mMaxPartitions + 1 ) * inPartitionFrames;
+
+	bankFloats = mNumChannels * ( mPartitionFrames + 2 * mMaxPartitions * mPartitionFrames );
+	totalFloats = mNumChannels * mTapCapacity										//	mTaps
+				+ kDSPExchangeSlots * bankFloats									//	kernel banks
+				+ 2 * mPartitionFrames												//	mBuildBuffer
+				+ mNumChannels * 2 * mPartitionFrames								//	mInput
+				+ mNumChannels * 2 * mMaxPartitions * mPartitionFrames				//	mSpectraReal, mSpectraImag
+				+ mNumChannels * 3 * mPartitionFrames								//	mTail, mFadeTail, mFadeHead
+				+ 2 * mPartitionFrames												//	mAccumulateReal, mAccumulateImag
+				+ 2 * mPartitionFrames;												//	mTimeScratch
+
+	mMemoryBytes = totalFloats * sizeof ( float );
+	mMemory = (float *)IOMalloc ( mMemoryBytes );
+	FailIf ( 0 == mMemory, Exit );
+	bzero ( mMemory, mMemoryBytes );
+
+	next = mMemory;
+	for ( channel = 0; channel < mNumChannels; channel++ ) {
+		mTaps[channel] = next;							next += mTapCapacity;
+	}
+	for ( slot = 0; slot < kDSPExchangeSlots; slot++ ) {
+		bzero ( &mKernelSlots[slot], sizeof ( ConvolverKernel ) );
+		for ( channel = 0; channel < mNumChannels; channel++ ) {
+			mKernelSlots[slot].head[channel] = next;		next += mPartitionFrames;
+			mKernelSlots[slot].tailReal[channel] = next;	next += mMaxPartitions * mPartitionFrames;
+			mKernelSlots[slot].tailImag[channel] = next;	next += mMaxPartitions * mPartitionFrames;
+		}
+	}
+	mBuildBuffer = next;								next += 2 * mPartitionFrames;
+	for ( channel = 0; channel < mNumChannels; channel++ ) {
+		mInput[channel] = next;							next += 2 * mPartitionFrames;
+		mSpectraReal[channel] = next;					next += mMaxPartitions * mPartitionFrames;
+		mSpectraImag[channel] = next;					next += mMaxPartitions * mPartitionFrames;
+		mTail[channel] = next;							next += mPartitionFrames;
+		mFadeTail[channel] = next;						next += mPartitionFrames;
+		mFadeHead[channel] = next;						next += mPartitionFrames;
+	}
+	mAccumulateReal = next;								next += mPartitionFrames;
+	mAccumulateImag = next;								next += mPartitionFrames;
+	mTimeScratch = next;								next += 2 * mPartitionFrames;
+
+	debugIOLog ( 3, "  DSP_Convolver::configure P %ld, %ld tail partitions, %ld bytes", mPartitionFrames, mMaxPartitions, mMemoryBytes );
+	result = true;
+Exit:
+	if ( !result ) {
+		releaseMemory ();
+		mPartitionFrames = 0;
+	}
+	return result;
+}
+
+#pragma mark ------------------------
+#pragma mark --- Parameters
+#pragma mark ------------------------
+
+void DSP_Convolver::setParameters ( OSDictionary * inDictionary ) {
+	OSArray *				leftArray;
+	OSArray *				rightArray;
+	SInt32					partitionFrames;
+	SInt32					fractionBits;
+	UInt32					numTaps;
+	UInt32					channel;
+
+	leftArray = OSDynamicCast ( OSArray, inDictionary->getObject ( kConvolverLeftTaps ) );
+	if ( 0 == leftArray ) {
+		leftArray = OSDynamicCast ( OSArray, inDictionary->getObject ( kConvolverTaps ) );
+	}
+	rightArray = OSDynamicCast ( OSArray, inDictionary->getObject ( kConvolverRightTaps ) );
+	if ( 0 == rightArray ) {
+		rightArray = leftArray;
+	}
+	FailIf ( 0 == leftArray, Exit );
+
+	numTaps = leftArray->getCount ();
+	if ( mNumChannels > 1 && rightArray->getCount () > numTaps ) {
+		numTaps = rightArray->getCount ();
+	}
+	if ( numTaps > kConvolverMaxTaps ) {
+		numTaps = kConvolverMaxTaps;
+	}
+	FailIf ( 0 == numTaps, Exit );
+
+	partitionFrames = DSPGetSInt32Parameter ( inDictionary, kConvolverPartitionFrames, kConvolverDefaultPartition );
+	if ( partitionFrames < kConvolverMinPartition || partitionFrames > kConvolverMaxPartition || 0 != ( partitionFrames & ( partitionFrames - 1 ) ) ) {
+		partitionFrames = kConvolverDefaultPartition;
+	}
+
+	if ( 0 == mMemory ) {
+		FailIf ( !configure ( partitionFrames, numTaps ), Exit );
+	} else if ( (UInt32)partitionFrames != mPartitionFrames || numTaps > mTapCapacity ) {
+		//	the geometry is fixed once the IOProc may be using the stage
+		debugIOLog ( 1, "  DSP_Convolver::setParameters P %ld / %ld taps does not fit P %ld / %ld taps, rebuild the chain", partitionFrames, numTaps, mPartitionFrames, mTapCapacity );
+		goto Exit;
+	}
+
+	fractionBits = DSPGetSInt32Parameter ( inDictionary, kConvolverTapFractionBits, kConvolverDefaultFractionBits );
+	if ( fractionBits < 0 || fractionBits > 31 ) {
+		fractionBits = kConvolverDefaultFractionBits;
+	}
+	for ( channel = 0; channel < mNumChannels; channel++ ) {
+		bzero ( mTaps[channel], mTapCapacity * sizeof ( float ) );
+		readTaps ( ( 0 == channel ) ? leftArray : rightArray, mTaps[channel], (UInt32)fractionBits );
+	}
+	mNumTaps = numTaps;
+	mRequiredSampleRate = (UInt32)DSPGetSInt32Parameter ( inDictionary, kConvolverSampleRate, 0 );
+
+	publishKernel ();
+Exit:
+	debugIOLog ( 3, "  DSP_Convolver::setParameters %ld taps, P %ld, rate %ld, active %d", mNumTaps, mPartitionFrames, mRequiredSampleRate, mActive );
+	return;
+}
+
+UInt32 DSP_Convolver::readTaps ( OSArray * inArray, float * outTaps, UInt32 inFractionBits ) {
+	OSNumber *				theNumber;
+	float					scale;
+	UInt32					index;
+	UInt32					count;
+
+	scale = 1.0f;
+	for ( index = 0; index < inFractionBits; index++ ) {
+		scale *= 0.5f;
+	}
+	count = inArray->getCount ();
+	if ( count > mTapCapacity ) {
+		count = mTapCapacity;
+	}
+	for ( index = 0; index < count; index++ ) {
+		theNumber = OSDynamicCast ( OSNumber, inArray->getObject ( index ) );
+		outTaps[index] = ( 0 == theNumber ) ? 0.0f : (float)(SInt32)theNumber->unsigned32BitValue () * scale;
+	}
+	return count;
+}
+
+void DSP_Convolver::setSampleRate ( UInt32 inSampleRate ) {
+	FailIf ( 0 == inSampleRate, Exit );
+	mSampleRate = inSampleRate;
+	if ( 0 != mMemory ) {
+		publishKernel ();
+	}
+Exit:
+	return;
+}
+
+//	The delay line belongs to the IOProc; it is cleared when the new count arrives.
+void DSP_Convolver::reset ( void ) {
+	if ( 0 != mMemory ) {
+		mResetCount++;
+		publishKernel ();
+	}
+}
+
+//	Transforms the tail partitions of the current taps into the bank of the
+//	slot the command gate owns and publishes it.
+void DSP_Convolver::publishKernel ( void ) {
+	ConvolverKernel *		kernel;
+	UInt32					partitionFrames;
+	UInt32					channel;
+	UInt32					partition;
+	bool					wasActive;
+
+	partitionFrames = mPartitionFrames;
+	wasActive = mActive;
+	mActive = ( 0 != mNumTaps ) && ( 0 == mRequiredSampleRate || mRequiredSampleRate == mSampleRate );
+	//	an inactive stage is not run, so its delay line stopped following the stream
+	if ( mActive && !wasActive ) {
+		mResetCount++;
+	}
+
+	kernel = &mKernelSlots[mExchange.writeSlot];
+	kernel->headLength = ( mNumTaps < partitionFrames ) ? mNumTaps : partitionFrames;
+	kernel->numPartitions = ( mNumTaps > partitionFrames ) ? ( mNumTaps - partitionFrames + partitionFrames - 1 ) / partitionFrames : 0;
+	kernel->active = mActive;
+	kernel->resetCount = mResetCount;
+
+	for ( channel = 0; channel < mNumChannels; channel++ ) {
+		//	reversed, so the direct part is a plain dot product against the input history
+		for ( partition = 0; partition < kernel->headLength; partition++ ) {
+			kernel->head[channel][partition] = mTaps[channel][kernel->headLength - 1 - partition];
+		}
+		for ( partition = 0; partition < kernel->numPartitions; partition++ ) {
+			memcpy ( mBuildBuffer, &mTaps[channel][( partition + 1 ) * partitionFrames], partitionFrames * sizeof ( float ) );
+			bzero ( &mBuildBuffer[partitionFrames], partitionFrames * sizeof ( float ) );
+			mFFT->forward ( mBuildBuffer, &kernel->tailReal[channel][partition * partitionFrames], &kernel->tailImag[channel][partition * partitionFrames] );
+		}
+	}
+	DSPExchangePublish ( &mExchange );
+}
+
+#pragma mark ------------------------
+#pragma mark --- Processing
+#pragma mark ------------------------
+
+void DSP_Convolver::clearState ( void ) {
+	UInt32					channel;
+
+	for ( channel = 0; channel < mNumChannels; channel++ ) {
+		bzero ( mInput[channel], 2 * mPartitionFrames * sizeof ( float ) );
+		bzero ( mSpectraReal[channel], mMaxPartitions * mPartitionFrames * sizeof ( float ) );
+		bzero ( mSpectraImag[channel], mMaxPartitions * mPartitionFrames * sizeof ( float ) );
+		bzero ( mTail[channel], mPartitionFrames * sizeof ( float ) );
+	}
+	mSpectrumIndex = 0;
+	mPosition = 0;
+	mFading = false;
+}
+
+//	Only called at a partition boundary, or while the live filter is an
+//	identity and there is no partition in progress to protect.
+void DSP_Convolver::acquireKernel ( void ) {
+	ConvolverKernel *		nextKernel;
+	UInt32					channel;
+
+	if ( !DSPExchangePending ( &mExchange ) ) {
+		return;
+	}
+	//	the outgoing head has to be copied while its bank is still ours
+	for ( channel = 0; channel < mNumChannels; channel++ ) {
+		memcpy ( mFadeHead[channel], mLiveKernel.head[channel], mLiveKernel.headLength * sizeof ( float ) );
+	}
+	DSPExchangeAcquire ( &mExchange );
+	nextKernel = &mKernelSlots[mExchange.readSlot];
+
+	if ( nextKernel->resetCount != mLiveKernel.resetCount ) {
+		mLiveKernel = *nextKernel;
+		clearState ();
+	} else {
+		//	the outgoing tail for this partition is already in mTail
+		for ( channel = 0; channel < mNumChannels; channel++ ) {
+			memcpy ( mFadeTail[channel], mTail[channel], mPartitionFrames * sizeof ( float ) );
+		}
+		mFadeHeadLength = mLiveKernel.headLength;
+		mFadeActive = mLiveKernel.active;
+		mLiveKernel = *nextKernel;
+		for ( channel = 0; channel < mNumChannels; channel++ ) {
+			computeTail ( channel, &mLiveKernel, mTail[channel] );
+		}
+		mFading = true;
+	}
+}
+
+//	Sums the delayed input spectra against the filter's tail spectra and
+//	keeps the second half of the inverse transform, which is the part of
+//	the circular result that equals the linear convolution.
+void DSP_Convolver::computeTail ( UInt32 inChannel, ConvolverKernel * inKernel, float * outTail ) {
+	UInt32					partition;
+	UInt32					spectrum;
+	UInt32					offset;
+
+	if ( 0 == inKernel->numPartitions || !inKernel->active ) {
+		bzero ( outTail, mPartitionFrames * sizeof ( float ) );
+		return;
+	}
+
+	bzero ( mAccumulateReal, mPartitionFrames * sizeof ( float ) );
+	bzero ( mAccumulateImag, mPartitionFrames * sizeof ( float ) );
+	spectrum = mSpectrumIndex;
+	for ( partition = 0; partition < inKernel->numPartitions; partition++ ) {
+		offset = partition * mPartitionFrames;
+		DSP_FFT::multiplyAccumulate ( mAccumulateReal, mAccumulateImag,
+									&inKernel->tailReal[inChannel][offset], &inKernel->tailImag[inChannel][offset],
+									&mSpectraReal[inChannel][spectrum * mPartitionFrames], &mSpectraImag[inChannel][spectrum * mPartitionFrames],
+									mPartitionFrames );
+		spectrum = ( 0 == spectrum ) ? mMaxPartitions - 1 : spectrum - 1;
+	}
+	mFFT->inverse ( mAccumulateReal, mAccumulateImag, mTimeScratch );
+	memcpy ( outTail, &mTimeScratch[mPartitionFrames], mPartitionFrames * sizeof ( float ) );
+}
+
+//	A full partition of input has arrived:  add its spectrum to the delay
+//	line and work out the tail for the partition that starts now.
+void DSP_Convolver::endPartition ( void ) {
+	UInt32					channel;
+
+	if ( 0 != mMaxPartitions ) {
+		mSpectrumIndex = ( mSpectrumIndex + 1 ) % mMaxPartitions;
+	}
+	for ( channel = 0; channel < mNumChannels; channel++ ) {
+		if ( 0 != mMaxPartitions ) {
+			mFFT->forward ( mInput[channel], &mSpectraReal[channel][mSpectrumIndex * mPartitionFrames], &mSpectraImag[channel][mSpectrumIndex * mPartitionFrames] );
+			computeTail ( channel, &mLiveKernel, mTail[channel] );
+		}
+		memcpy ( mInput[channel], &mInput[channel][mPartitionFrames], mPartitionFrames * sizeof ( float ) );
+	}
+	mPosition = 0;
+	mFading = false;
+}
+
+//	Head taps run directly against the input history; the tail for each
+//	output frame was computed at the last partition boundary.
+void DSP_Convolver::convolveChannel ( float * ioBuffer, UInt32 inChannel, UInt32 inNumFrames ) {
+	const float *			head;
+	const float *			tail;
+	float *					input;
+	float					sample;
+	float					output;
+	float					faded;
+	float					fadeStep;
+	float					fadeGain;
+	UInt32					headLength;
+	UInt32					frame;
+
+	head = mLiveKernel.head[inChannel];
+	headLength = mLiveKernel.headLength;
+	tail = &mTail[inChannel][mPosition];
+	input = &mInput[inChannel][mPartitionFrames + mPosition];
+	fadeStep = 1.0f / (float)mPartitionFrames;
+	fadeGain = (float)( mPartitionFrames - mPosition ) * fadeStep;
+
+	for ( frame = 0; frame < inNumFrames; frame++ ) {
+		sample = *ioBuffer;
+		input[frame] = sample;
+
+		if ( mLiveKernel.active ) {
+			output = DSPDotProduct ( head, &input[frame + 1] - headLength, headLength ) + tail[frame];
+		} else {
+			output = sample;
+		}
+
+		if ( mFading ) {
+			if ( mFadeActive ) {
+				faded = DSPDotProduct ( mFadeHead[inChannel], &input[frame + 1] - mFadeHeadLength, mFadeHeadLength ) + mFadeTail[inChannel][mPosition + frame];
+			} else {
+				faded = sample;
+			}
+			output += fadeGain * ( faded - output );
+			fadeGain -= fadeStep;
+		}
+
+		*ioBuffer = output;
+		ioBuffer += mNumChannels;
+	}
+}
+
+void DSP_Convolver::process ( float * ioBuffer, UInt32 inNumSamples ) {
+	UInt32					numFrames;
+	UInt32					framesThisPass;
+	UInt32					channel;
+
+	if ( 0 == mMemory ) {
+		return;
+	}
+	if ( !mLiveKernel.active && !mFading ) {
+		acquireKernel ();
+		if ( !mLiveKernel.active ) {
+			return;
+		}
+	}
+
+	numFrames = inNumSamples / mNumChannels;
+	while ( 0 != numFrames ) {
+		framesThisPass = mPartitionFrames - mPosition;
+		if ( framesThisPass > numFrames ) {
+			framesThisPass = numFrames;
+		}
+		for ( channel = 0; channel < mNumChannels; channel++ ) {
+			convolveChannel ( ioBuffer + channel, channel, framesThisPass );
+		}
+		ioBuffer += framesThisPass * mNumChannels;
+		numFrames -= framesThisPass;
+		mPosition += framesThisPass;
+
+		if ( mPosition == mPartitionFrames ) {
+			endPartition ();
+			acquireKernel ();
+		}
+	}
+}
@@ -0,0 +1,133 @@
+/*
+ *  DSP_Convolver.h
+ *  AppleOnboardAudio
+ *
+ *  Long FIR filter for measured speaker and room correction, run as a
+ *  uniformly partitioned convolution.  The filter is cut into partitions of
+ *  P taps.  The first partition is applied directly, sample by sample, and
+ *  the rest are applied in the frequency domain by overlap-save against a
+ *  delay line of input spectra, one 2P point FFT and one inverse per P
+ *  frames.  Because the direct head covers the first P taps, the frequency
+ *  domain tail only ever needs input that is already a full partition old,
+ *  and the stage adds no latency.
+ *
+ *  All memory is allocated when the stage is first configured; process ()
+ *  never allocates.  New taps are transformed on the command gate into one
+ *  of three kernel banks and handed over through a DSPExchange at a
+ *  partition boundary, where the old and new filters are crossfaded over
+ *  one partition.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSP_CONVOLVER__
+#define __DSP_CONVOLVER__
+
+#include <libkern/c++/OSArray.h>
+
+#include "DSP_Processor.h"
+#include "DSP_FFT.h"
+
+//	'SoftwareDSP' dictionary keys.  Taps are signed integers scaled by
+//	2^TapFractionBits.  'Taps' applies to every channel unless a channel has
+//	its own array.  A non zero 'SampleRate' limits the filter to the rate it
+//	was measured at; at any other rate the stage passes audio untouched.
+#define kConvolverEntry					"Convolver"
+#define kConvolverTaps					"Taps"
+#define kConvolverLeftTaps				"LeftTaps"
+#define kConvolverRightTaps				"RightTaps"
+#define kConvolverTapFractionBits		"TapFractionBits"
+#define kConvolverPartitionFrames		"PartitionFrames"
+#define kConvolverSampleRate			"SampleRate"
+
+#define kConvolverDefaultFractionBits	28
+#define kConvolverDefaultPartition		128
+#define kConvolverMinPartition			32
+#define kConvolverMaxPartition			1024
+#define kConvolverMaxTaps				4096
+
+//	One filter as published to the IOProc.  The arrays live in a bank owned
+//	by the slot; only the counts and flags change from one publish to the next.
+typedef struct {
+	float *					head[kDSPMaxChannels];		//	taps headLength - 1 ... 0, oldest input first
+	float *					tailReal[kDSPMaxChannels];	//	numPartitions spectra of P bins each
+	float *					tailImag[kDSPMaxChannels];
+	UInt32					headLength;
+	UInt32					numPartitions;
+	bool					active;
+	UInt32					resetCount;					//	a change clears the delay line
+} ConvolverKernel;
+
+class DSP_Convolver : public DSP_Processor {
+
+    OSDeclareDefaultStructors ( DSP_Convolver );
+
+public:
+
+	static DSP_Convolver *	create ( UInt32 inNumChannels );
+
+	virtual bool			init ( UInt32 inNumChannels );
+	virtual void			free ( void );
+
+	virtual const char *	getStageName ( void ) { return kConvolverEntry; }
+
+	//	the partition size and tap capacity are fixed by the first call
+	virtual void			setParameters ( OSDictionary * inDictionary );
+	virtual void			setSampleRate ( UInt32 inSampleRate );
+	virtual void			reset ( void );
+
+	virtual bool			isActive ( void ) { return mActive; }
+
+	virtual void			process ( float * ioBuffer, UInt32 inNumSamples );
+
+protected:
+
+	bool					configure ( UInt32 inPartitionFrames, UInt32 inNumTaps );
+	void					releaseMemory ( void );
+	UInt32					readTaps ( OSArray * inArray, float * outTaps, UInt32 inFractionBits );
+	void					publishKernel ( void );
+
+	void					acquireKernel ( void );
+	void					clearState ( void );
+	void					endPartition ( void );
+	void					computeTail ( UInt32 inChannel, ConvolverKernel * inKernel, float * outTail );
+	void					convolveChannel ( float * ioBuffer, UInt32 inChannel, UInt32 inNumFrames );
+
+	DSP_FFT *				mFFT;						//	2P points
+	float *					mMemory;					//	everything below comes out of this one block
+	UInt32					mMemoryBytes;
+	UInt32					mPartitionFrames;			//	P
+	UInt32					mMaxPartitions;				//	tail partitions the banks can hold
+	UInt32					mTapCapacity;
+
+	//	command gate side
+	float *					mTaps[kDSPMaxChannels];
+	UInt32					mNumTaps;
+	UInt32					mRequiredSampleRate;
+	bool					mActive;
+	UInt32					mResetCount;
+	float *					mBuildBuffer;				//	2P
+
+	ConvolverKernel			mKernelSlots[kDSPExchangeSlots];
+	DSPExchange				mExchange;
+
+	//	IOProc side
+	ConvolverKernel			mLiveKernel;
+	float *					mInput[kDSPMaxChannels];	//	previous and current partition, 2P
+	float *					mSpectraReal[kDSPMaxChannels];	//	mMaxPartitions input spectra, newest at mSpectrumIndex
+	float *					mSpectraImag[kDSPMaxChannels];
+	float *					mTail[kDSPMaxChannels];		//	frequency domain contribution to this partition, P
+	float *					mFadeTail[kDSPMaxChannels];	//	the same from the outgoing filter
+	float *					mFadeHead[kDSPMaxChannels];	//	the outgoing filter's head
+	UInt32					mFadeHeadLength;
+	bool					mFadeActive;				//	outgoing filter was not an identity
+	bool					mFading;					//	true for the partition after a filter change
+	float *					mAccumulateReal;			//	P bins
+	float *					mAccumulateImag;
+	float *					mTimeScratch;				//	2P
+	UInt32					mSpectrumIndex;
+	UInt32					mPosition;					//	frames into the current partition
+};
+
+#endif
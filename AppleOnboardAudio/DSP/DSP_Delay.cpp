@@ -0,0 +1,305 @@
+/*
+ *  DSP_Delay.cpp
+ *  AppleOnboardAudio
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#include "DSP_Delay.h"
+
+#define super DSP_Processor
+
+OSDefineMetaClassAndStructors ( DSP_Delay, DSP_Processor )
+
+//	fractions closer than this to a whole frame are rounded rather than interpolated
+static const float kDelayIntegerTolerance		= 0.01f;
+
+#pragma mark ------------------------
+#pragma mark --- Construction
+#pragma mark ------------------------
+
+DSP_Delay * DSP_Delay::create ( UInt32 inNumChannels, UInt32 inMaxDelayFrames ) {
+	DSP_Delay *				result;
+
+	result = new DSP_Delay;
+	if ( 0 != result ) {
+		if ( !result->init ( inNumChannels, inMaxDelayFrames ) ) {
+			result->release ();
+			result = 0;
+		}
+	}
+	return result;
+}
+
+bool DSP_Delay::init ( UInt32 inNumChannels, UInt32 inMaxDelayFrames ) {
+	UInt32					channel;
+	bool					result = false;
+
+	mRing = 0;
+	bzero ( &mTaps, sizeof ( mTaps ) );
+	bzero ( &mLiveTaps, sizeof ( mLiveTaps ) );
+	DSPExchangeInit ( &mExchange );
+
+	FailIf ( 0 == inNumChannels || inNumChannels > kDSPMaxChannels, Exit );
+	FailIf ( !super::init ( inNumChannels ), Exit );
+
+	mMaxDelayFrames = inMaxDelayFrames;
+
+	//	one extra frame so a full length delay never reads the frame being written
+	mRingFrames = 1;
+	while ( mRingFrames < mMaxDelayFrames + 1 ) {
+		mRingFrames <<= 1;
+	}
+	mRingMask = mRingFrames - 1;
+
+	mRing = (float *)IOMalloc ( mRingFrames * mNumChannels * sizeof ( float ) );
+	FailIf ( 0 == mRing, Exit );
+
+	for ( channel = 0; channel < kDSPMaxChannels; channel++ ) {
+		mRequestedFrames[channel] = 0.0f;
+		mRequestedMicroseconds[channel] = 0;
+		updateChannel ( channel );
+	}
+	mFadeRemaining = 0;
+	mWriteFrame = 0;
+	bzero ( mRing, mRingFrames * mNumChannels * sizeof ( float ) );
+	publishTaps ();
+
+	result = true;
+Exit:
+	return result;
+}
+
+void DSP_Delay::free ( void ) {
+	if ( 0 != mRing ) {
+		IOFree ( mRing, mRingFrames * mNumChannels * sizeof ( float ) );
+		mRing = 0;
+	}
+	super::free ();
+}
+
+#pragma mark ------------------------
+#pragma mark --- Parameters
+#pragma mark ------------------------
+
+void DSP_Delay::setParameters ( OSDictionary * inDictionary ) {
+	mRequestedMicroseconds[0] = DSPGetSInt32Parameter ( inDictionary, kDelayLeftMicroseconds, 0 );
+	mRequestedFrames[0] = (float)DSPGetSInt32Parameter ( inDictionary, kDelayLeftCentiFrames, 0 ) / 100.0f;
+	if ( mNumChannels > 1 ) {
+		mRequestedMicroseconds[1] = DSPGetSInt32Parameter ( inDictionary, kDelayRightMicroseconds, 0 );
+		mRequestedFrames[1] = (float)DSPGetSInt32Parameter ( inDictionary, kDelayRightCentiFrames, 0 ) / 100.0f;
+	}
+	updateChannel ( 0 );
+	updateChannel ( 1 );
+	publishTaps ();
+
+	debugIOLog ( 3, "  DSP_Delay::setParameters left %ld (+%ld us), right %ld (+%ld us), active %d", mTaps.integerDelay[0], mRequestedMicroseconds[0], mTaps.integerDelay[1], mRequestedMicroseconds[1], mTaps.active );
+}
+
+void DSP_Delay::setSampleRate ( UInt32 inSampleRate ) {
+	UInt32					channel;
+
+	FailIf ( 0 == inSampleRate, Exit );
+	mSampleRate = inSampleRate;
+	for ( channel = 0; channel < mNumChannels; channel++ ) {
+		updateChannel ( channel );
+	}
+	//	the ring holds audio taken at the old rate
+	reset ();
+Exit:
+	return;
+}
+
+void DSP_Delay::setDelayFrames ( UInt32 inChannel, float inFrames ) {
+	FailIf ( inChannel >= mNumChannels, Exit );
+	mRequestedFrames[inChannel] = inFrames;
+	mRequestedMicroseconds[inChannel] = 0;
+	updateChannel ( inChannel );
+	publishTaps ();
+Exit:
+	return;
+}
+
+void DSP_Delay::setDelayMicroseconds ( UInt32 inChannel, UInt32 inMicroseconds ) {
+	FailIf ( inChannel >= mNumChannels, Exit );
+	mRequestedFrames[inChannel] = 0.0f;
+	mRequestedMicroseconds[inChannel] = inMicroseconds;
+	updateChannel ( inChannel );
+	publishTaps ();
+Exit:
+	return;
+}
+
+//	A first order Thiran allpass is maximally flat in group delay for delays
+//	between 0.5 and 1.5 frames, so the integer part is chosen to leave the
+//	allpass inside that range:  coefficient = (1 - d) / (1 + d).
+void DSP_Delay::updateChannel ( UInt32 inChannel ) {
+	float					total;
+	float					fraction;
+	UInt32					whole;
+	UInt32					channel;
+	bool					wasActive;
+
+	if ( inChannel >= kDSPMaxChannels ) {
+		return;
+	}
+
+	total = mRequestedFrames[inChannel] + ( (float)mRequestedMicroseconds[inChannel] * (float)mSampleRate ) / 1000000.0f;
+	if ( total < 0.0f ) {
+		total = 0.0f;
+	} else if ( total > (float)mMaxDelayFrames ) {
+		total = (float)mMaxDelayFrames;
+	}
+
+	whole = (UInt32)( total + 0.5f );
+	fraction = total - (float)whole;
+	if ( DSPAbs ( fraction ) < kDelayIntegerTolerance || total < 0.5f ) {
+		mTaps.integerDelay[inChannel] = whole;
+		mTaps.useAllpass[inChannel] = false;
+		mTaps.allpassCoefficient[inChannel] = 0.0f;
+	} else {
+		whole = (UInt32)( total - 0.5f );
+		fraction = total - (float)whole;
+		mTaps.integerDelay[inChannel] = whole;
+		mTaps.useAllpass[inChannel] = true;
+		mTaps.allpassCoefficient[inChannel] = ( 1.0f - fraction ) / ( 1.0f + fraction );
+	}
+
+	wasActive = mTaps.active;
+	mTaps.active = false;
+	for ( channel = 0; channel < mNumChannels; channel++ ) {
+		if ( 0 != mTaps.integerDelay[channel] || mTaps.useAllpass[channel] ) {
+			mTaps.active = true;
+		}
+	}
+	//	an inactive stage is not run, so the ring stopped following the stream
+	if ( mTaps.active && !wasActive ) {
+		mTaps.resetCount++;
+	}
+}
+
+void DSP_Delay::publishTaps ( void ) {
+	mTapSlots[mExchange.writeSlot] = mTaps;
+	DSPExchangePublish ( &mExchange );
+}
+
+//	The ring and filter state belong to the IOProc, so a reset is only
+//	requested here and carried out at the start of the next block.
+void DSP_Delay::reset ( void ) {
+	mTaps.resetCount++;
+	publishTaps ();
+}
+
+//	The shortest channel delay is what the whole stream is late by.
+UInt32 DSP_Delay::getLatency ( void ) {
+	UInt32					channel;
+	UInt32					result;
+
+	result = mTaps.integerDelay[0] + ( mTaps.useAllpass[0] ? 1 : 0 );
+	for ( channel = 1; channel < mNumChannels; channel++ ) {
+		if ( mTaps.integerDelay[channel] + ( mTaps.useAllpass[channel] ? 1 : 0 ) < result ) {
+			result = mTaps.integerDelay[channel] + ( mTaps.useAllpass[channel] ? 1 : 0 );
+		}
+	}
+	return result;
+}
+
+#pragma mark ------------------------
+#pragma mark --- Processing
+#pragma mark ------------------------
+
+//	Runs at the top of a block, after the exchange has handed over a new set.
+//	A changed tap is not switched to directly:  the outgoing taps keep being
+//	read, with their own allpass state, and faded out under the new ones.
+void DSP_Delay::acquireTaps ( void ) {
+	DelayTaps *				nextTaps;
+	UInt32					channel;
+	bool					moved;
+
+	nextTaps = &mTapSlots[mExchange.readSlot];
+
+	if ( nextTaps->resetCount != mLiveTaps.resetCount ) {
+		bzero ( mRing, mRingFrames * mNumChannels * sizeof ( float ) );
+		bzero ( mAllpassInput, sizeof ( mAllpassInput ) );
+		bzero ( mAllpassOutput, sizeof ( mAllpassOutput ) );
+		mWriteFrame = 0;
+		mFadeRemaining = 0;
+	} else {
+		moved = false;
+		for ( channel = 0; channel < mNumChannels; channel++ ) {
+			if ( nextTaps->integerDelay[channel] != mLiveTaps.integerDelay[channel] || nextTaps->allpassCoefficient[channel] != mLiveTaps.allpassCoefficient[channel] || nextTaps->useAllpass[channel] != mLiveTaps.useAllpass[channel] ) {
+				moved = true;
+			}
+		}
+		if ( moved ) {
+			//	a change arriving mid fade restarts it from the taps now playing
+			mFadeTaps = mLiveTaps;
+			for ( channel = 0; channel < kDSPMaxChannels; channel++ ) {
+				mFadeAllpassInput[channel] = mAllpassInput[channel];
+				mFadeAllpassOutput[channel] = mAllpassOutput[channel];
+			}
+			mFadeRemaining = kDelayCrossfadeFrames;
+		}
+	}
+	mLiveTaps = *nextTaps;
+}
+
+void DSP_Delay::process ( float * ioBuffer, UInt32 inNumSamples ) {
+	float *					writeFrame;
+	float					input;
+	float					delayed;
+	float					output;
+	float					faded;
+	float					fadeGain;
+	UInt32					numFrames;
+	UInt32					channel;
+	UInt32					readFrame;
+
+	if ( DSPExchangeAcquire ( &mExchange ) ) {
+		acquireTaps ();
+	}
+	if ( !mLiveTaps.active && 0 == mFadeRemaining ) {
+		return;
+	}
+
+	numFrames = inNumSamples / mNumChannels;
+	while ( numFrames-- ) {
+		writeFrame = &mRing[mWriteFrame * mNumChannels];
+		for ( channel = 0; channel < mNumChannels; channel++ ) {
+			input = *ioBuffer;
+			writeFrame[channel] = input;
+
+			readFrame = ( mWriteFrame - mLiveTaps.integerDelay[channel] ) & mRingMask;
+			delayed = mRing[readFrame * mNumChannels + channel];
+
+			if ( mLiveTaps.useAllpass[channel] ) {
+				output = mLiveTaps.allpassCoefficient[channel] * ( delayed - mAllpassOutput[channel] ) + mAllpassInput[channel];
+				mAllpassInput[channel] = delayed;
+				mAllpassOutput[channel] = output;
+			} else {
+				output = delayed;
+			}
+
+			if ( 0 != mFadeRemaining ) {
+				readFrame = ( mWriteFrame - mFadeTaps.integerDelay[channel] ) & mRingMask;
+				delayed = mRing[readFrame * mNumChannels + channel];
+
+				if ( mFadeTaps.useAllpass[channel] ) {
+					faded = mFadeTaps.allpassCoefficient[channel] * ( delayed - mFadeAllpassOutput[channel] ) + mFadeAllpassInput[channel];
+					mFadeAllpassInput[channel] = delayed;
+					mFadeAllpassOutput[channel] = faded;
+				} else {
+					faded = delayed;
+				}
+				fadeGain = (float)mFadeRemaining * ( 1.0f / (float)kDelayCrossfadeFrames );
+				output += fadeGain * ( faded - output );
+			}
+			*ioBuffer++ = output;
+		}
+		if ( 0 != mFadeRemaining ) {
+			mFadeRemaining--;
+		}
+		mWriteFrame = ( mWriteFrame + 1 ) & mRingMask;
+	}
+}
@@ -0,0 +1,103 @@
+/*
+ *  DSP_Delay.h
+ *  AppleOnboardAudio
+ *
+ *  Per channel delay line.  Each channel is delayed by an integer number of
+ *  frames read from a shared interleaved ring, followed by an optional first
+ *  order Thiran allpass that supplies the fractional part.  A delay of exactly
+ *  one frame degenerates to a pure unit delay, which is what the legacy
+ *  delayRightChannel clip routine provided.
+ *
+ *  Tap settings are computed on the command gate and handed to the IOProc
+ *  through a DSPExchange.  When the taps move while audio is running, the
+ *  old and new taps are read side by side for kDelayCrossfadeFrames and
+ *  crossfaded, so a delay change never steps the waveform.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSP_DELAY__
+#define __DSP_DELAY__
+
+#include "DSP_Processor.h"
+
+//	'SoftwareDSP' dictionary keys.  The total delay of a channel is the sum of
+//	its microsecond term (converted at the current sample rate) and its frame
+//	term expressed in hundredths of a frame.
+#define kDelayEntry						"Delay"
+#define kDelayLeftMicroseconds			"LeftMicroseconds"
+#define kDelayRightMicroseconds			"RightMicroseconds"
+#define kDelayLeftCentiFrames			"LeftCentiFrames"
+#define kDelayRightCentiFrames			"RightCentiFrames"
+
+//	2048 frames covers 46 ms at 44.1 kHz and 21 ms at 96 kHz
+#define kDelayMaxFrames					2048
+#define kDelayCrossfadeFrames			128
+
+//	One complete set of taps, as published to the IOProc.  A change of
+//	resetCount asks the IOProc to clear the ring before it next reads it.
+typedef struct {
+	UInt32					integerDelay[kDSPMaxChannels];
+	float					allpassCoefficient[kDSPMaxChannels];
+	bool					useAllpass[kDSPMaxChannels];
+	bool					active;
+	UInt32					resetCount;
+} DelayTaps;
+
+class DSP_Delay : public DSP_Processor {
+
+    OSDeclareDefaultStructors ( DSP_Delay );
+
+public:
+
+	static DSP_Delay *		create ( UInt32 inNumChannels, UInt32 inMaxDelayFrames = kDelayMaxFrames );
+
+	virtual bool			init ( UInt32 inNumChannels, UInt32 inMaxDelayFrames );
+	virtual void			free ( void );
+
+	virtual const char *	getStageName ( void ) { return kDelayEntry; }
+
+	virtual void			setParameters ( OSDictionary * inDictionary );
+	virtual void			setSampleRate ( UInt32 inSampleRate );
+	virtual void			setDelayFrames ( UInt32 inChannel, float inFrames );
+	virtual void			setDelayMicroseconds ( UInt32 inChannel, UInt32 inMicroseconds );
+	virtual void			reset ( void );
+
+	virtual bool			isActive ( void ) { return mTaps.active; }
+	virtual UInt32			getLatency ( void );
+
+	virtual void			process ( float * ioBuffer, UInt32 inNumSamples );
+
+protected:
+
+	void					updateChannel ( UInt32 inChannel );
+	void					publishTaps ( void );
+	void					acquireTaps ( void );
+
+	float *					mRing;						//	mRingFrames interleaved frames
+	UInt32					mRingFrames;				//	power of two
+	UInt32					mRingMask;
+	UInt32					mMaxDelayFrames;
+
+	//	command gate side:  requested delay, kept in both forms so a sample rate
+	//	change can recompute the total, and the taps last computed from it
+	float					mRequestedFrames[kDSPMaxChannels];
+	UInt32					mRequestedMicroseconds[kDSPMaxChannels];
+	DelayTaps				mTaps;
+
+	DelayTaps				mTapSlots[kDSPExchangeSlots];
+	DSPExchange				mExchange;
+
+	//	IOProc side
+	DelayTaps				mLiveTaps;
+	DelayTaps				mFadeTaps;					//	taps being faded out
+	UInt32					mFadeRemaining;				//	frames left in the crossfade
+	UInt32					mWriteFrame;
+	float					mAllpassInput[kDSPMaxChannels];
+	float					mAllpassOutput[kDSPMaxChannels];
+	float					mFadeAllpassInput[kDSPMaxChannels];
+	float					mFadeAllpassOutput[kDSPMaxChannels];
+};
+
+#endif
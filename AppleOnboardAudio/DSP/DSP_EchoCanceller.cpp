@@ -0,0 +1,444 @@
+/*
+ *  DSP_EchoCanceller.cpp
+ *  AppleOnboardAudio
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#include "DSP_EchoCanceller.h"
+
+#include "AppleDBDMAFloatLib.h"
+
+#define super OSObject
+
+OSDefineMetaClassAndStructors ( DSP_EchoCanceller, OSObject )
+
+static const float kEchoPowerSmoothing		= 0.25f;		//	per block
+static const float kEchoPowerFloor			= 1.0e-8f;		//	mean square of the quietest reference worth adapting to
+static const float kEchoDivergenceRatio		= 4.0f;			//	residual power over microphone power that resets a filter
+
+#pragma mark ------------------------
+#pragma mark --- Construction
+#pragma mark ------------------------
+
+DSP_EchoCanceller * DSP_EchoCanceller::create ( UInt32 inNumChannels, UInt32 inBlockFrames, UInt32 inReferenceFrames ) {
+	DSP_EchoCanceller *		result;
+
+	result = new DSP_EchoCanceller;
+	if ( 0 != result ) {
+		if ( !result->init ( inNumChannels, inBlockFrames, inReferenceFrames ) ) {
+			result->release ();
+			result = 0;
+		}
+	}
+	return result;
+}
+
+bool DSP_EchoCanceller::init ( UInt32 inNumChannels, UInt32 inBlockFrames, UInt32 inReferenceFrames ) {
+	float *					next;
+	UInt32					log2Length;
+	UInt32					totalFloats;
+	UInt32					channel;
+	bool					result = false;
+
+	mFFT = 0;
+	mMemory = 0;
+	mMemoryBytes = 0;
+
+	FailIf ( !super::init (), Exit );
+	FailIf ( 0 == inNumChannels || inNumChannels > kDSPMaxChannels, Exit );
+	FailIf ( inBlockFrames < kEchoMinBlockFrames || inBlockFrames > kEchoMaxBlockFrames || 0 != ( inBlockFrames & ( inBlockFrames - 1 ) ), Exit );
+	FailIf ( inReferenceFrames < 4 * inBlockFrames, Exit );
+
+	mNumChannels = inNumChannels;
+	mBlockFrames = inBlockFrames;
+	mMaxPartitions = kEchoPartitionBudget / inNumChannels;
+	mReferenceFrames = inReferenceFrames;
+	mSampleRate = 44100;
+
+	for ( log2Length = 0; ( 1UL << log2Length ) < 2 * mBlockFrames; log2Length++ ) {}
+	mFFT = DSP_FFT::create ( log2Length );
+	FailIf ( 0 == mFFT, Exit );
+
+	totalFloats = mReferenceFrames													//	mReference
+				+ mNumChannels * 2 * mMaxPartitions * mBlockFrames					//	mFilterReal, mFilterImag
+				+ 2 * mMaxPartitions * mBlockFrames									//	mSpectraReal, mSpectraImag
+				+ mBlockFrames + 1													//	mPower
+				+ 2 * mBlockFrames													//	mReferenceBlock
+				+ mNumChannels * 2 * mBlockFrames									//	mMicrophone, mOutput
+				+ 2 * mBlockFrames													//	mScratchReal, mScratchImag
+				+ 2 * mBlockFrames													//	mTime
+				+ mMaxPartitions;													//	mBlockPeaks
+
+	mMemoryBytes = totalFloats * sizeof ( float );
+	mMemory = (float *)IOMalloc ( mMemoryBytes );
+	FailIf ( 0 == mMemory, Exit );
+	bzero ( mMemory, mMemoryBytes );
+
+	next = mMemory;
+	mReference = next;									next += mReferenceFrames;
+	for ( channel = 0; channel < mNumChannels; channel++ ) {
+		mFilterReal[channel] = next;					next += mMaxPartitions * mBlockFrames;
+		mFilterImag[channel] = next;					next += mMaxPartitions * mBlockFrames;
+		mMicrophone[channel] = next;					next += mBlockFrames;
+		mOutput[channel] = next;						next += mBlockFrames;
+	}
+	mSpectraReal = next;								next += mMaxPartitions * mBlockFrames;
+	mSpectraImag = next;								next += mMaxPartitions * mBlockFrames;
+	mPower = next;										next += mBlockFrames + 1;
+	mReferenceBlock = next;								next += 2 * mBlockFrames;
+	mScratchReal = next;								next += mBlockFrames;
+	mScratchImag = next;								next += mBlockFrames;
+	mTime = next;										next += 2 * mBlockFrames;
+	mBlockPeaks = next;									next += mMaxPartitions;
+
+	mTailMilliseconds = kEchoDefaultTailMilliseconds;
+	bzero ( &mSettings, sizeof ( mSettings ) );
+	DSPExchangeInit ( &mExchange );
+	setParameters ( 0 );
+	mLive = mSettings;
+	clearState ();
+
+	debugIOLog ( 3, "  DSP_EchoCanceller::init B %ld, %ld partitions per channel, %ld frame reference, %ld bytes", mBlockFrames, mMaxPartitions, mReferenceFrames, mMemoryBytes );
+	result = true;
+Exit:
+	return result;
+}
+
+void DSP_EchoCanceller::free ( void ) {
+	if ( 0 != mFFT ) {
+		mFFT->release ();
+		mFFT = 0;
+	}
+	if ( 0 != mMemory ) {
+		IOFree ( mMemory, mMemoryBytes );
+		mMemory = 0;
+		mMemoryBytes = 0;
+	}
+	super::free ();
+}
+
+#pragma mark ------------------------
+#pragma mark --- Parameters
+#pragma mark ------------------------
+
+void DSP_EchoCanceller::setParameters ( OSDictionary * inDictionary ) {
+	SInt32					tailMilliseconds;
+	SInt32					stepPercent;
+	SInt32					doubleTalkDecibels;
+	SInt32					referenceDelay;
+
+	tailMilliseconds = DSPGetSInt32Parameter ( inDictionary, kEchoTailMilliseconds, kEchoDefaultTailMilliseconds );
+	mTailMilliseconds = ( tailMilliseconds < 1 ) ? 1 : (UInt32)tailMilliseconds;
+
+	stepPercent = DSPGetSInt32Parameter ( inDictionary, kEchoStepPercent, kEchoDefaultStepPercent );
+	if ( stepPercent < 1 ) {
+		stepPercent = 1;
+	} else if ( stepPercent > 100 ) {
+		stepPercent = 100;
+	}
+	mSettings.step = (float)stepPercent / 100.0f;
+
+	doubleTalkDecibels = DSPGetSInt32Parameter ( inDictionary, kEchoDoubleTalkDecibels, kEchoDefaultDoubleTalkDecibels );
+	mSettings.doubleTalkRatio = dspPow ( 10.0f, (float)doubleTalkDecibels / 20.0f );
+
+	//	the input side reads this far behind the frames it converts and the output side writes
+	//	ahead of the ones it plays; both have to stay inside the ring
+	referenceDelay = DSPGetSInt32Parameter ( inDictionary, kEchoReferenceDelayFrames, 0 );
+	if ( referenceDelay < 0 ) {
+		referenceDelay = 0;
+	} else if ( (UInt32)referenceDelay > mReferenceFrames / 4 ) {
+		referenceDelay = mReferenceFrames / 4;
+	}
+	mSettings.referenceDelay = (UInt32)referenceDelay;
+
+	mSettings.active = ( 0 != inDictionary ) && !DSPGetBoolParameter ( inDictionary, kDSPProcessorBypass, false );
+
+	setSampleRate ( mSampleRate );
+
+	debugIOLog ( 3, "  DSP_EchoCanceller::setParameters %ld ms tail (%ld partitions), step %ld%%, double talk %ld dB, delay %ld, active %d", mTailMilliseconds, mSettings.numPartitions, stepPercent, doubleTalkDecibels, mSettings.referenceDelay, mSettings.active );
+}
+
+//	The partition count follows the rate so the tail stays the same length in time.  A new count
+//	changes the layout of the spectra, so the filters start over.
+void DSP_EchoCanceller::setSampleRate ( UInt32 inSampleRate ) {
+	UInt32					numPartitions;
+
+	mSampleRate = inSampleRate;
+	numPartitions = ( mTailMilliseconds * ( mSampleRate / 100 ) / 10 + mBlockFrames - 1 ) / mBlockFrames;
+	if ( numPartitions < 1 ) {
+		numPartitions = 1;
+	} else if ( numPartitions > mMaxPartitions ) {
+		numPartitions = mMaxPartitions;
+	}
+	if ( numPartitions != mSettings.numPartitions ) {
+		mSettings.numPartitions = numPartitions;
+		mSettings.resetCount++;
+	}
+	publishSettings ();
+}
+
+//	The filters belong to the input IOProc; they are cleared when the new count arrives.
+void DSP_EchoCanceller::reset ( void ) {
+	mSettings.resetCount++;
+	publishSettings ();
+}
+
+void DSP_EchoCanceller::publishSettings ( void ) {
+	mSettingsSlots[mExchange.writeSlot] = mSettings;
+	DSPExchangePublish ( &mExchange );
+}
+
+#pragma mark ------------------------
+#pragma mark --- Reference
+#pragma mark ------------------------
+
+//	Runs on the output IOProc.  It only writes frames ahead of the playback position and the input
+//	IOProc only touches frames behind it, so the two never meet in the ring.
+void DSP_EchoCanceller::writeReference ( const float * inBuffer, UInt32 inFirstFrame, UInt32 inNumFrames, UInt32 inNumChannels ) {
+	float					scale;
+	UInt32					index;
+	UInt32					frame;
+	UInt32					channel;
+	float					sum;
+
+	if ( inFirstFrame >= mReferenceFrames || 0 == inNumChannels ) {
+		return;
+	}
+	scale = 1.0f / (float)inNumChannels;
+	index = inFirstFrame;
+	for ( frame = 0; frame < inNumFrames; frame++ ) {
+		sum = inBuffer[0];
+		for ( channel = 1; channel < inNumChannels; channel++ ) {
+			sum += inBuffer[channel];
+		}
+		mReference[index] = sum * scale;
+		inBuffer += inNumChannels;
+		if ( ++index == mReferenceFrames ) {
+			index = 0;
+		}
+	}
+}
+
+#pragma mark ------------------------
+#pragma mark --- Processing
+#pragma mark ------------------------
+
+void DSP_EchoCanceller::clearState ( void ) {
+	UInt32					channel;
+	UInt32					index;
+
+	for ( channel = 0; channel < mNumChannels; channel++ ) {
+		bzero ( mFilterReal[channel], mMaxPartitions * mBlockFrames * sizeof ( float ) );
+		bzero ( mFilterImag[channel], mMaxPartitions * mBlockFrames * sizeof ( float ) );
+		bzero ( mMicrophone[channel], mBlockFrames * sizeof ( float ) );
+		bzero ( mOutput[channel], mBlockFrames * sizeof ( float ) );
+	}
+	bzero ( mSpectraReal, mMaxPartitions * mBlockFrames * sizeof ( float ) );
+	bzero ( mSpectraImag, mMaxPartitions * mBlockFrames * sizeof ( float ) );
+	bzero ( mReferenceBlock, 2 * mBlockFrames * sizeof ( float ) );
+	bzero ( mBlockPeaks, mMaxPartitions * sizeof ( float ) );
+	for ( index = 0; index <= mBlockFrames; index++ ) {
+		mPower[index] = 2.0f * (float)mBlockFrames * kEchoPowerFloor;
+	}
+	mSpectrumIndex = 0;
+	mConstrainIndex = 0;
+	mPosition = 0;
+	mDoubleTalkHold = 0;
+}
+
+//	Frames are delayed by one block:  each call hands back the cancelled frames of the previous
+//	block while it collects the next one.
+void DSP_EchoCanceller::process ( float * ioBuffer, UInt32 inFirstFrame, UInt32 inNumFrames ) {
+	float					sample;
+	UInt32					referenceIndex;
+	UInt32					frame;
+	UInt32					channel;
+
+	if ( DSPExchangeAcquire ( &mExchange ) ) {
+		if ( mSettingsSlots[mExchange.readSlot].resetCount != mLive.resetCount ) {
+			clearState ();
+			bzero ( mReference, mReferenceFrames * sizeof ( float ) );
+		}
+		mLive = mSettingsSlots[mExchange.readSlot];
+	}
+	if ( !mLive.active ) {
+		return;
+	}
+
+	referenceIndex = ( inFirstFrame % mReferenceFrames ) + mReferenceFrames - mLive.referenceDelay;
+	if ( referenceIndex >= mReferenceFrames ) {
+		referenceIndex -= mReferenceFrames;
+	}
+
+	for ( frame = 0; frame < inNumFrames; frame++ ) {
+		mReferenceBlock[mBlockFrames + mPosition] = mReference[referenceIndex];
+		mReference[referenceIndex] = 0.0f;
+		if ( ++referenceIndex == mReferenceFrames ) {
+			referenceIndex = 0;
+		}
+
+		for ( channel = 0; channel < mNumChannels; channel++ ) {
+			sample = ioBuffer[channel];
+			ioBuffer[channel] = mOutput[channel][mPosition];
+			mMicrophone[channel][mPosition] = sample;
+		}
+		ioBuffer += mNumChannels;
+
+		if ( ++mPosition == mBlockFrames ) {
+			processBlock ();
+			mPosition = 0;
+		}
+	}
+}
+
+void DSP_EchoCanceller::processBlock ( void ) {
+	float *					newestReal;
+	float *					newestImag;
+	float					referencePeak;
+	float					microphonePeak;
+	float					magnitude;
+	UInt32					numPartitions;
+	UInt32					index;
+	UInt32					channel;
+	bool					adapt;
+
+	numPartitions = mLive.numPartitions;
+	mSpectrumIndex = ( 0 == mSpectrumIndex ) ? numPartitions - 1 : mSpectrumIndex - 1;
+	newestReal = &mSpectraReal[mSpectrumIndex * mBlockFrames];
+	newestImag = &mSpectraImag[mSpectrumIndex * mBlockFrames];
+
+	referencePeak = 0.0f;
+	for ( index = mBlockFrames; index < 2 * mBlockFrames; index++ ) {
+		magnitude = DSPAbs ( mReferenceBlock[index] );
+		if ( magnitude > referencePeak ) {
+			referencePeak = magnitude;
+		}
+	}
+	mBlockPeaks[mSpectrumIndex] = referencePeak;
+
+	mFFT->forward ( mReferenceBlock, newestReal, newestImag );
+	memcpy ( mReferenceBlock, &mReferenceBlock[mBlockFrames], mBlockFrames * sizeof ( float ) );
+
+	mPower[0] += kEchoPowerSmoothing * ( newestReal[0] * newestReal[0] - mPower[0] );
+	mPower[mBlockFrames] += kEchoPowerSmoothing * ( newestImag[0] * newestImag[0] - mPower[mBlockFrames] );
+	for ( index = 1; index < mBlockFrames; index++ ) {
+		mPower[index] += kEchoPowerSmoothing * ( newestReal[index] * newestReal[index] + newestImag[index] * newestImag[index] - mPower[index] );
+	}
+
+	//	Geigel detector:  near end speech is assumed when a microphone peaks above what the loudest
+	//	reference still inside the modelled tail could produce.
+	for ( index = 0; index < numPartitions; index++ ) {
+		if ( mBlockPeaks[index] > referencePeak ) {
+			referencePeak = mBlockPeaks[index];
+		}
+	}
+	for ( channel = 0; channel < mNumChannels; channel++ ) {
+		microphonePeak = 0.0f;
+		for ( index = 0; index < mBlockFrames; index++ ) {
+			magnitude = DSPAbs ( mMicrophone[channel][index] );
+			if ( magnitude > microphonePeak ) {
+				microphonePeak = magnitude;
+			}
+		}
+		if ( microphonePeak > referencePeak * mLive.doubleTalkRatio ) {
+			mDoubleTalkHold = kEchoDoubleTalkHoldBlocks;
+		}
+	}
+
+	adapt = ( 0 == mDoubleTalkHold ) && ( referencePeak * referencePeak > kEchoPowerFloor );
+	for ( channel = 0; channel < mNumChannels; channel++ ) {
+		cancelChannel ( channel, adapt );
+	}
+
+	if ( 0 != mDoubleTalkHold ) {
+		mDoubleTalkHold--;
+	}
+	if ( ++mConstrainIndex >= numPartitions ) {
+		mConstrainIndex = 0;
+	}
+}
+
+void DSP_EchoCanceller::cancelChannel ( UInt32 inChannel, bool inAdapt ) {
+	float *					filterReal;
+	float *					filterImag;
+	float *					microphone;
+	float *					output;
+	float					error;
+	float					errorPower;
+	float					microphonePower;
+	float					regularization;
+	float					step;
+	UInt32					numPartitions;
+	UInt32					partition;
+	UInt32					spectrum;
+	UInt32					index;
+
+	numPartitions = mLive.numPartitions;
+	filterReal = mFilterReal[inChannel];
+	filterImag = mFilterImag[inChannel];
+	microphone = mMicrophone[inChannel];
+	output = mOutput[inChannel];
+
+	//	echo estimate, the last B samples of the circular convolution
+	bzero ( mScratchReal, mBlockFrames * sizeof ( float ) );
+	bzero ( mScratchImag, mBlockFrames * sizeof ( float ) );
+	spectrum = mSpectrumIndex;
+	for ( partition = 0; partition < numPartitions; partition++ ) {
+		DSP_FFT::multiplyAccumulate ( mScratchReal, mScratchImag, &filterReal[partition * mBlockFrames], &filterImag[partition * mBlockFrames], &mSpectraReal[spectrum * mBlockFrames], &mSpectraImag[spectrum * mBlockFrames], mBlockFrames );
+		if ( ++spectrum == numPartitions ) {
+			spectrum = 0;
+		}
+	}
+	mFFT->inverse ( mScratchReal, mScratchImag, mTime );
+
+	errorPower = 0.0f;
+	microphonePower = 0.0f;
+	for ( index = 0; index < mBlockFrames; index++ ) {
+		error = microphone[index] - mTime[mBlockFrames + index];
+		output[index] = error;
+		mTime[index] = 0.0f;
+		mTime[mBlockFrames + index] = error;
+		errorPower += error * error;
+		microphonePower += microphone[index] * microphone[index];
+	}
+
+	//	a filter that adds echo instead of removing it has diverged; pass the microphone and start over
+	if ( errorPower > kEchoDivergenceRatio * microphonePower + (float)mBlockFrames * kEchoPowerFloor ) {
+		memcpy ( output, microphone, mBlockFrames * sizeof ( float ) );
+		bzero ( filterReal, mMaxPartitions * mBlockFrames * sizeof ( float ) );
+		bzero ( filterImag, mMaxPartitions * mBlockFrames * sizeof ( float ) );
+		return;
+	}
+	if ( !inAdapt ) {
+		return;
+	}
+
+	//	error spectrum scaled by the per bin normalized step
+	mFFT->forward ( mTime, mScratchReal, mScratchImag );
+	regularization = 2.0f * (float)mBlockFrames * kEchoPowerFloor;
+	step = mLive.step / (float)numPartitions;
+	mScratchReal[0] *= step / ( mPower[0] + regularization );
+	mScratchImag[0] *= step / ( mPower[mBlockFrames] + regularization );
+	for ( index = 1; index < mBlockFrames; index++ ) {
+		mScratchReal[index] *= step / ( mPower[index] + regularization );
+		mScratchImag[index] *= step / ( mPower[index] + regularization );
+	}
+
+	spectrum = mSpectrumIndex;
+	for ( partition = 0; partition < numPartitions; partition++ ) {
+		DSP_FFT::multiplyAccumulateConjugate ( &filterReal[partition * mBlockFrames], &filterImag[partition * mBlockFrames], &mSpectraReal[spectrum * mBlockFrames], &mSpectraImag[spectrum * mBlockFrames], mScratchReal, mScratchImag, mBlockFrames );
+		if ( ++spectrum == numPartitions ) {
+			spectrum = 0;
+		}
+	}
+
+	//	bring one partition back to B taps so circular wrap does not build up in the filter
+	partition = ( mConstrainIndex < numPartitions ) ? mConstrainIndex : 0;
+	memcpy ( mScratchReal, &filterReal[partition * mBlockFrames], mBlockFrames * sizeof ( float ) );
+	memcpy ( mScratchImag, &filterImag[partition * mBlockFrames], mBlockFrames * sizeof ( float ) );
+	mFFT->inverse ( mScratchReal, mScratchImag, mTime );
+	bzero ( &mTime[mBlockFrames], mBlockFrames * sizeof ( float ) );
+	mFFT->forward ( mTime, &filterReal[partition * mBlockFrames], &filterImag[partition * mBlockFrames] );
+}
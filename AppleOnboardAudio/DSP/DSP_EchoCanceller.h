@@ -0,0 +1,135 @@
+/*
+ *  DSP_EchoCanceller.h
+ *  AppleOnboardAudio
+ *
+ *  Acoustic echo canceller for the internal speakers and microphones, run
+ *  as part of the capture chain.  The echo path is modelled by a
+ *  partitioned block frequency domain adaptive filter (PBFDAF) with per bin
+ *  normalized steps:  the filter is K partitions of B taps, the reference
+ *  is kept as a delay line of K spectra, and one 2B point FFT, one inverse
+ *  and an update of every partition are done per B frames.  One partition
+ *  per block has its gradient constrained back to B taps, in rotation.
+ *
+ *  The reference is what the output IOProc hands to the DAC, mixed to mono
+ *  and stored in a ring indexed by sample frame within the DMA buffer.  The
+ *  input and output DMA programs run from the same clock over buffers of
+ *  the same length, so output frame n and input frame n are converted at
+ *  the same instant and the ring lines the two streams up to the sample
+ *  with no time stamps.  The input side clears each reference frame once it
+ *  has used it, so when the output stops the canceller sees silence rather
+ *  than a stale loop of audio.
+ *
+ *  Cost is fixed by the partition count, which is capped at
+ *  kEchoPartitionBudget across all channels.  The canceller adds one block
+ *  of latency to the input stream.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSP_ECHOCANCELLER__
+#define __DSP_ECHOCANCELLER__
+
+#include "DSP_Processor.h"
+#include "DSP_FFT.h"
+
+//	'EchoCanceller' dictionary keys, within the input 'SoftwareDSP' dictionary
+#define kEchoCancellerEntry				"EchoCanceller"
+#define kEchoTailMilliseconds			"TailMilliseconds"		/*	echo path length to model							*/
+#define kEchoBlockFrames				"BlockFrames"			/*	B, power of two; fixed once allocated				*/
+#define kEchoStepPercent				"StepPercent"			/*	normalized adaptation step * 100					*/
+#define kEchoDoubleTalkDecibels			"DoubleTalkDecibels"	/*	microphone peak over reference peak that freezes adaptation	*/
+#define kEchoReferenceDelayFrames		"ReferenceDelayFrames"	/*	bulk delay ahead of the modelled tail				*/
+
+#define kEchoDefaultTailMilliseconds	40
+#define kEchoDefaultBlockFrames			128
+#define kEchoMinBlockFrames				64
+#define kEchoMaxBlockFrames				512
+#define kEchoDefaultStepPercent			50
+#define kEchoDefaultDoubleTalkDecibels	-6
+#define kEchoPartitionBudget			32						/*	partitions summed over all channels					*/
+#define kEchoDoubleTalkHoldBlocks		16
+
+typedef struct {
+	float					step;
+	float					doubleTalkRatio;
+	UInt32					referenceDelay;				//	frames, less than the reference ring
+	UInt32					numPartitions;				//	K, no more than mMaxPartitions
+	bool					active;
+	UInt32					resetCount;					//	a change clears the filters and the reference
+} EchoSettings;
+
+class DSP_EchoCanceller : public OSObject {
+
+    OSDeclareDefaultStructors ( DSP_EchoCanceller );
+
+public:
+
+	//	inReferenceFrames is the length of the DMA buffer in sample frames
+	static DSP_EchoCanceller *	create ( UInt32 inNumChannels, UInt32 inBlockFrames, UInt32 inReferenceFrames );
+
+	virtual bool			init ( UInt32 inNumChannels, UInt32 inBlockFrames, UInt32 inReferenceFrames );
+	virtual void			free ( void );
+
+	//	command gate; a null or bypassed dictionary turns the canceller off
+	void					setParameters ( OSDictionary * inDictionary );
+	void					setSampleRate ( UInt32 inSampleRate );
+	void					reset ( void );
+
+	bool					isActive ( void ) { return mSettings.active; }
+	UInt32					getLatency ( void ) { return mBlockFrames; }
+	UInt32					getBlockFrames ( void ) { return mBlockFrames; }
+	UInt32					getReferenceFrames ( void ) { return mReferenceFrames; }
+
+	//	output IOProc:  inBuffer holds inNumFrames frames of inNumChannels samples destined for DMA buffer frame inFirstFrame
+	void					writeReference ( const float * inBuffer, UInt32 inFirstFrame, UInt32 inNumFrames, UInt32 inNumChannels );
+
+	//	input IOProc:  ioBuffer holds inNumFrames frames captured at DMA buffer frame inFirstFrame
+	void					process ( float * ioBuffer, UInt32 inFirstFrame, UInt32 inNumFrames );
+
+protected:
+
+	void					publishSettings ( void );
+	void					clearState ( void );
+	void					processBlock ( void );
+	void					cancelChannel ( UInt32 inChannel, bool inAdapt );
+
+	DSP_FFT *				mFFT;						//	2B points
+	float *					mMemory;					//	every buffer below comes out of this one block
+	UInt32					mMemoryBytes;
+	UInt32					mNumChannels;
+	UInt32					mBlockFrames;				//	B
+	UInt32					mMaxPartitions;
+	UInt32					mReferenceFrames;
+	UInt32					mSampleRate;
+
+	//	command gate side
+	UInt32					mTailMilliseconds;
+	EchoSettings			mSettings;
+	EchoSettings			mSettingsSlots[kDSPExchangeSlots];
+	DSPExchange				mExchange;
+
+	//	written by the output IOProc, read and cleared by the input IOProc
+	float *					mReference;
+
+	//	input IOProc side
+	EchoSettings			mLive;
+	float *					mFilterReal[kDSPMaxChannels];	//	mMaxPartitions spectra of B bins
+	float *					mFilterImag[kDSPMaxChannels];
+	float *					mSpectraReal;				//	reference spectra, newest at mSpectrumIndex
+	float *					mSpectraImag;
+	float *					mPower;						//	smoothed reference power per bin; [0] DC, [B] Nyquist
+	float *					mReferenceBlock;			//	previous and current reference block, 2B
+	float *					mMicrophone[kDSPMaxChannels];	//	B frames being collected
+	float *					mOutput[kDSPMaxChannels];	//	B cancelled frames being played out
+	float *					mScratchReal;				//	B bins
+	float *					mScratchImag;
+	float *					mTime;						//	2B
+	float *					mBlockPeaks;				//	reference peak of each block held in the spectra
+	UInt32					mSpectrumIndex;
+	UInt32					mConstrainIndex;
+	UInt32					mPosition;					//	frames into the current block
+	UInt32					mDoubleTalkHold;
+};
+
+#endif
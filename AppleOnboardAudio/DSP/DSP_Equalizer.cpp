@@ -0,0 +1,743 @@
+/*
+ *  DSP_Equalizer.cpp
+ *  AppleOnboardAudio
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#include "DSP_Equalizer.h"
+
+#include "AppleDBDMAFloatLib.h"
+
+static const float kEQTwoPi					= 6.28318530717958647692f;
+static const float kEQMaxNormalizedFreq		= 0.45f;
+static const float kEQFourDotTwentyScale	= 1048576.0f;
+static const float kEQFourDotTwentyLSB		= 1.0f / 1048576.0f;
+static const float kEQFourDotTwentyMax		= 8.0f - 1.0f / 1048576.0f;
+static const float kEQMinLeadingCoefficient	= 1.0e-12f;
+static const float kEQGridLowFrequency		= 20.0f;
+static const float kEQMaxSectionError		= 1.0e30f;
+static const float kEQSectionHeadroom		= 4.0f;
+
+#define kEQGridPoints					32
+#define kEQPoleSearchSteps				1
+#define kEQMaxEvaluationPoints			( kEQGridPoints + 6 * kEQMaxCodecSections )
+
+//	one quadratic factor lead ( 1 + c1 z^-1 + c2 z^-2 ) and the root that stands
+//	for it: the upper one of a complex pair or the larger real root
+typedef struct {
+	float					lead;
+	float					c1;
+	float					c2;
+	float					re;
+	float					im;
+	float					radius;
+} EQRootPair;
+
+#pragma mark ------------------------
+#pragma mark --- Band Specifications
+#pragma mark ------------------------
+
+bool EQReadBandSpec ( OSDictionary * inDictionary, EQBandSpec * outSpec ) {
+	OSString *				theType;
+	SInt32					frequency;
+	SInt32					centiQ;
+	SInt32					centiDecibels;
+	bool					result = false;
+
+	FailIf ( 0 == inDictionary, Exit );
+	theType = OSDynamicCast ( OSString, inDictionary->getObject ( kEQBandType ) );
+	FailIf ( 0 == theType, Exit );
+
+	if ( theType->isEqualTo ( kEQBandTypePeak ) ) {
+		outSpec->type = kEQPeak;
+	} else if ( theType->isEqualTo ( kEQBandTypeLowShelf ) ) {
+		outSpec->type = kEQLowShelf;
+	} else if ( theType->isEqualTo ( kEQBandTypeHighShelf ) ) {
+		outSpec->type = kEQHighShelf;
+	} else if ( theType->isEqualTo ( kEQBandTypeLowPass ) ) {
+		outSpec->type = kEQLowPass;
+	} else if ( theType->isEqualTo ( kEQBandTypeHighPass ) ) {
+		outSpec->type = kEQHighPass;
+	} else {
+		debugIOLog ( 1, "  EQReadBandSpec unknown band type '%s'", theType->getCStringNoCopy () );
+		goto Exit;
+	}
+
+	frequency = DSPGetSInt32Parameter ( inDictionary, kEQBandFrequency, 0 );
+	FailIf ( frequency <= 0, Exit );
+
+	centiQ = DSPGetSInt32Parameter ( inDictionary, kEQBandCentiQ, kEQDefaultCentiQ );
+	if ( centiQ < kEQMinCentiQ ) {
+		centiQ = kEQMinCentiQ;
+	} else if ( centiQ > kEQMaxCentiQ ) {
+		centiQ = kEQMaxCentiQ;
+	}
+
+	centiDecibels = DSPGetSInt32Parameter ( inDictionary, kEQBandCentiDecibels, 0 );
+	if ( centiDecibels < -kEQMaxCentiDecibels ) {
+		centiDecibels = -kEQMaxCentiDecibels;
+	} else if ( centiDecibels > kEQMaxCentiDecibels ) {
+		centiDecibels = kEQMaxCentiDecibels;
+	}
+
+	outSpec->frequency = (float)frequency;
+	outSpec->q = (float)centiQ / 100.0f;
+	outSpec->gaindB = (float)centiDecibels / 100.0f;
+	result = true;
+Exit:
+	return result;
+}
+
+UInt32 EQReadBandArray ( OSArray * inArray, EQBandSpec * outSpecs, UInt32 inMaxBands ) {
+	UInt32					index;
+	UInt32					count;
+
+	count = 0;
+	if ( 0 != inArray ) {
+		for ( index = 0; index < inArray->getCount () && count < inMaxBands; index++ ) {
+			if ( EQReadBandSpec ( OSDynamicCast ( OSDictionary, inArray->getObject ( index ) ), &outSpecs[count] ) ) {
+				count++;
+			}
+		}
+	}
+	return count;
+}
+
+#pragma mark ------------------------
+#pragma mark --- Design
+#pragma mark ------------------------
+
+void EQSetIdentity ( EQBiquad * outBiquad ) {
+	outBiquad->b0 = 1.0f;
+	outBiquad->b1 = 0.0f;
+	outBiquad->b2 = 0.0f;
+	outBiquad->a1 = 0.0f;
+	outBiquad->a2 = 0.0f;
+}
+
+//	Bilinear transform designs after R. Bristow-Johnson's cookbook.  1 - cos w
+//	is taken as 2 sin^2 ( w / 2 ) so low corners keep their precision in
+//	single precision.
+void EQDesignBiquad ( const EQBandSpec * inSpec, UInt32 inSampleRate, EQBiquad * outBiquad ) {
+	float					w0;
+	float					cw;
+	float					sw;
+	float					oneMinusCos;
+	float					alpha;
+	float					A;
+	float					twoRootAAlpha;
+	float					b0;
+	float					b1;
+	float					b2;
+	float					a0;
+	float					a1;
+	float					a2;
+
+	if ( 0 == inSampleRate || inSpec->frequency >= kEQMaxNormalizedFreq * (float)inSampleRate ) {
+		EQSetIdentity ( outBiquad );
+		return;
+	}
+
+	w0 = kEQTwoPi * inSpec->frequency / (float)inSampleRate;
+	cw = dspCos ( w0 );
+	sw = dspSin ( w0 );
+	oneMinusCos = dspSin ( 0.5f * w0 );
+	oneMinusCos = 2.0f * oneMinusCos * oneMinusCos;
+	alpha = sw / ( 2.0f * inSpec->q );
+	A = dspPow ( 10.0f, inSpec->gaindB / 40.0f );
+	twoRootAAlpha = 2.0f * dspSqrt ( A ) * alpha;
+
+	switch ( inSpec->type ) {
+		case kEQLowShelf:
+			b0 = A * ( ( A + 1.0f ) - ( A - 1.0f ) * cw + twoRootAAlpha );
+			b1 = 2.0f * A * ( ( A - 1.0f ) - ( A + 1.0f ) * cw );
+			b2 = A * ( ( A + 1.0f ) - ( A - 1.0f ) * cw - twoRootAAlpha );
+			a0 = ( A + 1.0f ) + ( A - 1.0f ) * cw + twoRootAAlpha;
+			a1 = -2.0f * ( ( A - 1.0f ) + ( A + 1.0f ) * cw );
+			a2 = ( A + 1.0f ) + ( A - 1.0f ) * cw - twoRootAAlpha;
+			break;
+		case kEQHighShelf:
+			b0 = A * ( ( A + 1.0f ) + ( A - 1.0f ) * cw + twoRootAAlpha );
+			b1 = -2.0f * A * ( ( A - 1.0f ) + ( A + 1.0f ) * cw );
+			b2 = A * ( ( A + 1.0f ) + ( A - 1.0f ) * cw - twoRootAAlpha );
+			a0 = ( A + 1.0f ) - ( A - 1.0f ) * cw + twoRootAAlpha;
+			a1 = 2.0f * ( ( A - 1.0f ) - ( A + 1.0f ) * cw );
+			a2 = ( A + 1.0f ) - ( A - 1.0f ) * cw - twoRootAAlpha;
+			break;
+		case kEQLowPass:
+			b0 = 0.5f * oneMinusCos;
+			b1 = oneMinusCos;
+			b2 = 0.5f * oneMinusCos;
+			a0 = 1.0f + alpha;
+			a1 = -2.0f * cw;
+			a2 = 1.0f - alpha;
+			break;
+		case kEQHighPass:
+			b0 = 0.5f * ( 2.0f - oneMinusCos );
+			b1 = -( 2.0f - oneMinusCos );
+			b2 = 0.5f * ( 2.0f - oneMinusCos );
+			a0 = 1.0f + alpha;
+			a1 = -2.0f * cw;
+			a2 = 1.0f - alpha;
+			break;
+		case kEQPeak:
+		default:
+			b0 = 1.0f + alpha * A;
+			b1 = -2.0f * cw;
+			b2 = 1.0f - alpha * A;
+			a0 = 1.0f + alpha / A;
+			a1 = -2.0f * cw;
+			a2 = 1.0f - alpha / A;
+			break;
+	}
+
+	outBiquad->b0 = b0 / a0;
+	outBiquad->b1 = b1 / a0;
+	outBiquad->b2 = b2 / a0;
+	outBiquad->a1 = a1 / a0;
+	outBiquad->a2 = a2 / a0;
+}
+
+#pragma mark ------------------------
+#pragma mark --- Codec Export
+#pragma mark ------------------------
+
+float EQQuantizeFourDotTwenty ( float inValue, FourDotTwenty * outValue ) {
+	SInt32					fixed;
+
+	if ( inValue > kEQFourDotTwentyMax ) {
+		inValue = kEQFourDotTwentyMax;
+	} else if ( inValue < -8.0f ) {
+		inValue = -8.0f;
+	}
+	fixed = (SInt32)( inValue * kEQFourDotTwentyScale + ( inValue < 0.0f ? -0.5f : 0.5f ) );
+
+	outValue->integerAndFraction1 = (UInt8)( ( fixed >> 16 ) & 0xFF );
+	outValue->fraction2 = (UInt8)( ( fixed >> 8 ) & 0xFF );
+	outValue->fraction3 = (UInt8)( fixed & 0xFF );
+	return (float)fixed * kEQFourDotTwentyLSB;
+}
+
+float EQFourDotTwentyToFloat ( const FourDotTwenty * inValue ) {
+	SInt32					fixed;
+
+	fixed = ( (SInt32)inValue->integerAndFraction1 << 16 ) | ( (SInt32)inValue->fraction2 << 8 ) | (SInt32)inValue->fraction3;
+	if ( fixed & 0x00800000 ) {
+		fixed -= 0x01000000;
+	}
+	return (float)fixed * kEQFourDotTwentyLSB;
+}
+
+static void EQFactorQuadratic ( float inC1, float inC2, EQRootPair * outPair ) {
+	float					discriminant;
+	float					root;
+	float					r1;
+	float					r2;
+
+	outPair->lead = 1.0f;
+	outPair->c1 = inC1;
+	outPair->c2 = inC2;
+	discriminant = inC1 * inC1 - 4.0f * inC2;
+	if ( discriminant < 0.0f ) {
+		outPair->re = -0.5f * inC1;
+		outPair->im = 0.5f * dspSqrt ( -discriminant );
+		outPair->radius = dspSqrt ( inC2 );
+	} else {
+		root = dspSqrt ( discriminant );
+		r1 = 0.5f * ( -inC1 + root );
+		r2 = 0.5f * ( -inC1 - root );
+		outPair->re = ( DSPAbs ( r1 ) >= DSPAbs ( r2 ) ) ? r1 : r2;
+		outPair->im = 0.0f;
+		outPair->radius = DSPAbs ( outPair->re );
+	}
+}
+
+//	| c0 + c1 e^-jw + c2 e^-2jw |^2 written in s = sin^2 ( w / 2 ) as
+//	( c0 + c1 + c2 - 2 s ( c0 + c2 ) )^2 + ( c0 - c2 )^2 sin^2 w.  Expanding in
+//	cos w instead cancels away all of single precision for a pole pair near DC.
+static float EQQuadraticMagnitudeSquared ( float inC0, float inC1, float inC2, float inHalfSineSquared ) {
+	float					re;
+	float					im;
+
+	re = ( inC0 + inC1 + inC2 ) - 2.0f * inHalfSineSquared * ( inC0 + inC2 );
+	im = inC0 - inC2;
+	return re * re + 4.0f * inHalfSineSquared * ( 1.0f - inHalfSineSquared ) * im * im;
+}
+
+static float EQHalfSineSquared ( float inFrequency, UInt32 inSampleRate ) {
+	float					halfSine;
+
+	halfSine = dspSin ( 0.5f * kEQTwoPi * inFrequency / (float)inSampleRate );
+	return halfSine * halfSine;
+}
+
+//	Largest ratio, either way up, between the squared response of a trial
+//	section and the exact one over the evaluation points.
+static float EQSectionError ( const EQBiquad * inTrial, const float * inExactSquared, const float * inEvaluationPoints, UInt32 inNumPoints ) {
+	float					ratio;
+	float					error;
+	UInt32					index;
+
+	error = 1.0f;
+	for ( index = 0; index < inNumPoints; index++ ) {
+		if ( 0.0f == inExactSquared[index] ) {
+			continue;
+		}
+		ratio = EQQuadraticMagnitudeSquared ( inTrial->b0, inTrial->b1, inTrial->b2, inEvaluationPoints[index] ) / ( EQQuadraticMagnitudeSquared ( 1.0f, inTrial->a1, inTrial->a2, inEvaluationPoints[index] ) * inExactSquared[index] );
+		if ( 0.0f == ratio ) {
+			ratio = kEQMaxSectionError;
+		} else if ( ratio < 1.0f ) {
+			ratio = 1.0f / ratio;
+		}
+		if ( ratio > error ) {
+			error = ratio;
+		}
+	}
+	return error;
+}
+
+//	Rounds one section to 4.20.  Near DC the coefficient grid of a direct form
+//	section is coarse enough to move a narrow band or shelf by a fraction of a
+//	hertz, and rounding a1 and b1 separately can pull the poles and zeros of a
+//	low shelf apart by decibels.  So the pole pairs one step either side of
+//	the rounded one are tried, each with b1 solved for an exact DC gain, with
+//	b1 simply rounded and with b1 one step either side of the solved value,
+//	and the trial whose response stays closest to the exact section at the
+//	evaluation points is kept.  Returns the factor the numerator had to give
+//	up to stay within +/-8, 1 when nothing was lost.
+static float EQQuantizeSection ( const EQBiquad * inSection, const float * inEvaluationPoints, UInt32 inNumPoints, FourDotTwenty * outCoefficients, EQBiquad * outQuantized ) {
+	FourDotTwenty			candidate[kEQCoefficientsPerSection];
+	EQBiquad				trial;
+	float					exactSquared[kEQMaxEvaluationPoints];
+	float					roundedA1;
+	float					roundedA2;
+	float					b1;
+	float					dcGain;
+	float					largest;
+	float					reduction;
+	float					error;
+	float					bestError;
+	SInt32					step1;
+	SInt32					step2;
+	UInt32					choice;
+	UInt32					index;
+
+	largest = DSPAbs ( inSection->b0 );
+	if ( DSPAbs ( inSection->b1 ) > largest ) {
+		largest = DSPAbs ( inSection->b1 );
+	}
+	if ( DSPAbs ( inSection->b2 ) > largest ) {
+		largest = DSPAbs ( inSection->b2 );
+	}
+	reduction = 1.0f;
+	if ( largest > kEQFourDotTwentyMax ) {
+		reduction = kEQFourDotTwentyMax / largest;
+	}
+
+	dcGain = reduction * ( inSection->b0 + inSection->b1 + inSection->b2 ) / ( 1.0f + inSection->a1 + inSection->a2 );
+	for ( index = 0; index < inNumPoints; index++ ) {
+		exactSquared[index] = reduction * reduction * EQQuadraticMagnitudeSquared ( inSection->b0, inSection->b1, inSection->b2, inEvaluationPoints[index] ) / EQQuadraticMagnitudeSquared ( 1.0f, inSection->a1, inSection->a2, inEvaluationPoints[index] );
+	}
+
+	roundedA1 = (float)(SInt32)( inSection->a1 * kEQFourDotTwentyScale + ( inSection->a1 < 0.0f ? -0.5f : 0.5f ) ) * kEQFourDotTwentyLSB;
+	roundedA2 = (float)(SInt32)( inSection->a2 * kEQFourDotTwentyScale + ( inSection->a2 < 0.0f ? -0.5f : 0.5f ) ) * kEQFourDotTwentyLSB;
+	bestError = 0.0f;
+	for ( step2 = 0; step2 < 2 * kEQPoleSearchSteps + 1; step2++ ) {
+		for ( step1 = 0; step1 < 2 * kEQPoleSearchSteps + 1; step1++ ) {
+			//	0, +1, -1, +2, ... so the plain rounding is tried first and wins ties
+			trial.a1 = EQQuantizeFourDotTwenty ( roundedA1 + (float)( ( step1 & 1 ) ? ( step1 + 1 ) / 2 : -step1 / 2 ) * kEQFourDotTwentyLSB, &candidate[3] );
+			trial.a2 = EQQuantizeFourDotTwenty ( roundedA2 + (float)( ( step2 & 1 ) ? ( step2 + 1 ) / 2 : -step2 / 2 ) * kEQFourDotTwentyLSB, &candidate[4] );
+			if ( trial.a2 >= 1.0f || DSPAbs ( trial.a1 ) >= 1.0f + trial.a2 ) {
+				continue;
+			}
+			trial.b0 = EQQuantizeFourDotTwenty ( reduction * inSection->b0, &candidate[0] );
+			trial.b2 = EQQuantizeFourDotTwenty ( reduction * inSection->b2, &candidate[2] );
+			b1 = dcGain * ( 1.0f + trial.a1 + trial.a2 ) - trial.b0 - trial.b2;
+			for ( choice = 0; choice < 4; choice++ ) {
+				switch ( choice ) {
+					case 0:		trial.b1 = EQQuantizeFourDotTwenty ( b1, &candidate[1] );										break;
+					case 1:		trial.b1 = EQQuantizeFourDotTwenty ( reduction * inSection->b1, &candidate[1] );				break;
+					case 2:		trial.b1 = EQQuantizeFourDotTwenty ( b1 + kEQFourDotTwentyLSB, &candidate[1] );					break;
+					default:	trial.b1 = EQQuantizeFourDotTwenty ( b1 - kEQFourDotTwentyLSB, &candidate[1] );					break;
+				}
+				error = EQSectionError ( &trial, exactSquared, inEvaluationPoints, inNumPoints );
+				if ( 0.0f == bestError || error < bestError ) {
+					bestError = error;
+					*outQuantized = trial;
+					for ( index = 0; index < kEQCoefficientsPerSection; index++ ) {
+						outCoefficients[index] = candidate[index];
+					}
+				}
+			}
+		}
+	}
+	return reduction;
+}
+
+//	Spreads the numerator gain over the sections in processing order.  Under
+//	peak (L-infinity) scaling every partial cascade is scaled to peak where the
+//	complete one does, so no node between sections swings further than the
+//	output.  With inAsDesigned each section keeps the gain of the band its
+//	zeros came from instead, which keeps more numerator bits in a narrow low
+//	band, and false is returned if a node would then swing more than
+//	kEQSectionHeadroom past the output.  Either way a section whose numerator
+//	would need more than half the 4.20 range passes the excess on to the next,
+//	and whatever the last one cannot hold goes back onto earlier sections.
+static bool EQScaleSections ( const EQRootPair * inPoles, const EQRootPair * inZeros, const UInt32 * inOrder, const UInt32 * inPairing, UInt32 inNumBands, float inGain, bool inAsDesigned, const float * inEvaluationPoints, UInt32 inNumPoints, EQBiquad * outSections ) {
+	float					partialSquared[kEQMaxEvaluationPoints];
+	float					partialPeak[kEQMaxCodecSections];
+	float					largest[kEQMaxCodecSections];
+	float					sectionGain[kEQMaxCodecSections];
+	const EQRootPair *		pole;
+	const EQRootPair *		zero;
+	float					denominator;
+	float					peak;
+	float					totalPeak;
+	float					target;
+	float					previous;
+	float					excess;
+	float					room;
+	UInt32					index;
+	UInt32					point;
+
+	if ( 0 == inNumBands ) {
+		return true;
+	}
+	for ( point = 0; point < inNumPoints; point++ ) {
+		partialSquared[point] = 1.0f;
+	}
+	for ( index = 0; index < inNumBands; index++ ) {
+		pole = &inPoles[inOrder[index]];
+		zero = &inZeros[inPairing[inOrder[index]]];
+		peak = 0.0f;
+		for ( point = 0; point < inNumPoints; point++ ) {
+			denominator = EQQuadraticMagnitudeSquared ( 1.0f, pole->c1, pole->c2, inEvaluationPoints[point] );
+			if ( denominator > 0.0f ) {
+				partialSquared[point] *= EQQuadraticMagnitudeSquared ( 1.0f, zero->c1, zero->c2, inEvaluationPoints[point] ) / denominator;
+			}
+			if ( partialSquared[point] > peak ) {
+				peak = partialSquared[point];
+			}
+		}
+		partialPeak[index] = dspSqrt ( peak );
+		largest[index] = 1.0f;
+		if ( DSPAbs ( zero->c1 ) > largest[index] ) {
+			largest[index] = DSPAbs ( zero->c1 );
+		}
+		if ( DSPAbs ( zero->c2 ) > largest[index] ) {
+			largest[index] = DSPAbs ( zero->c2 );
+		}
+	}
+
+	totalPeak = DSPAbs ( inGain ) * partialPeak[inNumBands - 1];
+	previous = 1.0f;
+	for ( index = 0; index < inNumBands; index++ ) {
+		if ( inAsDesigned ) {
+			sectionGain[index] = inZeros[inPairing[inOrder[index]]].lead;
+			previous *= sectionGain[index];
+			if ( DSPAbs ( previous ) * partialPeak[index] > kEQSectionHeadroom * ( ( totalPeak > 1.0f ) ? totalPeak : 1.0f ) ) {
+				return false;
+			}
+			continue;
+		}
+		if ( index + 1 == inNumBands || 0.0f == totalPeak || 0.0f == partialPeak[index] ) {
+			target = inGain;
+		} else {
+			target = totalPeak / partialPeak[index];
+		}
+		sectionGain[index] = target / previous;
+		previous = target;
+	}
+
+	for ( index = 0; index + 1 < inNumBands; index++ ) {
+		excess = DSPAbs ( sectionGain[index] ) * largest[index] / kEQSectionHeadroom;
+		if ( excess > 1.0f ) {
+			sectionGain[index] /= excess;
+			sectionGain[index + 1] *= excess;
+		}
+	}
+	excess = DSPAbs ( sectionGain[inNumBands - 1] ) * largest[inNumBands - 1] / kEQSectionHeadroom;
+	for ( index = inNumBands - 1; index > 0 && excess > 1.0f; index-- ) {
+		room = kEQSectionHeadroom / ( DSPAbs ( sectionGain[index - 1] ) * largest[index - 1] );
+		if ( room > 1.0f ) {
+			if ( room > excess ) {
+				room = excess;
+			}
+			sectionGain[index - 1] *= room;
+			sectionGain[inNumBands - 1] /= room;
+			excess /= room;
+		}
+	}
+
+	for ( index = 0; index < inNumBands; index++ ) {
+		pole = &inPoles[inOrder[index]];
+		zero = &inZeros[inPairing[inOrder[index]]];
+		outSections[index].b0 = sectionGain[index];
+		outSections[index].b1 = sectionGain[index] * zero->c1;
+		outSections[index].b2 = sectionGain[index] * zero->c2;
+		outSections[index].a1 = pole->c1;
+		outSections[index].a2 = pole->c2;
+	}
+	return true;
+}
+
+//	Rounds the sections in order, carrying any gain one of them had to give up
+//	into the next.  Returns the largest ratio, either way up, between the
+//	squared response of the rounded cascade and inExactSquared.
+static float EQQuantizeCascade ( const EQBiquad * inSections, UInt32 inNumBands, const float * inExactSquared, const float * inEvaluationPoints, UInt32 inNumPoints, FourDotTwenty * outCoefficients, EQBiquad * outQuantized, float * outLostGain ) {
+	EQBiquad				section;
+	float					carry;
+	float					ratio;
+	float					error;
+	UInt32					index;
+	UInt32					point;
+
+	carry = 1.0f;
+	for ( index = 0; index < inNumBands; index++ ) {
+		section = inSections[index];
+		section.b0 *= carry;
+		section.b1 *= carry;
+		section.b2 *= carry;
+		carry = 1.0f / EQQuantizeSection ( &section, inEvaluationPoints, inNumPoints, &outCoefficients[index * kEQCoefficientsPerSection], &outQuantized[index] );
+	}
+	*outLostGain = carry;
+
+	error = 1.0f;
+	for ( point = 0; point < inNumPoints; point++ ) {
+		if ( 0.0f == inExactSquared[point] ) {
+			continue;
+		}
+		ratio = 1.0f / inExactSquared[point];
+		for ( index = 0; index < inNumBands; index++ ) {
+			ratio *= EQQuadraticMagnitudeSquared ( outQuantized[index].b0, outQuantized[index].b1, outQuantized[index].b2, inEvaluationPoints[point] ) / EQQuadraticMagnitudeSquared ( 1.0f, outQuantized[index].a1, outQuantized[index].a2, inEvaluationPoints[point] );
+		}
+		if ( 0.0f == ratio ) {
+			ratio = kEQMaxSectionError;
+		} else if ( ratio < 1.0f ) {
+			ratio = 1.0f / ratio;
+		}
+		if ( ratio > error ) {
+			error = ratio;
+		}
+	}
+	return error;
+}
+
+//	Each band's poles are kept, but its zeros are only a starting point.  The
+//	pole pair nearest the unit circle takes the nearest zero pair first, which
+//	keeps each section's own peak small, and sections run from the pole pair
+//	farthest from the unit circle to the nearest; with peak scaling that order
+//	is the least likely to overflow between sections and keeps the noise of
+//	the sharp sections out of the gain of the earlier ones.  Nearest is not
+//	always best for bands of different types, the zeros of a low pass at z = -1
+//	can end up on a shelf near DC, and peak scaling can leave a narrow low band
+//	too few numerator bits.  So the bands' own pairing is rounded as well, both
+//	peak scaled and with its designed gains, and whichever cascade lands
+//	closest to the exact response is used.
+UInt32 EQDesignCodecCascade ( const EQBandSpec * inSpecs, UInt32 inNumBands, UInt32 inSampleRate, UInt32 inNumSections, FourDotTwenty * outCoefficients, EQBiquad * outQuantized ) {
+	EQRootPair				poles[kEQMaxCodecSections];
+	EQRootPair				zeros[kEQMaxCodecSections];
+	EQBiquad				designed[kEQMaxCodecSections];
+	EQBiquad				sections[kEQMaxCodecSections];
+	EQBiquad				quantized[kEQMaxCodecSections];
+	EQBiquad				bestQuantized[kEQMaxCodecSections];
+	EQBiquad				identity;
+	FourDotTwenty			coefficients[kEQMaxCodecSections * kEQCoefficientsPerSection];
+	UInt32					order[kEQMaxCodecSections];
+	UInt32					pairing[kEQMaxCodecSections];
+	bool					zeroTaken[kEQMaxCodecSections];
+	float					evaluationPoints[kEQMaxEvaluationPoints];
+	float					exactSquared[kEQMaxEvaluationPoints];
+	UInt32					numBands;
+	UInt32					numPoints;
+	UInt32					candidate;
+	UInt32					index;
+	UInt32					inner;
+	UInt32					best;
+	UInt32					temp;
+	float					gain;
+	float					distance;
+	float					bestDistance;
+	float					halfSine;
+	float					halfCosine;
+	float					offset;
+	float					error;
+	float					bestError;
+	float					lostGain;
+	float					bestLostGain;
+	bool					ownPairing;
+
+	numBands = 0;
+	FailIf ( 0 == outCoefficients || 0 == inSampleRate, Exit );
+
+	gain = 1.0f;
+	for ( index = 0; index < inNumBands && numBands < inNumSections && numBands < kEQMaxCodecSections; index++ ) {
+		EQDesignBiquad ( &inSpecs[index], inSampleRate, &designed[numBands] );
+		if ( DSPAbs ( designed[numBands].b0 ) < kEQMinLeadingCoefficient ) {
+			debugIOLog ( 3, "  EQDesignCodecCascade band %ld has no usable numerator, skipped", index );
+			continue;
+		}
+		EQFactorQuadratic ( designed[numBands].a1, designed[numBands].a2, &poles[numBands] );
+		EQFactorQuadratic ( designed[numBands].b1 / designed[numBands].b0, designed[numBands].b2 / designed[numBands].b0, &zeros[numBands] );
+		zeros[numBands].lead = designed[numBands].b0;
+		gain *= designed[numBands].b0;
+		order[numBands] = numBands;
+		numBands++;
+	}
+	if ( numBands < inNumBands ) {
+		debugIOLog ( 3, "  EQDesignCodecCascade realized %ld of %ld bands in %ld sections", numBands, inNumBands, inNumSections );
+	}
+
+	//	processing order, least peaked pole pair first
+	for ( index = 1; index < numBands; index++ ) {
+		temp = order[index];
+		for ( inner = index; inner > 0 && poles[order[inner - 1]].radius > poles[temp].radius; inner-- ) {
+			order[inner] = order[inner - 1];
+		}
+		order[inner] = temp;
+	}
+
+	//	a log spaced grid plus every pole frequency and band centre, so narrow peaks are not missed
+	numPoints = 0;
+	for ( index = 0; index < kEQGridPoints; index++ ) {
+		evaluationPoints[numPoints++] = EQHalfSineSquared ( kEQGridLowFrequency * dspPow ( kEQMaxNormalizedFreq * (float)inSampleRate / kEQGridLowFrequency, (float)index / (float)( kEQGridPoints - 1 ) ), inSampleRate );
+	}
+	for ( index = 0; index < numBands; index++ ) {
+		if ( 0.0f != poles[index].im && poles[index].radius > 0.0f ) {
+			//	the pole frequency and a quarter and half a bandwidth either side, where a shifted pole shows most
+			if ( poles[index].re > 0.0f ) {
+				halfSine = poles[index].im * poles[index].im / ( 2.0f * poles[index].radius * ( poles[index].radius + poles[index].re ) );
+			} else {
+				halfSine = ( poles[index].radius - poles[index].re ) / ( 2.0f * poles[index].radius );
+			}
+			halfCosine = dspSqrt ( 1.0f - halfSine );
+			halfSine = dspSqrt ( halfSine );
+			evaluationPoints[numPoints++] = halfSine * halfSine;
+			for ( inner = 1; inner <= 2; inner++ ) {
+				distance = 0.25f * (float)inner * ( 1.0f - poles[index].radius );
+				offset = halfSine * dspCos ( distance ) - halfCosine * dspSin ( distance );
+				evaluationPoints[numPoints++] = offset * offset;
+				offset = halfSine * dspCos ( distance ) + halfCosine * dspSin ( distance );
+				evaluationPoints[numPoints++] = offset * offset;
+			}
+		}
+	}
+	for ( index = 0; index < inNumBands && index < kEQMaxCodecSections; index++ ) {
+		if ( inSpecs[index].frequency < kEQMaxNormalizedFreq * (float)inSampleRate ) {
+			evaluationPoints[numPoints++] = EQHalfSineSquared ( inSpecs[index].frequency, inSampleRate );
+		}
+	}
+	for ( index = 0; index < numPoints; index++ ) {
+		exactSquared[index] = 1.0f;
+		for ( inner = 0; inner < numBands; inner++ ) {
+			exactSquared[index] *= EQQuadraticMagnitudeSquared ( designed[inner].b0, designed[inner].b1, designed[inner].b2, evaluationPoints[index] ) / EQQuadraticMagnitudeSquared ( 1.0f, designed[inner].a1, designed[inner].a2, evaluationPoints[index] );
+		}
+	}
+
+	//	nearest zero pair, most peaked pole pair first
+	for ( index = 0; index < numBands; index++ ) {
+		zeroTaken[index] = false;
+	}
+	for ( index = numBands; index > 0; index-- ) {
+		temp = order[index - 1];
+		best = numBands;
+		bestDistance = 0.0f;
+		for ( inner = 0; inner < numBands; inner++ ) {
+			if ( zeroTaken[inner] ) {
+				continue;
+			}
+			distance = ( zeros[inner].re - poles[temp].re ) * ( zeros[inner].re - poles[temp].re ) + ( zeros[inner].im - poles[temp].im ) * ( zeros[inner].im - poles[temp].im );
+			if ( numBands == best || distance < bestDistance ) {
+				best = inner;
+				bestDistance = distance;
+			}
+		}
+		zeroTaken[best] = true;
+		pairing[temp] = best;
+	}
+	ownPairing = true;
+	for ( index = 0; index < numBands; index++ ) {
+		if ( pairing[index] != index ) {
+			ownPairing = false;
+		}
+	}
+
+	//	nearest pairs with peak scaling, then the bands' own pairs with peak scaling and as designed
+	bestError = 0.0f;
+	bestLostGain = 1.0f;
+	for ( candidate = 0; candidate < 3; candidate++ ) {
+		if ( 1 == candidate ) {
+			if ( ownPairing ) {
+				continue;
+			}
+			for ( index = 0; index < numBands; index++ ) {
+				pairing[index] = index;
+			}
+		}
+		if ( !EQScaleSections ( poles, zeros, order, pairing, numBands, gain, 2 == candidate, evaluationPoints, numPoints, sections ) ) {
+			continue;
+		}
+		error = EQQuantizeCascade ( sections, numBands, exactSquared, evaluationPoints, numPoints, coefficients, quantized, &lostGain );
+		if ( 0.0f == bestError || error < bestError ) {
+			bestError = error;
+			bestLostGain = lostGain;
+			for ( index = 0; index < numBands; index++ ) {
+				bestQuantized[index] = quantized[index];
+			}
+			for ( index = 0; index < numBands * kEQCoefficientsPerSection; index++ ) {
+				outCoefficients[index] = coefficients[index];
+			}
+		}
+	}
+	if ( bestLostGain > 1.0f ) {
+		debugIOLog ( 3, "  EQDesignCodecCascade lost %ld centidB of gain to the 4.20 range", (SInt32)( 2000.0f * dspLog10 ( bestLostGain ) ) );
+	}
+
+	for ( index = 0; index < inNumSections; index++ ) {
+		if ( index >= numBands ) {
+			EQSetIdentity ( &identity );
+			EQQuantizeSection ( &identity, evaluationPoints, 0, &outCoefficients[index * kEQCoefficientsPerSection], &identity );
+		}
+		if ( 0 != outQuantized ) {
+			outQuantized[index] = ( index < numBands ) ? bestQuantized[index] : identity;
+		}
+	}
+Exit:
+	return numBands;
+}
+
+float EQCascadePeakGain ( const EQBiquad * inSections, UInt32 inNumSections, UInt32 inSampleRate ) {
+	float					halfSineSquared;
+	float					squared;
+	float					denominator;
+	float					peak;
+	UInt32					point;
+	UInt32					index;
+
+	peak = 0.0f;
+	FailIf ( 0 == inSampleRate, Exit );
+	for ( point = 0; point < kEQGridPoints + 2; point++ ) {
+		if ( 0 == point ) {
+			halfSineSquared = 0.0f;
+		} else if ( kEQGridPoints + 1 == point ) {
+			halfSineSquared = 1.0f;
+		} else {
+			halfSineSquared = EQHalfSineSquared ( kEQGridLowFrequency * dspPow ( 0.5f * (float)inSampleRate / kEQGridLowFrequency, (float)( point - 1 ) / (float)( kEQGridPoints - 1 ) ), inSampleRate );
+		}
+		squared = 1.0f;
+		for ( index = 0; index < inNumSections; index++ ) {
+			denominator = EQQuadraticMagnitudeSquared ( 1.0f, inSections[index].a1, inSections[index].a2, halfSineSquared );
+			if ( denominator > 0.0f ) {
+				squared *= EQQuadraticMagnitudeSquared ( inSections[index].b0, inSections[index].b1, inSections[index].b2, halfSineSquared ) / denominator;
+			}
+		}
+		if ( squared > peak ) {
+			peak = squared;
+		}
+	}
+	peak = dspSqrt ( peak );
+Exit:
+	return peak;
+}
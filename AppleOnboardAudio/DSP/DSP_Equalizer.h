@@ -1 +1,127 @@
+/*
+ *  DSP_Equalizer.h
+ *  AppleOnboardAudio
+ *
+ *  Second order filter sections for the software stages.  A band is given
+ *  in a 'SoftwareDSP' dictionary as a type, a frequency, a Q and a gain and
+ *  is turned into biquad coefficients for the current sample rate with the
+ *  usual bilinear transform designs.
+ *
+ *  Sections run in transposed direct form II, which keeps two state values
+ *  per section and behaves well in single precision.
+ *
+ *  The same band specifications also feed codecs with fixed point biquads.
+ *  EQDesignCodecCascade re-pairs poles and zeros across the bands, orders and
+ *  scales the sections against overflow and rounds each one to 4.20 by
+ *  searching the neighbouring coefficients, so the hardware and the software
+ *  equalizer are built from one description.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
 
+#ifndef __DSP_EQUALIZER__
+#define __DSP_EQUALIZER__
+
+#include <libkern/c++/OSArray.h>
+#include <libkern/c++/OSString.h>
+
+#include "DSP_Common.h"
+#include "AppleDBDMAFloatLib.h"
+
+//	band dictionary keys
+#define kEQBandType						"Type"					/*	one of the type strings below						*/
+#define kEQBandFrequency				"Frequency"				/*	Hz													*/
+#define kEQBandCentiQ					"CentiQ"				/*	Q * 100, default 71 (Butterworth)					*/
+#define kEQBandCentiDecibels			"CentiDecibels"			/*	gain * 100 for peak and shelf bands					*/
+
+#define kEQBandTypePeak					"Peak"
+#define kEQBandTypeLowShelf				"LowShelf"
+#define kEQBandTypeHighShelf			"HighShelf"
+#define kEQBandTypeLowPass				"LowPass"
+#define kEQBandTypeHighPass				"HighPass"
+
+#define kEQDefaultCentiQ				71
+#define kEQMinCentiQ					10
+#define kEQMaxCentiQ					2000
+#define kEQMaxCentiDecibels				2400
+
+#define kEQMaxCodecSections				8
+#define kEQCoefficientsPerSection		5					/*	b0, b1, b2, a1, a2 as the codecs expect them		*/
+
+typedef enum {
+	kEQPeak							= 0,
+	kEQLowShelf,
+	kEQHighShelf,
+	kEQLowPass,
+	kEQHighPass
+} EQBandType;
+
+typedef struct {
+	EQBandType				type;
+	float					frequency;					//	Hz
+	float					q;
+	float					gaindB;
+} EQBandSpec;
+
+//	normalized so a0 == 1
+typedef struct {
+	float					b0;
+	float					b1;
+	float					b2;
+	float					a1;
+	float					a2;
+} EQBiquad;
+
+typedef struct {
+	float					z1;
+	float					z2;
+} EQBiquadState;
+
+//	false when the dictionary does not describe a usable band
+bool	EQReadBandSpec ( OSDictionary * inDictionary, EQBandSpec * outSpec );
+
+//	reads up to inMaxBands band dictionaries from an array and returns how many were usable
+UInt32	EQReadBandArray ( OSArray * inArray, EQBandSpec * outSpecs, UInt32 inMaxBands );
+
+//	a band at or above 45% of the sample rate designs to an identity section
+void	EQDesignBiquad ( const EQBandSpec * inSpec, UInt32 inSampleRate, EQBiquad * outBiquad );
+
+void	EQSetIdentity ( EQBiquad * outBiquad );
+
+//	Rounds to the nearest 4.20 value, saturating at -8 and 8 - 2^-20, and
+//	returns the value the codec will actually use.
+float	EQQuantizeFourDotTwenty ( float inValue, FourDotTwenty * outValue );
+float	EQFourDotTwentyToFloat ( const FourDotTwenty * inValue );
+
+//	Designs inNumBands bands into inNumSections sections of kEQCoefficientsPerSection
+//	4.20 values each, in processing order, with identity sections after the
+//	last band.  outQuantized, when not 0, receives the same sections as floats.
+//	Returns the number of bands realized, which is at most inNumSections.
+UInt32	EQDesignCodecCascade ( const EQBandSpec * inSpecs, UInt32 inNumBands, UInt32 inSampleRate, UInt32 inNumSections, FourDotTwenty * outCoefficients, EQBiquad * outQuantized );
+
+//	The largest magnitude of the cascade's response from DC to half the sample rate, as a
+//	linear gain, checked at DC, half the sample rate and a log spaced grid between.
+float	EQCascadePeakGain ( const EQBiquad * inSections, UInt32 inNumSections, UInt32 inSampleRate );
+
+static inline float EQBiquadProcess ( const EQBiquad * inBiquad, EQBiquadState * ioState, float inSample ) {
+	float					out;
+
+	out = inBiquad->b0 * inSample + ioState->z1;
+	ioState->z1 = inBiquad->b1 * inSample - inBiquad->a1 * out + ioState->z2;
+	ioState->z2 = inBiquad->b2 * inSample - inBiquad->a2 * out;
+	return out;
+}
+
+//	A section left ringing into silence decays into denormals, which the G4
+//	FPU handles in software.  Called between blocks, not per sample.
+static inline void EQFlushDenormals ( EQBiquadState * ioState ) {
+	if ( DSPAbs ( ioState->z1 ) < 1.0e-15f ) {
+		ioState->z1 = 0.0f;
+	}
+	if ( DSPAbs ( ioState->z2 ) < 1.0e-15f ) {
+		ioState->z2 = 0.0f;
+	}
+}
+
+#endif
@@ -0,0 +1,356 @@
+/*
+ *  DSP_FFT.cpp
+ *  AppleOnboardAudio
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#include "DSP_FFT.h"
+
+#include "AppleDBDMAFloatLib.h"
+
+#define super OSObject
+
+OSDefineMetaClassAndStructors ( DSP_FFT, OSObject )
+
+static const float kFFTTwoPi				= 6.28318530717958647692f;
+
+#pragma mark ------------------------
+#pragma mark --- Construction
+#pragma mark ------------------------
+
+DSP_FFT * DSP_FFT::create ( UInt32 inLog2Length ) {
+	DSP_FFT *				result;
+
+	result = new DSP_FFT;
+	if ( 0 != result ) {
+		if ( !result->init ( inLog2Length ) ) {
+			result->release ();
+			result = 0;
+		}
+	}
+	return result;
+}
+
+bool DSP_FFT::init ( UInt32 inLog2Length ) {
+	UInt32					index;
+	UInt32					bit;
+	UInt32					reversed;
+	bool					result = false;
+
+	mBitReverse = 0;
+	mTwiddleCos = 0;
+	mTwiddleSin = 0;
+	mSplitCos = 0;
+	mSplitSin = 0;
+
+	FailIf ( !super::init (), Exit );
+	FailIf ( inLog2Length < kFFTMinLog2Length || inLog2Length > kFFTMaxLog2Length, Exit );
+
+	mLog2Length = inLog2Length;
+	mLength = 1 << inLog2Length;
+	mHalfLength = mLength >> 1;
+
+	mBitReverse = (UInt16 *)IOMalloc ( mHalfLength * sizeof ( UInt16 ) );
+	FailIf ( 0 == mBitReverse, Exit );
+	mTwiddleCos = (float *)IOMalloc ( ( mHalfLength / 2 ) * sizeof ( float ) );
+	FailIf ( 0 == mTwiddleCos, Exit );
+	mTwiddleSin = (float *)IOMalloc ( ( mHalfLength / 2 ) * sizeof ( float ) );
+	FailIf ( 0 == mTwiddleSin, Exit );
+	mSplitCos = (float *)IOMalloc ( ( mHalfLength / 2 + 1 ) * sizeof ( float ) );
+	FailIf ( 0 == mSplitCos, Exit );
+	mSplitSin = (float *)IOMalloc ( ( mHalfLength / 2 + 1 ) * sizeof ( float ) );
+	FailIf ( 0 == mSplitSin, Exit );
+
+	for ( index = 0; index < mHalfLength; index++ ) {
+		reversed = 0;
+		for ( bit = 1; bit < mHalfLength; bit <<= 1 ) {
+			reversed = ( reversed << 1 ) | ( ( index & bit ) ? 1 : 0 );
+		}
+		mBitReverse[index] = (UInt16)reversed;
+	}
+	for ( index = 0; index < mHalfLength / 2; index++ ) {
+		mTwiddleCos[index] = dspCos ( kFFTTwoPi * (float)index / (float)mHalfLength );
+		mTwiddleSin[index] = dspSin ( kFFTTwoPi * (float)index / (float)mHalfLength );
+	}
+	for ( index = 0; index <= mHalfLength / 2; index++ ) {
+		mSplitCos[index] = dspCos ( kFFTTwoPi * (float)index / (float)mLength );
+		mSplitSin[index] = dspSin ( kFFTTwoPi * (float)index / (float)mLength );
+	}
+
+	result = true;
+Exit:
+	return result;
+}
+
+void DSP_FFT::free ( void ) {
+	if ( 0 != mBitReverse ) {
+		IOFree ( mBitReverse, mHalfLength * sizeof ( UInt16 ) );
+		mBitReverse = 0;
+	}
+	if ( 0 != mTwiddleCos ) {
+		IOFree ( mTwiddleCos, ( mHalfLength / 2 ) * sizeof ( float ) );
+		mTwiddleCos = 0;
+	}
+	if ( 0 != mTwiddleSin ) {
+		IOFree ( mTwiddleSin, ( mHalfLength / 2 ) * sizeof ( float ) );
+		mTwiddleSin = 0;
+	}
+	if ( 0 != mSplitCos ) {
+		IOFree ( mSplitCos, ( mHalfLength / 2 + 1 ) * sizeof ( float ) );
+		mSplitCos = 0;
+	}
+	if ( 0 != mSplitSin ) {
+		IOFree ( mSplitSin, ( mHalfLength / 2 + 1 ) * sizeof ( float ) );
+		mSplitSin = 0;
+	}
+	super::free ();
+}
+
+#pragma mark ------------------------
+#pragma mark --- Transforms
+#pragma mark ------------------------
+
+//	Iterative decimation in time butterflies on bit reversed input.  The first
+//	two passes have trivial twiddles and are done together as radix 4.
+void DSP_FFT::transform ( float * ioReal, float * ioImag, bool inInverse ) {
+	float					sign;
+	float					wr;
+	float					wi;
+	float					tr;
+	float					ti;
+	float					r0;
+	float					i0;
+	float					r1;
+	float					i1;
+	float					r2;
+	float					i2;
+	float					r3;
+	float					i3;
+	UInt32					size;
+	UInt32					half;
+	UInt32					step;
+	UInt32					start;
+	UInt32					k;
+	UInt32					a;
+	UInt32					b;
+
+	sign = inInverse ? 1.0f : -1.0f;
+
+	for ( start = 0; start < mHalfLength; start += 4 ) {
+		r0 = ioReal[start] + ioReal[start + 1];
+		i0 = ioImag[start] + ioImag[start + 1];
+		r1 = ioReal[start] - ioReal[start + 1];
+		i1 = ioImag[start] - ioImag[start + 1];
+		r2 = ioReal[start + 2] + ioReal[start + 3];
+		i2 = ioImag[start + 2] + ioImag[start + 3];
+		r3 = ioReal[start + 2] - ioReal[start + 3];
+		i3 = ioImag[start + 2] - ioImag[start + 3];
+
+		ioReal[start] = r0 + r2;
+		ioImag[start] = i0 + i2;
+		ioReal[start + 2] = r0 - r2;
+		ioImag[start + 2] = i0 - i2;
+		//	twiddle for the odd pair is -i going forward, +i going back
+		ioReal[start + 1] = r1 - sign * i3;
+		ioImag[start + 1] = i1 + sign * r3;
+		ioReal[start + 3] = r1 + sign * i3;
+		ioImag[start + 3] = i1 - sign * r3;
+	}
+
+	for ( size = 8; size <= mHalfLength; size <<= 1 ) {
+		half = size >> 1;
+		step = mHalfLength / size;
+		for ( k = 0; k < half; k++ ) {
+			wr = mTwiddleCos[k * step];
+			wi = sign * mTwiddleSin[k * step];
+			for ( start = 0; start < mHalfLength; start += size ) {
+				a = start + k;
+				b = a + half;
+				tr = wr * ioReal[b] - wi * ioImag[b];
+				ti = wr * ioImag[b] + wi * ioReal[b];
+				ioReal[b] = ioReal[a] - tr;
+				ioImag[b] = ioImag[a] - ti;
+				ioReal[a] += tr;
+				ioImag[a] += ti;
+			}
+		}
+	}
+}
+
+//	Even samples go to the real parts and odd samples to the imaginary parts
+//	of an N/2 point transform Z.  The split step then recovers
+//		X[k] = E[k] + W^k O[k],  E = ( Z[k] + Z*[N/2-k] ) / 2,  O = ( Z[k] - Z*[N/2-k] ) / 2i
+//	working on k and N/2-k together so it can run in place.
+void DSP_FFT::forward ( const float * inTime, float * outReal, float * outImag ) {
+	float					er;
+	float					ei;
+	float					orr;
+	float					oi;
+	float					tr;
+	float					ti;
+	float					c;
+	float					s;
+	UInt32					index;
+	UInt32					mirror;
+
+	for ( index = 0; index < mHalfLength; index++ ) {
+		outReal[mBitReverse[index]] = inTime[2 * index];
+		outImag[mBitReverse[index]] = inTime[2 * index + 1];
+	}
+	transform ( outReal, outImag, false );
+
+	er = outReal[0];
+	ei = outImag[0];
+	outReal[0] = er + ei;													//	DC
+	outImag[0] = er - ei;													//	Nyquist
+
+	for ( index = 1; index <= mHalfLength / 2; index++ ) {
+		mirror = mHalfLength - index;
+		c = mSplitCos[index];
+		s = mSplitSin[index];
+
+		er = 0.5f * ( outReal[index] + outReal[mirror] );
+		ei = 0.5f * ( outImag[index] - outImag[mirror] );
+		orr = 0.5f * ( outImag[index] + outImag[mirror] );
+		oi = 0.5f * ( outReal[mirror] - outReal[index] );
+
+		tr = c * orr + s * oi;
+		ti = c * oi - s * orr;
+
+		outReal[index] = er + tr;
+		outImag[index] = ei + ti;
+		outReal[mirror] = er - tr;
+		outImag[mirror] = ti - ei;
+	}
+}
+
+void DSP_FFT::inverse ( float * ioReal, float * ioImag, float * outTime ) {
+	float					er;
+	float					ei;
+	float					dr;
+	float					di;
+	float					orr;
+	float					oi;
+	float					c;
+	float					s;
+	float					scale;
+	float					swap;
+	UInt32					index;
+	UInt32					mirror;
+
+	er = ioReal[0];
+	ei = ioImag[0];
+	ioReal[0] = 0.5f * ( er + ei );
+	ioImag[0] = 0.5f * ( er - ei );
+
+	for ( index = 1; index <= mHalfLength / 2; index++ ) {
+		mirror = mHalfLength - index;
+		c = mSplitCos[index];
+		s = mSplitSin[index];
+
+		er = 0.5f * ( ioReal[index] + ioReal[mirror] );
+		ei = 0.5f * ( ioImag[index] - ioImag[mirror] );
+		dr = 0.5f * ( ioReal[index] - ioReal[mirror] );
+		di = 0.5f * ( ioImag[index] + ioImag[mirror] );
+
+		orr = c * dr - s * di;
+		oi = c * di + s * dr;
+
+		ioReal[index] = er - oi;
+		ioImag[index] = ei + orr;
+		ioReal[mirror] = er + oi;
+		ioImag[mirror] = orr - ei;
+	}
+
+	for ( index = 0; index < mHalfLength; index++ ) {
+		mirror = mBitReverse[index];
+		if ( mirror > index ) {
+			swap = ioReal[index];
+			ioReal[index] = ioReal[mirror];
+			ioReal[mirror] = swap;
+			swap = ioImag[index];
+			ioImag[index] = ioImag[mirror];
+			ioImag[mirror] = swap;
+		}
+	}
+	transform ( ioReal, ioImag, true );
+
+	scale = 1.0f / (float)mHalfLength;
+	for ( index = 0; index < mHalfLength; index++ ) {
+		outTime[2 * index] = ioReal[index] * scale;
+		outTime[2 * index + 1] = ioImag[index] * scale;
+	}
+}
+
+//	Two bins per pass keeps the loads ahead of the multiplies on the G4.
+void DSP_FFT::multiplyAccumulate ( float * ioReal, float * ioImag, const float * inAReal, const float * inAImag, const float * inBReal, const float * inBImag, UInt32 inNumBins ) {
+	float					ar0;
+	float					ai0;
+	float					ar1;
+	float					ai1;
+	float					br0;
+	float					bi0;
+	float					br1;
+	float					bi1;
+	UInt32					index;
+
+	ioReal[0] += inAReal[0] * inBReal[0];
+	ioImag[0] += inAImag[0] * inBImag[0];
+
+	for ( index = 1; index + 1 < inNumBins; index += 2 ) {
+		ar0 = inAReal[index];
+		ai0 = inAImag[index];
+		br0 = inBReal[index];
+		bi0 = inBImag[index];
+		ar1 = inAReal[index + 1];
+		ai1 = inAImag[index + 1];
+		br1 = inBReal[index + 1];
+		bi1 = inBImag[index + 1];
+
+		ioReal[index] += ar0 * br0 - ai0 * bi0;
+		ioImag[index] += ar0 * bi0 + ai0 * br0;
+		ioReal[index + 1] += ar1 * br1 - ai1 * bi1;
+		ioImag[index + 1] += ar1 * bi1 + ai1 * br1;
+	}
+	for ( ; index < inNumBins; index++ ) {
+		ioReal[index] += inAReal[index] * inBReal[index] - inAImag[index] * inBImag[index];
+		ioImag[index] += inAReal[index] * inBImag[index] + inAImag[index] * inBReal[index];
+	}
+}
+
+void DSP_FFT::multiplyAccumulateConjugate ( float * ioReal, float * ioImag, const float * inAReal, const float * inAImag, const float * inBReal, const float * inBImag, UInt32 inNumBins ) {
+	float					ar0;
+	float					ai0;
+	float					ar1;
+	float					ai1;
+	float					br0;
+	float					bi0;
+	float					br1;
+	float					bi1;
+	UInt32					index;
+
+	ioReal[0] += inAReal[0] * inBReal[0];
+	ioImag[0] += inAImag[0] * inBImag[0];
+
+	for ( index = 1; index + 1 < inNumBins; index += 2 ) {
+		ar0 = inAReal[index];
+		ai0 = inAImag[index];
+		br0 = inBReal[index];
+		bi0 = inBImag[index];
+		ar1 = inAReal[index + 1];
+		ai1 = inAImag[index + 1];
+		br1 = inBReal[index + 1];
+		bi1 = inBImag[index + 1];
+
+		ioReal[index] += ar0 * br0 + ai0 * bi0;
+		ioImag[index] += ar0 * bi0 - ai0 * br0;
+		ioReal[index + 1] += ar1 * br1 + ai1 * bi1;
+		ioImag[index + 1] += ar1 * bi1 - ai1 * br1;
+	}
+	for ( ; index < inNumBins; index++ ) {
+		ioReal[index] += inAReal[index] * inBReal[index] + inAImag[index] * inBImag[index];
+		ioImag[index] += inAReal[index] * inBImag[index] - inAImag[index] * inBReal[index];
+	}
+}
@@ -0,0 +1,71 @@
+/*
+ *  DSP_FFT.h
+ *  AppleOnboardAudio
+ *
+ *  Real input FFT of a fixed power of two length for the frequency domain
+ *  stages.  A length N transform runs as an N/2 point complex radix 2
+ *  transform on the even and odd samples followed by a split step.
+ *
+ *  Spectra are kept split complex in two arrays of N/2 floats.  Bin 0 is
+ *  packed:  its real part holds DC and its imaginary part holds Nyquist,
+ *  both of which are purely real for real input.
+ *
+ *  The object holds only read only tables, so one instance may be used by
+ *  the command gate and the IOProc at the same time.  Every transform works
+ *  in place in the caller's arrays.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSP_FFT__
+#define __DSP_FFT__
+
+#include "DSP_Common.h"
+
+#define kFFTMinLog2Length				4			/*	16 points		*/
+#define kFFTMaxLog2Length				13			/*	8192 points		*/
+
+class DSP_FFT : public OSObject {
+
+    OSDeclareDefaultStructors ( DSP_FFT );
+
+public:
+
+	static DSP_FFT *		create ( UInt32 inLog2Length );
+
+	virtual bool			init ( UInt32 inLog2Length );
+	virtual void			free ( void );
+
+	UInt32					getLength ( void ) { return mLength; }
+	UInt32					getNumBins ( void ) { return mHalfLength; }
+
+	//	inTime holds getLength () samples; outReal and outImag receive getNumBins () values each
+	void					forward ( const float * inTime, float * outReal, float * outImag );
+
+	//	ioReal and ioImag are used as work space and do not survive.  The result is scaled
+	//	so that inverse ( forward ( x ) ) == x.
+	void					inverse ( float * ioReal, float * ioImag, float * outTime );
+
+	//	ioReal/ioImag += inAReal/inAImag * inBReal/inBImag, bin by bin, honouring the bin 0 packing
+	static void				multiplyAccumulate ( float * ioReal, float * ioImag, const float * inAReal, const float * inAImag, const float * inBReal, const float * inBImag, UInt32 inNumBins );
+
+	//	the same with A conjugated, which correlates rather than convolves
+	static void				multiplyAccumulateConjugate ( float * ioReal, float * ioImag, const float * inAReal, const float * inAImag, const float * inBReal, const float * inBImag, UInt32 inNumBins );
+
+protected:
+
+	void					transform ( float * ioReal, float * ioImag, bool inInverse );
+
+	UInt32					mLog2Length;
+	UInt32					mLength;					//	N
+	UInt32					mHalfLength;				//	N / 2, the complex transform length
+
+	UInt16 *				mBitReverse;				//	mHalfLength entries
+	float *					mTwiddleCos;				//	cos ( 2 pi k / ( N / 2 ) ), k < N / 4
+	float *					mTwiddleSin;
+	float *					mSplitCos;					//	cos ( 2 pi k / N ), k <= N / 4
+	float *					mSplitSin;
+};
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ *  DSP_Loudness.cpp
+ *  AppleOnboardAudio
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#include "DSP_Loudness.h"
+
+#define super DSP_Processor
+
+OSDefineMetaClassAndStructors ( DSP_Loudness, DSP_Processor )
+
+//	gentle shelves; a steeper slope starts to sound like a tone control
+static const float kLoudnessShelfQ			= 0.5f;
+static const float kLoudnessMinFrequency	= 20.0f;
+
+#pragma mark ------------------------
+#pragma mark --- Construction
+#pragma mark ------------------------
+
+DSP_Loudness * DSP_Loudness::create ( UInt32 inNumChannels ) {
+	DSP_Loudness *			result;
+
+	result = new DSP_Loudness;
+	if ( 0 != result ) {
+		if ( !result->init ( inNumChannels ) ) {
+			result->release ();
+			result = 0;
+		}
+	}
+	return result;
+}
+
+bool DSP_Loudness::init ( UInt32 inNumChannels ) {
+	bool					result = false;
+
+	FailIf ( 0 == inNumChannels || inNumChannels > kDSPMaxChannels, Exit );
+	FailIf ( !super::init ( inNumChannels ), Exit );
+
+	mReferencedB = 0.0f;
+	mLowFrequency = (float)kLoudnessDefaultLowFrequency;
+	mHighFrequency = (float)kLoudnessDefaultHighFrequency;
+	mLowRatio = (float)kLoudnessDefaultLowPercent / 100.0f;
+	mHighRatio = (float)kLoudnessDefaultHighPercent / 100.0f;
+	mMaxLowdB = (float)kLoudnessDefaultMaxLowDecibels;
+	mMaxHighdB = (float)kLoudnessDefaultMaxHighDecibels;
+	mVolumedB = 0.0f;
+	mCodecVolume = false;
+
+	bzero ( &mFilters, sizeof ( mFilters ) );
+	DSPExchangeInit ( &mExchange );
+	design ();
+	mLive = mFilters;
+	bzero ( mLowState, sizeof ( mLowState ) );
+	bzero ( mHighState, sizeof ( mHighState ) );
+
+	result = true;
+Exit:
+	return result;
+}
+
+#pragma mark ------------------------
+#pragma mark --- Parameters
+#pragma mark ------------------------
+
+static float LoudnessGetDecibels ( OSDictionary * inDictionary, const char * inKey, SInt32 inDefault ) {
+	SInt32					decibels;
+
+	decibels = DSPGetSInt32Parameter ( inDictionary, inKey, inDefault );
+	if ( decibels < 0 ) {
+		decibels = 0;
+	} else if ( decibels > kEQMaxCentiDecibels / 100 ) {
+		decibels = kEQMaxCentiDecibels / 100;
+	}
+	return (float)decibels;
+}
+
+void DSP_Loudness::setParameters ( OSDictionary * inDictionary ) {
+	SInt32					percent;
+
+	mReferencedB = (float)DSPGetSInt32Parameter ( inDictionary, kLoudnessReferenceDecibels, 0 );
+	mLowFrequency = (float)DSPGetSInt32Parameter ( inDictionary, kLoudnessLowFrequency, kLoudnessDefaultLowFrequency );
+	mHighFrequency = (float)DSPGetSInt32Parameter ( inDictionary, kLoudnessHighFrequency, kLoudnessDefaultHighFrequency );
+	if ( mLowFrequency < kLoudnessMinFrequency ) {
+		mLowFrequency = kLoudnessMinFrequency;
+	}
+	if ( mHighFrequency < kLoudnessMinFrequency ) {
+		mHighFrequency = kLoudnessMinFrequency;
+	}
+
+	percent = DSPGetSInt32Parameter ( inDictionary, kLoudnessLowPercent, kLoudnessDefaultLowPercent );
+	mLowRatio = ( percent < 0 ) ? 0.0f : (float)percent / 100.0f;
+	percent = DSPGetSInt32Parameter ( inDictionary, kLoudnessHighPercent, kLoudnessDefaultHighPercent );
+	mHighRatio = ( percent < 0 ) ? 0.0f : (float)percent / 100.0f;
+
+	mMaxLowdB = LoudnessGetDecibels ( inDictionary, kLoudnessMaxLowDecibels, kLoudnessDefaultMaxLowDecibels );
+	mMaxHighdB = LoudnessGetDecibels ( inDictionary, kLoudnessMaxHighDecibels, kLoudnessDefaultMaxHighDecibels );
+
+	design ();
+
+	debugIOLog ( 3, "  DSP_Loudness::setParameters reference %ld dB, low %ld Hz x%ld%%, high %ld Hz x%ld%%", (SInt32)mReferencedB, (SInt32)mLowFrequency, (SInt32)( mLowRatio * 100.0f ), (SInt32)mHighFrequency, (SInt32)( mHighRatio * 100.0f ) );
+}
+
+void DSP_Loudness::setSampleRate ( UInt32 inSampleRate ) {
+	super::setSampleRate ( inSampleRate );
+	design ();
+}
+
+//	Called for every volume change, so it only interpolates.
+void DSP_Loudness::setVolume ( float inDecibels ) {
+	mVolumedB = inDecibels;
+	select ();
+}
+
+void DSP_Loudness::setCodecVolume ( bool inCodecVolume ) {
+	if ( inCodecVolume != mCodecVolume ) {
+		mCodecVolume = inCodecVolume;
+		select ();
+	}
+}
+
+//	The filter state belongs to the IOProc; it is cleared when the new count arrives.
+void DSP_Loudness::reset ( void ) {
+	mFilters.resetCount++;
+	publishFilters ();
+}
+
+void DSP_Loudness::publishFilters ( void ) {
+	mFilterSlots[mExchange.writeSlot] = mFilters;
+	DSPExchangePublish ( &mExchange );
+}
+
+//	Rebuilds both grids.  Only a new dictionary or sample rate comes through here.
+void DSP_Loudness::design ( void ) {
+	EQBandSpec				lowSpec;
+	EQBandSpec				highSpec;
+	EQBiquad				shelves[2];
+	float					attenuation;
+	UInt32					point;
+
+	lowSpec.type = kEQLowShelf;
+	lowSpec.frequency = mLowFrequency;
+	lowSpec.q = kLoudnessShelfQ;
+	highSpec.type = kEQHighShelf;
+	highSpec.frequency = mHighFrequency;
+	highSpec.q = kLoudnessShelfQ;
+
+	for ( point = 0; point < kLoudnessGridPoints; point++ ) {
+		attenuation = (float)( point * kLoudnessGridStepdB );
+		lowSpec.gaindB = attenuation * mLowRatio;
+		if ( lowSpec.gaindB > mMaxLowdB ) {
+			lowSpec.gaindB = mMaxLowdB;
+		}
+		highSpec.gaindB = attenuation * mHighRatio;
+		if ( highSpec.gaindB > mMaxHighdB ) {
+			highSpec.gaindB = mMaxHighdB;
+		}
+		EQDesignBiquad ( &lowSpec, mSampleRate, &mLowGrid[point] );
+		EQDesignBiquad ( &highSpec, mSampleRate, &mHighGrid[point] );
+		shelves[0] = mLowGrid[point];
+		shelves[1] = mHighGrid[point];
+		mGridPeak[point] = EQCascadePeakGain ( shelves, 2, mSampleRate );
+	}
+	select ();
+}
+
+static void LoudnessBlend ( const EQBiquad * inA, const EQBiquad * inB, float inFraction, EQBiquad * outBiquad ) {
+	outBiquad->b0 = inA->b0 + inFraction * ( inB->b0 - inA->b0 );
+	outBiquad->b1 = inA->b1 + inFraction * ( inB->b1 - inA->b1 );
+	outBiquad->b2 = inA->b2 + inFraction * ( inB->b2 - inA->b2 );
+	outBiquad->a1 = inA->a1 + inFraction * ( inB->a1 - inA->a1 );
+	outBiquad->a2 = inA->a2 + inFraction * ( inB->a2 - inA->a2 );
+}
+
+//	Beyond the last grid point the compensation stays at its maximum.  The stage leaves the
+//	run list while it is flat; coming back it starts from clear filters.  Under codec volume
+//	the cut is the larger of the two grid points' peaks, as a blend of two shelves is not
+//	guaranteed to peak below both.
+void DSP_Loudness::select ( void ) {
+	float					position;
+	float					fraction;
+	float					peak;
+	float					cut;
+	UInt32					point;
+	bool					wasActive;
+
+	wasActive = mFilters.active;
+	position = ( mReferencedB - mVolumedB ) / (float)kLoudnessGridStepdB;
+	mFilters.active = ( position > 0.0f ) && ( mLowRatio > 0.0f || mHighRatio > 0.0f );
+
+	peak = 1.0f;
+	if ( !mFilters.active ) {
+		EQSetIdentity ( &mFilters.low );
+		EQSetIdentity ( &mFilters.high );
+	} else if ( position >= (float)( kLoudnessGridPoints - 1 ) ) {
+		mFilters.low = mLowGrid[kLoudnessGridPoints - 1];
+		mFilters.high = mHighGrid[kLoudnessGridPoints - 1];
+		peak = mGridPeak[kLoudnessGridPoints - 1];
+	} else {
+		point = (UInt32)position;
+		fraction = position - (float)point;
+		LoudnessBlend ( &mLowGrid[point], &mLowGrid[point + 1], fraction, &mFilters.low );
+		LoudnessBlend ( &mHighGrid[point], &mHighGrid[point + 1], fraction, &mFilters.high );
+		peak = ( mGridPeak[point] > mGridPeak[point + 1] ) ? mGridPeak[point] : mGridPeak[point + 1];
+	}
+	if ( mCodecVolume && peak > 1.0f ) {
+		cut = 1.0f / peak;
+		mFilters.low.b0 *= cut;
+		mFilters.low.b1 *= cut;
+		mFilters.low.b2 *= cut;
+	}
+	if ( mFilters.active && !wasActive ) {
+		mFilters.resetCount++;
+	}
+	publishFilters ();
+}
+
+#pragma mark ------------------------
+#pragma mark --- Processing
+#pragma mark ------------------------
+
+void DSP_Loudness::process ( float * ioBuffer, UInt32 inNumSamples ) {
+	float					sample;
+	UInt32					channel;
+	UInt32					index;
+
+	if ( DSPExchangeAcquire ( &mExchange ) ) {
+		if ( mFilterSlots[mExchange.readSlot].resetCount != mLive.resetCount ) {
+			bzero ( mLowState, sizeof ( mLowState ) );
+			bzero ( mHighState, sizeof ( mHighState ) );
+		}
+		mLive = mFilterSlots[mExchange.readSlot];
+	}
+
+	for ( index = 0; index + mNumChannels <= inNumSamples; index += mNumChannels ) {
+		for ( channel = 0; channel < mNumChannels; channel++ ) {
+			sample = EQBiquadProcess ( &mLive.low, &mLowState[channel], ioBuffer[index + channel] );
+			ioBuffer[index + channel] = EQBiquadProcess ( &mLive.high, &mHighState[channel], sample );
+		}
+	}
+
+	for ( channel = 0; channel < mNumChannels; channel++ ) {
+		EQFlushDenormals ( &mLowState[channel] );
+		EQFlushDenormals ( &mHighState[channel] );
+	}
+}
@@ -0,0 +1,117 @@
+/*
+ *  DSP_Loudness.h
+ *  AppleOnboardAudio
+ *
+ *  Volume dependent loudness compensation.  As the listening level drops
+ *  the ear loses sensitivity at the frequency extremes faster than in the
+ *  midrange, so this stage raises a low shelf and a high shelf in
+ *  proportion to how far the volume sits below a reference level.
+ *
+ *  Both shelves are designed ahead of time for attenuations on a
+ *  kLoudnessGridStepdB grid.  A volume change only picks the two grid
+ *  points around the new attenuation and blends their coefficients; the
+ *  stable region of a second order denominator is convex, so the blend of
+ *  two stable shelves is stable too.
+ *
+ *  The engine hands the stage the volume in dB whether the codec or the
+ *  software volume does the attenuating.  With software volume the samples
+ *  reach the stage already attenuated and the shelves boost into that
+ *  headroom.  With codec volume they reach it at full scale, so the stage
+ *  also cuts everything by the peak of the shelves' response: the
+ *  extremes then come out where they went in and the midband lower, and
+ *  nothing is pushed past full scale ahead of the integer conversion.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSP_LOUDNESS__
+#define __DSP_LOUDNESS__
+
+#include "DSP_Processor.h"
+#include "DSP_Equalizer.h"
+
+//	'SoftwareDSP' dictionary keys
+#define kLoudnessEntry					"Loudness"
+#define kLoudnessReferenceDecibels		"ReferenceDecibels"		/*	volume at which the stage is flat					*/
+#define kLoudnessLowFrequency			"LowFrequency"			/*	low shelf corner, Hz								*/
+#define kLoudnessHighFrequency			"HighFrequency"			/*	high shelf corner, Hz								*/
+#define kLoudnessLowPercent				"LowPercent"			/*	low shelf boost as a percentage of the attenuation	*/
+#define kLoudnessHighPercent			"HighPercent"
+#define kLoudnessMaxLowDecibels			"MaxLowDecibels"
+#define kLoudnessMaxHighDecibels		"MaxHighDecibels"
+
+#define kLoudnessDefaultLowFrequency	120
+#define kLoudnessDefaultHighFrequency	8000
+#define kLoudnessDefaultLowPercent		33
+#define kLoudnessDefaultHighPercent		12
+#define kLoudnessDefaultMaxLowDecibels	15
+#define kLoudnessDefaultMaxHighDecibels	6
+
+#define kLoudnessGridPoints				21
+#define kLoudnessGridStepdB				3						/*	the grid covers 0 to 60 dB of attenuation			*/
+
+typedef struct {
+	EQBiquad				low;
+	EQBiquad				high;
+	bool					active;
+	UInt32					resetCount;					//	a change clears the filter state
+} LoudnessFilters;
+
+class DSP_Loudness : public DSP_Processor {
+
+    OSDeclareDefaultStructors ( DSP_Loudness );
+
+public:
+
+	static DSP_Loudness *	create ( UInt32 inNumChannels );
+
+	virtual bool			init ( UInt32 inNumChannels );
+
+	virtual const char *	getStageName ( void ) { return kLoudnessEntry; }
+
+	virtual void			setParameters ( OSDictionary * inDictionary );
+	virtual void			setSampleRate ( UInt32 inSampleRate );
+	virtual void			reset ( void );
+
+	//	command gate; the current output volume in dB relative to full scale
+	virtual void			setVolume ( float inDecibels );
+
+	//	command gate; true when the codec does the attenuating
+	virtual void			setCodecVolume ( bool inCodecVolume );
+
+	//	flat at or above the reference volume
+	virtual bool			isActive ( void ) { return mFilters.active; }
+
+	virtual void			process ( float * ioBuffer, UInt32 inNumSamples );
+
+protected:
+
+	void					design ( void );
+	void					select ( void );
+	void					publishFilters ( void );
+
+	//	command gate side
+	float					mReferencedB;
+	float					mLowFrequency;
+	float					mHighFrequency;
+	float					mLowRatio;
+	float					mHighRatio;
+	float					mMaxLowdB;
+	float					mMaxHighdB;
+	float					mVolumedB;
+	bool					mCodecVolume;
+	EQBiquad				mLowGrid[kLoudnessGridPoints];
+	EQBiquad				mHighGrid[kLoudnessGridPoints];
+	float					mGridPeak[kLoudnessGridPoints];		//	of both shelves together, linear
+	LoudnessFilters			mFilters;
+	LoudnessFilters			mFilterSlots[kDSPExchangeSlots];
+	DSPExchange				mExchange;
+
+	//	IOProc side
+	LoudnessFilters			mLive;
+	EQBiquadState			mLowState[kDSPMaxChannels];
+	EQBiquadState			mHighState[kDSPMaxChannels];
+};
+
+#endif
@@ -1 +1,394 @@
+/*
+ *  DSP_Manager.cpp
+ *  AppleOnboardAudio
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
 
+#include "DSP_Manager.h"
+
+#include "DSP_Convolver.h"
+#include "DSP_Delay.h"
+#include "DSP_Loudness.h"
+#include "DSP_ParametricEQ.h"
+#include "DSP_SoftClip.h"
+#include "DSP_TruePeakLimiter.h"
+
+#define super OSObject
+
+OSDefineMetaClassAndStructors ( DSP_Manager, OSObject )
+
+//	Order used for stages not named in 'ProcessingOrder'.  Linear stages first, then
+//	the soft clip, and the true peak limiter last so nothing downstream of it can
+//	push the reconstructed signal back over its ceiling.
+const char * DSP_Manager::sDefaultOrder[] = {
+	kParametricEQEntry,
+	kConvolverEntry,
+	kLoudnessEntry,
+	kDelayEntry,
+	kSoftClipEntry,
+	kTruePeakEntry,
+	0
+};
+
+#pragma mark ------------------------
+#pragma mark --- Construction
+#pragma mark ------------------------
+
+DSP_Manager * DSP_Manager::create ( void ) {
+	DSP_Manager *			result;
+
+	result = new DSP_Manager;
+	if ( 0 != result ) {
+		if ( !result->init () ) {
+			result->release ();
+			result = 0;
+		}
+	}
+	return result;
+}
+
+DSP_Processor * DSP_Manager::createProcessor ( const char * inStageName, UInt32 inNumChannels ) {
+	DSP_Processor *			theProcessor;
+
+	theProcessor = 0;
+
+	if ( 0 == strcmp ( inStageName, kParametricEQEntry ) ) {
+		theProcessor = DSP_ParametricEQ::create ( inNumChannels );
+	} else if ( 0 == strcmp ( inStageName, kConvolverEntry ) ) {
+		theProcessor = DSP_Convolver::create ( inNumChannels );
+	} else if ( 0 == strcmp ( inStageName, kLoudnessEntry ) ) {
+		theProcessor = DSP_Loudness::create ( inNumChannels );
+	} else if ( 0 == strcmp ( inStageName, kDelayEntry ) ) {
+		theProcessor = DSP_Delay::create ( inNumChannels );
+	} else if ( 0 == strcmp ( inStageName, kSoftClipEntry ) ) {
+		theProcessor = DSP_SoftClip::create ( inNumChannels );
+	} else if ( 0 == strcmp ( inStageName, kTruePeakEntry ) ) {
+		theProcessor = DSP_TruePeakLimiter::create ( inNumChannels );
+	}
+	return theProcessor;
+}
+
+bool DSP_Manager::init ( void ) {
+	bool					result = false;
+
+	FailIf ( !super::init (), Exit );
+
+	mStages = OSArray::withCapacity ( kDSPMaxStages );
+	FailIf ( 0 == mStages, Exit );
+
+	mNumChannels = 0;
+	mSampleRate = 44100;
+	mRunListCount[0] = 0;
+	mRunListCount[1] = 0;
+	mCurrentRunList = 0;
+	mEnabled = false;
+	mProcessCount[0] = 0;
+	mProcessCount[1] = 0;
+	mRunListStale = false;
+
+	result = true;
+Exit:
+	return result;
+}
+
+void DSP_Manager::free ( void ) {
+	disable ();
+	if ( 0 != mStages ) {
+		removeAllStages ();
+		mStages->release ();
+		mStages = 0;
+	}
+	super::free ();
+}
+
+#pragma mark ------------------------
+#pragma mark --- Chain Management
+#pragma mark ------------------------
+
+bool DSP_Manager::setProcessing ( OSDictionary * inDictionary, UInt32 inNumChannels, UInt32 inSampleRate ) {
+	OSArray *				theOrderArray;
+	OSString *				theStageName;
+	UInt32					index;
+	bool					result = false;
+
+	debugIOLog ( 3, "+ DSP_Manager::setProcessing ( %p, %ld, %ld )", inDictionary, inNumChannels, inSampleRate );
+
+	disable ();
+	FailIf ( 0 == inDictionary, Exit );
+	FailIf ( 0 == inNumChannels, Exit );
+	FailIf ( !waitForIdle (), Exit );
+
+	removeAllStages ();
+	mNumChannels = inNumChannels;
+	mSampleRate = inSampleRate;
+
+	theOrderArray = OSDynamicCast ( OSArray, inDictionary->getObject ( kDSPProcessingOrder ) );
+	if ( 0 != theOrderArray ) {
+		for ( index = 0; index < theOrderArray->getCount (); index++ ) {
+			theStageName = OSDynamicCast ( OSString, theOrderArray->getObject ( index ) );
+			if ( 0 != theStageName && 0 == getStage ( theStageName->getCStringNoCopy () ) ) {
+				appendStage ( inDictionary, theStageName->getCStringNoCopy () );
+			}
+		}
+	}
+	for ( index = 0; 0 != sDefaultOrder[index]; index++ ) {
+		if ( 0 == getStage ( sDefaultOrder[index] ) ) {
+			appendStage ( inDictionary, sDefaultOrder[index] );
+		}
+	}
+
+	updateRunList ();
+	result = true;
+Exit:
+	debugIOLog ( 3, "- DSP_Manager::setProcessing ( %p, %ld, %ld ) returns %d, %ld stages, latency %ld", inDictionary, inNumChannels, inSampleRate, result, getNumStages (), getLatency () );
+	return result;
+}
+
+//	A stage is only created when the dictionary carries an entry for it.
+bool DSP_Manager::appendStage ( OSDictionary * inDictionary, const char * inStageName ) {
+	OSDictionary *			theStageDict;
+	DSP_Processor *			theProcessor;
+	bool					result = false;
+
+	theStageDict = OSDynamicCast ( OSDictionary, inDictionary->getObject ( inStageName ) );
+	if ( 0 == theStageDict ) {
+		goto Exit;
+	}
+	FailIf ( mStages->getCount () >= kDSPMaxStages, Exit );
+
+	theProcessor = createProcessor ( inStageName, mNumChannels );
+	FailIf ( 0 == theProcessor, Exit );
+
+	theProcessor->setSampleRate ( mSampleRate );
+	theProcessor->setParameters ( theStageDict );
+	theProcessor->setBypass ( DSPGetBoolParameter ( theStageDict, kDSPProcessorBypass, false ) );
+	theProcessor->reset ();
+
+	mStages->setObject ( theProcessor );
+	theProcessor->release ();
+
+	debugIOLog ( 3, "  DSP_Manager::appendStage '%s' at %ld", inStageName, mStages->getCount () - 1 );
+	result = true;
+Exit:
+	return result;
+}
+
+void DSP_Manager::removeAllStages ( void ) {
+	mRunListCount[0] = 0;
+	mRunListCount[1] = 0;
+	OSSynchronizeIO ();
+	if ( 0 != mStages ) {
+		mStages->flushCollection ();
+	}
+}
+
+DSP_Processor * DSP_Manager::getStage ( const char * inStageName ) {
+	DSP_Processor *			theProcessor;
+	UInt32					index;
+
+	for ( index = 0; index < mStages->getCount (); index++ ) {
+		theProcessor = OSDynamicCast ( DSP_Processor, mStages->getObject ( index ) );
+		if ( 0 != theProcessor && 0 == strcmp ( theProcessor->getStageName (), inStageName ) ) {
+			return theProcessor;
+		}
+	}
+	return 0;
+}
+
+//	In processing order, including bypassed and idle stages.
+DSP_Processor * DSP_Manager::getStageAtIndex ( UInt32 inIndex ) {
+	return OSDynamicCast ( DSP_Processor, mStages->getObject ( inIndex ) );
+}
+
+void DSP_Manager::setStageBypass ( const char * inStageName, bool inBypass ) {
+	DSP_Processor *			theProcessor;
+
+	theProcessor = getStage ( inStageName );
+	FailIf ( 0 == theProcessor, Exit );
+
+	theProcessor->setBypass ( inBypass );
+	updateRunList ();
+Exit:
+	return;
+}
+
+bool DSP_Manager::setStageParameters ( const char * inStageName, OSDictionary * inDictionary ) {
+	DSP_Processor *			theProcessor;
+	bool					wasActive;
+	bool					result = false;
+
+	FailIf ( 0 == inDictionary, Exit );
+	theProcessor = getStage ( inStageName );
+	FailIf ( 0 == theProcessor, Exit );
+
+	wasActive = theProcessor->isActive ();
+	theProcessor->setParameters ( inDictionary );
+	if ( theProcessor->isActive () != wasActive || mRunListStale ) {
+		updateRunList ();
+	}
+	result = true;
+Exit:
+	return result;
+}
+
+//	Rebuilds the run list the IOProc is not using and publishes it.  The list
+//	being rebuilt may still be held by a call that started before the last
+//	publish.  Then the chain is marked stale instead, and the next gate call
+//	or updateRunListIfStale rebuilds it once that call has left.
+void DSP_Manager::updateRunList ( void ) {
+	DSP_Processor *			theProcessor;
+	UInt32					nextList;
+	UInt32					count;
+	UInt32					index;
+
+	nextList = mCurrentRunList ^ 1;
+	OSSynchronizeIO ();
+	if ( 0 != *(volatile SInt32 *)&mProcessCount[nextList] ) {
+		mRunListStale = true;
+		debugIOLog ( 3, "  DSP_Manager::updateRunList deferred, the IOProc is still on run list %ld", nextList );
+		goto Exit;
+	}
+	mRunListStale = false;
+
+	count = 0;
+	for ( index = 0; index < mStages->getCount () && count < kDSPMaxStages; index++ ) {
+		theProcessor = OSDynamicCast ( DSP_Processor, mStages->getObject ( index ) );
+		if ( 0 != theProcessor && !theProcessor->getBypass () && theProcessor->isActive () ) {
+			mRunList[nextList][count++] = theProcessor;
+		}
+	}
+	mRunListCount[nextList] = count;
+
+	OSSynchronizeIO ();
+	mCurrentRunList = nextList;
+Exit:
+	return;
+}
+
+void DSP_Manager::updateRunListIfStale ( void ) {
+	if ( mRunListStale ) {
+		updateRunList ();
+	}
+}
+
+//	Only setProcessing, which frees the stages, has to wait for the IOProc.
+bool DSP_Manager::waitForIdle ( void ) {
+	UInt32					attempts;
+
+	OSSynchronizeIO ();
+	for ( attempts = 0; attempts < kDSPQuiesceAttempts; attempts++ ) {
+		if ( 0 == *(volatile SInt32 *)&mProcessCount[0] && 0 == *(volatile SInt32 *)&mProcessCount[1] ) {
+			return true;
+		}
+		IOSleep ( 1 );
+	}
+	debugIOLog ( 3, "  DSP_Manager::waitForIdle timed out" );
+	return false;
+}
+
+#pragma mark ------------------------
+#pragma mark --- Parameters
+#pragma mark ------------------------
+
+void DSP_Manager::setSampleRate ( UInt32 inSampleRate ) {
+	DSP_Processor *			theProcessor;
+	UInt32					index;
+
+	mSampleRate = inSampleRate;
+	for ( index = 0; index < mStages->getCount (); index++ ) {
+		theProcessor = OSDynamicCast ( DSP_Processor, mStages->getObject ( index ) );
+		if ( 0 != theProcessor ) {
+			theProcessor->setSampleRate ( inSampleRate );
+		}
+	}
+	//	a stage may become an identity (or stop being one) at the new rate
+	updateRunList ();
+}
+
+void DSP_Manager::reset ( void ) {
+	DSP_Processor *			theProcessor;
+	UInt32					index;
+
+	for ( index = 0; index < mStages->getCount (); index++ ) {
+		theProcessor = OSDynamicCast ( DSP_Processor, mStages->getObject ( index ) );
+		if ( 0 != theProcessor ) {
+			theProcessor->reset ();
+		}
+	}
+}
+
+void DSP_Manager::enable ( void ) {
+	OSSynchronizeIO ();
+	mEnabled = true;
+}
+
+void DSP_Manager::disable ( void ) {
+	mEnabled = false;
+	OSSynchronizeIO ();
+}
+
+UInt32 DSP_Manager::getNumStages ( void ) {
+	return ( 0 == mStages ) ? 0 : mStages->getCount ();
+}
+
+//	Only stages on the run list delay the stream.
+UInt32 DSP_Manager::getLatency ( void ) {
+	UInt32					list;
+	UInt32					index;
+	UInt32					result;
+
+	result = 0;
+	list = mCurrentRunList;
+	for ( index = 0; index < mRunListCount[list]; index++ ) {
+		result += mRunList[list][index]->getLatency ();
+	}
+	return result;
+}
+
+#pragma mark ------------------------
+#pragma mark --- Processing
+#pragma mark ------------------------
+
+//	The first test keeps a disabled chain down to one load and branch.  The
+//	second, after announcing ourselves in mProcessCount, closes the window
+//	where disable () and waitForIdle () could run between the two.  The count
+//	is kept per run list, and taken again if a publish came in between, so
+//	updateRunList knows which list it may rebuild.
+void DSP_Manager::process ( float * ioBuffer, UInt32 inNumSamples ) {
+	DSP_Processor **		runList;
+	UInt32					list;
+	UInt32					count;
+	UInt32					stage;
+	UInt32					sliceSamples;
+	UInt32					samplesThisSlice;
+
+	if ( !mEnabled ) {
+		return;
+	}
+	list = mCurrentRunList;
+	OSIncrementAtomic ( &mProcessCount[list] );
+	OSSynchronizeIO ();
+	while ( list != mCurrentRunList ) {
+		OSDecrementAtomic ( &mProcessCount[list] );
+		list = mCurrentRunList;
+		OSIncrementAtomic ( &mProcessCount[list] );
+		OSSynchronizeIO ();
+	}
+	if ( mEnabled ) {
+		count = mRunListCount[list];
+		runList = mRunList[list];
+		sliceSamples = kDSPMaxSliceFrames * mNumChannels;
+
+		while ( 0 != count && 0 != inNumSamples ) {
+			samplesThisSlice = ( inNumSamples < sliceSamples ) ? inNumSamples : sliceSamples;
+			for ( stage = 0; stage < count; stage++ ) {
+				runList[stage]->process ( ioBuffer, samplesThisSlice );
+			}
+			ioBuffer += samplesThisSlice;
+			inNumSamples -= samplesThisSlice;
+		}
+	}
+	OSDecrementAtomic ( &mProcessCount[list] );
+}
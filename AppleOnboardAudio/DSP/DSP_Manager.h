@@ -1 +1,92 @@
+/*
+ *  DSP_Manager.h
+ *  AppleOnboardAudio
+ *
+ *  Owns the ordered chain of DSP_Processor stages for one direction of an
+ *  engine.  The chain is built from the layout's 'SoftwareDSP' dictionary
+ *  and run in place on the engine's intermediate float buffer.
+ *
+ *  The IOProc only ever walks a compact run list of stages that are neither
+ *  bypassed nor idle, so a disabled stage costs nothing.  Two run lists are
+ *  kept and the IOProc picks one per call; the command gate side rebuilds
+ *  the other one and publishes it with a single store.  If a call that
+ *  started before the last publish is still on that list, the rebuild is
+ *  left for the next gate call rather than waited for.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
 
+#ifndef __DSP_MANAGER__
+#define __DSP_MANAGER__
+
+#include <libkern/OSAtomic.h>
+#include <libkern/c++/OSArray.h>
+#include <libkern/c++/OSString.h>
+
+#include "DSP_Processor.h"
+
+//	optional array of stage names; stages not listed run after the listed ones in the default order
+#define kDSPProcessingOrder				"ProcessingOrder"
+
+#define kDSPMaxStages					16
+#define kDSPMaxSliceFrames				256			/*	largest block handed to a stage in one call		*/
+#define kDSPQuiesceAttempts				20			/*	milliseconds setProcessing waits for the IOProc to leave	*/
+
+class DSP_Manager : public OSObject {
+
+    OSDeclareDefaultStructors ( DSP_Manager );
+
+public:
+
+	static DSP_Manager *		create ( void );
+	static DSP_Processor *		createProcessor ( const char * inStageName, UInt32 inNumChannels );
+
+	virtual bool				init ( void );
+	virtual void				free ( void );
+
+	//	replaces the whole chain, leaving it disabled
+	virtual bool				setProcessing ( OSDictionary * inDictionary, UInt32 inNumChannels, UInt32 inSampleRate );
+	virtual void				removeAllStages ( void );
+
+	virtual void				setSampleRate ( UInt32 inSampleRate );
+	virtual void				reset ( void );
+
+	virtual void				enable ( void );
+	virtual void				disable ( void );
+	virtual bool				isEnabled ( void ) { return mEnabled; }
+
+	virtual DSP_Processor *		getStage ( const char * inStageName );
+	virtual DSP_Processor *		getStageAtIndex ( UInt32 inIndex );
+	virtual void				setStageBypass ( const char * inStageName, bool inBypass );
+	//	retunes a running stage; the stage hands the new set to the IOProc itself
+	virtual bool				setStageParameters ( const char * inStageName, OSDictionary * inDictionary );
+	virtual void				updateRunList ( void );
+	//	a rebuild the IOProc held off; the engine's poll calls this
+	virtual void				updateRunListIfStale ( void );
+
+	virtual UInt32				getNumStages ( void );
+	virtual UInt32				getLatency ( void );
+
+	void						process ( float * ioBuffer, UInt32 inNumSamples );
+
+protected:
+
+	bool						waitForIdle ( void );
+	bool						appendStage ( OSDictionary * inDictionary, const char * inStageName );
+
+	OSArray *					mStages;								//	DSP_Processor, in processing order
+	UInt32						mNumChannels;
+	UInt32						mSampleRate;
+
+	DSP_Processor *				mRunList[2][kDSPMaxStages];
+	UInt32						mRunListCount[2];
+	volatile UInt32				mCurrentRunList;
+	volatile bool				mEnabled;
+	SInt32						mProcessCount[2];						//	IOProc calls inside process () on each run list
+	volatile bool				mRunListStale;							//	a rebuild is waiting for the IOProc to leave a list
+
+	static const char *			sDefaultOrder[];
+};
+
+#endif
@@ -0,0 +1,233 @@
+/*
+ *  DSP_ParametricEQ.cpp
+ *  AppleOnboardAudio
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#include "DSP_ParametricEQ.h"
+
+#define super DSP_Processor
+
+OSDefineMetaClassAndStructors ( DSP_ParametricEQ, DSP_Processor )
+
+//	a pass filter up to the default Q has no peak
+static const float kParametricEQFlatPassQ	= (float)kEQDefaultCentiQ / 100.0f;
+
+#pragma mark ------------------------
+#pragma mark --- Construction
+#pragma mark ------------------------
+
+DSP_ParametricEQ * DSP_ParametricEQ::create ( UInt32 inNumChannels ) {
+	DSP_ParametricEQ *		result;
+
+	result = new DSP_ParametricEQ;
+	if ( 0 != result ) {
+		if ( !result->init ( inNumChannels ) ) {
+			result->release ();
+			result = 0;
+		}
+	}
+	return result;
+}
+
+bool DSP_ParametricEQ::init ( UInt32 inNumChannels ) {
+	bool					result = false;
+
+	mBands = 0;
+	mCodecBands = 0;
+
+	FailIf ( 0 == inNumChannels || inNumChannels > kDSPMaxChannels, Exit );
+	FailIf ( !super::init ( inNumChannels ), Exit );
+
+	mNumBands = 0;
+	bzero ( &mFilters, sizeof ( mFilters ) );
+	DSPExchangeInit ( &mExchange );
+	design ();
+	mLive = mFilters;
+	bzero ( mState, sizeof ( mState ) );
+
+	result = true;
+Exit:
+	return result;
+}
+
+void DSP_ParametricEQ::free ( void ) {
+	if ( 0 != mCodecBands ) {
+		mCodecBands->release ();
+		mCodecBands = 0;
+	}
+	if ( 0 != mBands ) {
+		mBands->release ();
+		mBands = 0;
+	}
+	super::free ();
+}
+
+#pragma mark ------------------------
+#pragma mark --- Parameters
+#pragma mark ------------------------
+
+//	A new band set starts out entirely in software until the next plan.
+void DSP_ParametricEQ::setParameters ( OSDictionary * inDictionary ) {
+	OSArray *				theBands;
+	UInt32					index;
+
+	if ( 0 != mCodecBands ) {
+		mCodecBands->release ();
+		mCodecBands = 0;
+	}
+	if ( 0 != mBands ) {
+		mBands->release ();
+		mBands = 0;
+	}
+	mNumBands = 0;
+
+	theBands = OSDynamicCast ( OSArray, inDictionary->getObject ( kParametricEQBands ) );
+	if ( 0 != theBands ) {
+		theBands->retain ();
+		mBands = theBands;
+		for ( index = 0; index < theBands->getCount () && mNumBands < kParametricEQMaxBands; index++ ) {
+			mBandDicts[mNumBands] = OSDynamicCast ( OSDictionary, theBands->getObject ( index ) );
+			if ( EQReadBandSpec ( mBandDicts[mNumBands], &mSpecs[mNumBands] ) ) {
+				mOnCodec[mNumBands] = false;
+				mNumBands++;
+			}
+		}
+	}
+	design ();
+
+	debugIOLog ( 3, "  DSP_ParametricEQ::setParameters %ld bands", mNumBands );
+}
+
+void DSP_ParametricEQ::setSampleRate ( UInt32 inSampleRate ) {
+	super::setSampleRate ( inSampleRate );
+	design ();
+}
+
+//	The filter state belongs to the IOProc; it is cleared when the new count arrives.
+void DSP_ParametricEQ::reset ( void ) {
+	mFilters.resetCount++;
+	publishFilters ();
+}
+
+void DSP_ParametricEQ::publishFilters ( void ) {
+	mFilterSlots[mExchange.writeSlot] = mFilters;
+	DSPExchangePublish ( &mExchange );
+}
+
+//	Designs the bands that stay in software.  The sections move around when the split
+//	changes, so the state is cleared along with them.
+void DSP_ParametricEQ::design ( void ) {
+	UInt32					index;
+
+	mFilters.numSections = 0;
+	for ( index = 0; index < mNumBands; index++ ) {
+		if ( !mOnCodec[index] ) {
+			EQDesignBiquad ( &mSpecs[index], mSampleRate, &mFilters.sections[mFilters.numSections] );
+			mFilters.numSections++;
+		}
+	}
+	mFilters.resetCount++;
+	publishFilters ();
+}
+
+#pragma mark ------------------------
+#pragma mark --- Offload
+#pragma mark ------------------------
+
+static bool ParametricEQCanBoost ( const EQBandSpec * inSpec ) {
+	bool					result;
+
+	switch ( inSpec->type ) {
+		case kEQLowPass:
+		case kEQHighPass:
+			result = inSpec->q > kParametricEQFlatPassQ;
+			break;
+		default:
+			result = inSpec->gaindB > 0.0f;
+			break;
+	}
+	return result;
+}
+
+//	Bands are taken in dictionary order, skipping any that may not go behind the chain,
+//	so the layout can list the bands it would rather see on the codec first.  The plan is
+//	made again for every output change, mostly to the same split; the software sections
+//	are only redesigned, and their state cleared, when the split moves.
+UInt32 DSP_ParametricEQ::planOffload ( UInt32 inNumCodecSections, bool inAllowBoost ) {
+	bool					onCodec[kParametricEQMaxBands];
+	bool					changed;
+	UInt32					index;
+	UInt32					count;
+
+	if ( 0 != mCodecBands ) {
+		mCodecBands->release ();
+		mCodecBands = 0;
+	}
+
+	for ( index = 0; index < mNumBands; index++ ) {
+		onCodec[index] = false;
+	}
+	count = 0;
+	for ( index = 0; index < mNumBands; index++ ) {
+		if ( count < inNumCodecSections && ( inAllowBoost || !ParametricEQCanBoost ( &mSpecs[index] ) ) ) {
+			if ( 0 == mCodecBands ) {
+				mCodecBands = OSArray::withCapacity ( inNumCodecSections );
+				FailIf ( 0 == mCodecBands, Exit );
+			}
+			if ( mCodecBands->setObject ( mBandDicts[index] ) ) {
+				onCodec[index] = true;
+				count++;
+			}
+		}
+	}
+Exit:
+	changed = false;
+	for ( index = 0; index < mNumBands; index++ ) {
+		if ( onCodec[index] != mOnCodec[index] ) {
+			mOnCodec[index] = onCodec[index];
+			changed = true;
+		}
+	}
+	if ( changed ) {
+		design ();
+	}
+	debugIOLog ( 3, "  DSP_ParametricEQ::planOffload %ld of %ld bands on %ld codec sections, boost %s%s", count, mNumBands, inNumCodecSections, inAllowBoost ? "allowed" : "kept in software", changed ? "" : ", split unchanged" );
+	return count;
+}
+
+#pragma mark ------------------------
+#pragma mark --- Processing
+#pragma mark ------------------------
+
+void DSP_ParametricEQ::process ( float * ioBuffer, UInt32 inNumSamples ) {
+	float					sample;
+	UInt32					section;
+	UInt32					channel;
+	UInt32					index;
+
+	if ( DSPExchangeAcquire ( &mExchange ) ) {
+		if ( mFilterSlots[mExchange.readSlot].resetCount != mLive.resetCount ) {
+			bzero ( mState, sizeof ( mState ) );
+		}
+		mLive = mFilterSlots[mExchange.readSlot];
+	}
+
+	for ( index = 0; index + mNumChannels <= inNumSamples; index += mNumChannels ) {
+		for ( channel = 0; channel < mNumChannels; channel++ ) {
+			sample = ioBuffer[index + channel];
+			for ( section = 0; section < mLive.numSections; section++ ) {
+				sample = EQBiquadProcess ( &mLive.sections[section], &mState[section][channel], sample );
+			}
+			ioBuffer[index + channel] = sample;
+		}
+	}
+
+	for ( section = 0; section < mLive.numSections; section++ ) {
+		for ( channel = 0; channel < mNumChannels; channel++ ) {
+			EQFlushDenormals ( &mState[section][channel] );
+		}
+	}
+}
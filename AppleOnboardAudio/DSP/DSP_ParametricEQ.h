@@ -0,0 +1,87 @@
+/*
+ *  DSP_ParametricEQ.h
+ *  AppleOnboardAudio
+ *
+ *  Parametric equalizer built from an array of band dictionaries.  When the
+ *  output codec has fixed point biquads of its own, some of the bands can
+ *  be handed to it and only the remainder runs here.
+ *
+ *  planOffload decides the split.  Every band is linear and time invariant,
+ *  so the order of the bands does not matter, but the codec runs after the
+ *  whole software chain.  A band that can raise the level is only moved
+ *  there when the chain has no soft clip or limiter that it would end up
+ *  behind.  The split is redone whenever the output or its codec changes.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSP_PARAMETRICEQ__
+#define __DSP_PARAMETRICEQ__
+
+#include <libkern/c++/OSArray.h>
+
+#include "DSP_Processor.h"
+#include "DSP_Equalizer.h"
+
+//	'SoftwareDSP' dictionary keys
+#define kParametricEQEntry				"ParametricEQ"
+#define kParametricEQBands				"Bands"					/*	array of band dictionaries, see DSP_Equalizer.h		*/
+
+#define kParametricEQMaxBands			16
+
+typedef struct {
+	EQBiquad				sections[kParametricEQMaxBands];
+	UInt32					numSections;
+	UInt32					resetCount;					//	a change clears the filter state
+} ParametricEQFilters;
+
+class DSP_ParametricEQ : public DSP_Processor {
+
+    OSDeclareDefaultStructors ( DSP_ParametricEQ );
+
+public:
+
+	static DSP_ParametricEQ *	create ( UInt32 inNumChannels );
+
+	virtual bool			init ( UInt32 inNumChannels );
+	virtual void			free ( void );
+
+	virtual const char *	getStageName ( void ) { return kParametricEQEntry; }
+
+	virtual void			setParameters ( OSDictionary * inDictionary );
+	virtual void			setSampleRate ( UInt32 inSampleRate );
+	virtual void			reset ( void );
+
+	//	Command gate.  Chooses up to inNumCodecSections bands for the codec and returns how
+	//	many were chosen; getCodecBands then holds exactly those band dictionaries.
+	virtual UInt32			planOffload ( UInt32 inNumCodecSections, bool inAllowBoost );
+	virtual OSArray *		getCodecBands ( void ) { return mCodecBands; }
+
+	//	idle when every band is on the codec
+	virtual bool			isActive ( void ) { return 0 != mFilters.numSections; }
+
+	virtual void			process ( float * ioBuffer, UInt32 inNumSamples );
+
+protected:
+
+	void					design ( void );
+	void					publishFilters ( void );
+
+	//	command gate side
+	EQBandSpec				mSpecs[kParametricEQMaxBands];
+	OSDictionary *			mBandDicts[kParametricEQMaxBands];	//	owned by mBands
+	bool					mOnCodec[kParametricEQMaxBands];
+	UInt32					mNumBands;
+	OSArray *				mBands;
+	OSArray *				mCodecBands;
+	ParametricEQFilters		mFilters;
+	ParametricEQFilters		mFilterSlots[kDSPExchangeSlots];
+	DSPExchange				mExchange;
+
+	//	IOProc side
+	ParametricEQFilters		mLive;
+	EQBiquadState			mState[kParametricEQMaxBands][kDSPMaxChannels];
+};
+
+#endif
@@ -0,0 +1,27 @@
+/*
+ *  DSP_Processor.cpp
+ *  AppleOnboardAudio
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#include "DSP_Processor.h"
+
+#define super OSObject
+
+OSDefineMetaClassAndAbstractStructors ( DSP_Processor, OSObject )
+
+bool DSP_Processor::init ( UInt32 inNumChannels ) {
+	bool					result = false;
+
+	FailIf ( !super::init (), Exit );
+
+	mNumChannels = inNumChannels;
+	mSampleRate = 44100;
+	mBypass = false;
+
+	result = true;
+Exit:
+	return result;
+}
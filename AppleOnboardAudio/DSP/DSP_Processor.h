@@ -0,0 +1,56 @@
+/*
+ *  DSP_Processor.h
+ *  AppleOnboardAudio
+ *
+ *  Abstract base for a stage in a DSP_Manager chain.  Every stage works in
+ *  place on interleaved floating point samples and is configured from its
+ *  own sub-dictionary of the layout's 'SoftwareDSP' entry.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSP_PROCESSOR__
+#define __DSP_PROCESSOR__
+
+#include "DSP_Common.h"
+
+//	present in any stage dictionary; a bypassed stage stays configured but is not run
+#define kDSPProcessorBypass				"Bypass"
+
+class DSP_Processor : public OSObject {
+
+    OSDeclareAbstractStructors ( DSP_Processor );
+
+public:
+
+	virtual bool			init ( UInt32 inNumChannels );
+
+	//	the stage's key in the 'SoftwareDSP' dictionary
+	virtual const char *	getStageName ( void ) = 0;
+
+	virtual void			setParameters ( OSDictionary * inDictionary ) = 0;
+	virtual void			setSampleRate ( UInt32 inSampleRate ) { mSampleRate = inSampleRate; }
+	virtual void			reset ( void ) = 0;
+
+	//	frames of delay the stage adds to the stream
+	virtual UInt32			getLatency ( void ) { return 0; }
+
+	//	false when the current parameters make the stage an identity, so the manager can drop it from the run list
+	virtual bool			isActive ( void ) { return true; }
+
+	//	ioBuffer holds inNumSamples interleaved samples (not frames); every stage and the manager take it this way
+	virtual void			process ( float * ioBuffer, UInt32 inNumSamples ) = 0;
+
+			void			setBypass ( bool inBypass ) { mBypass = inBypass; }
+			bool			getBypass ( void ) { return mBypass; }
+			UInt32			getNumChannels ( void ) { return mNumChannels; }
+
+protected:
+
+	UInt32					mNumChannels;
+	UInt32					mSampleRate;
+	bool					mBypass;
+};
+
+#endif
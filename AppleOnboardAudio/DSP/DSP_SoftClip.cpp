@@ -0,0 +1,249 @@
+/*
+ *  DSP_SoftClip.cpp
+ *  AppleOnboardAudio
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#include "DSP_SoftClip.h"
+
+#define super DSP_Processor
+
+OSDefineMetaClassAndStructors ( DSP_SoftClip, DSP_Processor )
+
+#pragma mark ------------------------
+#pragma mark --- Constants and Tables
+#pragma mark ------------------------
+
+//	tanh(i/32), i = 0 ... 128.  The curve is entered with unity slope so the
+//	transition at the knee has no corner.
+const float DSP_SoftClip::sTanhTable[kSoftClipTableSize] = {
+	0.000000f,	0.031240f,	0.062419f,	0.093476f,
+	0.124353f,	0.154991f,	0.185333f,	0.215326f,
+	0.244919f,	0.274062f,	0.302710f,	0.330821f,
+	0.358357f,	0.385284f,	0.411570f,	0.437189f,
+	0.462117f,	0.486336f,	0.509830f,	0.532587f,
+	0.554600f,	0.575862f,	0.596374f,	0.616134f,
+	0.635149f,	0.653424f,	0.670967f,	0.687790f,
+	0.703906f,	0.719328f,	0.734072f,	0.748154f,
+	0.761594f,	0.774409f,	0.786619f,	0.798243f,
+	0.809301f,	0.819814f,	0.829802f,	0.839285f,
+	0.848284f,	0.856818f,	0.864907f,	0.872570f,
+	0.879827f,	0.886695f,	0.893193f,	0.899339f,
+	0.905148f,	0.910638f,	0.915825f,	0.920722f,
+	0.925346f,	0.929710f,	0.933828f,	0.937712f,
+	0.941376f,	0.944829f,	0.948085f,	0.951154f,
+	0.954045f,	0.956769f,	0.959335f,	0.961752f,
+	0.964028f,	0.966170f,	0.968187f,	0.970086f,
+	0.971873f,	0.973554f,	0.975137f,	0.976625f,
+	0.978026f,	0.979344f,	0.980583f,	0.981749f,
+	0.982845f,	0.983876f,	0.984846f,	0.985757f,
+	0.986614f,	0.987420f,	0.988178f,	0.988890f,
+	0.989560f,	0.990189f,	0.990781f,	0.991337f,
+	0.991860f,	0.992351f,	0.992813f,	0.993247f,
+	0.993655f,	0.994038f,	0.994398f,	0.994737f,
+	0.995055f,	0.995354f,	0.995635f,	0.995899f,
+	0.996147f,	0.996380f,	0.996599f,	0.996804f,
+	0.996998f,	0.997179f,	0.997350f,	0.997510f,
+	0.997661f,	0.997803f,	0.997936f,	0.998060f,
+	0.998178f,	0.998288f,	0.998392f,	0.998489f,
+	0.998581f,	0.998667f,	0.998747f,	0.998823f,
+	0.998894f,	0.998961f,	0.999024f,	0.999083f,
+	0.999139f,	0.999191f,	0.999240f,	0.999286f,
+	0.999329f
+};
+
+//	4 tap halfband interpolator (odd phase) and 7 tap halfband decimator
+static const float kHalfbandInner		= 0.5625f;		//	 9/16
+static const float kHalfbandOuter		= 0.0625f;		//	 1/16
+static const float kDecimatorCenter		= 0.5f;
+static const float kDecimatorInner		= 0.28125f;		//	 9/32
+static const float kDecimatorOuter		= 0.03125f;		//	 1/32
+
+#pragma mark ------------------------
+#pragma mark --- Construction
+#pragma mark ------------------------
+
+DSP_SoftClip * DSP_SoftClip::create ( UInt32 inNumChannels ) {
+	DSP_SoftClip *			result;
+
+	result = new DSP_SoftClip;
+	if ( 0 != result ) {
+		if ( !result->init ( inNumChannels ) ) {
+			result->release ();
+			result = 0;
+		}
+	}
+	return result;
+}
+
+bool DSP_SoftClip::init ( UInt32 inNumChannels ) {
+	bool					result = false;
+
+	FailIf ( !super::init ( inNumChannels ), Exit );
+
+	bzero ( &mCurve, sizeof ( mCurve ) );
+	DSPExchangeInit ( &mExchange );
+	setKnee ( (float)kSoftClipDefaultKneePercent / 100.0f );
+	mLiveCurve = mCurve;
+	bzero ( mInputHistory, sizeof ( mInputHistory ) );
+	bzero ( mOddHistory, sizeof ( mOddHistory ) );
+	bzero ( mEvenHistory, sizeof ( mEvenHistory ) );
+
+	result = true;
+Exit:
+	return result;
+}
+
+#pragma mark ------------------------
+#pragma mark --- Parameters
+#pragma mark ------------------------
+
+void DSP_SoftClip::setParameters ( OSDictionary * inDictionary ) {
+	SInt32					kneePercent;
+
+	kneePercent = DSPGetSInt32Parameter ( inDictionary, kSoftClipKneePercent, kSoftClipDefaultKneePercent );
+	if ( kneePercent < kSoftClipMinKneePercent ) {
+		kneePercent = kSoftClipMinKneePercent;
+	} else if ( kneePercent > kSoftClipMaxKneePercent ) {
+		kneePercent = kSoftClipMaxKneePercent;
+	}
+	mCurve.knee = (float)kneePercent / 100.0f;
+	mCurve.headroom = 1.0f - mCurve.knee;
+	mCurve.tableIndexScale = kSoftClipTableScale / mCurve.headroom;
+	setOversample ( DSPGetBoolParameter ( inDictionary, kSoftClipOversample, false ) );
+
+	debugIOLog ( 3, "  DSP_SoftClip::setParameters knee %ld%%, oversample %d", kneePercent, mCurve.oversample );
+}
+
+void DSP_SoftClip::setKnee ( float inKnee ) {
+	mCurve.knee = inKnee;
+	mCurve.headroom = 1.0f - inKnee;
+	mCurve.tableIndexScale = kSoftClipTableScale / mCurve.headroom;
+	publishCurve ();
+}
+
+void DSP_SoftClip::setOversample ( bool inOversample ) {
+	//	the halfband history is kept per channel, so wider formats run at the base rate
+	if ( inOversample && mNumChannels > kDSPMaxChannels ) {
+		inOversample = false;
+	}
+	if ( inOversample != mCurve.oversample ) {
+		mCurve.oversample = inOversample;
+		mCurve.resetCount++;
+	}
+	publishCurve ();
+}
+
+//	The history belongs to the IOProc; it is cleared when the new count arrives.
+void DSP_SoftClip::reset ( void ) {
+	mCurve.resetCount++;
+	publishCurve ();
+}
+
+void DSP_SoftClip::publishCurve ( void ) {
+	mCurveSlots[mExchange.writeSlot] = mCurve;
+	DSPExchangePublish ( &mExchange );
+}
+
+#pragma mark ------------------------
+#pragma mark --- Processing
+#pragma mark ------------------------
+
+inline float DSP_SoftClip::shape ( float inSample ) {
+	float					magnitude;
+	float					position;
+	float					fraction;
+	float					curve;
+	UInt32					index;
+
+	magnitude = DSPAbs ( inSample );
+	if ( magnitude <= mLiveCurve.knee ) {
+		return inSample;
+	}
+
+	position = ( magnitude - mLiveCurve.knee ) * mLiveCurve.tableIndexScale;
+	if ( !( position < (float)( kSoftClipTableSize - 1 ) ) ) {				//	also catches NaN
+		curve = sTanhTable[kSoftClipTableSize - 1];
+	} else {
+		index = (UInt32)position;
+		fraction = position - (float)index;
+		curve = sTanhTable[index] + fraction * ( sTanhTable[index + 1] - sTanhTable[index] );
+	}
+	magnitude = mLiveCurve.knee + mLiveCurve.headroom * curve;
+
+	return ( inSample < 0.0f ) ? -magnitude : magnitude;
+}
+
+void DSP_SoftClip::process ( float * ioBuffer, UInt32 inNumSamples ) {
+	UInt32					index;
+
+	if ( DSPExchangeAcquire ( &mExchange ) ) {
+		if ( mCurveSlots[mExchange.readSlot].resetCount != mLiveCurve.resetCount ) {
+			bzero ( mInputHistory, sizeof ( mInputHistory ) );
+			bzero ( mOddHistory, sizeof ( mOddHistory ) );
+			bzero ( mEvenHistory, sizeof ( mEvenHistory ) );
+		}
+		mLiveCurve = mCurveSlots[mExchange.readSlot];
+	}
+
+	if ( mLiveCurve.oversample ) {
+		processOversampled ( ioBuffer, inNumSamples );
+		return;
+	}
+
+	//	The curve is the identity under the knee, so nothing before the first
+	//	loud sample needs to be written back.  A quiet block costs one compare
+	//	per sample.
+	for ( index = 0; index < inNumSamples; index++ ) {
+		if ( DSPAbs ( ioBuffer[index] ) > mLiveCurve.knee ) {
+			break;
+		}
+	}
+	for ( ; index < inNumSamples; index++ ) {
+		ioBuffer[index] = shape ( ioBuffer[index] );
+	}
+}
+
+//	Each input sample produces an even phase (the input delayed by two frames)
+//	and an odd phase interpolated by a 4 tap halfband.  Both phases go through
+//	the curve and are decimated back with a 7 tap halfband, which removes most
+//	of the harmonics the curve would otherwise alias into the audio band.
+void DSP_SoftClip::processOversampled ( float * ioBuffer, UInt32 inNumSamples ) {
+	float *					inputHistory;
+	float *					oddHistory;
+	float					input;
+	float					even;
+	float					odd;
+	UInt32					channel;
+	UInt32					numFrames;
+
+	FailIf ( 0 == mNumChannels, Exit );
+	numFrames = inNumSamples / mNumChannels;
+
+	while ( numFrames-- ) {
+		for ( channel = 0; channel < mNumChannels; channel++ ) {
+			inputHistory = mInputHistory[channel];				//	x[n-1], x[n-2], x[n-3]
+			oddHistory = mOddHistory[channel];					//	odd[n-1], odd[n-2], odd[n-3]
+
+			input = *ioBuffer;
+			even = shape ( inputHistory[1] );
+			odd = shape ( kHalfbandInner * ( inputHistory[1] + inputHistory[0] ) - kHalfbandOuter * ( inputHistory[2] + input ) );
+
+			*ioBuffer++ = kDecimatorCenter * mEvenHistory[channel]
+						+ kDecimatorInner * ( oddHistory[1] + oddHistory[0] )
+						- kDecimatorOuter * ( oddHistory[2] + odd );
+
+			inputHistory[2] = inputHistory[1];
+			inputHistory[1] = inputHistory[0];
+			inputHistory[0] = input;
+			oddHistory[2] = oddHistory[1];
+			oddHistory[1] = oddHistory[0];
+			oddHistory[0] = odd;
+			mEvenHistory[channel] = even;
+		}
+	}
+Exit:
+	return;
+}
@@ -0,0 +1,85 @@
+/*
+ *  DSP_SoftClip.h
+ *  AppleOnboardAudio
+ *
+ *  Table driven saturation applied as the last floating point stage before
+ *  conversion to the native integer stream format.  Samples under the knee
+ *  pass unmodified; above the knee the remaining headroom is mapped through
+ *  a tanh curve so the output approaches, but never reaches, full scale.
+ *
+ *  The curve is continuous in the knee, so a new knee can simply take effect
+ *  at the next block; it reaches the IOProc through a DSPExchange.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSP_SOFTCLIP__
+#define __DSP_SOFTCLIP__
+
+#include "DSP_Processor.h"
+
+//	'SoftwareDSP' dictionary keys
+#define kSoftClipEntry					"SoftClip"
+#define kSoftClipKneePercent			"KneePercent"			/*	knee as a percentage of full scale (50 - 99)		*/
+#define kSoftClipOversample				"Oversample"			/*	run the curve at twice the sample rate				*/
+
+#define kSoftClipDefaultKneePercent		90
+#define kSoftClipMinKneePercent			50
+#define kSoftClipMaxKneePercent			99
+
+#define kSoftClipTableSize				129						/*	tanh(x) for x = 0 ... 4 in steps of 1/32			*/
+#define kSoftClipTableScale				32.0f
+#define kSoftClipOversampleLatency		3						/*	sample frames added by the 2x halfband filters		*/
+
+typedef struct {
+	float					knee;
+	float					headroom;					//	1.0 - knee
+	float					tableIndexScale;			//	kSoftClipTableScale / headroom
+	bool					oversample;
+	UInt32					resetCount;					//	a change clears the filter history
+} SoftClipCurve;
+
+class DSP_SoftClip : public DSP_Processor {
+
+    OSDeclareDefaultStructors ( DSP_SoftClip );
+
+public:
+
+	static DSP_SoftClip *	create ( UInt32 inNumChannels );
+
+	virtual bool			init ( UInt32 inNumChannels );
+
+	virtual const char *	getStageName ( void ) { return kSoftClipEntry; }
+
+	virtual void			setParameters ( OSDictionary * inDictionary );
+	virtual void			setKnee ( float inKnee );
+	virtual void			setOversample ( bool inOversample );
+	virtual void			reset ( void );
+
+	virtual UInt32			getLatency ( void ) { return mCurve.oversample ? kSoftClipOversampleLatency : 0; }
+
+	virtual void			process ( float * ioBuffer, UInt32 inNumSamples );
+
+protected:
+
+	inline float			shape ( float inSample );
+	void					processOversampled ( float * ioBuffer, UInt32 inNumSamples );
+	void					publishCurve ( void );
+
+	SoftClipCurve			mCurve;						//	command gate side
+	SoftClipCurve			mCurveSlots[kDSPExchangeSlots];
+	DSPExchange				mExchange;
+
+	//	IOProc side
+	SoftClipCurve			mLiveCurve;
+
+	//	per channel halfband interpolator / decimator history
+	float					mInputHistory[kDSPMaxChannels][3];
+	float					mOddHistory[kDSPMaxChannels][3];
+	float					mEvenHistory[kDSPMaxChannels];
+
+	static const float		sTanhTable[kSoftClipTableSize];
+};
+
+#endif
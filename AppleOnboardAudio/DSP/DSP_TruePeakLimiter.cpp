@@ -0,0 +1,279 @@
+/*
+ *  DSP_TruePeakLimiter.cpp
+ *  AppleOnboardAudio
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#include "DSP_TruePeakLimiter.h"
+
+#include "AppleDBDMAFloatLib.h"
+
+#define super DSP_Processor
+
+OSDefineMetaClassAndStructors ( DSP_TruePeakLimiter, DSP_Processor )
+
+static const float kTruePeakPi				= 3.14159265f;
+
+#pragma mark ------------------------
+#pragma mark --- Construction
+#pragma mark ------------------------
+
+DSP_TruePeakLimiter * DSP_TruePeakLimiter::create ( UInt32 inNumChannels ) {
+	DSP_TruePeakLimiter *	result;
+
+	result = new DSP_TruePeakLimiter;
+	if ( 0 != result ) {
+		if ( !result->init ( inNumChannels ) ) {
+			result->release ();
+			result = 0;
+		}
+	}
+	return result;
+}
+
+//	The interpolator is a sinc with its zeros on the input samples, Blackman windowed over
+//	kTruePeakPhaseTaps input frames.  Branch p holds taps p, p + 4, p + 8 ... of the 4x filter.
+bool DSP_TruePeakLimiter::init ( UInt32 inNumChannels ) {
+	float					position;
+	float					window;
+	float					sinc;
+	UInt32					phase;
+	UInt32					tap;
+	UInt32					index;
+	bool					result = false;
+
+	FailIf ( 0 == inNumChannels || inNumChannels > kDSPMaxChannels, Exit );
+	FailIf ( !super::init ( inNumChannels ), Exit );
+
+	for ( phase = 1; phase < kTruePeakOversample; phase++ ) {
+		for ( tap = 0; tap < kTruePeakPhaseTaps; tap++ ) {
+			index = tap * kTruePeakOversample + phase;
+			position = (float)index / (float)kTruePeakOversample - (float)kTruePeakFilterDelay;
+			sinc = dspSin ( kTruePeakPi * position ) / ( kTruePeakPi * position );
+			window = 0.42f - 0.5f * dspCos ( 2.0f * kTruePeakPi * (float)index / (float)( kTruePeakOversample * kTruePeakPhaseTaps ) )
+				   + 0.08f * dspCos ( 4.0f * kTruePeakPi * (float)index / (float)( kTruePeakOversample * kTruePeakPhaseTaps ) );
+			mPhases[phase - 1][kTruePeakPhaseTaps - 1 - tap] = sinc * window;
+		}
+	}
+
+	mReleaseMilliseconds = kTruePeakDefaultRelease;
+	bzero ( &mSettings, sizeof ( mSettings ) );
+	mSettings.ceiling = dspPow ( 10.0f, (float)kTruePeakDefaultCeiling / 2000.0f );
+	mSettings.lookahead = kTruePeakDefaultLookahead;
+	DSPExchangeInit ( &mExchange );
+	setSampleRate ( mSampleRate );
+	mLive = mSettings;
+	clearState ();
+
+	result = true;
+Exit:
+	return result;
+}
+
+#pragma mark ------------------------
+#pragma mark --- Parameters
+#pragma mark ------------------------
+
+void DSP_TruePeakLimiter::setParameters ( OSDictionary * inDictionary ) {
+	SInt32					ceiling;
+	SInt32					lookahead;
+	SInt32					release;
+
+	ceiling = DSPGetSInt32Parameter ( inDictionary, kTruePeakCeilingCentiDecibels, kTruePeakDefaultCeiling );
+	if ( ceiling > 0 ) {
+		ceiling = 0;
+	} else if ( ceiling < kTruePeakMinCeiling ) {
+		ceiling = kTruePeakMinCeiling;
+	}
+	mSettings.ceiling = dspPow ( 10.0f, (float)ceiling / 2000.0f );
+
+	lookahead = DSPGetSInt32Parameter ( inDictionary, kTruePeakLookaheadFrames, kTruePeakDefaultLookahead );
+	if ( lookahead < kTruePeakMinLookahead ) {
+		lookahead = kTruePeakMinLookahead;
+	} else if ( lookahead > kTruePeakMaxLookahead ) {
+		lookahead = kTruePeakMaxLookahead;
+	}
+	if ( (UInt32)lookahead != mSettings.lookahead ) {
+		mSettings.lookahead = (UInt32)lookahead;
+		mSettings.resetCount++;
+	}
+
+	release = DSPGetSInt32Parameter ( inDictionary, kTruePeakReleaseMilliseconds, kTruePeakDefaultRelease );
+	mReleaseMilliseconds = ( release < 1 ) ? 1 : (UInt32)release;
+
+	setSampleRate ( mSampleRate );
+
+	debugIOLog ( 3, "  DSP_TruePeakLimiter::setParameters ceiling %ld cdB, lookahead %ld, release %ld ms, latency %ld", ceiling, lookahead, mReleaseMilliseconds, getLatency () );
+}
+
+void DSP_TruePeakLimiter::setSampleRate ( UInt32 inSampleRate ) {
+	super::setSampleRate ( inSampleRate );
+	mSettings.release = 1.0f - dspExp ( -1000.0f / ( (float)mReleaseMilliseconds * (float)mSampleRate ) );
+	publishSettings ();
+}
+
+//	The side chain and delay line belong to the IOProc; they are cleared when the new count arrives.
+void DSP_TruePeakLimiter::reset ( void ) {
+	mSettings.resetCount++;
+	publishSettings ();
+}
+
+void DSP_TruePeakLimiter::publishSettings ( void ) {
+	mSettingsSlots[mExchange.writeSlot] = mSettings;
+	DSPExchangePublish ( &mExchange );
+}
+
+#pragma mark ------------------------
+#pragma mark --- Processing
+#pragma mark ------------------------
+
+//	The box average starts full of unity gains, so the first frames pass untouched.
+void DSP_TruePeakLimiter::clearState ( void ) {
+	UInt32					index;
+
+	bzero ( mHistory, sizeof ( mHistory ) );
+	bzero ( mDelay, sizeof ( mDelay ) );
+	mHistoryIndex = 0;
+	mDelayIndex = 0;
+	mPreviousPeak = 0.0f;
+	mMinimumHead = 0;
+	mMinimumCount = 0;
+	mFrameCount = 0;
+	for ( index = 0; index < kTruePeakMaxLookahead; index++ ) {
+		mAverage[index] = 1.0f;
+	}
+	mAverageSum = (float)mLive.lookahead;
+	mAverageIndex = 0;
+	mGain = 1.0f;
+}
+
+//	Pushes one frame into the interpolator and returns the largest magnitude of any channel
+//	over the interval that starts kTruePeakFilterDelay frames back:  the sample itself and the
+//	three interpolated points after it.
+inline float DSP_TruePeakLimiter::detectFrame ( const float * inFrame ) {
+	const float *			history;
+	const float *			taps;
+	float					peak;
+	float					value;
+	UInt32					channel;
+	UInt32					phase;
+
+	peak = 0.0f;
+	for ( channel = 0; channel < mNumChannels; channel++ ) {
+		mHistory[channel][mHistoryIndex] = inFrame[channel];
+		mHistory[channel][mHistoryIndex + kTruePeakPhaseTaps] = inFrame[channel];
+		history = &mHistory[channel][mHistoryIndex + 1];			//	oldest of the last kTruePeakPhaseTaps frames
+
+		value = DSPAbs ( history[kTruePeakPhaseTaps - 1 - kTruePeakFilterDelay] );
+		if ( value > peak ) {
+			peak = value;
+		}
+		for ( phase = 0; phase < kTruePeakOversample - 1; phase++ ) {
+			taps = mPhases[phase];
+			value = taps[0] * history[0] + taps[1] * history[1] + taps[2] * history[2] + taps[3] * history[3]
+				  + taps[4] * history[4] + taps[5] * history[5] + taps[6] * history[6] + taps[7] * history[7]
+				  + taps[8] * history[8] + taps[9] * history[9] + taps[10] * history[10] + taps[11] * history[11];
+			value = DSPAbs ( value );
+			if ( value > peak ) {
+				peak = value;
+			}
+		}
+	}
+	if ( ++mHistoryIndex == kTruePeakPhaseTaps ) {
+		mHistoryIndex = 0;
+	}
+	return peak;
+}
+
+//	Sliding minimum over the last L gains, kept as a deque of rising values.
+inline float DSP_TruePeakLimiter::holdMinimum ( float inGain ) {
+	UInt32					tail;
+
+	//	retire the gain that has left the window first, so the deque never holds more than L
+	if ( 0 != mMinimumCount && mFrameCount - mMinimumFrame[mMinimumHead] >= mLive.lookahead ) {
+		if ( ++mMinimumHead == kTruePeakMaxLookahead ) {
+			mMinimumHead = 0;
+		}
+		mMinimumCount--;
+	}
+	while ( 0 != mMinimumCount ) {
+		tail = mMinimumHead + mMinimumCount - 1;
+		if ( tail >= kTruePeakMaxLookahead ) {
+			tail -= kTruePeakMaxLookahead;
+		}
+		if ( mMinimumGain[tail] < inGain ) {
+			break;
+		}
+		mMinimumCount--;
+	}
+	tail = mMinimumHead + mMinimumCount;
+	if ( tail >= kTruePeakMaxLookahead ) {
+		tail -= kTruePeakMaxLookahead;
+	}
+	mMinimumGain[tail] = inGain;
+	mMinimumFrame[tail] = mFrameCount;
+	mMinimumCount++;
+	mFrameCount++;
+	return mMinimumGain[mMinimumHead];
+}
+
+void DSP_TruePeakLimiter::process ( float * ioBuffer, UInt32 inNumSamples ) {
+	float					intervalPeak;
+	float					peak;
+	float					needed;
+	float					held;
+	float					sample;
+	UInt32					delayFrames;
+	UInt32					resetCount;
+	UInt32					channel;
+	UInt32					index;
+
+	if ( DSPExchangeAcquire ( &mExchange ) ) {
+		resetCount = mLive.resetCount;
+		mLive = mSettingsSlots[mExchange.readSlot];
+		if ( mLive.resetCount != resetCount ) {
+			clearState ();
+		}
+	}
+	delayFrames = mLive.lookahead + kTruePeakFilterDelay - 1;
+
+	//	the running sum is rebuilt once per call so rounding cannot accumulate
+	mAverageSum = 0.0f;
+	for ( index = 0; index < mLive.lookahead; index++ ) {
+		mAverageSum += mAverage[index];
+	}
+
+	for ( index = 0; index + mNumChannels <= inNumSamples; index += mNumChannels ) {
+		//	a sample is bounded by the intervals on both sides of it
+		intervalPeak = detectFrame ( &ioBuffer[index] );
+		peak = ( intervalPeak > mPreviousPeak ) ? intervalPeak : mPreviousPeak;
+		mPreviousPeak = intervalPeak;
+		needed = ( peak > mLive.ceiling ) ? mLive.ceiling / peak : 1.0f;
+
+		held = holdMinimum ( needed );
+		mAverageSum += held - mAverage[mAverageIndex];
+		mAverage[mAverageIndex] = held;
+		if ( ++mAverageIndex == mLive.lookahead ) {
+			mAverageIndex = 0;
+		}
+		held = mAverageSum / (float)mLive.lookahead;
+
+		//	the average already ramps down in time, so only the recovery is smoothed
+		if ( held < mGain ) {
+			mGain = held;
+		} else {
+			mGain += ( held - mGain ) * mLive.release;
+		}
+
+		for ( channel = 0; channel < mNumChannels; channel++ ) {
+			sample = mDelay[channel][mDelayIndex];
+			mDelay[channel][mDelayIndex] = ioBuffer[index + channel];
+			ioBuffer[index + channel] = sample * mGain;
+		}
+		if ( ++mDelayIndex == delayFrames ) {
+			mDelayIndex = 0;
+		}
+	}
+}
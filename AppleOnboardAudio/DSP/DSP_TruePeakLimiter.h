@@ -0,0 +1,111 @@
+/*
+ *  DSP_TruePeakLimiter.h
+ *  AppleOnboardAudio
+ *
+ *  Lookahead limiter on the true (inter-sample) peak, meant as the last
+ *  stage of the output chain.  The clip routines only see the samples, but
+ *  the DAC's reconstruction filter can swing well past them between two
+ *  loud samples of opposite slope and clip in the analog domain.
+ *
+ *  The side chain upsamples each channel 4x with a 48 tap polyphase
+ *  windowed sinc, the interpolator of the ITU-R BS.1770 meter, so the
+ *  limiter and a true peak meter agree.  Phase 0 of that filter is a pure
+ *  delay, so only the three fractional phases are computed.  The gain every frame needs is
+ *  held at its minimum over the lookahead window and then box averaged
+ *  over the same window, which ramps the gain down linearly and reaches
+ *  the needed value exactly at the peak; recovery is a one pole release.
+ *  The gain is linked across channels so the image does not move.
+ *
+ *  The audio path is delayed by the lookahead plus the side chain filter
+ *  delay, which is what getLatency reports.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSP_TRUEPEAKLIMITER__
+#define __DSP_TRUEPEAKLIMITER__
+
+#include "DSP_Processor.h"
+
+//	'SoftwareDSP' dictionary keys
+#define kTruePeakEntry					"TruePeakLimiter"
+#define kTruePeakCeilingCentiDecibels	"CeilingCentiDecibels"	/*	true peak ceiling * 100, dBTP						*/
+#define kTruePeakLookaheadFrames		"LookaheadFrames"
+#define kTruePeakReleaseMilliseconds	"ReleaseMilliseconds"
+
+#define kTruePeakDefaultCeiling			-100
+#define kTruePeakMinCeiling				-1200
+#define kTruePeakDefaultLookahead		32
+#define kTruePeakMinLookahead			8
+#define kTruePeakMaxLookahead			64
+#define kTruePeakDefaultRelease			50
+
+#define kTruePeakOversample				4
+#define kTruePeakPhaseTaps				12						/*	taps per polyphase branch							*/
+#define kTruePeakFilterDelay			( kTruePeakPhaseTaps / 2 )	/*	frames from input to its phase 0 output		*/
+#define kTruePeakMaxDelay				( kTruePeakMaxLookahead + kTruePeakFilterDelay )
+
+typedef struct {
+	float					ceiling;					//	linear
+	float					release;					//	per frame smoothing coefficient
+	UInt32					lookahead;					//	L, frames
+	UInt32					resetCount;					//	a change clears the side chain and delay line
+} TruePeakSettings;
+
+class DSP_TruePeakLimiter : public DSP_Processor {
+
+    OSDeclareDefaultStructors ( DSP_TruePeakLimiter );
+
+public:
+
+	static DSP_TruePeakLimiter *	create ( UInt32 inNumChannels );
+
+	virtual bool			init ( UInt32 inNumChannels );
+
+	virtual const char *	getStageName ( void ) { return kTruePeakEntry; }
+
+	virtual void			setParameters ( OSDictionary * inDictionary );
+	virtual void			setSampleRate ( UInt32 inSampleRate );
+	virtual void			reset ( void );
+
+	//	read by the engine when the chain is built; a new lookahead takes effect on the next rebuild
+	virtual UInt32			getLatency ( void ) { return mSettings.lookahead + kTruePeakFilterDelay - 1; }
+
+	virtual void			process ( float * ioBuffer, UInt32 inNumSamples );
+
+protected:
+
+	void					publishSettings ( void );
+	void					clearState ( void );
+	inline float			detectFrame ( const float * inFrame );
+	inline float			holdMinimum ( float inGain );
+
+	//	command gate side
+	UInt32					mReleaseMilliseconds;
+	TruePeakSettings		mSettings;
+	TruePeakSettings		mSettingsSlots[kDSPExchangeSlots];
+	DSPExchange				mExchange;
+
+	//	phases 1 to 3, taps in reverse order so they line up with the history
+	float					mPhases[kTruePeakOversample - 1][kTruePeakPhaseTaps];
+
+	//	IOProc side
+	TruePeakSettings		mLive;
+	float					mHistory[kDSPMaxChannels][2 * kTruePeakPhaseTaps];	//	written twice so a window never wraps
+	UInt32					mHistoryIndex;
+	float					mPreviousPeak;				//	true peak of the interval before the current frame
+	float					mMinimumGain[kTruePeakMaxLookahead];	//	monotonic deque of gains...
+	UInt32					mMinimumFrame[kTruePeakMaxLookahead];	//	...and the frame each one belongs to
+	UInt32					mMinimumHead;
+	UInt32					mMinimumCount;
+	UInt32					mFrameCount;
+	float					mAverage[kTruePeakMaxLookahead];		//	held gains in the box average
+	float					mAverageSum;
+	UInt32					mAverageIndex;
+	float					mGain;
+	float					mDelay[kDSPMaxChannels][kTruePeakMaxDelay];
+	UInt32					mDelayIndex;
+};
+
+#endif
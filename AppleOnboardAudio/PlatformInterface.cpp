@@ -99,6 +99,10 @@ bool PlatformInterface::init ( IOService* device, AppleOnboardAudio* provider, U
 	mComboInAssociation = kGPIO_Selector_NotAssociated;		//	[3453799]
 	mComboOutAssociation = kGPIO_Selector_NotAssociated;	//	[3453799]
 	
+	mI2CRegisterProfile = (i2cRegisterProfile *)IOMalloc ( kCodec_NumberOfTypes * kI2CProfileRegisters * sizeof ( i2cRegisterProfile ) );
+	FailWithAction ( 0 == mI2CRegisterProfile, result = FALSE, Exit );
+	clearI2CProfile ();
+	
 	switch ( KPlatformSupport_bitAddress_mask & ( supportSelectors >> kPlatformSupportDBDMA_bitAddress ) )
 	{
 		case kPlatformSupport_MAPPED:		platformInterfaceDBDMA = PlatformDBDMAFactory::createPlatform ( OSString::withCString ( kPlatformDBDMAMappedString ) );					break;
@@ -232,6 +236,11 @@ void	PlatformInterface::free ( void )
 		thread_call_free ( mRegisterNonDetectInterruptsThread );
 	}
 
+	if ( 0 != mI2CRegisterProfile ) {
+		IOFree ( mI2CRegisterProfile, kCodec_NumberOfTypes * kI2CProfileRegisters * sizeof ( i2cRegisterProfile ) );
+		mI2CRegisterProfile = 0;
+	}
+
 	super::free ();
 	
 	debugIOLog ( 3, "- PlatformInterface::free" );
@@ -1484,13 +1493,26 @@ Exit:
 #pragma mark Codec Methods	
 #pragma mark ---------------------------
 
+//	--------------------------------------------------------------------------------
+static inline UInt64 I2CProfileUptimeNanos ( void ) {
+	AbsoluteTime		uptime;
+	UInt64				nanos;
+
+	clock_get_uptime ( &uptime );
+	absolutetime_to_nanoseconds ( uptime, &nanos );
+	return nanos;
+}
+
 //	--------------------------------------------------------------------------------
 IOReturn PlatformInterface::readCodecRegister ( UInt32 codecRef, UInt8 subAddress, UInt8 *data, UInt32 dataLength ) {
 	IOReturn		result = kIOReturnError;
+	UInt64			startNanos;
 	
 	if ( platformInterfaceI2C )
 	{
+		startNanos = I2CProfileUptimeNanos ();
 		result = platformInterfaceI2C->readCodecRegister ( codecRef, subAddress, data, dataLength );
+		profileI2CTransaction ( codecRef, subAddress, dataLength, FALSE, result, startNanos );
 		FailIf ( kIOReturnSuccess != result, Exit );
 	}
 Exit:
@@ -1500,10 +1522,13 @@ Exit:
 //	--------------------------------------------------------------------------------
 IOReturn PlatformInterface::writeCodecRegister ( UInt32 codecRef, UInt8 subAddress, UInt8 *data, UInt32 dataLength ) {
 	IOReturn		result = kIOReturnError;
+	UInt64			startNanos;
 	
 	if ( platformInterfaceI2C )
 	{
+		startNanos = I2CProfileUptimeNanos ();
 		result = platformInterfaceI2C->WriteCodecRegister ( codecRef, subAddress, data, dataLength );
+		profileI2CTransaction ( codecRef, subAddress, dataLength, TRUE, result, startNanos );
 		FailIf ( kIOReturnSuccess != result, Exit );
 	}
 Exit:
@@ -1528,16 +1553,147 @@ UInt32 PlatformInterface::getSavedMAP ( UInt32 codecRef )
 IOReturn PlatformInterface::setMAP ( UInt32 codecRef, UInt8 subAddress )
 {
 	IOReturn		result = kIOReturnError;
+	UInt64			startNanos;
 	
 	if ( platformInterfaceI2C )
 	{
+		startNanos = I2CProfileUptimeNanos ();
 		result = platformInterfaceI2C->setMAP ( codecRef, subAddress );
+		profileI2CTransaction ( codecRef, subAddress, 0, TRUE, result, startNanos );
 		FailIf ( kIOReturnSuccess != result, Exit );
 	}
 Exit:
 	return result;
 }
 
+
+//	--------------------------------------------------------------------------------
+//	The codec methods are called from the work loop and from the plugins' own threads, and the
+//	profile is read through the user client without a lock.  The counts are for finding which
+//	control paths are bound by the bus, and a count torn by a concurrent update does no harm there.
+void PlatformInterface::profileI2CTransaction ( UInt32 codecRef, UInt8 subAddress, UInt32 dataLength, bool isWrite, IOReturn result, UInt64 startNanos )
+{
+	i2cCodecProfile *		codecProfile;
+	i2cRegisterProfile *	registerProfile;
+	UInt64					nanos;
+	UInt64					limit;
+	UInt32					micros;
+	UInt32					bucket;
+
+	if ( kCodec_NumberOfTypes <= codecRef || 0 == mI2CRegisterProfile )
+	{
+		goto Exit;
+	}
+	nanos = I2CProfileUptimeNanos () - startNanos;
+	micros = ( nanos / 1000 > 0xFFFFFFFFULL ) ? 0xFFFFFFFF : (UInt32)( nanos / 1000 );
+	bucket = 0;
+	limit = 1ULL << kI2CProfileHistogramFirstShift;
+	while ( bucket < kI2CProfileHistogramBuckets - 1 && nanos >= limit )
+	{
+		bucket++;
+		limit <<= 1;
+	}
+
+	codecProfile = &mI2CCodecProfile[codecRef];
+	registerProfile = &mI2CRegisterProfile[codecRef * kI2CProfileRegisters + subAddress];
+	if ( isWrite )
+	{
+		codecProfile->writes++;
+		codecProfile->writeHistogram[bucket]++;
+		registerProfile->writes++;
+		if ( kIOReturnSuccess != result )
+		{
+			codecProfile->writeErrors++;
+		}
+	}
+	else
+	{
+		codecProfile->reads++;
+		codecProfile->readHistogram[bucket]++;
+		registerProfile->reads++;
+		if ( kIOReturnSuccess != result )
+		{
+			codecProfile->readErrors++;
+		}
+	}
+	if ( kIOReturnSuccess != result )
+	{
+		registerProfile->errors++;
+	}
+	codecProfile->bytes += dataLength;
+	codecProfile->totalMicros += micros;
+	if ( micros > codecProfile->maxMicros )
+	{
+		codecProfile->maxMicros = micros;
+	}
+	registerProfile->totalMicros += micros;
+	if ( micros > registerProfile->maxMicros )
+	{
+		registerProfile->maxMicros = micros;
+	}
+Exit:
+	return;
+}
+
+
+//	--------------------------------------------------------------------------------
+//	The per codec profiles are copied whole.  Of the per register profiles only the registers
+//	with the most bus time fit, so they are kept sorted busiest first as the table is walked.
+void PlatformInterface::copyI2CProfile ( i2cProfileDescriptorPtr outProfile )
+{
+	i2cRegisterProfile *	registerProfile;
+	UInt32					codecRef;
+	UInt32					subAddress;
+	UInt32					count;
+	UInt32					index;
+
+	bzero ( outProfile, sizeof ( i2cProfileDescriptor ) );
+	outProfile->elapsedMillis = (UInt32)( ( I2CProfileUptimeNanos () - mI2CProfileStartNanos ) / 1000000 );
+	memcpy ( outProfile->codec, mI2CCodecProfile, sizeof ( mI2CCodecProfile ) );
+	FailIf ( 0 == mI2CRegisterProfile, Exit );
+
+	count = 0;
+	for ( codecRef = 0; codecRef < kCodec_NumberOfTypes; codecRef++ )
+	{
+		for ( subAddress = 0; subAddress < kI2CProfileRegisters; subAddress++ )
+		{
+			registerProfile = &mI2CRegisterProfile[codecRef * kI2CProfileRegisters + subAddress];
+			if ( 0 == registerProfile->reads && 0 == registerProfile->writes )
+			{
+				continue;
+			}
+			if ( kI2CProfileHotRegisters == count && registerProfile->totalMicros <= outProfile->hotRegisters[count - 1].totalMicros )
+			{
+				continue;
+			}
+			index = ( kI2CProfileHotRegisters == count ) ? count - 1 : count++;
+			while ( 0 < index && registerProfile->totalMicros > outProfile->hotRegisters[index - 1].totalMicros )
+			{
+				outProfile->hotRegisters[index] = outProfile->hotRegisters[index - 1];
+				index--;
+			}
+			outProfile->hotRegisters[index] = *registerProfile;
+			outProfile->hotRegisters[index].codecRef = codecRef;
+			outProfile->hotRegisters[index].subAddress = subAddress;
+		}
+	}
+	outProfile->hotRegisterCount = count;
+Exit:
+	return;
+}
+
+
+//	--------------------------------------------------------------------------------
+void PlatformInterface::clearI2CProfile ( void )
+{
+	bzero ( mI2CCodecProfile, sizeof ( mI2CCodecProfile ) );
+	if ( 0 != mI2CRegisterProfile )
+	{
+		bzero ( mI2CRegisterProfile, kCodec_NumberOfTypes * kI2CProfileRegisters * sizeof ( i2cRegisterProfile ) );
+	}
+	mI2CProfileStartNanos = I2CProfileUptimeNanos ();
+}
+
 #pragma mark ---------------------------
 #pragma mark GPIO Support	
 #pragma mark ---------------------------
@@ -2555,6 +2711,7 @@ IOReturn	PlatformInterface::getPlatformState ( PlatformStateStructPtr outState )
 	}
 	
 	if ( platformInterfaceI2C ) {
+		copyI2CProfile ( &outState->i2cProfile );
 	}
 	
 	if ( platformInterfaceI2S ) {
@@ -2581,6 +2738,12 @@ IOReturn	PlatformInterface::setPlatformState ( PlatformStateStructPtr inState )
 	IOReturn			result = kIOReturnBadArgument;
 	
 	FailIf ( NULL == inState, Exit );
+	if ( 0 != inState->i2cProfile.clearRequest ) {
+		debugIOLog (3,  "ShastaPlatform::setPlatformState clearI2CProfile" );
+		clearI2CProfile ();
+		result = kIOReturnSuccess;
+	}
+
 	if ( platformInterfaceDBDMA ) {
 	}
 	
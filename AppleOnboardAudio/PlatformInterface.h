@@ -191,6 +191,51 @@ typedef struct {
 } i2cDescriptor;
 typedef i2cDescriptor * i2cDescriptorPtr;
 
+//	Codec register traffic as seen through readCodecRegister, writeCodecRegister and setMAP.  Times
+//	are for the whole call, opening and closing the bus included.  Bucket 0 of a histogram holds
+//	transactions under 1 << kI2CProfileHistogramFirstShift ns and each bucket after it twice the
+//	span of the one before; the last takes everything longer.
+#define kI2CProfileHistogramBuckets			12		/*	< 64 us, < 128 us ... < 67 ms, and longer				*/
+#define kI2CProfileHistogramFirstShift		16
+#define kI2CProfileRegisters				256		/*	one per sub address										*/
+#define kI2CProfileHotRegisters				48		/*	the registers with the most bus time, busiest first		*/
+
+//	If this structure changes then please apply the same changes to the DiagnosticSupport/AOA Viewer sources.
+typedef struct {
+	UInt32					reads;
+	UInt32					writes;								//	setMAP counts as a write of no data
+	UInt32					readErrors;
+	UInt32					writeErrors;
+	UInt32					bytes;
+	UInt32					totalMicros;
+	UInt32					maxMicros;
+	UInt32					readHistogram[kI2CProfileHistogramBuckets];
+	UInt32					writeHistogram[kI2CProfileHistogramBuckets];
+} i2cCodecProfile;
+
+//	If this structure changes then please apply the same changes to the DiagnosticSupport/AOA Viewer sources.
+typedef struct {
+	UInt8					codecRef;
+	UInt8					subAddress;
+	UInt16					reserved;
+	UInt32					reads;
+	UInt32					writes;
+	UInt32					errors;
+	UInt32					totalMicros;
+	UInt32					maxMicros;
+} i2cRegisterProfile;
+
+//	If this structure changes then please apply the same changes to the DiagnosticSupport/AOA Viewer sources.
+//	Non zero clearRequest passed to setPlatformState starts the profile over.
+typedef struct {
+	UInt32					clearRequest;
+	UInt32					elapsedMillis;						//	since the profile was last started over
+	UInt32					hotRegisterCount;
+	i2cCodecProfile			codec[kCodec_NumberOfTypes];
+	i2cRegisterProfile		hotRegisters[kI2CProfileHotRegisters];
+} i2cProfileDescriptor;
+typedef i2cProfileDescriptor * i2cProfileDescriptorPtr;
+
 //	[3517297]
 
 typedef enum ComboStateMachineState {
@@ -206,6 +251,7 @@ typedef struct {
 	i2sDescriptor							i2s;
 	gpioDescriptor							gpio;
 	i2cDescriptor							i2c;
+	i2cProfileDescriptor					i2cProfile;
 } PlatformStateStruct ;
 typedef PlatformStateStruct * PlatformStateStructPtr;
 
@@ -279,6 +325,9 @@ public:
 	virtual UInt32						getSavedMAP ( UInt32 codecRef );
 	virtual IOReturn					setMAP ( UInt32 codecRef, UInt8 subAddress );
 
+	virtual void						copyI2CProfile ( i2cProfileDescriptorPtr outProfile );
+	virtual void						clearI2CProfile ( void );
+
 	//
 	// FCR Methods
 	//
@@ -417,6 +466,12 @@ protected:
 	
 	IOWorkLoop *						mWorkLoop;
 
+	void								profileI2CTransaction ( UInt32 codecRef, UInt8 subAddress, UInt32 dataLength, bool isWrite, IOReturn result, UInt64 startNanos );
+
+	i2cCodecProfile						mI2CCodecProfile[kCodec_NumberOfTypes];
+	i2cRegisterProfile *				mI2CRegisterProfile;												//	kCodec_NumberOfTypes * kI2CProfileRegisters
+	UInt64								mI2CProfileStartNanos;
+
 	UInt32								mSupportSelectors;
 
 	enum {
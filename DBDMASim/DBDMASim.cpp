@@ -0,0 +1,819 @@
+/*
+ *  DBDMASim.cpp
+ *  DBDMASim
+ *
+ *  Host side model of the output DMA in AppleDBDMAAudio.  The engine class
+ *  itself needs IOAudioEngine and cannot be built here.  What it decides
+ *  about the channel is shared: the wrap check in filterInterrupt, the
+ *  stall watchdog's looks, the engineDied poll and where a restart in
+ *  place picks the ring up are AppleDBDMARecovery.h, and the time stamp
+ *  loop filter is AppleDBDMATimeStamp.h, both as the driver builds them.
+ *  The code around those calls is carried over by hand and has to be kept
+ *  in step with the driver: the program createDMAPrograms writes, with a
+ *  branch at every page of descriptors; the S0 handshake of
+ *  performAudioEngineStart and performAudioEngineStop; and restartDMA.
+ *  All of it runs against DBDMASimChannel instead of the hardware.  -W
+ *  and -F take the watchdog and the restart in place away again, to
+ *  compare with the driver before them.
+ *
+ *  Only one output channel is modelled.  The input channel, the clip
+ *  routines with their deadline tracking and low latency back off, the
+ *  iSub and its position sync, and the restart claim that the IOProc and
+ *  the work loop share are not; with one thread the claim is always free.
+ *
+ *  A writer stands in for the IOProc.  Each cycle it estimates the play
+ *  position from the loop time stamps the way the HAL does, and writes
+ *  one I/O buffer of frames past the safety offset.  Every frame carries
+ *  its own absolute position, so when the channel fetches a block the
+ *  transfer handler can tell whether it got the frame it should play,
+ *  stale data, or nothing.  It erases a block once the serializer has
+ *  played it, as the erase head would; a block the channel fetched but
+ *  a stop dropped from the FIFO is left to be fetched again.  Stalls,
+ *  dead channels and late IOProcs can then be injected and the interrupt
+ *  timing, glitches and recovery time read off the report.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+//	Build from the top of the tree with the command below, on one line.
+//
+//	c++ -O2 -fno-extended-identifiers -o dbdmasim -IDBDMASim/Kernel -IDSPRender/Kernel
+//		-IDBDMASim -IAppleOnboardAudio DBDMASim/*.cpp
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "DBDMASimChannel.h"
+#include "AppleDBDMATimeStamp.h"
+#include "AppleDBDMARecovery.h"
+
+#define PAGE_SIZE						4096
+
+//	AppleDBDMAAudio.h
+#define kDBDMAAttemptsToStop			2
+#define kMinimumLatency					45
+#define DBDMAAUDIODMAENGINE_DEFAULT_NUM_BLOCKS		512
+
+#define kSimBytesPerFrame				4						/*	16 bit stereo, the frame is the stamp			*/
+#define kSimDefaultBlockSize			128						/*	64 samples of 16 bits							*/
+#define kSimDefaultSampleRate			44100
+#define kSimDefaultIOFrames				512
+#define kSimMaxPages					48
+#define kSimMaxFaults					8
+#define kSimSampleBufferPhys			0x00400000
+#define kSimCommandBufferPhys			0x00800000
+
+#define kSimNanosPerMilli				1000000ULL
+#define kSimSettlePasses				16						/*	time stamp error is counted once the loop has settled	*/
+
+typedef struct {
+	UInt64				at;
+	UInt64				duration;								//	0 for a dead channel
+	UInt64				restartNanos;							//	first restart after it, 0 until then
+	UInt64				silenceNanos;							//	serializer starved from here to the next fault
+	UInt32				glitchFrames;
+} SimFault;
+
+typedef struct {
+	UInt32				sampleRate;
+	UInt32				numBlocks;
+	UInt32				blockSize;
+	UInt32				ioFrames;
+	UInt64				durationNanos;
+	UInt64				ioProcNanos;
+	UInt64				jitterNanos;
+	UInt64				interruptJitterNanos;
+	UInt64				pollNanos;
+	SimFault			faults[kSimMaxFaults];
+	UInt32				numFaults;
+	bool				rawTimeStamps;
+	bool				noWatchdog;
+	bool				fullRestarts;
+	bool				verbose;
+} SimOptions;
+
+//	The driver's state, under the driver's names where it has one.
+typedef struct {
+	DBDMASimChannel		channel;
+	volatile IODBDMAChannelRegisters *	ioBaseDMAOutput;
+	SimOptions *		options;
+
+	UInt8 *				mOutputSampleBuffer;
+	IODBDMADescriptor *	dmaCommandBufferOut;
+	IOPhysicalAddress	samplePages[kSimMaxPages];
+	IOPhysicalAddress	commandPages[kSimMaxPages];
+	UInt32				numBlocks;
+	UInt32				blockSize;
+	UInt32				framesPerBuffer;
+
+	bool				interruptsEnabled;
+	bool				dmaRunState;
+	bool				mNeedToRestartDMA;
+	bool				mDmaRecoveryInProcess;
+	UInt32				mDmaInterruptCount;
+	UInt32				mLastDmaInterruptCount;
+	UInt32				mNumberOfFrozenDmaInterruptCounts;
+	UInt32				mDmaStalledCount;
+	UInt32				mDmaHwDiedCount;
+	UInt64				mWatchdogNanos;
+	UInt64				watchdogWake;							//	0 while the timer is cancelled
+	DBDMAStallWatchdog	mWatchdog;
+	bool				mInPlaceRestartTried;
+	UInt32				mInPlaceRestartInterruptCount;
+
+	UInt32				loopCount;								//	IOAudioEngine's fCurrentLoopCount and time stamp
+	UInt64				loopNanos;
+	DBDMATimeStampFilter	mTimeStampFilter;
+
+	UInt64				nextFrame;								//	IOProc: first frame not yet written this run
+	UInt64				firstFrame;
+	UInt32				readLoops;								//	what the channel has read this run
+	UInt32				lastReadFrame;
+	UInt8 *				playingBlock;							//	erased when the channel fetches another
+	UInt32				playingBytes;
+
+	UInt32				restarts;
+	UInt32				inPlaceRestarts;
+	UInt32				filterRestarts;
+	UInt32				pollRestarts;
+	UInt32				watchdogRestarts;
+	UInt32				ioProcCycles;
+	UInt64				glitchFrames;
+	UInt64				checkedFrames;
+	UInt64				lastInterruptNanos;
+	UInt64				minPeriod;
+	UInt64				maxPeriod;
+	UInt64				sumPeriod;
+	UInt32				numPeriods;
+	SInt64				minStampError;							//	published stamp less the end of the last block
+	SInt64				maxStampError;
+	SInt64				sumStampError;
+	UInt32				numStampErrors;
+	UInt64				underflowAtFault;
+} SimEngine;
+
+#pragma mark ------------------------
+#pragma mark --- Memory
+#pragma mark ------------------------
+
+//	Pages land at scattered physical addresses so the page branches in the program are
+//	taken for real; a missing branch shows up as a bus error.
+static IOPhysicalAddress SimPagePhys ( IOPhysicalAddress inBase, UInt32 inPage, UInt32 inNumPages ) {
+	return inBase + ( inNumPages - 1 - inPage ) * 2 * PAGE_SIZE;
+}
+
+static bool SimMapBuffer ( SimEngine * ioEngine, UInt8 * inHost, UInt32 inLength, IOPhysicalAddress inBase, IOPhysicalAddress * outPages ) {
+	UInt32				numPages;
+	UInt32				page;
+	UInt32				length;
+	bool				result = false;
+
+	numPages = ( inLength + PAGE_SIZE - 1 ) / PAGE_SIZE;
+	if ( numPages > kSimMaxPages ) {
+		fprintf ( stderr, "dbdmasim: %lu pages is more than the map holds\n", (unsigned long)numPages );
+		goto Exit;
+	}
+	for ( page = 0; page < numPages; page++ ) {
+		outPages[page] = SimPagePhys ( inBase, page, numPages );
+		length = ( inLength - page * PAGE_SIZE < PAGE_SIZE ) ? inLength - page * PAGE_SIZE : PAGE_SIZE;
+		if ( !DBDMASimMapMemory ( &ioEngine->channel, outPages[page], inHost + page * PAGE_SIZE, length ) ) {
+			fprintf ( stderr, "dbdmasim: the buffers do not fit the channel's address map\n" );
+			goto Exit;
+		}
+	}
+	result = true;
+Exit:
+	return result;
+}
+
+//	IOMemoryDescriptor::getPhysicalSegment
+static IOPhysicalAddress SimPhysicalSegment ( const IOPhysicalAddress * inPages, UInt32 inOffset ) {
+	return inPages[inOffset / PAGE_SIZE] + inOffset % PAGE_SIZE;
+}
+
+#pragma mark ------------------------
+#pragma mark --- Engine
+#pragma mark ------------------------
+
+static bool createDMAPrograms ( SimEngine * ioEngine ) {
+	UInt32				offset;
+	IOPhysicalAddress	commandBufferPhys;
+	IOPhysicalAddress	sampleBufferPhys;
+	IOPhysicalAddress	stopCommandPhys;
+	IOPhysicalAddress	cmdDest;
+	UInt32				dmaCommand;
+	UInt32				blockNum;
+	bool				doInterrupt;
+
+	offset = 0;
+	dmaCommand = kdbdmaOutputMore;
+	doInterrupt = false;
+
+	commandBufferPhys = SimPhysicalSegment ( ioEngine->commandPages, 0 );
+	sampleBufferPhys = SimPhysicalSegment ( ioEngine->samplePages, 0 );
+	stopCommandPhys = SimPhysicalSegment ( ioEngine->commandPages, ioEngine->numBlocks * sizeof ( IODBDMADescriptor ) );
+
+	for ( blockNum = 0; blockNum < ioEngine->numBlocks; blockNum++ ) {
+		if ( offset >= PAGE_SIZE ) {
+			sampleBufferPhys = SimPhysicalSegment ( ioEngine->samplePages, blockNum * ioEngine->blockSize );
+			offset = 0;
+		}
+
+		if ( blockNum == ( ioEngine->numBlocks - 1 ) ) {
+			cmdDest = commandBufferPhys;
+			doInterrupt = true;
+		} else if ( ( ( ( blockNum + 1 ) * sizeof ( IODBDMADescriptor ) ) % PAGE_SIZE ) == 0 ) {
+			cmdDest = SimPhysicalSegment ( ioEngine->commandPages, ( blockNum + 1 ) * sizeof ( IODBDMADescriptor ) );
+		} else {
+			cmdDest = 0;
+		}
+
+		if ( cmdDest ) {
+			IOMakeDBDMADescriptorDep ( &ioEngine->dmaCommandBufferOut[blockNum], dmaCommand, kdbdmaKeyStream0,
+									doInterrupt ? kdbdmaIntAlways : kdbdmaIntNever, kdbdmaBranchAlways, kdbdmaWaitNever,
+									ioEngine->blockSize, sampleBufferPhys + offset, cmdDest );
+		} else {
+			IOMakeDBDMADescriptorDep ( &ioEngine->dmaCommandBufferOut[blockNum], dmaCommand, kdbdmaKeyStream0,
+									kdbdmaIntNever, kdbdmaBranchIfTrue, kdbdmaWaitNever,
+									ioEngine->blockSize, sampleBufferPhys + offset, stopCommandPhys );
+		}
+		offset += ioEngine->blockSize;
+	}
+
+	IOMakeDBDMADescriptor ( &ioEngine->dmaCommandBufferOut[blockNum], kdbdmaStop, kdbdmaKeyStream0,
+						kdbdmaIntNever, kdbdmaBranchNever, kdbdmaWaitNever, 0, 0 );
+	return true;
+}
+
+//	IOAudioEngine::takeTimeStamp
+static void takeTimeStamp ( SimEngine * ioEngine, bool inIncrementLoopCount, UInt64 inNanos ) {
+	if ( inIncrementLoopCount ) {
+		ioEngine->loopCount++;
+	}
+	ioEngine->loopNanos = inNanos;
+}
+
+static void SimInterrupt ( void * inRefCon, DBDMASimChannel * inChannel ) {
+	SimEngine *			theEngine = (SimEngine *)inRefCon;
+	UInt64				period;
+	UInt64				stamp;
+	SInt64				error;
+
+	if ( !theEngine->interruptsEnabled ) {
+		return;
+	}
+
+	//	filterInterrupt
+	if ( !( IOGetDBDMAChannelStatus ( theEngine->ioBaseDMAOutput ) & kdbdmaActive ) ) {
+		theEngine->mNeedToRestartDMA = true;
+	}
+	if ( !DBDMATakeWrap ( &theEngine->dmaCommandBufferOut[theEngine->numBlocks - 1], IOGetDBDMAChannelStatus ( theEngine->ioBaseDMAOutput ) ) ) {
+		return;
+	}
+	stamp = DBDMATimeStampFilterUpdate ( &theEngine->mTimeStampFilter, inChannel->clock );
+	takeTimeStamp ( theEngine, true, theEngine->options->rawTimeStamps ? inChannel->clock : stamp );
+	theEngine->mDmaInterruptCount++;
+	theEngine->mDmaRecoveryInProcess = false;
+
+	if ( kSimSettlePasses < theEngine->loopCount && !theEngine->mNeedToRestartDMA ) {
+		error = (SInt64)( theEngine->loopNanos - inChannel->interruptRaisedNanos );
+		if ( 0 == theEngine->numStampErrors || error < theEngine->minStampError ) {
+			theEngine->minStampError = error;
+		}
+		if ( 0 == theEngine->numStampErrors || error > theEngine->maxStampError ) {
+			theEngine->maxStampError = error;
+		}
+		theEngine->sumStampError += error;
+		theEngine->numStampErrors++;
+	}
+
+	if ( 0 != theEngine->lastInterruptNanos && !theEngine->mNeedToRestartDMA ) {
+		period = inChannel->clock - theEngine->lastInterruptNanos;
+		if ( 0 == theEngine->numPeriods || period < theEngine->minPeriod ) {
+			theEngine->minPeriod = period;
+		}
+		if ( period > theEngine->maxPeriod ) {
+			theEngine->maxPeriod = period;
+		}
+		theEngine->sumPeriod += period;
+		theEngine->numPeriods++;
+	}
+	theEngine->lastInterruptNanos = inChannel->clock;
+}
+
+static void armStallWatchdog ( SimEngine * ioEngine );
+
+//	IOSleep, in simulated time
+static void SimSleep ( SimEngine * ioEngine, UInt32 inMilliseconds ) {
+	DBDMASimRunUntil ( &ioEngine->channel, ioEngine->channel.clock + inMilliseconds * kSimNanosPerMilli );
+}
+
+static void performAudioEngineStart ( SimEngine * ioEngine ) {
+	ioEngine->interruptsEnabled = true;
+	DBDMATimeStampFilterReset ( &ioEngine->mTimeStampFilter, ioEngine->framesPerBuffer, ioEngine->options->sampleRate );
+	takeTimeStamp ( ioEngine, false, ioEngine->channel.clock );
+	ioEngine->loopCount = 0;
+	ioEngine->lastInterruptNanos = 0;
+
+	IOSetDBDMAChannelControl ( ioEngine->ioBaseDMAOutput, IOClearDBDMAChannelControlBits ( kdbdmaS0 ) );
+	IOSetDBDMABranchSelect ( ioEngine->ioBaseDMAOutput, IOSetDBDMAChannelControlBits ( kdbdmaS0 ) );
+	IOSetCCDescriptor ( &ioEngine->dmaCommandBufferOut[ioEngine->numBlocks - 1], result, 0 );
+	IODBDMAStart ( ioEngine->ioBaseDMAOutput, (IODBDMADescriptor *)(uintptr_t)SimPhysicalSegment ( ioEngine->commandPages, 0 ) );
+
+	ioEngine->nextFrame = 0;
+	ioEngine->firstFrame = ~0ULL;
+	ioEngine->readLoops = 0;
+	ioEngine->lastReadFrame = 0;
+	ioEngine->mInPlaceRestartTried = false;
+	ioEngine->dmaRunState = true;
+	armStallWatchdog ( ioEngine );
+}
+
+static void performAudioEngineStop ( SimEngine * ioEngine ) {
+	UInt16				attemptsToStop = kDBDMAAttemptsToStop;
+
+	ioEngine->interruptsEnabled = false;
+	ioEngine->watchdogWake = 0;
+
+	IOSetDBDMAChannelControl ( ioEngine->ioBaseDMAOutput, IOSetDBDMAChannelControlBits ( kdbdmaS0 ) );
+	while ( ( IOGetDBDMAChannelStatus ( ioEngine->ioBaseDMAOutput ) & kdbdmaActive ) && ( attemptsToStop-- ) ) {
+		eieio ();
+		SimSleep ( ioEngine, 1 );
+	}
+	IODBDMAStop ( ioEngine->ioBaseDMAOutput );
+	IODBDMAReset ( ioEngine->ioBaseDMAOutput );
+
+	ioEngine->dmaRunState = false;
+	ioEngine->interruptsEnabled = true;
+}
+
+static bool restartChannelAtBlock ( SimEngine * ioEngine, UInt32 inBlockNum ) {
+	IOPhysicalAddress	commandPhys;
+
+	commandPhys = SimPhysicalSegment ( ioEngine->commandPages, inBlockNum * sizeof ( IODBDMADescriptor ) );
+	DBDMARestartChannel ( ioEngine->ioBaseDMAOutput, (IODBDMADescriptor *)(uintptr_t)commandPhys );
+	return true;
+}
+
+static bool restartDMAInPlace ( SimEngine * ioEngine ) {
+	UInt64				loopNanos;
+	UInt64				passNanos;
+	UInt32				passes;
+	UInt32				pass;
+	UInt32				blockNum;
+	bool				result = false;
+
+	if ( ioEngine->mInPlaceRestartTried && ioEngine->mDmaInterruptCount == ioEngine->mInPlaceRestartInterruptCount ) {
+		goto Exit;
+	}
+	loopNanos = ioEngine->loopNanos;
+	if ( !DBDMAInPlaceRestartPoint ( ioEngine->channel.clock, loopNanos, ioEngine->options->sampleRate, ioEngine->framesPerBuffer,
+								ioEngine->blockSize / kSimBytesPerFrame, ioEngine->numBlocks, &passes, &blockNum ) ) {
+		goto Exit;
+	}
+	restartChannelAtBlock ( ioEngine, blockNum );
+	IOSetCCDescriptor ( &ioEngine->dmaCommandBufferOut[ioEngine->numBlocks - 1], result, 0 );
+
+	passNanos = DBDMATimeStampFilterPeriod ( &ioEngine->mTimeStampFilter );
+	for ( pass = 1; pass <= passes; pass++ ) {
+		takeTimeStamp ( ioEngine, true, loopNanos + pass * passNanos );
+	}
+	DBDMATimeStampFilterSkip ( &ioEngine->mTimeStampFilter, passes );
+
+	//	not the driver's: the frame check follows the channel to the pass the HAL is in
+	ioEngine->readLoops = ioEngine->loopCount;
+	ioEngine->lastReadFrame = blockNum * ( ioEngine->blockSize / kSimBytesPerFrame );
+
+	ioEngine->mInPlaceRestartTried = true;
+	ioEngine->mInPlaceRestartInterruptCount = ioEngine->mDmaInterruptCount;
+	armStallWatchdog ( ioEngine );
+	result = true;
+Exit:
+	return result;
+}
+
+static void restartDMA ( SimEngine * ioEngine ) {
+	UInt32				index;
+	bool				inPlace;
+
+	inPlace = !ioEngine->options->fullRestarts && restartDMAInPlace ( ioEngine );
+	if ( inPlace ) {
+		ioEngine->inPlaceRestarts++;
+	} else {
+		performAudioEngineStop ( ioEngine );
+		performAudioEngineStart ( ioEngine );
+	}
+	//	releaseRestart; with one thread the claim is always free
+	ioEngine->mNeedToRestartDMA = false;
+	ioEngine->restarts++;
+	for ( index = 0; index < ioEngine->options->numFaults; index++ ) {
+		if ( ioEngine->options->faults[index].at <= ioEngine->channel.clock && 0 == ioEngine->options->faults[index].restartNanos ) {
+			ioEngine->options->faults[index].restartNanos = ioEngine->channel.clock;
+		}
+	}
+	if ( ioEngine->options->verbose ) {
+		printf ( "%10.3f ms  restart%s\n", (double)ioEngine->channel.clock / 1.0e6, inPlace ? " in place" : "" );
+	}
+}
+
+static void armStallWatchdog ( SimEngine * ioEngine ) {
+	if ( ioEngine->options->noWatchdog ) {
+		return;
+	}
+	ioEngine->mWatchdogNanos = DBDMAStallWatchdogPeriod ( ioEngine->blockSize / kSimBytesPerFrame, ioEngine->options->sampleRate );
+	DBDMAStallWatchdogArm ( &ioEngine->mWatchdog, IOGetDBDMACommandPtr ( ioEngine->ioBaseDMAOutput ), ioEngine->mDmaInterruptCount );
+	ioEngine->mDmaRecoveryInProcess = false;
+	ioEngine->watchdogWake = ioEngine->channel.clock + ioEngine->mWatchdogNanos;
+}
+
+//	True when it calls for a recovery; the restart rearms it.
+static bool checkForStall ( SimEngine * ioEngine ) {
+	bool				stalled = false;
+
+	ioEngine->watchdogWake = 0;
+	if ( !ioEngine->dmaRunState ) {
+		goto Exit;
+	}
+	switch ( DBDMAStallWatchdogCheck ( &ioEngine->mWatchdog, IOGetDBDMAChannelStatus ( ioEngine->ioBaseDMAOutput ),
+									IOGetDBDMACommandPtr ( ioEngine->ioBaseDMAOutput ), ioEngine->mDmaInterruptCount ) ) {
+		case kDBDMAWatchdogDead:
+			ioEngine->mDmaHwDiedCount++;
+			stalled = true;
+			break;
+		case kDBDMAWatchdogStalled:
+			ioEngine->mDmaStalledCount++;
+			stalled = true;
+			break;
+	}
+
+	if ( stalled ) {
+		ioEngine->mDmaRecoveryInProcess = true;
+	} else {
+		ioEngine->watchdogWake = ioEngine->channel.clock + ioEngine->mWatchdogNanos;
+	}
+Exit:
+	return stalled;
+}
+
+static bool engineDied ( SimEngine * ioEngine ) {
+	bool				result = false;
+
+	if ( !ioEngine->mDmaRecoveryInProcess ) {
+		switch ( DBDMAPollInterruptCount ( ioEngine->mDmaInterruptCount, ioEngine->dmaRunState,
+										&ioEngine->mLastDmaInterruptCount, &ioEngine->mNumberOfFrozenDmaInterruptCounts ) ) {
+			case kDBDMAInterruptsFrozen:
+				result = true;
+				ioEngine->mDmaRecoveryInProcess = true;
+				ioEngine->mDmaStalledCount++;
+				break;
+			case kDBDMAInterruptsMoving:
+				ioEngine->mDmaRecoveryInProcess = false;
+				break;
+		}
+	}
+	return result;
+}
+
+#pragma mark ------------------------
+#pragma mark --- IOProc
+#pragma mark ------------------------
+
+//	Where the time stamps put the serializer at inNanos, extrapolated as the HAL does.
+static UInt64 SimPlayPosition ( SimEngine * inEngine, UInt64 inNanos ) {
+	if ( inNanos < inEngine->loopNanos ) {
+		inNanos = inEngine->loopNanos;
+	}
+	return (UInt64)inEngine->loopCount * inEngine->framesPerBuffer + (UInt64)( (double)( inNanos - inEngine->loopNanos ) * inEngine->options->sampleRate / 1.0e9 );
+}
+
+//	The HAL wakes the IOProc when the serializer is one buffer and the safety offset short
+//	of the next frame it owes.
+static UInt64 SimNextWake ( SimEngine * inEngine ) {
+	UInt64				loopStart;
+	UInt64				frame;
+
+	loopStart = (UInt64)inEngine->loopCount * inEngine->framesPerBuffer;
+	if ( ~0ULL == inEngine->firstFrame || inEngine->nextFrame < loopStart + kMinimumLatency + inEngine->options->ioFrames ) {
+		return inEngine->channel.clock;
+	}
+	frame = inEngine->nextFrame - kMinimumLatency - inEngine->options->ioFrames;
+	return inEngine->loopNanos + (UInt64)( (double)( frame - loopStart ) * 1.0e9 / inEngine->options->sampleRate );
+}
+
+//	One I/O cycle.  The first after a start lines up one buffer and the safety offset past
+//	the position the time stamps give; after that the sample time runs on by one buffer a
+//	cycle.  The frames reach memory when the IOProc returns, inWakeNanos is when it woke.
+static void SimIOProc ( SimEngine * ioEngine, UInt64 inWakeNanos ) {
+	UInt32 *			theFrames;
+	UInt64				frame;
+
+	//	clipOutputSamples
+	if ( ioEngine->mNeedToRestartDMA ) {
+		ioEngine->filterRestarts++;
+		restartDMA ( ioEngine );
+	}
+
+	if ( ~0ULL == ioEngine->firstFrame ) {
+		ioEngine->firstFrame = SimPlayPosition ( ioEngine, inWakeNanos ) + kMinimumLatency + ioEngine->options->ioFrames;
+		ioEngine->nextFrame = ioEngine->firstFrame;
+	}
+
+	theFrames = (UInt32 *)ioEngine->mOutputSampleBuffer;
+	for ( frame = ioEngine->nextFrame; frame < ioEngine->nextFrame + ioEngine->options->ioFrames; frame++ ) {
+		OSWriteLittleInt32 ( &theFrames[frame % ioEngine->framesPerBuffer], 0, (UInt32)( frame + 1 ) );
+	}
+	ioEngine->nextFrame += ioEngine->options->ioFrames;
+	ioEngine->ioProcCycles++;
+}
+
+//	The channel has fetched one block.  Erase the one the serializer has just played,
+//	then check each frame of this one against the position the serializer is at.
+static void SimTransfer ( void * inRefCon, DBDMASimChannel * /* inChannel */, void * inBuffer, UInt32 inByteCount, UInt64 inStartNanos ) {
+	SimEngine *			theEngine = (SimEngine *)inRefCon;
+	UInt32 *			theFrames;
+	UInt32				bufferFrame;
+	UInt32				stamp;
+	UInt64				frame;
+	UInt32				index;
+	UInt32				bad;
+
+	if ( 0 != theEngine->playingBlock && theEngine->playingBlock != inBuffer ) {
+		bzero ( theEngine->playingBlock, theEngine->playingBytes );
+	}
+	theEngine->playingBlock = (UInt8 *)inBuffer;
+	theEngine->playingBytes = inByteCount;
+
+	theFrames = (UInt32 *)inBuffer;
+	bufferFrame = (UInt32)( (UInt8 *)inBuffer - theEngine->mOutputSampleBuffer ) / kSimBytesPerFrame;
+	if ( bufferFrame < theEngine->lastReadFrame ) {
+		theEngine->readLoops++;
+	}
+	theEngine->lastReadFrame = bufferFrame;
+
+	bad = 0;
+	for ( index = 0; index < inByteCount / kSimBytesPerFrame; index++ ) {
+		frame = (UInt64)theEngine->readLoops * theEngine->framesPerBuffer + bufferFrame + index;
+		stamp = OSReadLittleInt32 ( &theFrames[index], 0 );
+		if ( ~0ULL != theEngine->firstFrame && frame >= theEngine->firstFrame ) {
+			theEngine->checkedFrames++;
+			if ( stamp != (UInt32)( frame + 1 ) ) {
+				bad++;
+			}
+		}
+	}
+	if ( 0 != bad ) {
+		theEngine->glitchFrames += bad;
+		for ( index = theEngine->options->numFaults; index > 0; index-- ) {
+			if ( theEngine->options->faults[index - 1].at <= inStartNanos ) {
+				theEngine->options->faults[index - 1].glitchFrames += bad;
+				break;
+			}
+		}
+		if ( theEngine->options->verbose ) {
+			printf ( "%10.3f ms  %lu frames wrong at buffer frame %lu\n", (double)inStartNanos / 1.0e6, (unsigned long)bad, (unsigned long)bufferFrame );
+		}
+	}
+}
+
+#pragma mark ------------------------
+#pragma mark --- Options
+#pragma mark ------------------------
+
+static void SimUsage ( void ) {
+	fprintf ( stderr,
+		"usage: dbdmasim [options]\n"
+		"  -r rate    sample rate (default %d)\n"
+		"  -b blocks  DMA blocks in the ring (default %d)\n"
+		"  -k bytes   bytes per block (default %d)\n"
+		"  -t sec     simulated time (default 10)\n"
+		"  -f frames  IOProc buffer (default %d)\n"
+		"  -l ms      time the IOProc takes to render (default 0.5)\n"
+		"  -j ms      largest extra wake up latency of the IOProc (default 0)\n"
+		"  -J ms      largest extra latency of the DMA interrupt (default 0)\n"
+		"  -R         publish the raw interrupt times, not the loop filtered ones\n"
+		"  -W         no stall watchdog, only the poll looks for a stopped channel\n"
+		"  -F         always stop and start the engine, never restart in place\n"
+		"  -p ms      runPolledTasks period (default 1000)\n"
+		"  -S at:dur  hang the channel at 'at' ms for 'dur' ms\n"
+		"  -D at      kill the channel with a bus error at 'at' ms\n"
+		"  -v         print each restart and glitch\n",
+		kSimDefaultSampleRate, DBDMAAUDIODMAENGINE_DEFAULT_NUM_BLOCKS, kSimDefaultBlockSize, kSimDefaultIOFrames );
+}
+
+static UInt64 SimParseMillis ( const char * inText, char ** outEnd ) {
+	return (UInt64)( strtod ( inText, outEnd ) * 1.0e6 );
+}
+
+static bool SimParseOptions ( int argc, char * argv[], SimOptions * outOptions ) {
+	SimFault *			theFault;
+	char *				end;
+	int					option;
+
+	bzero ( outOptions, sizeof ( SimOptions ) );
+	outOptions->sampleRate = kSimDefaultSampleRate;
+	outOptions->numBlocks = DBDMAAUDIODMAENGINE_DEFAULT_NUM_BLOCKS;
+	outOptions->blockSize = kSimDefaultBlockSize;
+	outOptions->ioFrames = kSimDefaultIOFrames;
+	outOptions->durationNanos = 10000 * kSimNanosPerMilli;
+	outOptions->ioProcNanos = kSimNanosPerMilli / 2;
+	outOptions->pollNanos = 1000 * kSimNanosPerMilli;
+
+	while ( -1 != ( option = getopt ( argc, argv, "r:b:k:t:f:l:j:J:p:S:D:RWFv" ) ) ) {
+		end = ( 0 != optarg ) ? optarg : (char *)"";
+		switch ( option ) {
+			case 'r':	outOptions->sampleRate = (UInt32)strtoul ( optarg, &end, 10 );				break;
+			case 'b':	outOptions->numBlocks = (UInt32)strtoul ( optarg, &end, 10 );				break;
+			case 'k':	outOptions->blockSize = (UInt32)strtoul ( optarg, &end, 10 );				break;
+			case 't':	outOptions->durationNanos = SimParseMillis ( optarg, &end ) * 1000;			break;
+			case 'f':	outOptions->ioFrames = (UInt32)strtoul ( optarg, &end, 10 );				break;
+			case 'l':	outOptions->ioProcNanos = SimParseMillis ( optarg, &end );					break;
+			case 'j':	outOptions->jitterNanos = SimParseMillis ( optarg, &end );					break;
+			case 'J':	outOptions->interruptJitterNanos = SimParseMillis ( optarg, &end );			break;
+			case 'p':	outOptions->pollNanos = SimParseMillis ( optarg, &end );					break;
+			case 'S':
+			case 'D':
+				if ( outOptions->numFaults == kSimMaxFaults ) {
+					fprintf ( stderr, "dbdmasim: at most %d faults\n", kSimMaxFaults );
+					return false;
+				}
+				theFault = &outOptions->faults[outOptions->numFaults++];
+				theFault->at = SimParseMillis ( optarg, &end );
+				if ( 'S' == option ) {
+					if ( ':' != *end ) {
+						fprintf ( stderr, "dbdmasim: a stall is at:duration in ms\n" );
+						return false;
+					}
+					theFault->duration = SimParseMillis ( end + 1, &end );
+				}
+				break;
+			case 'R':	outOptions->rawTimeStamps = true;											break;
+			case 'W':	outOptions->noWatchdog = true;												break;
+			case 'F':	outOptions->fullRestarts = true;											break;
+			case 'v':	outOptions->verbose = true;													break;
+			default:	return false;
+		}
+		if ( 0 != *end ) {
+			fprintf ( stderr, "dbdmasim: bad value '%s' for -%c\n", optarg, option );
+			return false;
+		}
+	}
+	if ( optind != argc ) {
+		return false;
+	}
+	if ( 0 == outOptions->sampleRate || outOptions->numBlocks < 2 || 0 == outOptions->blockSize || 0 != outOptions->blockSize % kSimBytesPerFrame
+			|| 0 != PAGE_SIZE % outOptions->blockSize || 0 == outOptions->ioFrames || 0 == outOptions->pollNanos ) {
+		fprintf ( stderr, "dbdmasim: blocks must divide a page into whole frames, and rates and periods must not be 0\n" );
+		return false;
+	}
+	return true;
+}
+
+#pragma mark ------------------------
+#pragma mark --- Main
+#pragma mark ------------------------
+
+//	Ends the silence count of the fault before inNextFault and starts the next one's.
+static void SimCloseFault ( SimEngine * ioEngine, UInt32 inNextFault ) {
+	if ( 0 != inNextFault ) {
+		ioEngine->options->faults[inNextFault - 1].silenceNanos = ioEngine->channel.underflowNanos - ioEngine->underflowAtFault;
+	}
+	ioEngine->underflowAtFault = ioEngine->channel.underflowNanos;
+}
+
+static void SimReport ( const SimEngine * inEngine, const SimOptions * inOptions ) {
+	const DBDMASimChannel *		theChannel = &inEngine->channel;
+	UInt32						index;
+
+	printf ( "ring          %lu blocks of %lu bytes, %lu frames, %.3f ms\n", (unsigned long)inEngine->numBlocks, (unsigned long)inEngine->blockSize,
+			(unsigned long)inEngine->framesPerBuffer, inEngine->framesPerBuffer * 1000.0 / inOptions->sampleRate );
+	printf ( "commands      %lu, %llu bytes, serializer starved %.3f ms\n", (unsigned long)theChannel->commandCount,
+			(unsigned long long)theChannel->byteCount, (double)theChannel->underflowNanos / 1.0e6 );
+	printf ( "interrupts    %lu", (unsigned long)theChannel->interruptCount );
+	if ( 0 != inEngine->numPeriods ) {
+		printf ( ", period %.3f / %.3f / %.3f ms min / mean / max", (double)inEngine->minPeriod / 1.0e6,
+				(double)inEngine->sumPeriod / inEngine->numPeriods / 1.0e6, (double)inEngine->maxPeriod / 1.0e6 );
+	}
+	printf ( "\n" );
+	printf ( "time stamps   %s", inOptions->rawTimeStamps ? "raw" : "filtered" );
+	if ( 0 != inEngine->numStampErrors ) {
+		printf ( ", late by %.3f / %.3f / %.3f ms min / mean / max", (double)inEngine->minStampError / 1.0e6,
+				(double)inEngine->sumStampError / inEngine->numStampErrors / 1.0e6, (double)inEngine->maxStampError / 1.0e6 );
+	}
+	printf ( ", residual %.3f / %.3f ms mean / max, %lu unlocks\n", (double)inEngine->mTimeStampFilter.meanResidual / 1.0e6,
+			(double)inEngine->mTimeStampFilter.maxResidual / 1.0e6, (unsigned long)inEngine->mTimeStampFilter.unlockCount );
+	printf ( "IOProc        %lu cycles of %lu frames\n", (unsigned long)inEngine->ioProcCycles, (unsigned long)inOptions->ioFrames );
+	printf ( "frames        %llu checked, %llu wrong\n", (unsigned long long)inEngine->checkedFrames, (unsigned long long)inEngine->glitchFrames );
+	printf ( "restarts      %lu, %lu in place: %lu from filterInterrupt, %lu from engineDied, %lu from the watchdog\n", (unsigned long)inEngine->restarts,
+			(unsigned long)inEngine->inPlaceRestarts, (unsigned long)inEngine->filterRestarts, (unsigned long)inEngine->pollRestarts,
+			(unsigned long)inEngine->watchdogRestarts );
+	for ( index = 0; index < inOptions->numFaults; index++ ) {
+		printf ( "fault %lu       %s at %.3f ms: ", (unsigned long)index, ( 0 == inOptions->faults[index].duration ) ? "dead" : "stall",
+				(double)inOptions->faults[index].at / 1.0e6 );
+		if ( 0 == inOptions->faults[index].restartNanos ) {
+			printf ( "no restart" );
+		} else {
+			printf ( "restarted after %.3f ms", (double)( inOptions->faults[index].restartNanos - inOptions->faults[index].at ) / 1.0e6 );
+		}
+		printf ( ", silent %.3f ms, %lu frames wrong\n", (double)inOptions->faults[index].silenceNanos / 1.0e6, (unsigned long)inOptions->faults[index].glitchFrames );
+	}
+}
+
+int main ( int argc, char * argv[] ) {
+	SimOptions			options;
+	SimEngine			engine;
+	UInt32				bufferSize;
+	UInt32				commandBufferSize;
+	UInt32				faultIndex;
+	UInt64				wake;
+	UInt64				nextPoll;
+	UInt64				next;
+	int					result = 1;
+
+	if ( !SimParseOptions ( argc, argv, &options ) ) {
+		SimUsage ();
+		return 1;
+	}
+
+	bzero ( &engine, sizeof ( engine ) );
+	engine.options = &options;
+	engine.numBlocks = options.numBlocks;
+	engine.blockSize = options.blockSize;
+	engine.framesPerBuffer = options.numBlocks * options.blockSize / kSimBytesPerFrame;
+	DBDMASimInit ( &engine.channel, "output", options.sampleRate, kSimBytesPerFrame );
+	engine.channel.interruptJitterNanos = options.interruptJitterNanos;
+	engine.ioBaseDMAOutput = &engine.channel.registers;
+	DBDMASimSetInterruptHandler ( &engine.channel, SimInterrupt, &engine );
+	DBDMASimSetTransferHandler ( &engine.channel, SimTransfer, &engine );
+
+	bufferSize = engine.numBlocks * engine.blockSize;
+	commandBufferSize = ( engine.numBlocks + 1 ) * sizeof ( IODBDMADescriptor );
+	engine.mOutputSampleBuffer = (UInt8 *)calloc ( 1, bufferSize + PAGE_SIZE );
+	engine.dmaCommandBufferOut = (IODBDMADescriptor *)calloc ( 1, commandBufferSize + PAGE_SIZE );
+	if ( 0 == engine.mOutputSampleBuffer || 0 == engine.dmaCommandBufferOut ) {
+		goto Exit;
+	}
+	if ( !SimMapBuffer ( &engine, engine.mOutputSampleBuffer, bufferSize, kSimSampleBufferPhys, engine.samplePages ) ) {
+		goto Exit;
+	}
+	if ( !SimMapBuffer ( &engine, (UInt8 *)engine.dmaCommandBufferOut, commandBufferSize, kSimCommandBufferPhys, engine.commandPages ) ) {
+		goto Exit;
+	}
+	if ( !createDMAPrograms ( &engine ) ) {
+		goto Exit;
+	}
+
+	performAudioEngineStart ( &engine );
+
+	srandom ( 1 );
+	faultIndex = 0;
+	wake = 0;
+	nextPoll = options.pollNanos;
+	while ( engine.channel.clock < options.durationNanos ) {
+		next = wake + options.ioProcNanos;
+		if ( nextPoll < next ) {
+			next = nextPoll;
+		}
+		if ( faultIndex < options.numFaults && options.faults[faultIndex].at < next ) {
+			next = options.faults[faultIndex].at;
+		}
+		if ( 0 != engine.watchdogWake && engine.watchdogWake < next ) {
+			next = engine.watchdogWake;
+		}
+		DBDMASimRunUntil ( &engine.channel, next );
+
+		if ( faultIndex < options.numFaults && options.faults[faultIndex].at == next ) {
+			SimCloseFault ( &engine, faultIndex );
+			if ( 0 == options.faults[faultIndex].duration ) {
+				DBDMASimKill ( &engine.channel );
+			} else {
+				DBDMASimStall ( &engine.channel, options.faults[faultIndex].duration );
+			}
+			faultIndex++;
+		} else if ( engine.watchdogWake == next ) {
+			if ( checkForStall ( &engine ) ) {
+				engine.watchdogRestarts++;
+				restartDMA ( &engine );
+			}
+		} else if ( nextPoll == next ) {
+			if ( engineDied ( &engine ) ) {
+				engine.pollRestarts++;
+				restartDMA ( &engine );
+			}
+			nextPoll += options.pollNanos;
+		} else {
+			SimIOProc ( &engine, wake );
+			wake = SimNextWake ( &engine ) + ( ( 0 == options.jitterNanos ) ? 0 : (UInt64)random () % options.jitterNanos );
+		}
+	}
+
+	SimCloseFault ( &engine, faultIndex );
+	SimReport ( &engine, &options );
+	result = 0;
+Exit:
+	free ( engine.mOutputSampleBuffer );
+	free ( engine.dmaCommandBufferOut );
+	return result;
+}
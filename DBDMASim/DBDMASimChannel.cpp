@@ -0,0 +1,344 @@
+/*
+ *  DBDMASimChannel.cpp
+ *  DBDMASim
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "DBDMASimChannel.h"
+
+//	the serializer's FIFO lets the channel fetch the next descriptor while this one drains
+#define kDBDMASimFIFOBytes				32
+
+#define kDBDMASimCommandShift			28
+#define kDBDMASimInterruptShift			20
+#define kDBDMASimBranchShift			18
+#define kDBDMASimWaitShift				16
+#define kDBDMASimConditionMask			0x3
+#define kDBDMASimCountMask				0xFFFF
+#define kDBDMASimStatusBitsMask			0xFF
+
+static UInt32 DBDMASimGetStatus ( DBDMASimChannel * inChannel ) {
+	return OSReadLittleInt32 ( &inChannel->registers, offsetof ( IODBDMAChannelRegisters, channelStatus ) );
+}
+
+static void DBDMASimSetStatus ( DBDMASimChannel * inChannel, UInt32 inStatus ) {
+	OSWriteLittleInt32 ( &inChannel->registers, offsetof ( IODBDMAChannelRegisters, channelStatus ), inStatus );
+}
+
+static UInt32 DBDMASimGetRegister ( DBDMASimChannel * inChannel, UInt32 inOffset ) {
+	return OSReadLittleInt32 ( &inChannel->registers, inOffset );
+}
+
+#pragma mark ------------------------
+#pragma mark --- Setup
+#pragma mark ------------------------
+
+void DBDMASimInit ( DBDMASimChannel * outChannel, const char * inName, UInt32 inSampleRate, UInt32 inBytesPerFrame ) {
+	memset ( outChannel, 0, sizeof ( DBDMASimChannel ) );
+	outChannel->name = inName;
+	DBDMASimSetSampleRate ( outChannel, inSampleRate, inBytesPerFrame );
+}
+
+void DBDMASimSetSampleRate ( DBDMASimChannel * ioChannel, UInt32 inSampleRate, UInt32 inBytesPerFrame ) {
+	ioChannel->nanosPerByte = 1.0e9 / ( (double)inSampleRate * (double)inBytesPerFrame );
+}
+
+bool DBDMASimMapMemory ( DBDMASimChannel * ioChannel, IOPhysicalAddress inPhysical, void * inHost, UInt32 inLength ) {
+	DBDMASimRegion *		theRegion;
+	UInt32					index;
+	bool					result = false;
+
+	if ( ioChannel->numRegions < kDBDMASimMaxRegions && 0 != inLength ) {
+		for ( index = 0; index < ioChannel->numRegions; index++ ) {
+			theRegion = &ioChannel->regions[index];
+			if ( inPhysical < theRegion->physical + theRegion->length && theRegion->physical < inPhysical + inLength ) {
+				goto Exit;
+			}
+		}
+		theRegion = &ioChannel->regions[ioChannel->numRegions++];
+		theRegion->physical = inPhysical;
+		theRegion->host = (UInt8 *)inHost;
+		theRegion->length = inLength;
+		result = true;
+	}
+Exit:
+	return result;
+}
+
+//	0 unless the whole range lies in one region, which is what a bus error would catch
+void * DBDMASimHostAddress ( DBDMASimChannel * inChannel, IOPhysicalAddress inPhysical, UInt32 inLength ) {
+	DBDMASimRegion *		theRegion;
+	UInt32					index;
+
+	for ( index = 0; index < inChannel->numRegions; index++ ) {
+		theRegion = &inChannel->regions[index];
+		if ( inPhysical >= theRegion->physical && inPhysical - theRegion->physical + inLength <= theRegion->length ) {
+			return theRegion->host + ( inPhysical - theRegion->physical );
+		}
+	}
+	return 0;
+}
+
+void DBDMASimSetInterruptHandler ( DBDMASimChannel * ioChannel, DBDMASimInterruptHandler inHandler, void * inRefCon ) {
+	ioChannel->interruptHandler = inHandler;
+	ioChannel->interruptRefCon = inRefCon;
+}
+
+void DBDMASimSetTransferHandler ( DBDMASimChannel * ioChannel, DBDMASimTransferHandler inHandler, void * inRefCon ) {
+	ioChannel->transferHandler = inHandler;
+	ioChannel->transferRefCon = inRefCon;
+}
+
+#pragma mark ------------------------
+#pragma mark --- Control
+#pragma mark ------------------------
+
+//	The upper half of a control store selects the bits the lower half writes.  Clearing
+//	'run' stops the channel and clears 'dead' and any stall; setting it, or 'wake' while
+//	it is set, makes the channel fetch from the command pointer again.  'wake' and 'flush'
+//	read back as zero, since the model has no FIFO contents to flush.
+void DBDMASimWriteControl ( volatile IODBDMAChannelRegisters * inRegisters, UInt32 inValue ) {
+	DBDMASimChannel *		theChannel = (DBDMASimChannel *)inRegisters;
+	UInt32					mask;
+	UInt32					bits;
+	UInt32					status;
+	bool					wasRunning;
+
+	mask = inValue >> 16;
+	bits = inValue & mask & 0xFFFF;
+	status = DBDMASimGetStatus ( theChannel );
+	wasRunning = 0 != ( status & kdbdmaRun );
+
+	status = ( status & ~mask ) | bits;
+	if ( 0 == ( status & kdbdmaRun ) ) {
+		if ( wasRunning && theChannel->clock > theChannel->streamNanos ) {
+			theChannel->underflowNanos += theChannel->clock - theChannel->streamNanos;
+		}
+		status &= ~( kdbdmaActive | kdbdmaDead );
+		theChannel->now = theChannel->clock;
+		theChannel->streamNanos = theChannel->clock;
+		theChannel->stallUntil = 0;
+	} else if ( ( !wasRunning || 0 != ( bits & kdbdmaWake ) ) && 0 == ( status & kdbdmaDead ) ) {
+		status |= kdbdmaActive;
+		if ( theChannel->now < theChannel->clock ) {
+			theChannel->now = theChannel->clock;
+		}
+	}
+	status &= ~( kdbdmaWake | kdbdmaFlush );
+
+	OSWriteLittleInt32 ( &theChannel->registers, offsetof ( IODBDMAChannelRegisters, channelControl ), inValue );
+	DBDMASimSetStatus ( theChannel, status );
+}
+
+void IODBDMAStart ( volatile IODBDMAChannelRegisters * registerSetPtr, volatile IODBDMADescriptor * physicalDescPtr ) {
+	if ( 0 != ( (uintptr_t)physicalDescPtr & 0xF ) ) {
+		fprintf ( stderr, "IODBDMAStart: unaligned IODBDMADescriptor 0x%lx\n", (unsigned long)(uintptr_t)physicalDescPtr );
+	}
+	IOSetDBDMAChannelControl ( registerSetPtr, IOClearDBDMAChannelControlBits ( kdbdmaRun | kdbdmaPause | kdbdmaFlush | kdbdmaWake | kdbdmaDead | kdbdmaActive ) );
+	IOSetDBDMACommandPtr ( registerSetPtr, (UInt32)(uintptr_t)physicalDescPtr );
+	IOSetDBDMAChannelControl ( registerSetPtr, IOSetDBDMAChannelControlBits ( kdbdmaRun | kdbdmaWake ) );
+}
+
+void IODBDMAStop ( volatile IODBDMAChannelRegisters * registerSetPtr ) {
+	IOSetDBDMAChannelControl ( registerSetPtr, IOClearDBDMAChannelControlBits ( kdbdmaRun ) | IOSetDBDMAChannelControlBits ( kdbdmaFlush ) );
+	while ( 0 != ( IOGetDBDMAChannelStatus ( registerSetPtr ) & ( kdbdmaActive | kdbdmaFlush ) ) ) {
+		eieio ();
+	}
+}
+
+void IODBDMAFlush ( volatile IODBDMAChannelRegisters * registerSetPtr ) {
+	IOSetDBDMAChannelControl ( registerSetPtr, IOSetDBDMAChannelControlBits ( kdbdmaFlush ) );
+	while ( 0 != ( IOGetDBDMAChannelStatus ( registerSetPtr ) & kdbdmaFlush ) ) {
+		eieio ();
+	}
+}
+
+void IODBDMAReset ( volatile IODBDMAChannelRegisters * registerSetPtr ) {
+	IOSetDBDMAChannelControl ( registerSetPtr, IOClearDBDMAChannelControlBits ( kdbdmaRun | kdbdmaPause | kdbdmaFlush | kdbdmaWake | kdbdmaDead | kdbdmaActive ) );
+	while ( 0 != ( IOGetDBDMAChannelStatus ( registerSetPtr ) & kdbdmaActive ) ) {
+		eieio ();
+	}
+}
+
+void IODBDMAContinue ( volatile IODBDMAChannelRegisters * registerSetPtr ) {
+	IOSetDBDMAChannelControl ( registerSetPtr, IOClearDBDMAChannelControlBits ( kdbdmaPause ) | IOSetDBDMAChannelControlBits ( kdbdmaRun | kdbdmaWake ) );
+}
+
+void IODBDMAPause ( volatile IODBDMAChannelRegisters * registerSetPtr ) {
+	IOSetDBDMAChannelControl ( registerSetPtr, IOSetDBDMAChannelControlBits ( kdbdmaPause ) );
+}
+
+#pragma mark ------------------------
+#pragma mark --- Faults
+#pragma mark ------------------------
+
+static void DBDMASimRaiseInterrupt ( DBDMASimChannel * ioChannel, UInt64 inNanos ) {
+	if ( 0 == ioChannel->pendingInterrupt ) {
+		ioChannel->interruptRaisedNanos = inNanos;
+		ioChannel->pendingInterrupt = inNanos + kDBDMASimInterruptNanos;
+		if ( 0 != ioChannel->interruptJitterNanos ) {
+			ioChannel->pendingInterrupt += (UInt64)random () % ioChannel->interruptJitterNanos;
+		}
+	}
+}
+
+void DBDMASimStall ( DBDMASimChannel * ioChannel, UInt64 inNanos ) {
+	ioChannel->stallUntil = ioChannel->clock + inNanos;
+}
+
+void DBDMASimKill ( DBDMASimChannel * ioChannel ) {
+	UInt32					status;
+
+	status = DBDMASimGetStatus ( ioChannel );
+	if ( 0 != ( status & kdbdmaRun ) ) {
+		DBDMASimSetStatus ( ioChannel, ( status | kdbdmaDead ) & ~kdbdmaActive );
+		DBDMASimRaiseInterrupt ( ioChannel, ioChannel->clock );
+		ioChannel->deadCount++;
+	}
+}
+
+#pragma mark ------------------------
+#pragma mark --- Execution
+#pragma mark ------------------------
+
+//	c = ( S7..S0 & mask ) == ( value & mask ), with the mask in the upper half of the select register
+static bool DBDMASimTest ( UInt32 inField, UInt32 inSelect, UInt32 inStatus ) {
+	bool					condition;
+	bool					result;
+
+	condition = ( inStatus & ( inSelect >> 16 ) & kDBDMASimStatusBitsMask ) == ( inSelect & ( inSelect >> 16 ) & kDBDMASimStatusBitsMask );
+	switch ( inField & kDBDMASimConditionMask ) {
+		case kdbdmaIntIfTrue:		result = condition;			break;
+		case kdbdmaIntIfFalse:		result = !condition;		break;
+		case kdbdmaIntAlways:		result = true;				break;
+		default:					result = false;				break;
+	}
+	return result;
+}
+
+static void DBDMASimBusError ( DBDMASimChannel * ioChannel, const char * inWhat, IOPhysicalAddress inPhysical ) {
+	fprintf ( stderr, "%s: bus error %s at 0x%08lx, %.3f ms\n", ioChannel->name, inWhat, (unsigned long)inPhysical, (double)ioChannel->now / 1.0e6 );
+	DBDMASimKill ( ioChannel );
+}
+
+//	Executes the command at the command pointer, which the caller has checked can start
+//	before its deadline.  Returns false when the channel stops or waits.
+static bool DBDMASimStep ( DBDMASimChannel * ioChannel ) {
+	IODBDMADescriptor *		theDescriptor;
+	IOPhysicalAddress		commandPtr;
+	void *					theBuffer;
+	UInt32					operation;
+	UInt32					command;
+	UInt32					count;
+	UInt32					status;
+	UInt64					start;
+	UInt64					end;
+	bool					result = false;
+
+	commandPtr = DBDMASimGetRegister ( ioChannel, offsetof ( IODBDMAChannelRegisters, commandPtrLo ) );
+	theDescriptor = (IODBDMADescriptor *)DBDMASimHostAddress ( ioChannel, commandPtr, sizeof ( IODBDMADescriptor ) );
+	if ( 0 == theDescriptor ) {
+		DBDMASimBusError ( ioChannel, "fetching a descriptor", commandPtr );
+		goto Exit;
+	}
+
+	operation = IOGetCCDescriptor ( theDescriptor, operation );
+	command = operation >> kDBDMASimCommandShift;
+	count = operation & kDBDMASimCountMask;
+	status = DBDMASimGetStatus ( ioChannel );
+	start = ioChannel->now + kDBDMASimFetchNanos;
+	ioChannel->commandCount++;
+
+	if ( DBDMASimTest ( operation >> kDBDMASimWaitShift, DBDMASimGetRegister ( ioChannel, offsetof ( IODBDMAChannelRegisters, waitSelect ) ), status ) ) {
+		ioChannel->now = ioChannel->clock;
+		goto Exit;
+	}
+
+	switch ( command ) {
+		case kdbdmaOutputMore:
+		case kdbdmaOutputLast:
+		case kdbdmaInputMore:
+		case kdbdmaInputLast:
+			theBuffer = DBDMASimHostAddress ( ioChannel, IOGetCCDescriptor ( theDescriptor, address ), count );
+			if ( 0 == theBuffer ) {
+				DBDMASimBusError ( ioChannel, "moving data", IOGetCCDescriptor ( theDescriptor, address ) );
+				goto Exit;
+			}
+			if ( start < ioChannel->streamNanos ) {
+				start = ioChannel->streamNanos;
+			} else if ( 0 != ioChannel->byteCount ) {
+				ioChannel->underflowNanos += start - ioChannel->streamNanos;
+			}
+			if ( 0 != ioChannel->transferHandler ) {
+				( *ioChannel->transferHandler ) ( ioChannel->transferRefCon, ioChannel, theBuffer, count, start );
+			}
+			end = start + (UInt64)( (double)count * ioChannel->nanosPerByte );
+			ioChannel->streamNanos = end;
+			ioChannel->byteCount += count;
+			ioChannel->now = ( end > start + (UInt64)( kDBDMASimFIFOBytes * ioChannel->nanosPerByte ) ) ? end - (UInt64)( kDBDMASimFIFOBytes * ioChannel->nanosPerByte ) : start;
+			break;
+		case kdbdmaNop:
+			end = start;
+			ioChannel->now = end;
+			break;
+		case kdbdmaStop:
+			DBDMASimSetStatus ( ioChannel, status & ~kdbdmaActive );
+			ioChannel->now = start;
+			goto Exit;
+		default:
+			fprintf ( stderr, "%s: command %ld is not modelled\n", ioChannel->name, (long)command );
+			DBDMASimKill ( ioChannel );
+			goto Exit;
+	}
+
+	IOSetCCDescriptor ( theDescriptor, result, ( status & 0xFFFF ) << 16 );
+	if ( DBDMASimTest ( operation >> kDBDMASimInterruptShift, DBDMASimGetRegister ( ioChannel, offsetof ( IODBDMAChannelRegisters, interruptSelect ) ), status ) ) {
+		DBDMASimRaiseInterrupt ( ioChannel, end );
+	}
+	if ( DBDMASimTest ( operation >> kDBDMASimBranchShift, DBDMASimGetRegister ( ioChannel, offsetof ( IODBDMAChannelRegisters, branchSelect ) ), status ) ) {
+		commandPtr = IOGetCCDescriptor ( theDescriptor, cmdDep );
+	} else {
+		commandPtr += sizeof ( IODBDMADescriptor );
+	}
+	IOSetDBDMACommandPtr ( &ioChannel->registers, commandPtr );
+	result = true;
+Exit:
+	return result;
+}
+
+void DBDMASimRunUntil ( DBDMASimChannel * ioChannel, UInt64 inNanos ) {
+	UInt64					fetch;
+	bool					running;
+
+	running = true;
+	while ( ioChannel->clock < inNanos ) {
+		fetch = ( ioChannel->now > ioChannel->stallUntil ) ? ioChannel->now : ioChannel->stallUntil;
+		running = running && 0 != ( DBDMASimGetStatus ( ioChannel ) & kdbdmaActive );
+
+		if ( 0 != ioChannel->pendingInterrupt && ioChannel->pendingInterrupt <= inNanos && ( !running || ioChannel->pendingInterrupt <= fetch ) ) {
+			if ( ioChannel->clock < ioChannel->pendingInterrupt ) {
+				ioChannel->clock = ioChannel->pendingInterrupt;
+			}
+			ioChannel->pendingInterrupt = 0;
+			ioChannel->interruptCount++;
+			if ( 0 != ioChannel->interruptHandler ) {
+				( *ioChannel->interruptHandler ) ( ioChannel->interruptRefCon, ioChannel );
+			}
+			running = true;											//	the handler may have restarted the channel
+		} else if ( running && fetch < inNanos ) {
+			if ( ioChannel->clock < fetch ) {
+				ioChannel->clock = fetch;
+			}
+			ioChannel->now = fetch;
+			running = DBDMASimStep ( ioChannel );
+		} else {
+			ioChannel->clock = inNanos;
+		}
+	}
+}
@@ -0,0 +1,86 @@
+/*
+ *  DBDMASimChannel.h
+ *  DBDMASim
+ *
+ *  Cycle approximate model of one DBDMA channel feeding an I2S serializer.
+ *  The channel walks a descriptor program in host memory through a small
+ *  physical address map, moves each INPUT_MORE / OUTPUT_MORE buffer at the
+ *  rate the sample clock drains it, writes the result word back, and
+ *  evaluates the interrupt, branch and wait conditions against the S7..S0
+ *  status bits the way the DBDMA specification describes them.
+ *
+ *  Time is kept in nanoseconds.  Each command costs a descriptor fetch on
+ *  top of its transfer, and an interrupt reaches the handler a fixed
+ *  latency after the command that raised it completes, plus up to
+ *  'interruptJitterNanos' more drawn at random.  A stall holds the
+ *  channel active without progress until it runs out or the channel is
+ *  reset, as a hung channel does; a kill sets 'dead', drops 'active' and
+ *  raises the unconditional interrupt, as a bus error does.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DBDMASIM_CHANNEL__
+#define __DBDMASIM_CHANNEL__
+
+#include <IOKit/ppc/IODBDMA.h>
+
+#define kDBDMASimMaxRegions				64
+#define kDBDMASimFetchNanos				240				/*	descriptor fetch and result write back on a 100 MHz bus	*/
+#define kDBDMASimInterruptNanos			2000			/*	completion to the filter routine						*/
+
+typedef struct DBDMASimChannel DBDMASimChannel;
+
+typedef void ( *DBDMASimInterruptHandler ) ( void * inRefCon, DBDMASimChannel * inChannel );
+
+//	inBuffer is host memory; inStartNanos is when the serializer reaches its first byte
+typedef void ( *DBDMASimTransferHandler ) ( void * inRefCon, DBDMASimChannel * inChannel, void * inBuffer, UInt32 inByteCount, UInt64 inStartNanos );
+
+typedef struct {
+	IOPhysicalAddress			physical;
+	UInt8 *						host;
+	UInt32						length;
+} DBDMASimRegion;
+
+struct DBDMASimChannel {
+	IODBDMAChannelRegisters		registers;				//	first, so a register pointer is a channel pointer
+	const char *				name;
+	DBDMASimRegion				regions[kDBDMASimMaxRegions];
+	UInt32						numRegions;
+	double						nanosPerByte;
+	UInt64						clock;					//	how far the simulation has run
+	UInt64						now;					//	when the channel can fetch its next descriptor
+	UInt64						streamNanos;			//	when the serializer runs out of data
+	UInt64						stallUntil;
+	UInt64						pendingInterrupt;		//	0 when none is in flight
+	UInt64						interruptJitterNanos;
+	UInt64						interruptRaisedNanos;	//	when the command that raised the last one completed
+	DBDMASimInterruptHandler	interruptHandler;
+	void *						interruptRefCon;
+	DBDMASimTransferHandler		transferHandler;
+	void *						transferRefCon;
+	UInt32						commandCount;
+	UInt32						interruptCount;
+	UInt32						deadCount;
+	UInt64						byteCount;
+	UInt64						underflowNanos;			//	time the serializer sat with nothing to send
+};
+
+void		DBDMASimInit ( DBDMASimChannel * outChannel, const char * inName, UInt32 inSampleRate, UInt32 inBytesPerFrame );
+void		DBDMASimSetSampleRate ( DBDMASimChannel * ioChannel, UInt32 inSampleRate, UInt32 inBytesPerFrame );
+
+//	false when the map is full or the range overlaps one already mapped
+bool		DBDMASimMapMemory ( DBDMASimChannel * ioChannel, IOPhysicalAddress inPhysical, void * inHost, UInt32 inLength );
+void *		DBDMASimHostAddress ( DBDMASimChannel * inChannel, IOPhysicalAddress inPhysical, UInt32 inLength );
+
+void		DBDMASimSetInterruptHandler ( DBDMASimChannel * ioChannel, DBDMASimInterruptHandler inHandler, void * inRefCon );
+void		DBDMASimSetTransferHandler ( DBDMASimChannel * ioChannel, DBDMASimTransferHandler inHandler, void * inRefCon );
+
+//	runs commands that start before inNanos and delivers interrupts due by then
+void		DBDMASimRunUntil ( DBDMASimChannel * ioChannel, UInt64 inNanos );
+
+void		DBDMASimStall ( DBDMASimChannel * ioChannel, UInt64 inNanos );
+void		DBDMASimKill ( DBDMASimChannel * ioChannel );
+
+#endif
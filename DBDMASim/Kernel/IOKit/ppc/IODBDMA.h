@@ -0,0 +1,182 @@
+/*
+ *  IODBDMA.h
+ *  DBDMASim
+ *
+ *  Userland stand-in for the kernel's DBDMA header.  The descriptor and
+ *  register layouts, the command encodings and the macros that build a
+ *  program are the same, so a channel program is written exactly the way
+ *  AppleDBDMAAudio::createDMAPrograms writes it.
+ *
+ *  The one difference is the channel control register.  On hardware a
+ *  store to it starts, wakes or stops the channel; here the store is
+ *  handed to the simulator so it can do the same.  Everything else is a
+ *  plain little endian access to the register block, which DBDMASimChannel
+ *  keeps up to date.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DBDMASIM_IODBDMA__
+#define __DBDMASIM_IODBDMA__
+
+#include <stddef.h>
+
+#include <libkern/OSTypes.h>
+#include <libkern/OSByteOrder.h>
+
+typedef UInt32					IOPhysicalAddress;
+
+//	channel registers, all little endian
+struct IODBDMAChannelRegisters {
+	volatile UInt32				channelControl;
+	volatile UInt32				channelStatus;
+	volatile UInt32				commandPtrHi;
+	volatile UInt32				commandPtrLo;
+	volatile UInt32				interruptSelect;
+	volatile UInt32				branchSelect;
+	volatile UInt32				waitSelect;
+	volatile UInt32				transferModes;
+	volatile UInt32				data2PtrHi;
+	volatile UInt32				data2PtrLo;
+	volatile UInt32				reserved1;
+	volatile UInt32				addressHi;
+	volatile UInt32				reserved2[4];
+	volatile UInt32				unimplemented[16];
+	volatile UInt32				undefined[32];
+};
+typedef struct IODBDMAChannelRegisters IODBDMAChannelRegisters;
+
+//	control and status bits
+enum {
+	kdbdmaRun					= 0x00008000,
+	kdbdmaPause					= 0x00004000,
+	kdbdmaFlush					= 0x00002000,
+	kdbdmaWake					= 0x00001000,
+	kdbdmaDead					= 0x00000800,
+	kdbdmaActive				= 0x00000400,
+	kdbdmaBt					= 0x00000100,
+	kdbdmaS7					= 0x00000080,
+	kdbdmaS6					= 0x00000040,
+	kdbdmaS5					= 0x00000020,
+	kdbdmaS4					= 0x00000010,
+	kdbdmaS3					= 0x00000008,
+	kdbdmaS2					= 0x00000004,
+	kdbdmaS1					= 0x00000002,
+	kdbdmaS0					= 0x00000001
+};
+
+#define IOSetDBDMAChannelControlBits( mask )			( ( ( mask ) | ( mask ) << 16 ) )
+#define IOClearDBDMAChannelControlBits( mask )			( ( mask ) << 16 )
+
+//	a descriptor, all little endian
+struct IODBDMADescriptor {
+	UInt32						operation;
+	UInt32						address;
+	volatile UInt32				cmdDep;
+	volatile UInt32				result;
+};
+typedef struct IODBDMADescriptor IODBDMADescriptor;
+
+enum {
+	kdbdmaOutputMore			= 0,
+	kdbdmaOutputLast			= 1,
+	kdbdmaInputMore				= 2,
+	kdbdmaInputLast				= 3,
+	kdbdmaStoreQuad				= 4,
+	kdbdmaLoadQuad				= 5,
+	kdbdmaNop					= 6,
+	kdbdmaStop					= 7
+};
+
+enum {
+	kdbdmaKeyStream0			= 0,
+	kdbdmaKeyStream1			= 1,
+	kdbdmaKeyStream2			= 2,
+	kdbdmaKeyStream3			= 3,
+	kdbdmaKeyRegs				= 5,
+	kdbdmaKeySystem				= 6,
+	kdbdmaKeyDevice				= 7
+};
+
+enum {
+	kdbdmaIntNever				= 0,
+	kdbdmaIntIfTrue				= 1,
+	kdbdmaIntIfFalse			= 2,
+	kdbdmaIntAlways				= 3
+};
+
+enum {
+	kdbdmaBranchNever			= 0,
+	kdbdmaBranchIfTrue			= 1,
+	kdbdmaBranchIfFalse			= 2,
+	kdbdmaBranchAlways			= 3
+};
+
+enum {
+	kdbdmaWaitNever				= 0,
+	kdbdmaWaitIfTrue			= 1,
+	kdbdmaWaitIfFalse			= 2,
+	kdbdmaWaitAlways			= 3
+};
+
+#define eieio()															do { __sync_synchronize (); } while ( 0 )
+#define flush_dcache( address, count, physical )						do { (void)( address ); (void)( count ); (void)( physical ); } while ( 0 )
+
+#define IOMakeDBDMAOperation( cmd, key, interrupt, branch, wait, count )	\
+	( ( ( cmd ) << 28 ) | ( ( key ) << 24 ) | ( ( interrupt ) << 20 ) | ( ( branch ) << 18 ) | ( ( wait ) << 16 ) | ( count ) )
+
+#define IOSetCCDescriptor( descPtr, field, value )						\
+	OSWriteLittleInt32 ( descPtr, offsetof ( IODBDMADescriptor, field ), value )
+#define IOGetCCDescriptor( descPtr, field )								\
+	OSReadLittleInt32 ( descPtr, offsetof ( IODBDMADescriptor, field ) )
+
+#define IOMakeDBDMADescriptor( descPtr, cmd, key, interrupt, branch, wait, count, addr )			\
+	do {																							\
+		IOSetCCDescriptor ( descPtr, address, addr );												\
+		IOSetCCDescriptor ( descPtr, cmdDep, 0 );													\
+		IOSetCCDescriptor ( descPtr, result, 0 );													\
+		eieio ();																					\
+		IOSetCCDescriptor ( descPtr, operation, IOMakeDBDMAOperation ( cmd, key, interrupt, branch, wait, count ) );	\
+		eieio ();																					\
+	} while ( 0 )
+
+#define IOMakeDBDMADescriptorDep( descPtr, cmd, key, interrupt, branch, wait, count, addr, dep )	\
+	do {																							\
+		IOSetCCDescriptor ( descPtr, address, addr );												\
+		IOSetCCDescriptor ( descPtr, cmdDep, dep );													\
+		IOSetCCDescriptor ( descPtr, result, 0 );													\
+		eieio ();																					\
+		IOSetCCDescriptor ( descPtr, operation, IOMakeDBDMAOperation ( cmd, key, interrupt, branch, wait, count ) );	\
+		eieio ();																					\
+	} while ( 0 )
+
+#define IOGetCCResult( descPtr )										IOGetCCDescriptor ( descPtr, result )
+
+//	the simulator's side of a channel control store, see DBDMASimChannel.cpp
+void	DBDMASimWriteControl ( volatile IODBDMAChannelRegisters * inRegisters, UInt32 inValue );
+
+#define IOSetDBDMAChannelControl( registerSetPtr, ctlValue )			DBDMASimWriteControl ( registerSetPtr, ctlValue )
+
+#define IOGetDBDMAChannelStatus( registerSetPtr )						\
+	OSReadSwapInt32 ( registerSetPtr, offsetof ( IODBDMAChannelRegisters, channelStatus ) )
+#define IOGetDBDMACommandPtr( registerSetPtr )							\
+	OSReadSwapInt32 ( registerSetPtr, offsetof ( IODBDMAChannelRegisters, commandPtrLo ) )
+#define IOSetDBDMACommandPtr( registerSetPtr, cmdPtr )					\
+	OSWriteSwapInt32 ( registerSetPtr, offsetof ( IODBDMAChannelRegisters, commandPtrLo ), cmdPtr )
+#define IOSetDBDMAInterruptSelect( registerSetPtr, intSelValue )		\
+	OSWriteSwapInt32 ( registerSetPtr, offsetof ( IODBDMAChannelRegisters, interruptSelect ), intSelValue )
+#define IOSetDBDMABranchSelect( registerSetPtr, braSelValue )			\
+	OSWriteSwapInt32 ( registerSetPtr, offsetof ( IODBDMAChannelRegisters, branchSelect ), braSelValue )
+#define IOSetDBDMAWaitSelect( registerSetPtr, waitSelValue )			\
+	OSWriteSwapInt32 ( registerSetPtr, offsetof ( IODBDMAChannelRegisters, waitSelect ), waitSelValue )
+
+//	as in the kernel; each returns once the channel has reached the new state
+void	IODBDMAStart ( volatile IODBDMAChannelRegisters * registerSetPtr, volatile IODBDMADescriptor * physicalDescPtr );
+void	IODBDMAStop ( volatile IODBDMAChannelRegisters * registerSetPtr );
+void	IODBDMAFlush ( volatile IODBDMAChannelRegisters * registerSetPtr );
+void	IODBDMAReset ( volatile IODBDMAChannelRegisters * registerSetPtr );
+void	IODBDMAContinue ( volatile IODBDMAChannelRegisters * registerSetPtr );
+void	IODBDMAPause ( volatile IODBDMAChannelRegisters * registerSetPtr );
+
+#endif
@@ -0,0 +1,36 @@
+/*
+ *  OSByteOrder.h
+ *  DBDMASim
+ *
+ *  The DBDMA descriptors and channel registers are little endian whatever
+ *  the host, so every access goes through these, as in the kernel.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DBDMASIM_OSBYTEORDER__
+#define __DBDMASIM_OSBYTEORDER__
+
+#include <libkern/OSTypes.h>
+
+static inline UInt32 OSReadLittleInt32 ( const volatile void * inBase, UInt32 inOffset ) {
+	const volatile UInt8 *		bytes = (const volatile UInt8 *)inBase + inOffset;
+
+	return (UInt32)bytes[0] | ( (UInt32)bytes[1] << 8 ) | ( (UInt32)bytes[2] << 16 ) | ( (UInt32)bytes[3] << 24 );
+}
+
+static inline void OSWriteLittleInt32 ( volatile void * inBase, UInt32 inOffset, UInt32 inValue ) {
+	volatile UInt8 *			bytes = (volatile UInt8 *)inBase + inOffset;
+
+	bytes[0] = (UInt8)inValue;
+	bytes[1] = (UInt8)( inValue >> 8 );
+	bytes[2] = (UInt8)( inValue >> 16 );
+	bytes[3] = (UInt8)( inValue >> 24 );
+}
+
+//	the PowerPC kernel spells little endian access as a byte swap
+#define OSReadSwapInt32( base, offset )				OSReadLittleInt32 ( base, offset )
+#define OSWriteSwapInt32( base, offset, value )		OSWriteLittleInt32 ( base, offset, value )
+
+#endif
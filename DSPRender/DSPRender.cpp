@@ -0,0 +1,459 @@
+/*
+ *  DSPRender.cpp
+ *  DSPRender
+ *
+ *  Offline renderer for the output signal path.  It builds a DSP_Manager
+ *  chain from a layout's 'SoftwareDSP' dictionary and pushes a WAV file
+ *  through it in engine sized blocks, in the order clipOutputSamples does:
+ *  the iSub low pass taps the mix first, then the software volume, then
+ *  the chain, then the iSub down sampler.  The stages, the manager and the
+ *  portable routines of AppleDBDMAClip.c are the driver's own sources; only
+ *  the kernel services underneath them come from DSPRender/Kernel.
+ *
+ *  Each stage on the run list is timed on its own, so a coefficient change
+ *  and its cost can be judged in the same run on a workstation.
+ *
+ *  The PowerPC integer conversion routines in AppleDBDMAClip.c are not
+ *  built here; DSPRenderWAV.cpp converts with the same scaling, rounding
+ *  and clipping.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+//	Build from the top of the tree with the command below, on one line.  The sources
+//	mark their sections with non ASCII '#pragma mark' text, which C++ would otherwise
+//	try to read as identifiers.
+//
+//	c++ -O2 -fno-extended-identifiers -o dsprender -IDSPRender/Kernel -IDSPRender
+//		-IAppleOnboardAudio -IAppleOnboardAudio/DSP -IAppleLegacyAudio -I.
+//		DSPRender/*.cpp DSPRender/Kernel/*.cpp AppleOnboardAudio/DSP/*.cpp
+//		-x c AppleOnboardAudio/AppleDBDMAClip.c -lm
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "DSP_Manager.h"
+#include "DSP_Loudness.h"
+#include "AppleDBDMAFloatLib.h"
+
+#include "DSPRenderPlist.h"
+#include "DSPRenderWAV.h"
+
+#define kSoftwareDSP					"SoftwareDSP"
+
+#define kRenderChannels					2						/*	the onboard engines are a stereo pair			*/
+#define kRenderDefaultBlockFrames		512
+#define kRenderMaxBlockFrames			16384
+#define kRenderiSubSampleRate			6000					/*	AppleiSubEngine::kDefaultOutputSampleRate		*/
+
+typedef struct {
+	const char *		plistPath;
+	const char *		inputPath;
+	const char *		outputPath;
+	const char *		iSubPath;
+	UInt32				blockFrames;
+	float				volumedB;
+	UInt32				outputBits;						//	0 keeps the input format
+	bool				outputFloat;
+	bool				align;
+	bool				useVolume;
+	bool				codecVolume;
+} RenderOptions;
+
+typedef struct {
+	DSP_Processor *		stage;
+	UInt64				nanoseconds;
+} RenderStageTime;
+
+typedef struct {
+	PreviousValues		filterState;
+	PreviousValues		filterState2;
+	iSubCoefficients	coefficients;
+	float				srcPhase;
+	float				srcState;
+	float *				low;
+	SInt16 *			buffer;
+	SInt32				bufferOffset;
+	UInt32				bufferLength;
+	UInt32				loopCount;
+} RenderiSub;
+
+#pragma mark ------------------------
+#pragma mark --- Utilities
+#pragma mark ------------------------
+
+static void RenderUsage ( void ) {
+	fprintf ( stderr,
+		"usage: dsprender [options] dsp.plist in.wav out.wav\n"
+		"  -b frames  frames per IOProc call (default %d)\n"
+		"  -v dB      output volume; applied by the software volume and handed to the loudness stage\n"
+		"  -c         with -v, leave the attenuation to the codec: the volume only reaches the loudness stage\n"
+		"  -s file    also write the 6 kHz mono iSub feed\n"
+		"  -f format  output format: 16, 24, 32 or float (default: the input's)\n"
+		"  -a         remove the chain's latency so the output lines up with the input\n"
+		"The plist may be a layout dictionary holding a '%s' entry or that entry itself.\n",
+		kRenderDefaultBlockFrames, kSoftwareDSP );
+}
+
+static bool RenderParseOptions ( int argc, char * argv[], RenderOptions * outOptions ) {
+	char *				end;
+	int					option;
+
+	bzero ( outOptions, sizeof ( RenderOptions ) );
+	outOptions->blockFrames = kRenderDefaultBlockFrames;
+
+	while ( -1 != ( option = getopt ( argc, argv, "b:v:s:f:ac" ) ) ) {
+		switch ( option ) {
+			case 'b':
+				outOptions->blockFrames = (UInt32)strtoul ( optarg, &end, 10 );
+				if ( 0 != *end || 0 == outOptions->blockFrames || outOptions->blockFrames > kRenderMaxBlockFrames ) {
+					fprintf ( stderr, "dsprender: block size must be 1 to %d frames\n", kRenderMaxBlockFrames );
+					return false;
+				}
+				break;
+			case 'v':
+				outOptions->volumedB = (float)strtod ( optarg, &end );
+				if ( 0 != *end || outOptions->volumedB > 0.0f ) {
+					fprintf ( stderr, "dsprender: volume must be a number of dB at or below 0\n" );
+					return false;
+				}
+				outOptions->useVolume = true;
+				break;
+			case 's':
+				outOptions->iSubPath = optarg;
+				break;
+			case 'f':
+				if ( 0 == strcmp ( optarg, "float" ) ) {
+					outOptions->outputBits = 32;
+					outOptions->outputFloat = true;
+				} else if ( 0 == strcmp ( optarg, "16" ) || 0 == strcmp ( optarg, "24" ) || 0 == strcmp ( optarg, "32" ) ) {
+					outOptions->outputBits = (UInt32)atoi ( optarg );
+				} else {
+					fprintf ( stderr, "dsprender: unknown format '%s'\n", optarg );
+					return false;
+				}
+				break;
+			case 'a':
+				outOptions->align = true;
+				break;
+			case 'c':
+				outOptions->codecVolume = true;
+				break;
+			default:
+				return false;
+		}
+	}
+	if ( 3 != argc - optind ) {
+		return false;
+	}
+	outOptions->plistPath = argv[optind];
+	outOptions->inputPath = argv[optind + 1];
+	outOptions->outputPath = argv[optind + 2];
+	return true;
+}
+
+static UInt64 RenderThreadTime ( void ) {
+	struct timespec		now;
+
+	clock_gettime ( CLOCK_THREAD_CPUTIME_ID, &now );
+	return (UInt64)now.tv_sec * 1000000000ULL + (UInt64)now.tv_nsec;
+}
+
+//	The layout's 'SoftwareDSP' entry, or the file's root when it is that entry.
+static OSDictionary * RenderFindSoftwareDSP ( OSObject * inRoot ) {
+	OSDictionary *		theRoot;
+	OSDictionary *		theEntry;
+
+	theRoot = OSDynamicCast ( OSDictionary, inRoot );
+	if ( 0 == theRoot ) {
+		return 0;
+	}
+	theEntry = OSDynamicCast ( OSDictionary, theRoot->getObject ( kSoftwareDSP ) );
+	return ( 0 == theEntry ) ? theRoot : theEntry;
+}
+
+#pragma mark ------------------------
+#pragma mark --- Rendering
+#pragma mark ------------------------
+
+//	Same order and slicing as DSP_Manager::process, with a clock around each stage.
+static void RenderChain ( RenderStageTime * ioStages, UInt32 inNumStages, float * ioBuffer, UInt32 inNumSamples ) {
+	UInt32				sliceSamples;
+	UInt32				samplesThisSlice;
+	UInt32				stage;
+	UInt64				start;
+
+	sliceSamples = kDSPMaxSliceFrames * kRenderChannels;
+	while ( 0 != inNumStages && 0 != inNumSamples ) {
+		samplesThisSlice = ( inNumSamples < sliceSamples ) ? inNumSamples : sliceSamples;
+		for ( stage = 0; stage < inNumStages; stage++ ) {
+			start = RenderThreadTime ();
+			ioStages[stage].stage->process ( ioBuffer, samplesThisSlice );
+			ioStages[stage].nanoseconds += RenderThreadTime () - start;
+		}
+		ioBuffer += samplesThisSlice;
+		inNumSamples -= samplesThisSlice;
+	}
+}
+
+static bool RenderiSubInit ( RenderiSub * outiSub, UInt32 inSampleRate, UInt32 inBlockFrames, UInt32 inNumFrames ) {
+	bzero ( outiSub, sizeof ( RenderiSub ) );
+	Set4thOrderCoefficients ( &outiSub->coefficients, inSampleRate );
+	outiSub->low = (float *)calloc ( inBlockFrames * kRenderChannels, sizeof ( float ) );
+	//	one pass over the file never wraps the ring
+	outiSub->bufferLength = (UInt32)( (UInt64)inNumFrames * kRenderiSubSampleRate / inSampleRate ) + inBlockFrames + 2;
+	outiSub->buffer = (SInt16 *)calloc ( outiSub->bufferLength, sizeof ( SInt16 ) );
+	return 0 != outiSub->low && 0 != outiSub->buffer;
+}
+
+static void RenderiSubFree ( RenderiSub * ioiSub ) {
+	if ( 0 != ioiSub->low ) {
+		free ( ioiSub->low );
+	}
+	if ( 0 != ioiSub->buffer ) {
+		free ( ioiSub->buffer );
+	}
+	bzero ( ioiSub, sizeof ( RenderiSub ) );
+}
+
+//	The down sampler leaves its samples byte swapped for USB; the swap is its own inverse.
+static bool RenderiSubWrite ( const char * inPath, const RenderiSub * iniSub ) {
+	DSPRenderAudio		theAudio;
+	UInt16				swapped;
+	UInt32				index;
+	bool				result;
+
+	bzero ( &theAudio, sizeof ( theAudio ) );
+	theAudio.sampleRate = kRenderiSubSampleRate;
+	theAudio.numChannels = 1;
+	theAudio.numFrames = (UInt32)iniSub->bufferOffset;
+	theAudio.bitsPerSample = 16;
+	if ( !DSPRenderAllocateAudio ( &theAudio ) ) {
+		return false;
+	}
+	for ( index = 0; index < theAudio.numFrames; index++ ) {
+		swapped = (UInt16)iniSub->buffer[index];
+		theAudio.samples[index] = (float)(SInt16)( ( swapped << 8 ) | ( swapped >> 8 ) ) / 32768.0f;
+	}
+	result = DSPRenderWriteWAV ( inPath, &theAudio );
+	DSPRenderFreeAudio ( &theAudio );
+	return result;
+}
+
+//	Loudness follows the output volume exactly as AppleDBDMAAudio::applyOutputVolumeDecibels has it.
+static void RenderApplyVolume ( DSP_Manager * inManager, float inVolumedB, bool inCodecVolume ) {
+	DSP_Loudness *		theLoudness;
+	bool				wasActive;
+
+	theLoudness = OSDynamicCast ( DSP_Loudness, inManager->getStage ( kLoudnessEntry ) );
+	if ( 0 != theLoudness ) {
+		wasActive = theLoudness->isActive ();
+		theLoudness->setCodecVolume ( inCodecVolume );
+		theLoudness->setVolume ( inVolumedB );
+		if ( theLoudness->isActive () != wasActive ) {
+			inManager->updateRunList ();
+		}
+	}
+}
+
+static void RenderReport ( DSP_Manager * inManager, const RenderStageTime * inStages, UInt32 inNumStages, UInt64 inVolumeTime, UInt64 iniSubTime, double inSeconds, UInt32 inFrames ) {
+	DSP_Processor *		theStage;
+	const char *		state;
+	UInt64				total;
+	UInt32				index;
+	UInt32				run;
+
+	printf ( "%-22s %-8s %8s %10s %10s %8s\n", "stage", "state", "latency", "cpu ms", "ns/frame", "% rt" );
+	total = 0;
+	for ( index = 0; index < inManager->getNumStages (); index++ ) {
+		theStage = inManager->getStageAtIndex ( index );
+		for ( run = 0; run < inNumStages && inStages[run].stage != theStage; run++ ) {}
+		if ( run < inNumStages ) {
+			total += inStages[run].nanoseconds;
+			printf ( "%-22s %-8s %8u %10.3f %10.2f %8.3f\n", theStage->getStageName (), "run", (unsigned int)theStage->getLatency (),
+					(double)inStages[run].nanoseconds / 1.0e6, (double)inStages[run].nanoseconds / (double)inFrames,
+					100.0 * (double)inStages[run].nanoseconds / 1.0e9 / inSeconds );
+		} else {
+			state = theStage->getBypass () ? "bypass" : "idle";
+			printf ( "%-22s %-8s %8s %10s %10s %8s\n", theStage->getStageName (), state, "-", "-", "-", "-" );
+		}
+	}
+	if ( 0 != inVolumeTime ) {
+		printf ( "%-22s %-8s %8s %10.3f %10.2f %8.3f\n", "(software volume)", "run", "0", (double)inVolumeTime / 1.0e6,
+				(double)inVolumeTime / (double)inFrames, 100.0 * (double)inVolumeTime / 1.0e9 / inSeconds );
+	}
+	if ( 0 != iniSubTime ) {
+		printf ( "%-22s %-8s %8s %10.3f %10.2f %8.3f\n", "(iSub)", "run", "-", (double)iniSubTime / 1.0e6,
+				(double)iniSubTime / (double)inFrames, 100.0 * (double)iniSubTime / 1.0e9 / inSeconds );
+	}
+	total += inVolumeTime + iniSubTime;
+	printf ( "%-22s %-8s %8u %10.3f %10.2f %8.3f\n", "total", "", (unsigned int)inManager->getLatency (), (double)total / 1.0e6,
+			(double)total / (double)inFrames, 100.0 * (double)total / 1.0e9 / inSeconds );
+}
+
+int main ( int argc, char * argv[] ) {
+	RenderOptions		theOptions;
+	DSPRenderAudio		theInput;
+	DSPRenderAudio		theOutput;
+	RenderiSub			theiSub;
+	RenderStageTime		theStages[kDSPMaxStages];
+	DSP_Manager *		theManager;
+	DSP_Processor *		theStage;
+	OSObject *			theRoot;
+	OSDictionary *		theDSPDict;
+	float *				block;
+	float				gain;
+	float				previousLeft[1];
+	float				previousRight[1];
+	UInt64				start;
+	UInt64				volumeTime;
+	UInt64				iSubTime;
+	UInt32				numStages;
+	UInt32				latency;
+	UInt32				skipFrames;
+	UInt32				renderFrames;
+	UInt32				frame;
+	UInt32				frames;
+	UInt32				source;
+	UInt32				channel;
+	UInt32				index;
+	int					result = 1;
+
+	theManager = 0;
+	theRoot = 0;
+	block = 0;
+	bzero ( &theInput, sizeof ( theInput ) );
+	bzero ( &theOutput, sizeof ( theOutput ) );
+	bzero ( &theiSub, sizeof ( theiSub ) );
+
+	if ( !RenderParseOptions ( argc, argv, &theOptions ) ) {
+		RenderUsage ();
+		goto Exit;
+	}
+
+	theRoot = DSPRenderReadPropertyList ( theOptions.plistPath );
+	FailIf ( 0 == theRoot, Exit );
+	theDSPDict = RenderFindSoftwareDSP ( theRoot );
+	if ( 0 == theDSPDict ) {
+		fprintf ( stderr, "%s: the root is not a dictionary\n", theOptions.plistPath );
+		goto Exit;
+	}
+
+	FailIf ( !DSPRenderReadWAV ( theOptions.inputPath, &theInput ), Exit );
+	if ( theInput.numChannels > kRenderChannels ) {
+		fprintf ( stderr, "%s: %u channels; the engine carries at most %d\n", theOptions.inputPath, (unsigned int)theInput.numChannels, kRenderChannels );
+		goto Exit;
+	}
+
+	theManager = DSP_Manager::create ();
+	FailIf ( 0 == theManager, Exit );
+	if ( !theManager->setProcessing ( theDSPDict, kRenderChannels, theInput.sampleRate ) ) {
+		fprintf ( stderr, "%s: the chain could not be built\n", theOptions.plistPath );
+		goto Exit;
+	}
+	RenderApplyVolume ( theManager, theOptions.volumedB, theOptions.codecVolume );
+	theManager->enable ();
+
+	//	the run list as updateRunList builds it
+	numStages = 0;
+	for ( index = 0; index < theManager->getNumStages (); index++ ) {
+		theStage = theManager->getStageAtIndex ( index );
+		if ( 0 != theStage && !theStage->getBypass () && theStage->isActive () ) {
+			theStages[numStages].stage = theStage;
+			theStages[numStages].nanoseconds = 0;
+			numStages++;
+		}
+	}
+	latency = theManager->getLatency ();
+	skipFrames = theOptions.align ? latency : 0;
+	renderFrames = theInput.numFrames + skipFrames;
+
+	theOutput.sampleRate = theInput.sampleRate;
+	theOutput.numChannels = kRenderChannels;
+	theOutput.numFrames = theInput.numFrames;
+	theOutput.bitsPerSample = ( 0 == theOptions.outputBits ) ? theInput.bitsPerSample : theOptions.outputBits;
+	theOutput.isFloat = ( 0 == theOptions.outputBits ) ? theInput.isFloat : theOptions.outputFloat;
+	FailIf ( !DSPRenderAllocateAudio ( &theOutput ), Exit );
+
+	block = (float *)calloc ( theOptions.blockFrames * kRenderChannels, sizeof ( float ) );
+	FailIf ( 0 == block, Exit );
+	if ( 0 != theOptions.iSubPath ) {
+		FailIf ( !RenderiSubInit ( &theiSub, theInput.sampleRate, theOptions.blockFrames, renderFrames ), Exit );
+	}
+
+	//	an offline render starts at the requested volume rather than ramping to it
+	gain = (float)pow ( 10.0, theOptions.volumedB / 20.0 );
+	previousLeft[0] = gain;
+	previousRight[0] = gain;
+	volumeTime = 0;
+	iSubTime = 0;
+
+	for ( frame = 0; frame < renderFrames; frame += frames ) {
+		frames = ( renderFrames - frame < theOptions.blockFrames ) ? renderFrames - frame : theOptions.blockFrames;
+
+		//	mono files feed both sides; the tail that flushes the latency is silence
+		for ( index = 0; index < frames; index++ ) {
+			for ( channel = 0; channel < kRenderChannels; channel++ ) {
+				if ( frame + index < theInput.numFrames ) {
+					source = ( channel < theInput.numChannels ) ? channel : 0;
+					block[index * kRenderChannels + channel] = theInput.samples[( frame + index ) * theInput.numChannels + source];
+				} else {
+					block[index * kRenderChannels + channel] = 0.0f;
+				}
+			}
+		}
+
+		if ( 0 != theOptions.iSubPath ) {
+			start = RenderThreadTime ();
+			StereoLowPass4thOrder ( block, theiSub.low, frames, theInput.sampleRate, &theiSub.coefficients, &theiSub.filterState, &theiSub.filterState2 );
+			iSubTime += RenderThreadTime () - start;
+		}
+		if ( theOptions.useVolume && !theOptions.codecVolume ) {
+			start = RenderThreadTime ();
+			volume ( block, frames * kRenderChannels, &gain, &gain, previousLeft, previousRight );
+			volumeTime += RenderThreadTime () - start;
+		}
+		RenderChain ( theStages, numStages, block, frames * kRenderChannels );
+		if ( 0 != theOptions.iSubPath ) {
+			start = RenderThreadTime ();
+			iSubDownSampleLinearAndConvert ( theiSub.low, &theiSub.srcPhase, &theiSub.srcState, theInput.sampleRate, kRenderiSubSampleRate, 0, frames * kRenderChannels,
+					theiSub.buffer, &theiSub.bufferOffset, theiSub.bufferLength, &theiSub.loopCount );
+			iSubTime += RenderThreadTime () - start;
+		}
+
+		for ( index = 0; index < frames; index++ ) {
+			if ( frame + index >= skipFrames ) {
+				memcpy ( &theOutput.samples[( frame + index - skipFrames ) * kRenderChannels], &block[index * kRenderChannels], kRenderChannels * sizeof ( float ) );
+			}
+		}
+	}
+
+	FailIf ( !DSPRenderWriteWAV ( theOptions.outputPath, &theOutput ), Exit );
+	if ( 0 != theOptions.iSubPath ) {
+		FailIf ( !RenderiSubWrite ( theOptions.iSubPath, &theiSub ), Exit );
+	}
+
+	printf ( "%s: %u frames at %u Hz, %u frame blocks%s\n", theOptions.inputPath, (unsigned int)theInput.numFrames, (unsigned int)theInput.sampleRate,
+			(unsigned int)theOptions.blockFrames, theOptions.align ? ", latency removed" : "" );
+	RenderReport ( theManager, theStages, numStages, volumeTime, iSubTime, (double)theInput.numFrames / (double)theInput.sampleRate, theInput.numFrames );
+	result = 0;
+Exit:
+	if ( 0 != block ) {
+		free ( block );
+	}
+	RenderiSubFree ( &theiSub );
+	DSPRenderFreeAudio ( &theInput );
+	DSPRenderFreeAudio ( &theOutput );
+	if ( 0 != theManager ) {
+		theManager->release ();
+	}
+	if ( 0 != theRoot ) {
+		theRoot->release ();
+	}
+	return result;
+}
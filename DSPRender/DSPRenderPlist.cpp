@@ -0,0 +1,420 @@
+/*
+ *  DSPRenderPlist.cpp
+ *  DSPRender
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#include "DSPRenderPlist.h"
+
+#include <ctype.h>
+#include <math.h>
+
+#include <libkern/c++/OSArray.h>
+#include <libkern/c++/OSBoolean.h>
+#include <libkern/c++/OSDictionary.h>
+#include <libkern/c++/OSNumber.h>
+#include <libkern/c++/OSString.h>
+#include <IOKit/IOLib.h>
+
+#include "AudioHardwareUtilities.h"
+
+#define kPlistMaxTagLength				32
+#define kPlistMaxDepth					32
+
+typedef struct {
+	const char *		path;
+	const char *		text;
+	const char *		position;
+	UInt32				line;
+	bool				failed;
+} PlistParser;
+
+typedef struct {
+	char				name[kPlistMaxTagLength];
+	bool				closing;					//	</name>
+	bool				empty;						//	<name/>
+} PlistTag;
+
+static OSObject * PlistParseValue ( PlistParser * ioParser, const PlistTag * inTag, UInt32 inDepth );
+
+#pragma mark ------------------------
+#pragma mark --- Lexing
+#pragma mark ------------------------
+
+static void PlistError ( PlistParser * ioParser, const char * inMessage ) {
+	if ( !ioParser->failed ) {
+		fprintf ( stderr, "%s:%u: %s\n", ioParser->path, (unsigned int)ioParser->line, inMessage );
+		ioParser->failed = true;
+	}
+}
+
+static void PlistAdvance ( PlistParser * ioParser, UInt32 inCount ) {
+	while ( 0 != inCount-- && 0 != *ioParser->position ) {
+		if ( '\n' == *ioParser->position ) {
+			ioParser->line++;
+		}
+		ioParser->position++;
+	}
+}
+
+static bool PlistSkipPast ( PlistParser * ioParser, const char * inTerminator ) {
+	const char *		end;
+
+	end = strstr ( ioParser->position, inTerminator );
+	if ( 0 == end ) {
+		PlistError ( ioParser, "unterminated markup" );
+		return false;
+	}
+	PlistAdvance ( ioParser, (UInt32)( end - ioParser->position ) + (UInt32)strlen ( inTerminator ) );
+	return true;
+}
+
+//	Skips white space, comments, the XML declaration and the DOCTYPE.
+static void PlistSkipMisc ( PlistParser * ioParser ) {
+	while ( !ioParser->failed ) {
+		if ( isspace ( (unsigned char)*ioParser->position ) ) {
+			PlistAdvance ( ioParser, 1 );
+		} else if ( 0 == strncmp ( ioParser->position, "<!--", 4 ) ) {
+			PlistSkipPast ( ioParser, "-->" );
+		} else if ( 0 == strncmp ( ioParser->position, "<?", 2 ) ) {
+			PlistSkipPast ( ioParser, "?>" );
+		} else if ( 0 == strncmp ( ioParser->position, "<!", 2 ) ) {
+			PlistSkipPast ( ioParser, ">" );
+		} else {
+			break;
+		}
+	}
+}
+
+//	Reads the next tag.  Attributes, such as the kernel's ID and size, are skipped.
+static bool PlistNextTag ( PlistParser * ioParser, PlistTag * outTag ) {
+	UInt32				length;
+
+	PlistSkipMisc ( ioParser );
+	FailIf ( ioParser->failed, Exit );
+	if ( '<' != *ioParser->position ) {
+		PlistError ( ioParser, ( 0 == *ioParser->position ) ? "unexpected end of file" : "expected a tag" );
+		goto Exit;
+	}
+	PlistAdvance ( ioParser, 1 );
+
+	outTag->closing = ( '/' == *ioParser->position );
+	if ( outTag->closing ) {
+		PlistAdvance ( ioParser, 1 );
+	}
+	length = 0;
+	while ( isalnum ( (unsigned char)*ioParser->position ) ) {
+		if ( length + 1 >= kPlistMaxTagLength ) {
+			PlistError ( ioParser, "tag name too long" );
+			goto Exit;
+		}
+		outTag->name[length++] = *ioParser->position;
+		PlistAdvance ( ioParser, 1 );
+	}
+	outTag->name[length] = 0;
+
+	while ( 0 != *ioParser->position && '>' != *ioParser->position ) {
+		PlistAdvance ( ioParser, 1 );
+	}
+	if ( 0 == *ioParser->position ) {
+		PlistError ( ioParser, "unterminated tag" );
+		goto Exit;
+	}
+	outTag->empty = ( '/' == ioParser->position[-1] );
+	PlistAdvance ( ioParser, 1 );
+	return true;
+Exit:
+	return false;
+}
+
+static bool PlistExpectClose ( PlistParser * ioParser, const char * inName ) {
+	PlistTag			theTag;
+
+	if ( !PlistNextTag ( ioParser, &theTag ) ) {
+		return false;
+	}
+	if ( !theTag.closing || 0 != strcmp ( theTag.name, inName ) ) {
+		PlistError ( ioParser, "mismatched closing tag" );
+		return false;
+	}
+	return true;
+}
+
+//	Returns the character data up to the next '<' with the five predefined entities decoded.
+//	The caller frees the result.
+static char * PlistReadText ( PlistParser * ioParser ) {
+	static const struct { const char * entity; char character; } kEntities[] = {
+		{ "&lt;", '<' }, { "&gt;", '>' }, { "&amp;", '&' }, { "&quot;", '"' }, { "&apos;", '\'' }
+	};
+	const char *		end;
+	char *				result;
+	UInt32				length;
+	UInt32				index;
+
+	end = strchr ( ioParser->position, '<' );
+	if ( 0 == end ) {
+		PlistError ( ioParser, "unexpected end of file" );
+		return 0;
+	}
+	result = (char *)malloc ( (size_t)( end - ioParser->position ) + 1 );
+	if ( 0 == result ) {
+		PlistError ( ioParser, "out of memory" );
+		return 0;
+	}
+	length = 0;
+	while ( ioParser->position < end ) {
+		if ( '&' == *ioParser->position ) {
+			for ( index = 0; index < sizeof ( kEntities ) / sizeof ( kEntities[0] ); index++ ) {
+				if ( 0 == strncmp ( ioParser->position, kEntities[index].entity, strlen ( kEntities[index].entity ) ) ) {
+					break;
+				}
+			}
+			if ( index < sizeof ( kEntities ) / sizeof ( kEntities[0] ) ) {
+				result[length++] = kEntities[index].character;
+				PlistAdvance ( ioParser, (UInt32)strlen ( kEntities[index].entity ) );
+				continue;
+			}
+		}
+		result[length++] = *ioParser->position;
+		PlistAdvance ( ioParser, 1 );
+	}
+	result[length] = 0;
+	return result;
+}
+
+#pragma mark ------------------------
+#pragma mark --- Values
+#pragma mark ------------------------
+
+static OSObject * PlistParseNumber ( PlistParser * ioParser, bool inReal ) {
+	OSObject *			result;
+	char *				text;
+	char *				end;
+	double				realValue;
+	long long			value;
+
+	result = 0;
+	text = PlistReadText ( ioParser );
+	FailIf ( 0 == text, Exit );
+
+	if ( inReal ) {
+		realValue = strtod ( text, &end );
+		value = (long long)floor ( realValue + 0.5 );
+		if ( (double)value != realValue ) {
+			fprintf ( stderr, "%s:%u: warning: <real> %s rounded to %lld\n", ioParser->path, (unsigned int)ioParser->line, text, value );
+		}
+	} else {
+		value = strtoll ( text, &end, 0 );
+	}
+	while ( isspace ( (unsigned char)*end ) ) {
+		end++;
+	}
+	if ( end == text || 0 != *end ) {
+		PlistError ( ioParser, "malformed number" );
+	} else {
+		result = OSNumber::withNumber ( (unsigned long long)value, 64 );
+	}
+	free ( text );
+Exit:
+	return result;
+}
+
+static OSObject * PlistParseString ( PlistParser * ioParser ) {
+	OSString *			result;
+	char *				text;
+
+	result = 0;
+	text = PlistReadText ( ioParser );
+	if ( 0 != text ) {
+		result = OSString::withCString ( text );
+		free ( text );
+	}
+	return result;
+}
+
+static OSObject * PlistParseArray ( PlistParser * ioParser, UInt32 inDepth ) {
+	OSArray *			result;
+	OSObject *			theValue;
+	PlistTag			theTag;
+
+	result = OSArray::withCapacity ( 4 );
+	FailIf ( 0 == result, Exit );
+
+	while ( PlistNextTag ( ioParser, &theTag ) ) {
+		if ( theTag.closing ) {
+			if ( 0 != strcmp ( theTag.name, "array" ) ) {
+				PlistError ( ioParser, "mismatched closing tag" );
+			}
+			break;
+		}
+		theValue = PlistParseValue ( ioParser, &theTag, inDepth + 1 );
+		if ( 0 == theValue ) {
+			break;
+		}
+		result->setObject ( theValue );
+		theValue->release ();
+	}
+Exit:
+	return result;
+}
+
+static OSObject * PlistParseDictionary ( PlistParser * ioParser, UInt32 inDepth ) {
+	OSDictionary *		result;
+	OSObject *			theValue;
+	PlistTag			theTag;
+	char *				theKey;
+
+	result = OSDictionary::withCapacity ( 8 );
+	FailIf ( 0 == result, Exit );
+
+	while ( PlistNextTag ( ioParser, &theTag ) ) {
+		if ( theTag.closing ) {
+			if ( 0 != strcmp ( theTag.name, "dict" ) ) {
+				PlistError ( ioParser, "mismatched closing tag" );
+			}
+			break;
+		}
+		if ( 0 != strcmp ( theTag.name, "key" ) || theTag.empty ) {
+			PlistError ( ioParser, "expected <key>" );
+			break;
+		}
+		theKey = PlistReadText ( ioParser );
+		if ( 0 == theKey ) {
+			break;
+		}
+		theValue = 0;
+		if ( PlistExpectClose ( ioParser, "key" ) && PlistNextTag ( ioParser, &theTag ) ) {
+			if ( theTag.closing ) {
+				PlistError ( ioParser, "key without a value" );
+			} else {
+				theValue = PlistParseValue ( ioParser, &theTag, inDepth + 1 );
+			}
+		}
+		if ( 0 != theValue ) {
+			result->setObject ( theKey, theValue );
+			theValue->release ();
+		}
+		free ( theKey );
+		if ( 0 == theValue ) {
+			break;
+		}
+	}
+Exit:
+	return result;
+}
+
+//	Parses the value whose opening tag has just been read, through its closing tag.
+static OSObject * PlistParseValue ( PlistParser * ioParser, const PlistTag * inTag, UInt32 inDepth ) {
+	OSObject *			result;
+
+	result = 0;
+	if ( inDepth > kPlistMaxDepth ) {
+		PlistError ( ioParser, "nested too deeply" );
+		goto Exit;
+	}
+
+	if ( 0 == strcmp ( inTag->name, "true" ) || 0 == strcmp ( inTag->name, "false" ) ) {
+		result = ( 't' == inTag->name[0] ) ? kOSBooleanTrue : kOSBooleanFalse;
+		result->retain ();
+		if ( !inTag->empty ) {
+			PlistExpectClose ( ioParser, inTag->name );
+		}
+	} else if ( inTag->empty ) {
+		if ( 0 == strcmp ( inTag->name, "dict" ) ) {
+			result = OSDictionary::withCapacity ( 1 );
+		} else if ( 0 == strcmp ( inTag->name, "array" ) ) {
+			result = OSArray::withCapacity ( 1 );
+		} else if ( 0 == strcmp ( inTag->name, "string" ) ) {
+			result = OSString::withCString ( "" );
+		} else {
+			PlistError ( ioParser, "empty element where a value was expected" );
+		}
+	} else if ( 0 == strcmp ( inTag->name, "dict" ) ) {
+		result = PlistParseDictionary ( ioParser, inDepth );
+	} else if ( 0 == strcmp ( inTag->name, "array" ) ) {
+		result = PlistParseArray ( ioParser, inDepth );
+	} else if ( 0 == strcmp ( inTag->name, "integer" ) || 0 == strcmp ( inTag->name, "real" ) ) {
+		result = PlistParseNumber ( ioParser, 'r' == inTag->name[0] );
+		if ( 0 != result ) {
+			PlistExpectClose ( ioParser, inTag->name );
+		}
+	} else if ( 0 == strcmp ( inTag->name, "string" ) ) {
+		result = PlistParseString ( ioParser );
+		if ( 0 != result ) {
+			PlistExpectClose ( ioParser, inTag->name );
+		}
+	} else {
+		//	<data> and <date> never appear in a 'SoftwareDSP' entry
+		PlistError ( ioParser, "unsupported element" );
+	}
+
+	if ( ioParser->failed && 0 != result ) {
+		result->release ();
+		result = 0;
+	}
+Exit:
+	return result;
+}
+
+#pragma mark ------------------------
+#pragma mark --- Entry
+#pragma mark ------------------------
+
+OSObject * DSPRenderReadPropertyList ( const char * inPath ) {
+	PlistParser			theParser;
+	PlistTag			theTag;
+	OSObject *			result;
+	FILE *				theFile;
+	char *				text;
+	long				length;
+
+	result = 0;
+	text = 0;
+	theFile = fopen ( inPath, "rb" );
+	if ( 0 == theFile ) {
+		fprintf ( stderr, "%s: cannot open\n", inPath );
+		goto Exit;
+	}
+	FailIf ( 0 != fseek ( theFile, 0, SEEK_END ), Exit );
+	length = ftell ( theFile );
+	FailIf ( length < 0 || 0 != fseek ( theFile, 0, SEEK_SET ), Exit );
+	text = (char *)malloc ( (size_t)length + 1 );
+	FailIf ( 0 == text, Exit );
+	FailIf ( (size_t)length != fread ( text, 1, (size_t)length, theFile ), Exit );
+	text[length] = 0;
+
+	theParser.path = inPath;
+	theParser.text = text;
+	theParser.position = text;
+	theParser.line = 1;
+	theParser.failed = false;
+
+	//	the root is either wrapped in <plist> or stands alone
+	FailIf ( !PlistNextTag ( &theParser, &theTag ), Exit );
+	if ( 0 == strcmp ( theTag.name, "plist" ) && !theTag.closing && !theTag.empty ) {
+		FailIf ( !PlistNextTag ( &theParser, &theTag ), Exit );
+		if ( theTag.closing ) {
+			PlistError ( &theParser, "empty property list" );
+			goto Exit;
+		}
+		result = PlistParseValue ( &theParser, &theTag, 0 );
+		if ( 0 != result && !PlistExpectClose ( &theParser, "plist" ) ) {
+			result->release ();
+			result = 0;
+		}
+	} else if ( !theTag.closing ) {
+		result = PlistParseValue ( &theParser, &theTag, 0 );
+	} else {
+		PlistError ( &theParser, "unexpected closing tag" );
+	}
+Exit:
+	if ( 0 != text ) {
+		free ( text );
+	}
+	if ( 0 != theFile ) {
+		fclose ( theFile );
+	}
+	return result;
+}
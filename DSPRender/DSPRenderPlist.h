@@ -0,0 +1,25 @@
+/*
+ *  DSPRenderPlist.h
+ *  DSPRender
+ *
+ *  Reads an XML property list into the same OSDictionary / OSArray /
+ *  OSString / OSNumber / OSBoolean tree the kernel hands the driver, so a
+ *  layout's 'SoftwareDSP' entry can be passed to DSP_Manager as is.
+ *
+ *  Like the kernel's unserializer only integers are kept as numbers; a
+ *  <real> is rounded to the nearest integer with a warning, since every
+ *  stage already expects its fractional parameters in scaled units.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSPRENDER_PLIST__
+#define __DSPRENDER_PLIST__
+
+#include <libkern/c++/OSObject.h>
+
+//	returns the root object with one reference, or 0 after printing where the file went wrong
+OSObject *	DSPRenderReadPropertyList ( const char * inPath );
+
+#endif
@@ -0,0 +1,293 @@
+/*
+ *  DSPRenderWAV.cpp
+ *  DSPRender
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#include "DSPRenderWAV.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <IOKit/IOLib.h>
+
+#include "AudioHardwareUtilities.h"
+
+#define kWAVFormatPCM					0x0001
+#define kWAVFormatFloat					0x0003
+#define kWAVFormatExtensible			0xFFFE
+
+#define kWAVMaxChannels					8
+
+#pragma mark ------------------------
+#pragma mark --- Byte Order
+#pragma mark ------------------------
+
+static UInt32 WAVGetLittle16 ( const UInt8 * inBytes ) {
+	return (UInt32)inBytes[0] | ( (UInt32)inBytes[1] << 8 );
+}
+
+static UInt32 WAVGetLittle32 ( const UInt8 * inBytes ) {
+	return (UInt32)inBytes[0] | ( (UInt32)inBytes[1] << 8 ) | ( (UInt32)inBytes[2] << 16 ) | ( (UInt32)inBytes[3] << 24 );
+}
+
+static void WAVPutLittle16 ( UInt8 * outBytes, UInt32 inValue ) {
+	outBytes[0] = (UInt8)inValue;
+	outBytes[1] = (UInt8)( inValue >> 8 );
+}
+
+static void WAVPutLittle32 ( UInt8 * outBytes, UInt32 inValue ) {
+	outBytes[0] = (UInt8)inValue;
+	outBytes[1] = (UInt8)( inValue >> 8 );
+	outBytes[2] = (UInt8)( inValue >> 16 );
+	outBytes[3] = (UInt8)( inValue >> 24 );
+}
+
+#pragma mark ------------------------
+#pragma mark --- Samples
+#pragma mark ------------------------
+
+//	Integers are scaled by 2^-(bits - 1), so full scale negative maps to exactly -1.0.
+static float WAVDecodeSample ( const UInt8 * inBytes, UInt32 inBitsPerSample, bool inIsFloat ) {
+	union {
+		UInt32			i;
+		float			f;
+	}					theValue;
+	SInt32				integer;
+
+	if ( inIsFloat ) {
+		theValue.i = WAVGetLittle32 ( inBytes );
+		return theValue.f;
+	}
+	switch ( inBitsPerSample ) {
+		case 16:
+			integer = (SInt16)WAVGetLittle16 ( inBytes );
+			return (float)integer * ( 1.0f / 32768.0f );
+		case 24:
+			integer = (SInt32)( ( (UInt32)inBytes[0] << 8 ) | ( (UInt32)inBytes[1] << 16 ) | ( (UInt32)inBytes[2] << 24 ) ) >> 8;
+			return (float)integer * ( 1.0f / 8388608.0f );
+		default:
+			integer = (SInt32)WAVGetLittle32 ( inBytes );
+			return (float)( (double)integer * ( 1.0 / 2147483648.0 ) );
+	}
+}
+
+static void WAVEncodeSample ( UInt8 * outBytes, float inSample, UInt32 inBitsPerSample, bool inIsFloat ) {
+	union {
+		UInt32			i;
+		float			f;
+	}					theValue;
+	double				scaled;
+	double				limit;
+
+	if ( inIsFloat ) {
+		theValue.f = inSample;
+		WAVPutLittle32 ( outBytes, theValue.i );
+		return;
+	}
+	limit = ldexp ( 1.0, (int)inBitsPerSample - 1 );
+	scaled = floor ( (double)inSample * limit + 0.5 );
+	if ( scaled > limit - 1.0 ) {
+		scaled = limit - 1.0;
+	} else if ( scaled < -limit ) {
+		scaled = -limit;
+	}
+	switch ( inBitsPerSample ) {
+		case 16:
+			WAVPutLittle16 ( outBytes, (UInt32)(SInt32)scaled );
+			break;
+		case 24:
+			WAVPutLittle16 ( outBytes, (UInt32)(SInt32)scaled );
+			outBytes[2] = (UInt8)( (UInt32)(SInt32)scaled >> 16 );
+			break;
+		default:
+			WAVPutLittle32 ( outBytes, (UInt32)(SInt32)scaled );
+			break;
+	}
+}
+
+#pragma mark ------------------------
+#pragma mark --- Files
+#pragma mark ------------------------
+
+bool DSPRenderAllocateAudio ( DSPRenderAudio * ioAudio ) {
+	ioAudio->samples = (float *)calloc ( (size_t)ioAudio->numFrames * ioAudio->numChannels + 1, sizeof ( float ) );
+	return 0 != ioAudio->samples;
+}
+
+void DSPRenderFreeAudio ( DSPRenderAudio * ioAudio ) {
+	if ( 0 != ioAudio->samples ) {
+		free ( ioAudio->samples );
+		ioAudio->samples = 0;
+	}
+}
+
+bool DSPRenderReadWAV ( const char * inPath, DSPRenderAudio * outAudio ) {
+	UInt8				header[12];
+	UInt8				chunkHeader[8];
+	UInt8				format[40];
+	UInt8 *				data;
+	FILE *				theFile;
+	UInt32				chunkSize;
+	UInt32				formatTag;
+	UInt32				bytesPerSample;
+	UInt32				dataSize;
+	UInt32				index;
+	bool				haveFormat;
+	bool				result = false;
+
+	bzero ( outAudio, sizeof ( DSPRenderAudio ) );
+	data = 0;
+	haveFormat = false;
+	formatTag = 0;
+	bytesPerSample = 0;
+
+	theFile = fopen ( inPath, "rb" );
+	if ( 0 == theFile ) {
+		fprintf ( stderr, "%s: cannot open\n", inPath );
+		goto Exit;
+	}
+	if ( 1 != fread ( header, sizeof ( header ), 1, theFile ) || 0 != memcmp ( header, "RIFF", 4 ) || 0 != memcmp ( &header[8], "WAVE", 4 ) ) {
+		fprintf ( stderr, "%s: not a RIFF WAVE file\n", inPath );
+		goto Exit;
+	}
+
+	//	walk the chunks until the data, which must come after the format
+	while ( 1 == fread ( chunkHeader, sizeof ( chunkHeader ), 1, theFile ) ) {
+		chunkSize = WAVGetLittle32 ( &chunkHeader[4] );
+
+		if ( 0 == memcmp ( chunkHeader, "fmt ", 4 ) ) {
+			FailIf ( chunkSize < 16, Exit );
+			bzero ( format, sizeof ( format ) );
+			FailIf ( 1 != fread ( format, ( chunkSize < sizeof ( format ) ) ? chunkSize : sizeof ( format ), 1, theFile ), Exit );
+			if ( chunkSize > sizeof ( format ) ) {
+				FailIf ( 0 != fseek ( theFile, (long)( chunkSize - sizeof ( format ) ), SEEK_CUR ), Exit );
+			}
+			formatTag = WAVGetLittle16 ( &format[0] );
+			if ( kWAVFormatExtensible == formatTag && chunkSize >= 40 ) {
+				formatTag = WAVGetLittle16 ( &format[24] );			//	first two bytes of the sub format GUID
+			}
+			outAudio->numChannels = WAVGetLittle16 ( &format[2] );
+			outAudio->sampleRate = WAVGetLittle32 ( &format[4] );
+			outAudio->bitsPerSample = WAVGetLittle16 ( &format[14] );
+			outAudio->isFloat = ( kWAVFormatFloat == formatTag );
+			bytesPerSample = outAudio->bitsPerSample / 8;
+			haveFormat = true;
+
+		} else if ( 0 == memcmp ( chunkHeader, "data", 4 ) ) {
+			if ( !haveFormat ) {
+				fprintf ( stderr, "%s: data before format\n", inPath );
+				goto Exit;
+			}
+			if ( ( kWAVFormatPCM != formatTag && kWAVFormatFloat != formatTag )
+					|| ( outAudio->isFloat && 32 != outAudio->bitsPerSample )
+					|| ( 16 != outAudio->bitsPerSample && 24 != outAudio->bitsPerSample && 32 != outAudio->bitsPerSample )
+					|| 0 == outAudio->numChannels || outAudio->numChannels > kWAVMaxChannels || 0 == outAudio->sampleRate ) {
+				fprintf ( stderr, "%s: unsupported format %#x, %u channels, %u bits\n", inPath, (unsigned int)formatTag, (unsigned int)outAudio->numChannels, (unsigned int)outAudio->bitsPerSample );
+				goto Exit;
+			}
+			outAudio->numFrames = chunkSize / ( bytesPerSample * outAudio->numChannels );
+			dataSize = outAudio->numFrames * outAudio->numChannels * bytesPerSample;
+			data = (UInt8 *)malloc ( dataSize + 1 );
+			FailIf ( 0 == data, Exit );
+			if ( dataSize != fread ( data, 1, dataSize, theFile ) ) {
+				fprintf ( stderr, "%s: truncated data\n", inPath );
+				goto Exit;
+			}
+			FailIf ( !DSPRenderAllocateAudio ( outAudio ), Exit );
+			for ( index = 0; index < outAudio->numFrames * outAudio->numChannels; index++ ) {
+				outAudio->samples[index] = WAVDecodeSample ( &data[index * bytesPerSample], outAudio->bitsPerSample, outAudio->isFloat );
+			}
+			result = true;
+			goto Exit;
+
+		} else {
+			FailIf ( 0 != fseek ( theFile, (long)chunkSize, SEEK_CUR ), Exit );
+		}
+		//	chunks are padded to an even length
+		if ( 0 != ( chunkSize & 1 ) ) {
+			FailIf ( 0 != fseek ( theFile, 1, SEEK_CUR ), Exit );
+		}
+	}
+	fprintf ( stderr, "%s: no data chunk\n", inPath );
+Exit:
+	if ( 0 != data ) {
+		free ( data );
+	}
+	if ( 0 != theFile ) {
+		fclose ( theFile );
+	}
+	if ( !result ) {
+		DSPRenderFreeAudio ( outAudio );
+	}
+	return result;
+}
+
+bool DSPRenderWriteWAV ( const char * inPath, const DSPRenderAudio * inAudio ) {
+	UInt8				header[58];
+	UInt8 *				data;
+	FILE *				theFile;
+	UInt32				bytesPerSample;
+	UInt32				headerSize;
+	UInt32				dataSize;
+	UInt32				index;
+	bool				result = false;
+
+	data = 0;
+	bytesPerSample = inAudio->bitsPerSample / 8;
+	dataSize = inAudio->numFrames * inAudio->numChannels * bytesPerSample;
+
+	theFile = fopen ( inPath, "wb" );
+	if ( 0 == theFile ) {
+		fprintf ( stderr, "%s: cannot create\n", inPath );
+		goto Exit;
+	}
+
+	//	float files carry the fact chunk every non PCM format is supposed to have
+	bzero ( header, sizeof ( header ) );
+	headerSize = inAudio->isFloat ? 58 : 44;
+	memcpy ( &header[0], "RIFF", 4 );
+	WAVPutLittle32 ( &header[4], headerSize - 8 + dataSize + ( dataSize & 1 ) );
+	memcpy ( &header[8], "WAVE", 4 );
+	memcpy ( &header[12], "fmt ", 4 );
+	WAVPutLittle32 ( &header[16], inAudio->isFloat ? 18 : 16 );
+	WAVPutLittle16 ( &header[20], inAudio->isFloat ? kWAVFormatFloat : kWAVFormatPCM );
+	WAVPutLittle16 ( &header[22], inAudio->numChannels );
+	WAVPutLittle32 ( &header[24], inAudio->sampleRate );
+	WAVPutLittle32 ( &header[28], inAudio->sampleRate * inAudio->numChannels * bytesPerSample );
+	WAVPutLittle16 ( &header[32], inAudio->numChannels * bytesPerSample );
+	WAVPutLittle16 ( &header[34], inAudio->bitsPerSample );
+	if ( inAudio->isFloat ) {
+		memcpy ( &header[38], "fact", 4 );
+		WAVPutLittle32 ( &header[42], 4 );
+		WAVPutLittle32 ( &header[46], inAudio->numFrames );
+		memcpy ( &header[50], "data", 4 );
+		WAVPutLittle32 ( &header[54], dataSize );
+	} else {
+		memcpy ( &header[36], "data", 4 );
+		WAVPutLittle32 ( &header[40], dataSize );
+	}
+
+	data = (UInt8 *)calloc ( dataSize + 1, 1 );
+	FailIf ( 0 == data, Exit );
+	for ( index = 0; index < inAudio->numFrames * inAudio->numChannels; index++ ) {
+		WAVEncodeSample ( &data[index * bytesPerSample], inAudio->samples[index], inAudio->bitsPerSample, inAudio->isFloat );
+	}
+	if ( 1 != fwrite ( header, headerSize, 1, theFile ) || dataSize + ( dataSize & 1 ) != fwrite ( data, 1, dataSize + ( dataSize & 1 ), theFile ) ) {
+		fprintf ( stderr, "%s: write failed\n", inPath );
+		goto Exit;
+	}
+	result = true;
+Exit:
+	if ( 0 != data ) {
+		free ( data );
+	}
+	if ( 0 != theFile && 0 != fclose ( theFile ) ) {
+		result = false;
+	}
+	return result;
+}
@@ -0,0 +1,37 @@
+/*
+ *  DSPRenderWAV.h
+ *  DSPRender
+ *
+ *  RIFF WAVE reading and writing for the render tool.  Files are read into
+ *  interleaved floats scaled the way the driver's integer to float routines
+ *  scale them, and written back with round to nearest and clipping the way
+ *  the float to integer routines do.  Byte order is handled explicitly, so
+ *  the tool behaves the same on either host endianness.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSPRENDER_WAV__
+#define __DSPRENDER_WAV__
+
+#include <libkern/OSTypes.h>
+
+typedef struct {
+	UInt32				sampleRate;
+	UInt32				numChannels;
+	UInt32				numFrames;
+	UInt32				bitsPerSample;				//	16, 24 or 32
+	bool				isFloat;					//	only with 32 bits
+	float *				samples;					//	numFrames * numChannels, interleaved
+} DSPRenderAudio;
+
+//	PCM, IEEE float and WAVE_FORMAT_EXTENSIBLE carrying either are accepted
+bool	DSPRenderReadWAV ( const char * inPath, DSPRenderAudio * outAudio );
+bool	DSPRenderWriteWAV ( const char * inPath, const DSPRenderAudio * inAudio );
+
+//	allocates samples for the frames, channels and format already filled in
+bool	DSPRenderAllocateAudio ( DSPRenderAudio * ioAudio );
+void	DSPRenderFreeAudio ( DSPRenderAudio * ioAudio );
+
+#endif
@@ -0,0 +1,37 @@
+/*
+ *  IOLib.h
+ *  DSPRender
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSPRENDER_IOLIB__
+#define __DSPRENDER_IOLIB__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <libkern/OSTypes.h>
+#include <IOKit/IOReturn.h>
+
+static inline void * IOMalloc ( size_t inSize ) {
+	return malloc ( inSize );
+}
+
+static inline void IOFree ( void * inAddress, size_t inSize ) {
+	(void)inSize;
+	free ( inAddress );
+}
+
+static inline void IOSleep ( unsigned int inMilliseconds ) {
+	usleep ( inMilliseconds * 1000 );
+}
+
+//	kernel log messages go to stderr so they never mix with a tool's report
+#define IOLog( message... )		fprintf ( stderr, message )
+
+#endif
@@ -0,0 +1,19 @@
+/*
+ *  IOReturn.h
+ *  DSPRender
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSPRENDER_IORETURN__
+#define __DSPRENDER_IORETURN__
+
+typedef int						IOReturn;
+
+#define kIOReturnSuccess		0
+#define kIOReturnError			0xe00002bc
+#define kIOReturnNoMemory		0xe00002bd
+#define kIOReturnBadArgument	0xe00002c2
+
+#endif
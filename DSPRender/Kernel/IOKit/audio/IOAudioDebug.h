@@ -0,0 +1,9 @@
+/*
+ *  IOAudioDebug.h
+ *  DSPRender
+ *
+ *  AppleDBDMAClip.c includes this, but its portable routines use none of it.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
@@ -0,0 +1,10 @@
+/*
+ *  IOUSBLog.h
+ *  DSPRender
+ *
+ *  Only reached through AudioHardwareUtilities.h.  DSPRender builds without
+ *  DEBUGLOG, so debugIOLog never calls USBLog.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
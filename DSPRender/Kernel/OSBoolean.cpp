@@ -0,0 +1,15 @@
+/*
+ *  OSBoolean.cpp
+ *  DSPRender
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#include <libkern/c++/OSBoolean.h>
+
+static OSBoolean			sTrue ( true );
+static OSBoolean			sFalse ( false );
+
+OSBoolean * const			kOSBooleanTrue = &sTrue;
+OSBoolean * const			kOSBooleanFalse = &sFalse;
@@ -0,0 +1,16 @@
+/*
+ *  fp_internal.h
+ *  DSPRender
+ *
+ *  The kernel's private floating point header; in userland that is libm.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSPRENDER_FP_INTERNAL__
+#define __DSPRENDER_FP_INTERNAL__
+
+#include <math.h>
+
+#endif
@@ -0,0 +1,35 @@
+/*
+ *  OSAtomic.h
+ *  DSPRender
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSPRENDER_OSATOMIC__
+#define __DSPRENDER_OSATOMIC__
+
+#include <libkern/OSTypes.h>
+
+//	like the kernel versions, these return the value before the operation
+static inline SInt32 OSIncrementAtomic ( volatile SInt32 * inAddress ) {
+	return __sync_fetch_and_add ( inAddress, 1 );
+}
+
+static inline SInt32 OSDecrementAtomic ( volatile SInt32 * inAddress ) {
+	return __sync_fetch_and_sub ( inAddress, 1 );
+}
+
+static inline SInt32 OSAddAtomic ( SInt32 inAmount, volatile SInt32 * inAddress ) {
+	return __sync_fetch_and_add ( inAddress, inAmount );
+}
+
+static inline bool OSCompareAndSwap ( UInt32 inOldValue, UInt32 inNewValue, volatile UInt32 * inAddress ) {
+	return __sync_bool_compare_and_swap ( inAddress, inOldValue, inNewValue );
+}
+
+static inline void OSSynchronizeIO ( void ) {
+	__sync_synchronize ();
+}
+
+#endif
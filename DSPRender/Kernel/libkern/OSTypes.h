@@ -0,0 +1,36 @@
+/*
+ *  OSTypes.h
+ *  DSPRender
+ *
+ *  Userland stand-in for the kernel header of the same name.  The headers
+ *  under DSPRender/Kernel cover only what the software DSP stages and the
+ *  portable part of AppleDBDMAClip.c use, so those build unchanged.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSPRENDER_OSTYPES__
+#define __DSPRENDER_OSTYPES__
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t					UInt8;
+typedef int8_t					SInt8;
+typedef uint16_t				UInt16;
+typedef int16_t					SInt16;
+typedef uint32_t				UInt32;
+typedef int32_t					SInt32;
+typedef uint64_t				UInt64;
+typedef int64_t					SInt64;
+typedef unsigned char			Boolean;
+
+#ifndef TRUE
+#define TRUE					1
+#endif
+#ifndef FALSE
+#define FALSE					0
+#endif
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ *  OSArray.h
+ *  DSPRender
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSPRENDER_OSARRAY__
+#define __DSPRENDER_OSARRAY__
+
+#include <stdlib.h>
+
+#include <libkern/c++/OSObject.h>
+
+class OSArray : public OSObject {
+
+public:
+
+	static OSArray *		withCapacity ( unsigned int inCapacity ) {
+		OSArray *			result;
+
+		result = new OSArray;
+		if ( !result->ensureCapacity ( ( 0 == inCapacity ) ? 1 : inCapacity ) ) {
+			result->release ();
+			result = 0;
+		}
+		return result;
+	}
+
+	virtual void			free ( void ) {
+		flushCollection ();
+		::free ( mObjects );
+		mObjects = 0;
+		OSObject::free ();
+	}
+
+	unsigned int			getCount ( void ) const { return mCount; }
+	OSObject *				getObject ( unsigned int inIndex ) const { return ( inIndex < mCount ) ? mObjects[inIndex] : 0; }
+
+	//	the array takes its own reference
+	bool					setObject ( OSObject * inObject ) {
+		if ( 0 == inObject || !ensureCapacity ( mCount + 1 ) ) {
+			return false;
+		}
+		inObject->retain ();
+		mObjects[mCount++] = inObject;
+		return true;
+	}
+
+	bool					replaceObject ( unsigned int inIndex, OSObject * inObject ) {
+		if ( 0 == inObject || inIndex >= mCount ) {
+			return false;
+		}
+		inObject->retain ();
+		mObjects[inIndex]->release ();
+		mObjects[inIndex] = inObject;
+		return true;
+	}
+
+	void					flushCollection ( void ) {
+		while ( 0 != mCount ) {
+			mObjects[--mCount]->release ();
+		}
+	}
+
+protected:
+
+							OSArray ( void ) : mObjects ( 0 ), mCount ( 0 ), mCapacity ( 0 ) {}
+
+	bool					ensureCapacity ( unsigned int inCapacity ) {
+		OSObject **			objects;
+
+		if ( inCapacity <= mCapacity ) {
+			return true;
+		}
+		inCapacity = ( inCapacity < 2 * mCapacity ) ? 2 * mCapacity : inCapacity;
+		objects = (OSObject **)realloc ( mObjects, inCapacity * sizeof ( OSObject * ) );
+		if ( 0 == objects ) {
+			return false;
+		}
+		mObjects = objects;
+		mCapacity = inCapacity;
+		return true;
+	}
+
+	OSObject **				mObjects;
+	unsigned int			mCount;
+	unsigned int			mCapacity;
+};
+
+#endif
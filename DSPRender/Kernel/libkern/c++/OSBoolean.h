@@ -0,0 +1,35 @@
+/*
+ *  OSBoolean.h
+ *  DSPRender
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSPRENDER_OSBOOLEAN__
+#define __DSPRENDER_OSBOOLEAN__
+
+#include <libkern/c++/OSObject.h>
+
+class OSBoolean : public OSObject {
+
+public:
+
+							OSBoolean ( bool inValue ) : mValue ( inValue ) {}
+
+	bool					getValue ( void ) const { return mValue; }
+	bool					isTrue ( void ) const { return mValue; }
+	bool					isFalse ( void ) const { return !mValue; }
+
+	//	the two shared instances are never freed
+	virtual void			free ( void ) {}
+
+protected:
+
+	bool					mValue;
+};
+
+extern OSBoolean * const	kOSBooleanTrue;
+extern OSBoolean * const	kOSBooleanFalse;
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ *  OSDictionary.h
+ *  DSPRender
+ *
+ *  Keys are kept as OSStrings in insertion order and looked up linearly;
+ *  a 'SoftwareDSP' dictionary never holds more than a few dozen entries.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSPRENDER_OSDICTIONARY__
+#define __DSPRENDER_OSDICTIONARY__
+
+#include <libkern/c++/OSArray.h>
+#include <libkern/c++/OSString.h>
+
+class OSDictionary : public OSObject {
+
+public:
+
+	static OSDictionary *	withCapacity ( unsigned int inCapacity ) {
+		OSDictionary *		result;
+
+		result = new OSDictionary;
+		result->mKeys = OSArray::withCapacity ( inCapacity );
+		result->mValues = OSArray::withCapacity ( inCapacity );
+		if ( 0 == result->mKeys || 0 == result->mValues ) {
+			result->release ();
+			result = 0;
+		}
+		return result;
+	}
+
+	virtual void			free ( void ) {
+		if ( 0 != mKeys ) {
+			mKeys->release ();
+			mKeys = 0;
+		}
+		if ( 0 != mValues ) {
+			mValues->release ();
+			mValues = 0;
+		}
+		OSObject::free ();
+	}
+
+	unsigned int			getCount ( void ) const { return mKeys->getCount (); }
+
+	OSObject *				getObject ( const char * inKey ) const {
+		unsigned int		index;
+
+		index = indexOf ( inKey );
+		return ( index < mKeys->getCount () ) ? mValues->getObject ( index ) : 0;
+	}
+
+	OSObject *				getObject ( const OSString * inKey ) const { return getObject ( inKey->getCStringNoCopy () ); }
+
+	//	like the kernel, setting an existing key replaces its value
+	bool					setObject ( const char * inKey, OSObject * inObject ) {
+		OSString *			theKey;
+		unsigned int		index;
+		bool				result;
+
+		if ( 0 == inKey || 0 == inObject ) {
+			return false;
+		}
+		index = indexOf ( inKey );
+		if ( index < mKeys->getCount () ) {
+			return mValues->replaceObject ( index, inObject );
+		}
+		theKey = OSString::withCString ( inKey );
+		if ( 0 == theKey ) {
+			return false;
+		}
+		result = mKeys->setObject ( theKey ) && mValues->setObject ( inObject );
+		theKey->release ();
+		return result;
+	}
+
+	bool					setObject ( const OSString * inKey, OSObject * inObject ) { return setObject ( inKey->getCStringNoCopy (), inObject ); }
+
+	const OSString *		getKey ( unsigned int inIndex ) const { return OSDynamicCast ( OSString, mKeys->getObject ( inIndex ) ); }
+
+protected:
+
+							OSDictionary ( void ) : mKeys ( 0 ), mValues ( 0 ) {}
+
+	unsigned int			indexOf ( const char * inKey ) const {
+		OSString *			theKey;
+		unsigned int		index;
+
+		for ( index = 0; index < mKeys->getCount (); index++ ) {
+			theKey = OSDynamicCast ( OSString, mKeys->getObject ( index ) );
+			if ( 0 != theKey && theKey->isEqualTo ( inKey ) ) {
+				break;
+			}
+		}
+		return index;
+	}
+
+	OSArray *				mKeys;
+	OSArray *				mValues;
+};
+
+#endif
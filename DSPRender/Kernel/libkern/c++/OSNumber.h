@@ -0,0 +1,37 @@
+/*
+ *  OSNumber.h
+ *  DSPRender
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSPRENDER_OSNUMBER__
+#define __DSPRENDER_OSNUMBER__
+
+#include <libkern/c++/OSObject.h>
+
+class OSNumber : public OSObject {
+
+public:
+
+	static OSNumber *		withNumber ( unsigned long long inValue, unsigned int inNumberOfBits ) {
+		OSNumber *			result;
+
+		result = new OSNumber;
+		result->mValue = inValue;
+		result->mNumberOfBits = inNumberOfBits;
+		return result;
+	}
+
+	UInt32					unsigned32BitValue ( void ) const { return (UInt32)mValue; }
+	UInt64					unsigned64BitValue ( void ) const { return mValue; }
+	unsigned int			numberOfBits ( void ) const { return mNumberOfBits; }
+
+protected:
+
+	UInt64					mValue;
+	unsigned int			mNumberOfBits;
+};
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ *  OSObject.h
+ *  DSPRender
+ *
+ *  Reference counted base with the kernel's create / init / free shape.
+ *  OSDynamicCast maps onto dynamic_cast, so no meta classes are kept.
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSPRENDER_OSOBJECT__
+#define __DSPRENDER_OSOBJECT__
+
+#include <libkern/OSTypes.h>
+
+class OSObject {
+
+public:
+
+							OSObject ( void ) : mRetainCount ( 1 ) {}
+
+	virtual bool			init ( void ) { return true; }
+	virtual void			free ( void ) { delete this; }
+
+			void			retain ( void ) const { mRetainCount++; }
+			void			release ( void ) const { if ( 0 == --mRetainCount ) { const_cast<OSObject *> ( this )->free (); } }
+			SInt32			getRetainCount ( void ) const { return mRetainCount; }
+
+protected:
+
+	virtual					~OSObject ( void ) {}
+
+private:
+
+	mutable SInt32			mRetainCount;
+};
+
+#define OSDeclareDefaultStructors( className )								\
+	public:																	\
+		className ( void );													\
+	protected:																\
+		virtual ~className ( void );										\
+	private:
+
+#define OSDeclareAbstractStructors( className )								\
+	OSDeclareDefaultStructors ( className )
+
+#define OSDefineMetaClassAndStructors( className, superClassName )			\
+	className::className ( void ) : superClassName () {}					\
+	className::~className ( void ) {}
+
+#define OSDefineMetaClassAndAbstractStructors( className, superClassName )	\
+	OSDefineMetaClassAndStructors ( className, superClassName )
+
+#define OSDynamicCast( type, inst )		( dynamic_cast<type *> ( inst ) )
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ *  OSString.h
+ *  DSPRender
+ *
+ *  Copyright (c) 2005 Apple Computer Inc. All rights reserved.
+ *
+ */
+
+#ifndef __DSPRENDER_OSSTRING__
+#define __DSPRENDER_OSSTRING__
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libkern/c++/OSObject.h>
+
+class OSString : public OSObject {
+
+public:
+
+	static OSString *		withCString ( const char * inCString ) {
+		OSString *			result;
+
+		result = new OSString;
+		if ( !result->initWithCString ( inCString ) ) {
+			result->release ();
+			result = 0;
+		}
+		return result;
+	}
+
+	virtual bool			initWithCString ( const char * inCString ) {
+		if ( 0 == inCString ) {
+			return false;
+		}
+		if ( 0 != mString ) {
+			::free ( mString );
+		}
+		mString = strdup ( inCString );
+		return 0 != mString;
+	}
+
+	virtual void			free ( void ) {
+		if ( 0 != mString ) {
+			::free ( mString );
+			mString = 0;
+		}
+		OSObject::free ();
+	}
+
+	const char *			getCStringNoCopy ( void ) const { return mString; }
+	UInt32					getLength ( void ) const { return (UInt32)strlen ( mString ); }
+	bool					isEqualTo ( const char * inCString ) const { return 0 == strcmp ( mString, inCString ); }
+
+protected:
+
+							OSString ( void ) : mString ( 0 ) {}
+
+	char *					mString;
+};
+
+#endif